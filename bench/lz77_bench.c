@@ -0,0 +1,578 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "lz77.h"
+
+// Бенчмарк кодека: для каждого корпуса, размера, уровня и числа потоков порождается
+// отдельный процесс, чтобы пиковая RSS относилась только к этому замеру.
+
+#define MAX_LIST 16
+#define MAX_RUNS 64
+#define MB (1024.0 * 1024.0)
+
+// Корпуса данных
+typedef enum
+{
+    CORPUS_RANDOM,
+    CORPUS_ZEROS,
+    CORPUS_TEXT,
+    CORPUS_JSON,
+    CORPUS_BINARY,
+    CORPUS_COUNT
+} corpus_kind;
+
+static const char *corpus_names[CORPUS_COUNT] = {"random", "zeros", "text", "json", "binary"};
+
+// Параметры запуска
+typedef struct {
+    int corpora[CORPUS_COUNT];
+    int corpus_count;
+    size_t sizes[MAX_LIST];
+    int size_count;
+    int levels[MAX_LIST];
+    int level_count;
+    int threads[MAX_LIST];
+    int thread_count;
+    int runs;
+    int warmups;
+    const char *out_dir;
+} bench_config;
+
+// Результат одного замера, передаётся из дочернего процесса через канал
+typedef struct {
+    int status;
+    size_t compressed;
+    double c_times[MAX_RUNS];
+    double d_times[MAX_RUNS];
+    long peak_rss_kb;
+    int equal;
+} bench_result;
+
+// xorshift64*: один и тот же seed даёт один и тот же корпус на любой машине
+static uint64_t rng_next(uint64_t *state)
+{
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 2685821657736338717ULL;
+}
+
+static uint32_t rng_below(uint64_t *state, uint32_t n)
+{
+    return (uint32_t)((rng_next(state) >> 32) * n >> 32);
+}
+
+// Слово словаря по рангу: частые слова короче, ранги распределены примерно по Ципфу
+static size_t vocab_word(uint64_t seed, uint32_t rank, char *word)
+{
+    uint64_t state = seed ^ (0x9E3779B97F4A7C15ULL * (rank + 1));
+    size_t len = 2 + rank % 5 + rng_below(&state, 2 + rank / 512);
+    static const char letters[] = "etaoinshrdlucmfwypvbgkjqxz";
+    for (size_t i = 0; i < len; i++)
+        word[i] = letters[rng_below(&state, 1 + rng_below(&state, 26))];
+    return len;
+}
+
+static uint32_t zipf_rank(uint64_t *state, uint32_t vocab)
+{
+    // Куб равномерной величины смещает выбор к малым рангам
+    uint64_t u = rng_next(state) >> 48;
+    return (uint32_t)((u * u >> 16) * u * vocab >> 32);
+}
+
+static void gen_text(uint8_t *dst, size_t len, uint64_t *state)
+{
+    char word[64];
+    size_t pos = 0, sentence = 0;
+    uint32_t rank = 0;
+    while (pos < len)
+    {
+        // Устойчивые словосочетания: у слова часто один и тот же преемник
+        rank = rng_below(state, 10) < 4 ? (rank * 7 + 3) % 97 : zipf_rank(state, 2048);
+        size_t n = vocab_word(1, rank, word);
+        if (sentence == 0 && n)
+            word[0] -= 'a' - 'A';
+        for (size_t i = 0; i < n && pos < len; i++)
+            dst[pos++] = word[i];
+        sentence++;
+        if (pos < len)
+        {
+            uint32_t r = rng_below(state, 100);
+            dst[pos++] = sentence > 6 && r < 12 ? (r < 2 ? '\n' : '.') : r < 16 ? ',' : ' ';
+            if (dst[pos - 1] == '.' || dst[pos - 1] == '\n')
+                sentence = 0;
+            if (dst[pos - 1] != ' ' && dst[pos - 1] != '\n' && pos < len)
+                dst[pos++] = ' ';
+        }
+    }
+}
+
+static void gen_json(uint8_t *dst, size_t len, uint64_t *state)
+{
+    static const char *levels[] = {"DEBUG", "INFO", "INFO", "INFO", "WARN", "ERROR"};
+    static const char *services[] = {"auth", "billing", "gateway", "search", "storage", "notify"};
+    static const char *paths[] = {"/api/v1/login", "/api/v1/items", "/api/v2/search", "/health", "/api/v1/orders"};
+    char line[512], word[64];
+    uint64_t ts = 1700000000000ULL;
+    size_t pos = 0;
+    while (pos < len)
+    {
+        ts += rng_below(state, 50);
+        int n = snprintf(line, sizeof(line),
+                         "{\"ts\":%llu,\"level\":\"%s\",\"service\":\"%s\",\"path\":\"%s\",\"status\":%u,"
+                         "\"user_id\":%u,\"latency_ms\":%u,\"msg\":\"",
+                         (unsigned long long)ts, levels[rng_below(state, 6)], services[rng_below(state, 6)],
+                         paths[rng_below(state, 5)], rng_below(state, 10) ? 200 : 500, 1000 + rng_below(state, 90000),
+                         rng_below(state, 400));
+        for (int w = 0, words = 3 + rng_below(state, 6); w < words; w++)
+        {
+            size_t wl = vocab_word(2, zipf_rank(state, 1024), word);
+            if (n + wl + 8 >= sizeof(line))
+                break;
+            memcpy(line + n, word, wl);
+            n += wl;
+            line[n++] = w + 1 < words ? ' ' : '"';
+        }
+        line[n++] = '}';
+        line[n++] = '\n';
+        size_t chunk = (size_t)n < len - pos ? (size_t)n : len - pos;
+        memcpy(dst + pos, line, chunk);
+        pos += chunk;
+    }
+}
+
+// Похоже на исполняемый файл: повторяющиеся последовательности опкодов, таблицы с
+// медленно растущими указателями и участки плотных данных
+static void gen_binary(uint8_t *dst, size_t len, uint64_t *state)
+{
+    static const uint8_t ops[][4] = {
+        {0x55, 0x48, 0x89, 0xE5}, {0x48, 0x83, 0xEC, 0x20}, {0xE8, 0x00, 0x00, 0x00},
+        {0x48, 0x8B, 0x45, 0xF8}, {0x89, 0x7D, 0xFC, 0x90}, {0xC9, 0xC3, 0x0F, 0x1F},
+    };
+    uint32_t ptr = 0x401000;
+    size_t pos = 0;
+    while (pos < len)
+    {
+        uint32_t kind = rng_below(state, 10);
+        size_t n = 16 + rng_below(state, 240);
+        if (n > len - pos)
+            n = len - pos;
+        for (size_t i = 0; i < n; i++)
+        {
+            if (kind < 6) // Код
+                dst[pos + i] = ops[(i / 4 + kind) % 6][i % 4] ^ (rng_below(state, 16) ? 0 : (uint8_t)rng_next(state));
+            else if (kind < 9) // Таблица указателей
+            {
+                if (i % 4 == 0)
+                    ptr += 8 + rng_below(state, 64);
+                dst[pos + i] = (uint8_t)(ptr >> (8 * (i % 4)));
+            }
+            else // Сжатые или зашифрованные данные
+                dst[pos + i] = (uint8_t)rng_next(state);
+        }
+        pos += n;
+    }
+}
+
+static void gen_corpus(corpus_kind kind, uint8_t *dst, size_t len)
+{
+    uint64_t state = 0x1234567ULL + kind;
+    switch (kind)
+    {
+    case CORPUS_RANDOM:
+        for (size_t i = 0; i < len; i++)
+            dst[i] = (uint8_t)(rng_next(&state) >> 56);
+        break;
+    case CORPUS_ZEROS:
+        memset(dst, 0, len);
+        break;
+    case CORPUS_TEXT:
+        gen_text(dst, len, &state);
+        break;
+    case CORPUS_JSON:
+        gen_json(dst, len, &state);
+        break;
+    case CORPUS_BINARY:
+        gen_binary(dst, len, &state);
+        break;
+    default:
+        break;
+    }
+}
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Сброс временного файла перед очередным прогоном
+static int reset_file(FILE *file)
+{
+    rewind(file);
+    return ftruncate(fileno(file), 0);
+}
+
+// Уровень 0 в списке — старый потоковый формат (lz77_compress/lz77_decompress)
+#define LEGACY_LEVEL 0
+
+// Замер в дочернем процессе; сжатие и распаковка идут через фреймовый API на временных
+// файлах, как у утилиты, поэтому работает и параллельная распаковка по таблице поиска.
+// Старый формат замеряется так же и так же проверяется распаковкой.
+static void run_case(corpus_kind kind, size_t size, int level, int threads, const bench_config *cfg, bench_result *res)
+{
+    uint8_t *data = malloc(size ? size : 1);
+    uint8_t *check = malloc(size ? size : 1);
+    FILE *raw = tmpfile(), *packed = tmpfile(), *unpacked = tmpfile();
+    lz77_params params;
+
+    memset(res, 0, sizeof(*res));
+    res->status = -1;
+    if (!data || !check || !raw || !packed || !unpacked)
+        goto done;
+    gen_corpus(kind, data, size);
+    if (fwrite(data, 1, size, raw) != size || fflush(raw) != 0)
+        goto done;
+
+    lz77_params_default(&params);
+    params.level = level;
+    params.threads = threads;
+
+    for (int i = -cfg->warmups; i < cfg->runs; i++)
+    {
+        rewind(raw);
+        if (reset_file(packed) != 0)
+            goto done;
+        double start = now_sec();
+        int status = level == LEGACY_LEVEL ? lz77_compress(raw, packed, NULL) : lz77_compress_frames(raw, packed, NULL, &params);
+        if (status != 0 || fflush(packed) != 0)
+            goto done;
+        if (i >= 0)
+            res->c_times[i] = now_sec() - start;
+    }
+    res->compressed = ftello(packed);
+
+    for (int i = -cfg->warmups; i < cfg->runs; i++)
+    {
+        rewind(packed);
+        if (reset_file(unpacked) != 0)
+            goto done;
+        double start = now_sec();
+        int status = level == LEGACY_LEVEL ? lz77_decompress(packed, unpacked, NULL)
+                                           : lz77_decompress_frames(packed, unpacked, NULL, threads);
+        if (status != 0 || fflush(unpacked) != 0)
+            goto done;
+        if (i >= 0)
+            res->d_times[i] = now_sec() - start;
+    }
+
+    rewind(unpacked);
+    res->equal = fread(check, 1, size, unpacked) == size && fgetc(unpacked) == EOF && memcmp(check, data, size) == 0;
+    res->status = 0;
+
+done:
+    {
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) == 0)
+            res->peak_rss_kb = usage.ru_maxrss;
+    }
+    if (raw)
+        fclose(raw);
+    if (packed)
+        fclose(packed);
+    if (unpacked)
+        fclose(unpacked);
+    free(data);
+    free(check);
+}
+
+static int run_isolated(corpus_kind kind, size_t size, int level, int threads, const bench_config *cfg, bench_result *res)
+{
+    int fds[2];
+    if (pipe(fds) != 0)
+        return -1;
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    if (pid == 0)
+    {
+        close(fds[0]);
+        run_case(kind, size, level, threads, cfg, res);
+        _exit(write(fds[1], res, sizeof(*res)) == (ssize_t)sizeof(*res) ? 0 : 1);
+    }
+    close(fds[1]);
+    size_t got = 0;
+    while (got < sizeof(*res))
+    {
+        ssize_t n = read(fds[0], (char *)res + got, sizeof(*res) - got);
+        if (n <= 0)
+            break;
+        got += n;
+    }
+    close(fds[0]);
+    int wstatus;
+    waitpid(pid, &wstatus, 0);
+    return got == sizeof(*res) && WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0 ? res->status : -1;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Перцентиль по ближайшему рангу
+static double percentile(const double *times, int n, int pct)
+{
+    double sorted[MAX_RUNS];
+    memcpy(sorted, times, n * sizeof(double));
+    qsort(sorted, n, sizeof(double), cmp_double);
+    int rank = (pct * n + 99) / 100;
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+static void format_size(size_t size, char *buf, size_t cap)
+{
+    if (size >= (1 << 20) && size % (1 << 20) == 0)
+        snprintf(buf, cap, "%zuMB", size >> 20);
+    else if (size >= 1024 && size % 1024 == 0)
+        snprintf(buf, cap, "%zuKB", size >> 10);
+    else
+        snprintf(buf, cap, "%zuB", size);
+}
+
+static void write_times(FILE *csv, const double *times, int n)
+{
+    fputs("\"[", csv);
+    for (int i = 0; i < n; i++)
+        fprintf(csv, "%s%.9g", i ? ", " : "", times[i]);
+    fputs("]\"", csv);
+}
+
+// Строка CSV: первые столбцы совпадают со схемой прежних compression_times.csv и
+// decompression_times.csv, дальше — параметры замера и статистика
+static void write_row(FILE *csv, const char *name, size_t size, const double *times, int runs, const char *equal,
+                      int level, int threads, const bench_result *res)
+{
+    double median = percentile(times, runs, 50);
+    fprintf(csv, "%s,%zu,%.9g,", name, size, times[runs - 1]);
+    write_times(csv, times, runs);
+    if (equal)
+        fprintf(csv, ",%s", equal);
+    fprintf(csv, ",%d,%d,%.9g,%.9g,%.9g,%.2f,%.4f,%ld\n", level, threads, median, percentile(times, runs, 90),
+            percentile(times, runs, 99), median > 0 ? size / MB / median : 0.0,
+            size ? (double)res->compressed / size : 0.0, res->peak_rss_kb);
+}
+
+static const char *CSV_EXTRA = "Уровень,Потоки,Медиана (сек),p90 (сек),p99 (сек),МБ/с (по медиане),Коэффициент,Пиковая RSS (КБ)";
+
+static FILE *open_csv(const char *dir, const char *name, const char *columns)
+{
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE *csv = fopen(path, "w");
+    if (!csv)
+    {
+        fprintf(stderr, "Ошибка: не удалось создать %s\n", path);
+        return NULL;
+    }
+    fprintf(csv, "%s,%s\n", columns, CSV_EXTRA);
+    return csv;
+}
+
+// Размер с суффиксом K или M
+static int parse_size(const char *text, size_t *size)
+{
+    char *end;
+    unsigned long long value = strtoull(text, &end, 10);
+    if (end == text)
+        return 1;
+    if (*end == 'K' || *end == 'k')
+        value <<= 10, end++;
+    else if (*end == 'M' || *end == 'm')
+        value <<= 20, end++;
+    *size = value;
+    return *end != '\0';
+}
+
+// Разбор списка через запятую; parse_item возвращает 0 при успехе
+static int parse_list(char *text, int max, int *count, int (*parse_item)(const char *item, int index, void *out), void *out)
+{
+    *count = 0;
+    for (char *item = strtok(text, ","); item; item = strtok(NULL, ","))
+        if (*count >= max || parse_item(item, (*count)++, out) != 0)
+            return 1;
+    return *count == 0;
+}
+
+static int parse_int_item(const char *item, int index, void *out)
+{
+    char *end;
+    long value = strtol(item, &end, 10);
+    ((int *)out)[index] = (int)value;
+    return end == item || *end || value < 0 || value > 1024;
+}
+
+static int parse_size_item(const char *item, int index, void *out)
+{
+    return parse_size(item, &((size_t *)out)[index]);
+}
+
+static int parse_corpus_item(const char *item, int index, void *out)
+{
+    for (int i = 0; i < CORPUS_COUNT; i++)
+        if (strcmp(item, corpus_names[i]) == 0)
+        {
+            ((int *)out)[index] = i;
+            return 0;
+        }
+    return 1;
+}
+
+static void print_usage(void)
+{
+    printf("Бенчмарк lz77: скорость сжатия и распаковки, коэффициент и пиковая RSS\n");
+    printf("Использование: lz77_bench [флаги]\n");
+    printf("  -c <список>   Корпуса: random,zeros,text,json,binary (по умолчанию все)\n");
+    printf("  -s <список>   Размеры с суффиксами K/M (по умолчанию 100K,1M,10M)\n");
+    printf("  -l <список>   Уровни сжатия %d..%d, 0 — старый потоковый формат (по умолчанию 0,1,3,6,9)\n",
+           LZ77_MIN_LEVEL, LZ77_MAX_LEVEL);
+    printf("  -T <список>   Числа потоков (по умолчанию 1,4)\n");
+    printf("  -r <n>        Замеров на конфигурацию (по умолчанию 5, не больше %d)\n", MAX_RUNS);
+    printf("  -w <n>        Прогревочных прогонов (по умолчанию 1)\n");
+    printf("  -o <каталог>  Куда писать compression_times.csv и decompression_times.csv (по умолчанию .)\n");
+}
+
+int main(int argc, char *argv[])
+{
+    bench_config cfg = {
+        .corpora = {CORPUS_RANDOM, CORPUS_ZEROS, CORPUS_TEXT, CORPUS_JSON, CORPUS_BINARY},
+        .corpus_count = CORPUS_COUNT,
+        .sizes = {100 << 10, 1 << 20, 10 << 20},
+        .size_count = 3,
+        .levels = {LEGACY_LEVEL, 1, 3, 6, 9},
+        .level_count = 5,
+        .threads = {1, 4},
+        .thread_count = 2,
+        .runs = 5,
+        .warmups = 1,
+        .out_dir = ".",
+    };
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char *flag = argv[i];
+        if (strcmp(flag, "-h") == 0 || strcmp(flag, "--help") == 0)
+        {
+            print_usage();
+            return 0;
+        }
+        if (flag[0] != '-' || !flag[1] || flag[2] || i + 1 >= argc)
+        {
+            fprintf(stderr, "Ошибка: неизвестный флаг %s\n", flag);
+            print_usage();
+            return 1;
+        }
+        char *value = argv[++i];
+        int bad = 0, n;
+        switch (flag[1])
+        {
+        case 'c':
+            bad = parse_list(value, CORPUS_COUNT, &cfg.corpus_count, parse_corpus_item, cfg.corpora);
+            break;
+        case 's':
+            bad = parse_list(value, MAX_LIST, &cfg.size_count, parse_size_item, cfg.sizes);
+            break;
+        case 'l':
+            bad = parse_list(value, MAX_LIST, &cfg.level_count, parse_int_item, cfg.levels);
+            for (int k = 0; !bad && k < cfg.level_count; k++)
+                bad = cfg.levels[k] != LEGACY_LEVEL && (cfg.levels[k] < LZ77_MIN_LEVEL || cfg.levels[k] > LZ77_MAX_LEVEL);
+            break;
+        case 'T':
+            bad = parse_list(value, MAX_LIST, &cfg.thread_count, parse_int_item, cfg.threads);
+            for (int k = 0; !bad && k < cfg.thread_count; k++)
+                bad = cfg.threads[k] < 1;
+            break;
+        case 'r':
+            bad = parse_int_item(value, 0, &n) || n < 1 || n > MAX_RUNS;
+            cfg.runs = n;
+            break;
+        case 'w':
+            bad = parse_int_item(value, 0, &n);
+            cfg.warmups = n;
+            break;
+        case 'o':
+            cfg.out_dir = value;
+            break;
+        default:
+            bad = 1;
+        }
+        if (bad)
+        {
+            fprintf(stderr, "Ошибка: неверное значение %s для %s\n", value, flag);
+            return 1;
+        }
+    }
+
+    FILE *c_csv = open_csv(cfg.out_dir, "compression_times.csv",
+                           "Файл,Размер (байт),\"Время сжатия (последняя попытка, сек)\",Все времена попыток (сек)");
+    FILE *d_csv = open_csv(cfg.out_dir, "decompression_times.csv",
+                           "Файл,Размер (байт),\"Время декомпрессии (последняя попытка, сек)\",Все времена попыток (сек),Эквивалентность");
+    if (!c_csv || !d_csv)
+        return 1;
+
+    printf("%-8s %8s %5s %7s %9s %9s %9s %9s %8s %10s\n", "корпус", "размер", "ур.", "потоки",
+           "сж МБ/с", "p90 сек", "рас МБ/с", "p90 сек", "коэфф.", "RSS КБ");
+    int failures = 0;
+    for (int ci = 0; ci < cfg.corpus_count; ci++)
+        for (int si = 0; si < cfg.size_count; si++)
+            for (int li = 0; li < cfg.level_count; li++)
+                for (int ti = 0; ti < cfg.thread_count; ti++)
+                {
+                    // Старый формат однопоточный: повтор для других чисел потоков ничего не даёт
+                    if (cfg.levels[li] == LEGACY_LEVEL && ti > 0)
+                        continue;
+                    corpus_kind kind = cfg.corpora[ci];
+                    size_t size = cfg.sizes[si];
+                    bench_result res;
+                    char size_name[32], name[64];
+                    format_size(size, size_name, sizeof(size_name));
+                    snprintf(name, sizeof(name), "%s_%s", corpus_names[kind], size_name);
+
+                    if (run_isolated(kind, size, cfg.levels[li], cfg.threads[ti], &cfg, &res) != 0)
+                    {
+                        fprintf(stderr, "Ошибка замера %s, уровень %d, потоков %d\n", name, cfg.levels[li], cfg.threads[ti]);
+                        failures++;
+                        continue;
+                    }
+                    failures += !res.equal;
+                    write_row(c_csv, name, size, res.c_times, cfg.runs, NULL, cfg.levels[li], cfg.threads[ti], &res);
+                    write_row(d_csv, name, size, res.d_times, cfg.runs, res.equal ? "True" : "False",
+                              cfg.levels[li], cfg.threads[ti], &res);
+                    double c_med = percentile(res.c_times, cfg.runs, 50), d_med = percentile(res.d_times, cfg.runs, 50);
+                    printf("%-8s %8s %5d %7d %9.1f %9.4f %9.1f %9.4f %8.4f %10ld%s\n", corpus_names[kind], size_name,
+                           cfg.levels[li], cfg.threads[ti], c_med > 0 ? size / MB / c_med : 0.0,
+                           percentile(res.c_times, cfg.runs, 90), d_med > 0 ? size / MB / d_med : 0.0,
+                           percentile(res.d_times, cfg.runs, 90), size ? (double)res.compressed / size : 0.0,
+                           res.peak_rss_kb, res.equal ? "" : "  РАСХОЖДЕНИЕ");
+                    fflush(stdout);
+                }
+
+    fclose(c_csv);
+    fclose(d_csv);
+    return failures ? 1 : 0;
+}
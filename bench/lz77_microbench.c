@@ -0,0 +1,611 @@
+// syscall() и ioctl() для perf_event_open объявлены только с расширениями GNU
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include "lz77_internal.h"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/perf_event.h>)
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#if defined(__NR_perf_event_open)
+#define HAVE_PERF 1
+#endif
+#endif
+#endif
+
+// Микробенчмарк ядер кодека: хеш и вставка старого кодера, перебор кандидатов, сравнение,
+// запись литералов, копирование совпадений и разбор токенов. Каждое ядро гоняется на
+// синтетическом потоке последовательностей (серия литералов, совпадение, next_char) с
+// заданными распределениями длин совпадений, дистанций и серий литералов. Время — лучший
+// из прогонов; аппаратные счётчики (такты, инструкции, промахи переходов и кеша) снимаются
+// через perf_event_open, а без них остаются только времена.
+
+#define MAX_RUNS 64
+// Запас за концом буферов: чтение хеша и копирование с перехлёстом
+#define SLACK (4 + WILD_COPY + MAX_MATCH_LENGTH + 2)
+
+// Распределения последовательностей; величины берутся лог-равномерно из [min, max]
+typedef struct {
+    const char *name;
+    const char *about;
+    uint32_t lit_min, lit_max;
+    uint32_t len_min, len_max;
+    uint32_t off_min, off_max;
+} profile;
+
+static const profile profiles[] = {
+    {"short", "короткие совпадения рядом", 1, 8, MIN_MATCH_LENGTH, 8, MIN_MATCH_LENGTH, 64},
+    {"mixed", "смесь на всё окно", 0, 32, MIN_MATCH_LENGTH, 64, MIN_MATCH_LENGTH, SEARCH_BUFFER_SIZE},
+    {"long", "длинные совпадения", 0, 4, 64, MAX_MATCH_LENGTH, 16, SEARCH_BUFFER_SIZE},
+    {"overlap", "дистанция меньше длины", 0, 4, 8, MAX_MATCH_LENGTH, 1, 15},
+    {"literal", "длинные серии литералов", 64, 4096, MIN_MATCH_LENGTH, 4, MIN_MATCH_LENGTH, SEARCH_BUFFER_SIZE},
+};
+#define PROFILE_COUNT (sizeof(profiles) / sizeof(profiles[0]))
+
+typedef struct {
+    uint32_t lit, len, off;
+    size_t pos; // Начало совпадения в исходных данных
+} sequence;
+
+// Входы одного профиля: исходные данные, их последовательности и токены старого формата
+typedef struct {
+    uint8_t *raw;
+    size_t raw_len;
+    sequence *seqs;
+    size_t seq_count;
+    uint8_t *tokens;
+    size_t token_len;
+    uint8_t *out;     // Выход копирования и разбора, raw_len + SLACK байт
+    uint8_t *scratch; // Выход записи литералов
+    lz77_legacy_table *table;
+} workload;
+
+// Результат прогона ядра: ops операций над bytes байт
+typedef struct {
+    uint64_t ops;
+    uint64_t bytes;
+    int status;
+} kernel_result;
+
+typedef struct {
+    const char *name;
+    const char *about;
+    void (*run)(workload *w, kernel_result *res);
+} kernel;
+
+// Защита от выбрасывания результатов ядер компилятором
+static volatile uint64_t sink_value;
+
+// xorshift64*, как в lz77_bench: один seed — один вход на любой машине
+static uint64_t rng_next(uint64_t *state)
+{
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 2685821657736338717ULL;
+}
+
+static uint32_t rng_below(uint64_t *state, uint32_t n)
+{
+    return (uint32_t)((rng_next(state) >> 32) * n >> 32);
+}
+
+// Лог-равномерно из [lo, hi]: сначала октава, затем значение внутри неё
+static uint32_t rng_log(uint64_t *state, uint32_t lo, uint32_t hi)
+{
+    if (hi <= lo)
+        return lo;
+    int lo_bit = 0, hi_bit = 0;
+    while ((lo >> lo_bit) > 1)
+        lo_bit++;
+    while ((hi >> hi_bit) > 1)
+        hi_bit++;
+    int bit = lo_bit + (int)rng_below(state, hi_bit - lo_bit + 1);
+    uint32_t a = bit ? 1u << bit : 0, b = (2u << bit) - 1;
+    if (a < lo)
+        a = lo;
+    if (b > hi)
+        b = hi;
+    return a + rng_below(state, b - a + 1);
+}
+
+// Поток последовательностей по профилю: литералы случайные, так что совпадения находятся
+// в основном там, где они заложены
+static int workload_build(workload *w, const profile *p, size_t size)
+{
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+    size_t cap = size / (MIN_MATCH_LENGTH + 1) + 1;
+    memset(w, 0, sizeof(*w));
+    w->raw = malloc(size + SLACK);
+    w->out = malloc(size + SLACK);
+    w->seqs = malloc(cap * sizeof(sequence));
+    w->tokens = malloc(lz77_block_bound(size) + SLACK);
+    w->scratch = malloc(lz77_block_bound(size) + SLACK);
+    if (posix_memalign((void **)&w->table, 64, sizeof(lz77_legacy_table)) != 0)
+        w->table = NULL;
+    if (!w->raw || !w->out || !w->seqs || !w->tokens || !w->scratch || !w->table)
+        return -1;
+    memset(w->raw, 0, size + SLACK);
+
+    uint8_t *op = w->tokens;
+    size_t pos = 0;
+    while (pos < size)
+    {
+        sequence s;
+        s.lit = rng_log(&state, p->lit_min, p->lit_max);
+        s.len = rng_log(&state, p->len_min, p->len_max);
+        s.off = rng_log(&state, p->off_min, p->off_max);
+        if (s.lit > size - pos)
+            s.lit = size - pos;
+        for (uint32_t i = 0; i < s.lit; i++)
+            w->raw[pos + i] = (uint8_t)(rng_next(&state) >> 56);
+        op = emit_literals(op, w->raw + pos, s.lit);
+        pos += s.lit;
+        // Совпадению нужна история до дистанции, длина и next_char за ним
+        if (s.off > pos || size - pos < s.len + 1)
+            continue;
+        s.pos = pos;
+        for (uint32_t i = 0; i < s.len; i++, pos++)
+            w->raw[pos] = w->raw[pos - s.off];
+        w->raw[pos++] = (uint8_t)(rng_next(&state) >> 56);
+        op = emit_distance(op, s.off, 0);
+        *op++ = (uint8_t)s.len;
+        *op++ = w->raw[pos - 1];
+        w->seqs[w->seq_count++] = s;
+    }
+    w->raw_len = size;
+    w->token_len = op - w->tokens;
+    return 0;
+}
+
+static void workload_free(workload *w)
+{
+    free(w->raw);
+    free(w->out);
+    free(w->seqs);
+    free(w->tokens);
+    free(w->scratch);
+    free(w->table);
+}
+
+static void kernel_hash(workload *w, kernel_result *res)
+{
+    const uint8_t *src = w->raw;
+    uint64_t acc = 0;
+    for (size_t pos = 0; pos < w->raw_len; pos++)
+        acc += lz77_legacy_hash(src + pos);
+    sink_value = acc;
+    res->ops = w->raw_len;
+    res->bytes = w->raw_len;
+}
+
+static void kernel_insert(workload *w, kernel_result *res)
+{
+    const uint8_t *src = w->raw;
+    memset(w->table, 0, sizeof(lz77_legacy_table));
+    for (size_t pos = 0; pos < w->raw_len; pos++)
+        lz77_legacy_insert(w->table, pos, lz77_legacy_hash(src + pos));
+    res->ops = w->raw_len;
+    res->bytes = w->raw_len;
+}
+
+// Цикл поиска старого кодера по отображённому входу (compress_mapped) без записи токенов
+static void kernel_search(workload *w, kernel_result *res)
+{
+    const uint8_t *src = w->raw;
+    size_t n = w->raw_len, found = 0;
+    memset(w->table, 0, sizeof(lz77_legacy_table));
+    res->ops = 0;
+    for (size_t pos = 0; pos < n; pos++)
+    {
+        uint32_t ihash = lz77_legacy_hash(src + pos);
+        size_t dist = 0;
+        size_t max_len = n - pos - 1 < LOOKAHEAD_BUFFER_SIZE ? n - pos - 1 : LOOKAHEAD_BUFFER_SIZE;
+        size_t len = lz77_legacy_search(w->table, ihash, src, pos, max_len, &dist);
+        res->ops++;
+        if (len >= MIN_MATCH_LENGTH)
+        {
+            found += len;
+            for (size_t end = pos + len; pos < end; pos++)
+                lz77_legacy_insert(w->table, pos, lz77_legacy_hash(src + pos));
+            if (pos >= n)
+                break;
+            ihash = lz77_legacy_hash(src + pos);
+        }
+        lz77_legacy_insert(w->table, pos, ihash);
+    }
+    sink_value = found;
+    res->bytes = n;
+}
+
+static void kernel_match(workload *w, kernel_result *res)
+{
+    uint64_t total = 0;
+    for (size_t i = 0; i < w->seq_count; i++)
+    {
+        const sequence *s = &w->seqs[i];
+        size_t max_len = w->raw_len - s->pos < MAX_MATCH_LENGTH ? w->raw_len - s->pos : MAX_MATCH_LENGTH;
+        total += lz77_match_length(w->raw + s->pos, w->raw + s->pos - s->off, max_len);
+    }
+    sink_value = total;
+    res->ops = w->seq_count;
+    res->bytes = total;
+}
+
+// Серии литералов в том виде, в каком их пишет print_literals
+static void kernel_literals(workload *w, kernel_result *res)
+{
+    const uint8_t *src = w->raw;
+    uint8_t *op = w->scratch;
+    res->ops = res->bytes = 0;
+    for (size_t i = 0; i < w->seq_count; i++)
+    {
+        const sequence *s = &w->seqs[i];
+        if (!s->lit)
+            continue;
+        op = emit_literals(op, src + s->pos - s->lit, s->lit);
+        res->ops++;
+        res->bytes += s->lit;
+    }
+    sink_value = op - w->scratch;
+}
+
+// Только совпадения: литералы между ними не пишутся, поэтому перехлёст портит выход, и
+// проверяет его лишь decode
+static void kernel_copy(workload *w, kernel_result *res)
+{
+    uint8_t *out = w->out, *end = w->out + w->raw_len;
+    res->ops = res->bytes = 0;
+    for (size_t i = 0; i < w->seq_count; i++)
+    {
+        const sequence *s = &w->seqs[i];
+        copy_match(out + s->pos, s->off, s->len, end - (out + s->pos));
+        res->ops++;
+        res->bytes += s->len;
+    }
+}
+
+static void kernel_decode(workload *w, kernel_result *res)
+{
+    const uint8_t *ip = w->tokens;
+    uint8_t *op = w->out;
+    res->ops = w->seq_count;
+    res->bytes = w->raw_len;
+    res->status = lz77_decode_tokens(&ip, w->tokens + w->token_len, &op, w->out + w->raw_len, w->out, 0);
+    if (res->status == 0 && (ip != w->tokens + w->token_len || op != w->out + w->raw_len ||
+                             memcmp(w->out, w->raw, w->raw_len) != 0))
+        res->status = -1;
+}
+
+static const kernel kernels[] = {
+    {"hash", "lz77_legacy_hash на каждой позиции", kernel_hash},
+    {"insert", "хеш и вставка в таблицу", kernel_insert},
+    {"search", "перебор кандидатов старого кодера со вставкой", kernel_search},
+    {"match", "lz77_match_length по заложенным совпадениям", kernel_match},
+    {"literals", "emit_literals серий литералов, как в print_literals", kernel_literals},
+    {"copy", "copy_match заложенных совпадений", kernel_copy},
+    {"decode", "lz77_decode_tokens старого формата", kernel_decode},
+};
+#define KERNEL_COUNT (sizeof(kernels) / sizeof(kernels[0]))
+
+// Аппаратные счётчики. Каждый открывается отдельно: недоступный (виртуальная машина,
+// perf_event_paranoid, чужой PMU) не мешает остальным, в отчёте на его месте прочерк.
+typedef enum
+{
+    COUNTER_CYCLES,
+    COUNTER_INSTRUCTIONS,
+    COUNTER_BRANCH_MISSES,
+    COUNTER_CACHE_MISSES,
+    COUNTER_COUNT
+} counter_kind;
+
+static const char *counter_names[COUNTER_COUNT] = {"cycles", "instructions", "branch-misses", "cache-misses"};
+
+typedef struct {
+    int fd[COUNTER_COUNT];
+} counters;
+
+typedef struct {
+    double ns;
+    uint64_t value[COUNTER_COUNT];
+    int valid[COUNTER_COUNT];
+} sample;
+
+static void counters_open(counters *c, int enabled)
+{
+    for (int i = 0; i < COUNTER_COUNT; i++)
+        c->fd[i] = -1;
+#ifdef HAVE_PERF
+    static const uint64_t configs[COUNTER_COUNT] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                                    PERF_COUNT_HW_BRANCH_MISSES, PERF_COUNT_HW_CACHE_MISSES};
+    int opened = 0, err = 0;
+    for (int i = 0; enabled && i < COUNTER_COUNT; i++)
+    {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = configs[i];
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        c->fd[i] = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+        if (c->fd[i] < 0)
+            err = errno;
+        else
+            opened++;
+    }
+    if (enabled && opened < COUNTER_COUNT)
+    {
+        fprintf(stderr, "Аппаратные счётчики недоступны (%s):", strerror(err));
+        for (int i = 0; i < COUNTER_COUNT; i++)
+            if (c->fd[i] < 0)
+                fprintf(stderr, " %s", counter_names[i]);
+        fprintf(stderr, "%s\n", c->fd[COUNTER_CYCLES] < 0 ? "; такты на байт — по -g, если задан" : "");
+    }
+#else
+    if (enabled)
+        fprintf(stderr, "Аппаратные счётчики на этой платформе не поддерживаются, замеряется только время\n");
+#endif
+}
+
+static void counters_close(counters *c)
+{
+    for (int i = 0; i < COUNTER_COUNT; i++)
+        if (c->fd[i] >= 0)
+            close(c->fd[i]);
+}
+
+static void counters_start(counters *c)
+{
+#ifdef HAVE_PERF
+    for (int i = 0; i < COUNTER_COUNT; i++)
+        if (c->fd[i] >= 0)
+        {
+            ioctl(c->fd[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(c->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+#else
+    (void)c;
+#endif
+}
+
+// Значения с поправкой на мультиплексирование: счётчик мог работать не всё время замера
+static void counters_stop(counters *c, sample *s)
+{
+    (void)c;
+    for (int i = 0; i < COUNTER_COUNT; i++)
+    {
+        s->valid[i] = 0;
+        s->value[i] = 0;
+#ifdef HAVE_PERF
+        uint64_t v[3];
+        if (c->fd[i] < 0)
+            continue;
+        ioctl(c->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+        if (read(c->fd[i], v, sizeof(v)) != (ssize_t)sizeof(v) || v[2] == 0)
+            continue;
+        s->value[i] = v[2] < v[1] ? (uint64_t)((double)v[0] * v[1] / v[2]) : v[0];
+        s->valid[i] = 1;
+#endif
+    }
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+typedef struct {
+    int kernels[KERNEL_COUNT];
+    int kernel_count;
+    int profiles[PROFILE_COUNT];
+    int profile_count;
+    size_t size;
+    int runs;
+    int use_counters;
+    double ghz; // Частота для оценки тактов без счётчика, 0 — не оценивать
+} micro_config;
+
+static void print_per(double value, int valid, uint64_t ops)
+{
+    if (valid && ops)
+        printf(" %10.3f", value / ops);
+    else
+        printf(" %10s", "-");
+}
+
+// Лучший по времени из прогонов; счётчики берутся из того же прогона
+static int run_kernel(const kernel *k, const profile *p, workload *w, counters *c, const micro_config *cfg)
+{
+    sample best = {0};
+    kernel_result res = {0};
+    for (int r = 0; r < cfg->runs; r++)
+    {
+        sample s;
+        res.status = 0;
+        counters_start(c);
+        double start = now_ns();
+        k->run(w, &res);
+        s.ns = now_ns() - start;
+        counters_stop(c, &s);
+        if (res.status != 0)
+        {
+            fprintf(stderr, "Ошибка: ядро %s на профиле %s дало неверный результат\n", k->name, p->name);
+            return -1;
+        }
+        if (r == 0 || s.ns < best.ns)
+            best = s;
+    }
+
+    printf("%-9s %-8s %10llu %9.3f %8.1f", k->name, p->name, (unsigned long long)res.ops,
+           res.ops ? best.ns / res.ops : 0.0, res.bytes ? res.bytes / best.ns * 1e3 : 0.0);
+    if (best.valid[COUNTER_CYCLES] && res.bytes)
+        printf(" %9.3f", (double)best.value[COUNTER_CYCLES] / res.bytes);
+    else if (cfg->ghz > 0 && res.bytes)
+        printf(" %8.3f~", best.ns * cfg->ghz / res.bytes);
+    else
+        printf(" %9s", "-");
+    print_per(best.value[COUNTER_INSTRUCTIONS], best.valid[COUNTER_INSTRUCTIONS], res.ops);
+    print_per(best.value[COUNTER_BRANCH_MISSES], best.valid[COUNTER_BRANCH_MISSES], res.ops);
+    print_per(best.value[COUNTER_CACHE_MISSES], best.valid[COUNTER_CACHE_MISSES], res.ops);
+    printf("\n");
+    fflush(stdout);
+    return 0;
+}
+
+static int run_profile(const profile *p, counters *c, const micro_config *cfg)
+{
+    workload w;
+    int failures = 0;
+    if (workload_build(&w, p, cfg->size) != 0)
+    {
+        fprintf(stderr, "Ошибка: не хватает памяти\n");
+        workload_free(&w);
+        return 1;
+    }
+    for (int i = 0; i < cfg->kernel_count; i++)
+        failures += run_kernel(&kernels[cfg->kernels[i]], p, &w, c, cfg) != 0;
+    workload_free(&w);
+    return failures;
+}
+
+static int parse_size(const char *text, size_t *size)
+{
+    char *end;
+    unsigned long long value = strtoull(text, &end, 10);
+    if (end == text)
+        return 1;
+    if (*end == 'K' || *end == 'k')
+        value <<= 10, end++;
+    else if (*end == 'M' || *end == 'm')
+        value <<= 20, end++;
+    *size = value;
+    return *end != '\0' || value == 0;
+}
+
+// Список имён через запятую в индексы names; 0 при успехе
+static int parse_names(char *text, const char *(*name_at)(size_t i), size_t count, int *out, int *n)
+{
+    *n = 0;
+    for (char *item = strtok(text, ","); item; item = strtok(NULL, ","))
+    {
+        size_t i = 0;
+        while (i < count && strcmp(item, name_at(i)) != 0)
+            i++;
+        if (i == count || (size_t)*n >= count)
+            return 1;
+        out[(*n)++] = (int)i;
+    }
+    return *n == 0;
+}
+
+static const char *kernel_name(size_t i)
+{
+    return kernels[i].name;
+}
+
+static const char *profile_name(size_t i)
+{
+    return profiles[i].name;
+}
+
+static void print_usage(void)
+{
+    printf("Микробенчмарк ядер lz77: нс на операцию, такты на байт и аппаратные счётчики\n");
+    printf("Использование: lz77_microbench [флаги]\n");
+    printf("  -k <список>   Ядра (по умолчанию все):\n");
+    for (size_t i = 0; i < KERNEL_COUNT; i++)
+        printf("                  %-9s %s\n", kernels[i].name, kernels[i].about);
+    printf("  -p <список>   Профили входа (по умолчанию все):\n");
+    for (size_t i = 0; i < PROFILE_COUNT; i++)
+        printf("                  %-9s %s: литералы %u..%u, длина %u..%u, дистанция %u..%u\n", profiles[i].name,
+               profiles[i].about, profiles[i].lit_min, profiles[i].lit_max, profiles[i].len_min, profiles[i].len_max,
+               profiles[i].off_min, profiles[i].off_max);
+    printf("  -s <размер>   Объём входа с суффиксом K/M (по умолчанию 1M)\n");
+    printf("  -r <n>        Прогонов на замер, берётся лучший (по умолчанию 5, не больше %d)\n", MAX_RUNS);
+    printf("  -g <ГГц>      Частота для оценки тактов на байт, когда счётчика тактов нет (помечается ~)\n");
+    printf("  -n            Не открывать аппаратные счётчики\n");
+    printf("Счётчики в столбцах — на операцию; ядро сравнения: %s (LZ77_MATCH_KERNEL)\n", lz77_match_kernel());
+}
+
+int main(int argc, char *argv[])
+{
+    micro_config cfg = {.size = 1 << 20, .runs = 5, .use_counters = 1};
+    for (size_t i = 0; i < KERNEL_COUNT; i++)
+        cfg.kernels[cfg.kernel_count++] = (int)i;
+    for (size_t i = 0; i < PROFILE_COUNT; i++)
+        cfg.profiles[cfg.profile_count++] = (int)i;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char *flag = argv[i];
+        if (strcmp(flag, "-h") == 0 || strcmp(flag, "--help") == 0)
+        {
+            print_usage();
+            return 0;
+        }
+        if (strcmp(flag, "-n") == 0)
+        {
+            cfg.use_counters = 0;
+            continue;
+        }
+        if (flag[0] != '-' || !flag[1] || flag[2] || i + 1 >= argc)
+        {
+            fprintf(stderr, "Ошибка: неизвестный флаг %s\n", flag);
+            print_usage();
+            return 1;
+        }
+        char *value = argv[++i], *end;
+        int bad = 0;
+        switch (flag[1])
+        {
+        case 'k':
+            bad = parse_names(value, kernel_name, KERNEL_COUNT, cfg.kernels, &cfg.kernel_count);
+            break;
+        case 'p':
+            bad = parse_names(value, profile_name, PROFILE_COUNT, cfg.profiles, &cfg.profile_count);
+            break;
+        case 's':
+            bad = parse_size(value, &cfg.size);
+            break;
+        case 'r':
+            cfg.runs = (int)strtol(value, &end, 10);
+            bad = end == value || *end || cfg.runs < 1 || cfg.runs > MAX_RUNS;
+            break;
+        case 'g':
+            cfg.ghz = strtod(value, &end);
+            bad = end == value || *end || cfg.ghz <= 0;
+            break;
+        default:
+            bad = 1;
+        }
+        if (bad)
+        {
+            fprintf(stderr, "Ошибка: неверное значение %s для %s\n", value, flag);
+            return 1;
+        }
+    }
+
+    counters c;
+    counters_open(&c, cfg.use_counters);
+    printf("%-9s %-8s %10s %9s %8s %9s %10s %10s %10s\n", "ядро", "профиль", "операций", "нс/оп", "МБ/с",
+           "такт/байт", "инстр/оп", "пром.пер.", "пром.кеша");
+    int failures = 0;
+    for (int i = 0; i < cfg.profile_count; i++)
+        failures += run_profile(&profiles[cfg.profiles[i]], &c, &cfg);
+    counters_close(&c);
+    return failures ? 1 : 0;
+}
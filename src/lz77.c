@@ -3,433 +3,409 @@
 #include <string.h>
 #include <stdint.h>
 #include <time.h>
-#include "lz77.h"
-
-// Глобальные переменные
-int block_num = 1, byte = 0;
-
-// Добавление статистики блока
-void add_block_stats(BlockStatsNode **head, uint32_t bytes_read, uint32_t match_count, uint32_t match_len, FILE *log)
+#include "lz77_internal.h"
+
+// Куски входа и выхода потокового распаковщика
+#define DECODE_INPUT_SIZE (1 << 20)
+#define DECODE_OUTPUT_SIZE (1 << 20)
+// Блок токенов кодера, уходящий одной записью
+#define ENCODE_OUTPUT_SIZE (1 << 20)
+// Блок кодера выдаёт меньше 2 * MAX_BUFFER_SIZE байт входа: отложенные литералы короче окна
+// поиска, новые позиции — блок пробы плюс заход последнего совпадения
+#define ENCODE_PASS_BOUND lz77_block_bound(2 * MAX_BUFFER_SIZE)
+
+// Состояние кодера старого формата между порциями входа. Позиции отсчитываются от начала
+// буфера; в таблице лежат их младшие 16 бит, поэтому буфер сдвигается только на кратное 65536.
+typedef struct {
+    lz77_legacy_table *table;
+    lz77_sink sink;
+    lz77_metrics metrics;
+    size_t block; // Начало следующего блока пробы
+    size_t pos;   // Следующая позиция поиска
+    size_t lit;   // Начало отложенных литералов
+    int prev_incompressible;
+} legacy_encoder;
+
+// Запас за концом блока, при котором его кодирование не зависит от данных дальше: совпадение
+// с последней позиции блока заходит на LOOKAHEAD_BUFFER_SIZE байт, за ним идёт следующий байт,
+// а хеш позиции читает 4 байта
+#define ENCODE_MARGIN (LOOKAHEAD_BUFFER_SIZE + 1 + 4)
+// Буфер потокового кодера и шаг его сдвига
+#define ENCODE_STREAM_SIZE (4 << 16)
+#define ENCODE_SHIFT_MASK ((size_t)0xFFFF)
+
+// Перед сдвигом в буфере остаются отложенные литералы (короче SEARCH_BUFFER_SIZE), окно поиска
+// и блок, не дождавшийся запаса; после сдвига должно хватить места ещё на блок с запасом
+#if ENCODE_STREAM_SIZE - HALF_BUFFER_SIZE - ENCODE_MARGIN - SEARCH_BUFFER_SIZE < (2 << 16)
+#error "Буфер потокового кодера слишком мал"
+#endif
+
+static int legacy_encoder_init(legacy_encoder *enc, lz77_io *out)
 {
-    BlockStatsNode *node = malloc(sizeof(BlockStatsNode));
-    if (!node)
+    memset(enc, 0, sizeof(*enc));
+    enc->prev_incompressible = 1;
+    if (!out || posix_memalign((void **)&enc->table, 64, sizeof(lz77_legacy_table)) != 0)
+    {
+        enc->table = NULL;
+        return -1;
+    }
+    memset(enc->table, 0, sizeof(lz77_legacy_table));
+    if (lz77_sink_init(&enc->sink, NULL, ENCODE_OUTPUT_SIZE, lz77_io_write, out) != 0)
     {
-        if (log)
-            fprintf(log, "[DEBUG] add_block_stats: ERROR: Failed to allocate BlockStatsNode\n");
-        return;
+        free(enc->table);
+        enc->table = NULL;
+        return -1;
     }
-    node->stats.block_number = block_num;
-    node->stats.bytes_read = bytes_read;
-    node->stats.match_count = match_count;
-    node->stats.total_match_len = match_len;
-    node->next = *head;
-    *head = node;
+    return 0;
 }
 
-// Освобождение списка статистики
-void free_block_stats(BlockStatsNode **head)
+static void legacy_encoder_free(legacy_encoder *enc)
 {
-    BlockStatsNode *current = *head;
-    while (current)
-    {
-        BlockStatsNode *temp = current;
-        current = current->next;
-        free(temp);
-    }
-    *head = NULL;
+    if (enc->table)
+        lz77_sink_free(&enc->sink);
+    free(enc->table);
 }
 
-// Вывод статистики в лог
-void log_block_stats(BlockStatsNode *head, FILE *log)
+// Кодирование блоков пробы по HALF_BUFFER_SIZE байт из n доступных байт src. Пока вход не
+// кончился (eof 0), останавливается на блоке без полного запаса ENCODE_MARGIN: так выход
+// не зависит от того, какими порциями пришёл вход, и совпадает с кодированием всего входа
+// разом. Совпадение может зайти за конец блока, тогда следующий начинается с его конца.
+static int legacy_encode(legacy_encoder *enc, const uint8_t *src, size_t n, int eof)
 {
-    if (!log || !head)
-        return;
-    uint32_t total_blocks = 0, total_bytes = 0, total_matches = 0, total_len = 0;
-    BlockStatsNode *current = head;
-    fprintf(log, "[DEBUG --- LZ77 Compression Block Statistics --- ]\n");
-    while (current)
+    // Хеш и вставка читают 4 байта с позиции; последние позиции уходят только литералами
+    size_t hash_end = n > 3 ? n - 3 : 0;
+    size_t pos = enc->pos, lit = enc->lit;
+    lz77_metrics *mt = &enc->metrics;
+    while (enc->block < n)
     {
-        total_blocks++;
-        total_bytes += current->stats.bytes_read;
-        total_matches += current->stats.match_count;
-        total_len += current->stats.total_match_len;
-        fprintf(log, "\t Block #%u: bytes_read=%u, matches=%u, total_match_len=%u\n",
-                current->stats.block_number, current->stats.bytes_read,
-                current->stats.match_count, current->stats.total_match_len);
-        current = current->next;
+        size_t block = enc->block;
+        size_t block_end = n - block < HALF_BUFFER_SIZE ? n : block + HALF_BUFFER_SIZE;
+        if (!eof && (block_end - block < HALF_BUFFER_SIZE || n - block_end < ENCODE_MARGIN))
+            break;
+        uint8_t *op = lz77_sink_reserve(&enc->sink, ENCODE_PASS_BOUND);
+        if (!op)
+            return -1;
+        mt->bytes_in += block_end - block;
+        mt->blocks++;
+        // На несжимаемых данных поиск не запускается: позиции только заносятся в хеш, а байты
+        // уходят литералами. Совпадение прошлого блока могло зайти в этот, поэтому пропуск
+        // только когда несжимаемы оба
+        int incompressible = lz77_probe_block(src + block, block_end - block) != LZ77_PROBE_COMPRESSIBLE;
+        int skip_search = incompressible && enc->prev_incompressible;
+        enc->prev_incompressible = incompressible;
+        mt->skipped_blocks += skip_search;
+
+        for (; pos < block_end && pos < hash_end; pos++)
+        {
+            uint32_t ihash = lz77_legacy_hash(src + pos);
+            size_t max_math_index = 0;
+            size_t max_len = n - pos - 1 < LOOKAHEAD_BUFFER_SIZE ? n - pos - 1 : LOOKAHEAD_BUFFER_SIZE;
+            size_t max_len_match = skip_search ? 0 : lz77_legacy_search(enc->table, ihash, src, pos, max_len, &max_math_index);
+
+            if (max_len_match >= MIN_MATCH_LENGTH)
+            {
+                metrics_literals(mt, pos - lit);
+                op = emit_literals(op, src + lit, pos - lit);
+                metrics_match(mt, max_len_match, max_math_index);
+                for (size_t end = pos + max_len_match; pos < end; pos++)
+                    if (pos < hash_end)
+                        lz77_legacy_insert(enc->table, pos, lz77_legacy_hash(src + pos));
+                op = emit_distance(op, max_math_index, 0);
+                *op++ = max_len_match;
+                *op++ = src[pos];
+                lit = pos + 1;
+                if (pos >= hash_end)
+                    continue;
+                ihash = lz77_legacy_hash(src + pos);
+            }
+            lz77_legacy_insert(enc->table, pos, ihash);
+        }
+        // Длинная серия литералов не копится через весь вход: резерв рассчитан на проход
+        if (pos - lit >= SEARCH_BUFFER_SIZE)
+        {
+            metrics_literals(mt, pos - lit);
+            op = emit_literals(op, src + lit, pos - lit);
+            lit = pos;
+        }
+        mt->bytes_out += op - enc->sink.op;
+        enc->sink.op = op;
+        enc->block = block_end;
     }
-    float avg_match_len = total_matches ? (float)total_len / total_matches : 0;
-    fprintf(log, "[DEBUG] lz77_compress: Summary: blocks=%u, total_bytes=%u, total_matches=%u, avg_match_len=%.2f\n",
-            total_blocks, total_bytes, total_matches, avg_match_len);
+    enc->pos = pos;
+    enc->lit = lit;
+    return 0;
 }
 
-#define add_hash(x) hash_table[x][pos_in_hash_tabel[x]++ & 7] = pos_in_buf++
+// Хвост литералов после конца входа и отдача накопленного в конвейер записи
+static int legacy_encoder_finish(legacy_encoder *enc, const uint8_t *src, size_t n)
+{
+    uint8_t *op = lz77_sink_reserve(&enc->sink, ENCODE_PASS_BOUND);
+    if (!op)
+        return -1;
+    if (n > enc->lit)
+        metrics_literals(&enc->metrics, n - enc->lit);
+    op = emit_literals(op, src + enc->lit, n - enc->lit);
+    enc->metrics.bytes_out += op - enc->sink.op;
+    enc->sink.op = op;
+    enc->lit = n;
+    return lz77_sink_flush(&enc->sink);
+}
 
-uint16_t hash(uint8_t *ctx)
+static void legacy_encoder_log(legacy_encoder *enc, FILE *log)
 {
-    return ((*((uint32_t *)ctx) & 0x00ffffff) * 2654435769LL) >> (32 - HASH_LOG) & HASH_MASK;
+    if (LZ77_LOG_ON(log, LZ77_LOG_INFO))
+        fprintf(log, "[INFO] lz77_compress: Completed: total_bytes_read=%llu, blocks=%llu, matches=%llu\n",
+                (unsigned long long)enc->metrics.bytes_in, (unsigned long long)enc->metrics.blocks,
+                (unsigned long long)enc->metrics.matches);
+    lz77_metrics_log(&enc->metrics, log);
 }
 
-void print_literals(uint8_t *buffer_start, uint32_t start, uint32_t end, FILE *output, FILE *log)
+// Кодер по входу, отображённому в память: поиск идёт прямо по страницам файла.
+// Ограничения формата: дистанция до SEARCH_BUFFER_SIZE, совпадение не длиннее дистанции и
+// LOOKAHEAD_BUFFER_SIZE, за ним всегда следующий байт. Позиции в таблице — младшие 16 бит
+// смещения, дистанция восстанавливается по модулю 65536; устаревшая запись даёт лишь другого
+// кандидата, которого всё равно проверяет сравнение.
+static int compress_mapped(lz77_map *map, FILE *output, FILE *log)
 {
-    if (!output || start >= MAX_BUFFER_SIZE)
+    lz77_io *out = lz77_io_writer(output);
+    legacy_encoder enc;
+    if (legacy_encoder_init(&enc, out) != 0)
     {
-        if (log)
-            fprintf(log, "[DEBUG] print_literals: ERROR: output is NULL or start (%u) >= MAX_BUFFER_SIZE (%u)\n", start, MAX_BUFFER_SIZE);
-        return;
+        fprintf(stderr, "[ERROR] Out of memory\n");
+        lz77_map_close(map, 0);
+        lz77_io_close(out);
+        return -1;
     }
-
-    uint32_t len = end < start ? MAX_BUFFER_SIZE - start : end - start;
-    uint8_t *ptr = buffer_start + start;
-
-    do
-    {
-        while (len)
-        {
-            uint32_t chunk = len < MAX_COPY ? len : MAX_COPY;
-            uint8_t axiscyd = (chunk & 0x7F) << 1 | 1;
-            fwrite(&axiscyd, 1, 1, output);
-            axiscyd = (chunk >> 7) & 0xFF;
-            fwrite(&axiscyd, 1, 1, output);
-            if (log)
-                fprintf(log, "[DEBUG] print_literals: Writing literal: length=%u, pos=%u\n", chunk, start);
-            uint32_t written = fwrite(ptr, 1, chunk, output);
-            if (written != chunk && log)
-                fprintf(log, "[DEBUG] print_literals: ERROR: Failed to write %u bytes, wrote %d\n", chunk, written);
-            ptr += chunk;
-            len -= chunk;
-        }
-        if (end < start && end)
-            len = end, ptr = buffer_start, end = 0;
-        else
-            break;
-    } while (len);
+    if (LZ77_LOG_ON(log, LZ77_LOG_DEBUG))
+        fprintf(log, "[DEBUG] lz77_compress: Mapped input: %zu bytes, io=%s\n", map->len, lz77_io_backend_name(out));
+
+    uint64_t t = metrics_clock();
+    int status = legacy_encode(&enc, map->data, map->len, 1);
+    t = metrics_phase(&enc.metrics, LZ77_PHASE_SEARCH, t);
+    if (!status)
+        status = legacy_encoder_finish(&enc, map->data, map->len);
+    lz77_map_close(map, 0);
+    if (lz77_io_close(out) != 0)
+        status = -1;
+    metrics_phase(&enc.metrics, LZ77_PHASE_WRITE, t);
+    if (status)
+        fprintf(stderr, "[ERROR] Write error\n");
+    else
+        legacy_encoder_log(&enc, log);
+    legacy_encoder_free(&enc);
+    return status;
 }
 
-int lz77_compress(FILE *input, FILE *output, FILE *log)
+// Тот же кодер по потоку (канал, stdin, ввод без отображения): вход копится в буфере
+// [окно поиска | новые данные] и кодируется теми же блоками, так что выход совпадает с
+// compress_mapped байт в байт. Буфер сдвигается на кратное 65536, чтобы позиции таблицы
+// оставались верными без пересчёта.
+static int compress_stream(FILE *input, FILE *output, FILE *log)
 {
-    if (!input || !output)
+    lz77_io *in = lz77_io_reader(input);
+    lz77_io *out = lz77_io_writer(output);
+    uint8_t *buf = malloc(ENCODE_STREAM_SIZE);
+    legacy_encoder enc;
+    if (!in || !buf || legacy_encoder_init(&enc, out) != 0)
     {
-        if (log)
-            fprintf(log, "[DEBUG] lz77_compress: ERROR: input or output is NULL\n");
+        fprintf(stderr, "[ERROR] Out of memory\n");
+        lz77_io_close(in);
+        lz77_io_close(out);
+        free(buf);
         return -1;
     }
-
-    uint8_t buffer[MAX_BUFFER_SIZE + LOOKAHEAD_BUFFER_SIZE] = {0};
-
-    uint32_t pos_in_buf = 0;
-    uint16_t cycle_pos = 0;
-    uint32_t buffer_refill_trigger[] = {SEARCH_BUFFER_SIZE + 1, SEARCH_BUFFER_SIZE + HALF_BUFFER_SIZE + 1, MAX_BUFFER_SIZE + 1};
-    uint32_t hash_table[HASH_TABLE_SIZE][MAX_MATCH_INDICES] = {0};
-    uint8_t pos_in_hash_tabel[HASH_TABLE_SIZE] = {0};
-    uint32_t last_pos_math = 0;
-    int bytes_read;
-    uint32_t match_count = 0;
-    uint32_t total_match_len = 0;
-    uint32_t old_pos_in_buf = 0;
-    uint32_t main_loop_count = 0;
-    uint32_t inner_loop_count = 0;
-    uint32_t search_limit = SEARCH_BUFFER_SIZE;
-    BlockStatsNode *block_stats = NULL;
-
-    if (log)
-        fprintf(log, "[DEBUG] lz77_compress: Initialized: MAX_BUFFER_SIZE=%d, HALF_BUFFER_SIZE=%d, SEARCH_BUFFER_SIZE=%d\n",
-                MAX_BUFFER_SIZE, HALF_BUFFER_SIZE, SEARCH_BUFFER_SIZE);
-
-    uint32_t border = buffer_refill_trigger[0];
-    while ((bytes_read = fread(buffer + (HALF_BUFFER_SIZE) * (cycle_pos++ & 1), 1, HALF_BUFFER_SIZE, input)))
+    if (LZ77_LOG_ON(log, LZ77_LOG_DEBUG))
+        fprintf(log, "[DEBUG] lz77_compress: Streamed input, io=%s/%s\n", lz77_io_backend_name(in),
+                lz77_io_backend_name(out));
+
+    size_t fill = 0;
+    int eof = 0, status = 0, read_error = 0;
+    uint64_t t = metrics_clock();
+    while (!status)
     {
-        byte += bytes_read;
-        main_loop_count++;
-        if (log)
-            fprintf(log, "[DEBUG] lz77_compress: Main loop #%u: read=%d bytes, cycle_pos=%u\n", main_loop_count, bytes_read, cycle_pos);
-        if (0) // main_loop_count > 10000
+        size_t n = lz77_io_read(in, buf + fill, ENCODE_STREAM_SIZE - fill);
+        eof = n < ENCODE_STREAM_SIZE - fill;
+        fill += n;
+        t = metrics_phase(&enc.metrics, LZ77_PHASE_READ, t);
+        if (eof && lz77_io_error(in))
         {
-            if (log)
-                fprintf(log, "[DEBUG] lz77_compress: ERROR: Main loop exceeded 10000 iterations\n");
-            free_block_stats(&block_stats);
-            return -1;
-        }
-
-        if (cycle_pos & 1)
-            memcpy(buffer + MAX_BUFFER_SIZE, buffer, LOOKAHEAD_BUFFER_SIZE);
-
-        match_count = 0;
-        total_match_len = 0;
-        if (bytes_read != HALF_BUFFER_SIZE)
-        {
-            buffer_refill_trigger[0] = bytes_read;
-            buffer_refill_trigger[1] = bytes_read + HALF_BUFFER_SIZE;
-            search_limit = bytes_read - 1;
-            if (cycle_pos & 1 && !pos_in_buf)
-                border = bytes_read;
-            if ((cycle_pos & 1) == 0)
-                border = buffer_refill_trigger[(cycle_pos ^ 1) & 1];
-        }
-        inner_loop_count = 0;
-        for (uint32_t ihash = hash(buffer + pos_in_buf), max_len_match = MIN_MATCH_LENGTH - 1, max_math_index = 0;
-             (pos_in_buf < border);
-             ihash = hash(buffer + pos_in_buf), max_len_match = MIN_MATCH_LENGTH - 1, max_math_index = 0)
-        {
-            inner_loop_count++;
-            if (inner_loop_count > 20000)
-            {
-                if (log)
-                    fprintf(log, "[DEBUG] lz77_compress: ERROR: Inner loop exceeded 100000 iterations, pos_in_buf=%u, border=%u\n",
-                            pos_in_buf, border);
-                free_block_stats(&block_stats);
-                return -1;
-            }
-
-            if (inner_loop_count % 1000 == 0 && log)
-                fprintf(log, "[DEBUG] lz77_compress: Inner loop #%u: pos_in_buf=%u, old_pos_in_buf=%u, border=%u\n",
-                        inner_loop_count, pos_in_buf, old_pos_in_buf, border);
-
-            old_pos_in_buf = pos_in_buf;
-            if (pos_in_buf >= MAX_BUFFER_SIZE)
-            {
-                pos_in_buf -= MAX_BUFFER_SIZE;
-                border = buffer_refill_trigger[0];
-                if (log)
-                    fprintf(log, "[DEBUG] lz77_compress: Buffer wrap: pos_in_buf=%u, new border=%u\n", pos_in_buf, border);
-            }
-            if (bytes_read != HALF_BUFFER_SIZE)
-                search_limit = border - pos_in_buf - 1;
-
-            for (uint32_t j = 0, i = 0, distance, next_pos; i < MAX_MATCH_INDICES; i++, j = 0)
-            {
-                next_pos = hash_table[ihash][i];
-                distance = (pos_in_buf >= next_pos) ? (pos_in_buf - next_pos) : (pos_in_buf + MAX_BUFFER_SIZE - next_pos);
-
-                if (distance < MIN_MATCH_LENGTH || distance > SEARCH_BUFFER_SIZE)
-                    continue;
-
-                while (buffer[pos_in_buf + j] == buffer[next_pos + j] && distance > j && j < search_limit && j < LOOKAHEAD_BUFFER_SIZE)
-                    j++;
-
-                if (j > max_len_match)
-                {
-                    max_len_match = j;
-                    max_math_index = distance;
-                }
-            }
-
-            if (max_len_match >= MIN_MATCH_LENGTH)
-            {
-                print_literals(buffer, last_pos_math, pos_in_buf, output, log);
-                match_count++;
-                total_match_len += max_len_match;
-                if (log)
-                    fprintf(log, "[DEBUG] lz77_compress: Writing match: distance=%u, length=%u, next_char=%c, pos_in_buf=%u\n",
-                            max_math_index, max_len_match, buffer[pos_in_buf], pos_in_buf);
-                for (uint32_t i = 0; i < max_len_match; i++, ihash = hash(buffer + pos_in_buf))
-                    add_hash(ihash);
-                uint8_t axiscyd = (max_math_index & 0x7F) << 1;
-                fwrite(&axiscyd, 1, 1, output);
-                axiscyd = max_math_index >> 7;
-                fwrite(&axiscyd, 1, 1, output);
-                axiscyd = max_len_match;
-                fwrite(&axiscyd, 1, 1, output);
-                fwrite(&buffer[pos_in_buf], 1, 1, output);
-                last_pos_math = pos_in_buf + 1;
-                if (last_pos_math >= MAX_BUFFER_SIZE)
-                    last_pos_math -= MAX_BUFFER_SIZE;
-            }
-
-            add_hash(ihash);
+            fprintf(stderr, "[ERROR] Read error\n");
+            status = read_error = -1;
+            break;
         }
-        if (pos_in_buf >= MAX_BUFFER_SIZE)
-            pos_in_buf -= MAX_BUFFER_SIZE;
-        uint32_t distance = (pos_in_buf >= last_pos_math) ? (pos_in_buf - last_pos_math) : (pos_in_buf + MAX_BUFFER_SIZE - last_pos_math);
-        if (distance >= SEARCH_BUFFER_SIZE)
+        // Пустой вход (пустой файл, сразу закрытый канал) — пустой поток без единого токена
+        if (eof && !fill)
         {
-            print_literals(buffer, last_pos_math, pos_in_buf, output, log);
-            last_pos_math = pos_in_buf;
+            if (LZ77_LOG_ON(log, LZ77_LOG_INFO))
+                fprintf(log, "[INFO] lz77_compress: Empty input, empty stream written\n");
+            break;
         }
-        border = buffer_refill_trigger[1 + ((cycle_pos ^ 1) & 1)];
+        status = legacy_encode(&enc, buf, fill, eof);
+        t = metrics_phase(&enc.metrics, LZ77_PHASE_SEARCH, t);
+        if (status || eof)
+            break;
 
-        // Сохранение статистики блока
-        add_block_stats(&block_stats, bytes_read, match_count, total_match_len, log);
-        block_num++;
+        // Остаются окно поиска перед позицией, отложенные литералы и незакодированный блок
+        size_t keep = enc.pos > SEARCH_BUFFER_SIZE ? enc.pos - SEARCH_BUFFER_SIZE : 0;
+        if (enc.lit < keep)
+            keep = enc.lit;
+        if (enc.block < keep)
+            keep = enc.block;
+        size_t shift = keep & ~ENCODE_SHIFT_MASK;
+        memmove(buf, buf + shift, fill - shift);
+        fill -= shift;
+        enc.pos -= shift;
+        enc.lit -= shift;
+        enc.block -= shift;
     }
-    print_literals(buffer, last_pos_math, buffer_refill_trigger[cycle_pos & 1], output, log);
-    if (log)
-        fprintf(log, "[DEBUG] lz77_compress: Completed: total_bytes_read=%d, blocks=%d, matches=%u\n", byte, block_num, match_count);
-
-    // Вывод статистики блоков
-    log_block_stats(block_stats, log);
-    free_block_stats(&block_stats);
-    return 0;
+    if (!status)
+        status = legacy_encoder_finish(&enc, buf, fill);
+    lz77_io_close(in);
+    if (lz77_io_close(out) != 0)
+        status = -1;
+    metrics_phase(&enc.metrics, LZ77_PHASE_WRITE, t);
+    if (!status)
+        legacy_encoder_log(&enc, log);
+    else if (!read_error)
+        fprintf(stderr, "[ERROR] Write error\n");
+    legacy_encoder_free(&enc);
+    free(buf);
+    return status;
 }
 
-void cpy(uint8_t *output_buffer, int32_t pos, int32_t offset, int32_t len)
+int lz77_compress(FILE *input, FILE *output, FILE *log)
 {
-    if (offset <= 0 || offset > MAX_OUTPUT_BUFFER_SIZE || len <= 0 || len > MAX_OUTPUT_BUFFER_SIZE)
+    if (!input || !output)
     {
-        fprintf(stderr, "[ERROR] cpy: Invalid offset=%d or len=%d\n", offset, len);
-        return;
-    }
-    int32_t top_pos = (pos - offset) & OUTPUT_BUF_MASK;
-    if (top_pos + len > MAX_OUTPUT_BUFFER_SIZE) {
-        int first_right = MAX_OUTPUT_BUFFER_SIZE - top_pos;
-        memcpy(output_buffer + pos, output_buffer + top_pos, first_right);
-        memcpy(output_buffer+ pos+ first_right, output_buffer, len - first_right);
-    } else {
-        if(len+pos > MAX_OUTPUT_BUFFER_SIZE){
-            int first_right = MAX_OUTPUT_BUFFER_SIZE - pos;
-            memcpy(output_buffer + pos, output_buffer + top_pos, first_right);
-            memcpy(output_buffer, output_buffer + top_pos+first_right, len - first_right);
-        }else
-            memcpy(output_buffer + pos, output_buffer + top_pos, len);
+        fprintf(stderr, "[ERROR] Input or output is NULL\n");
+        return -1;
     }
-
+    lz77_map map;
+    if (lz77_map_input(&map, input) == 0)
+        return compress_mapped(&map, output, log);
+    return compress_stream(input, output, log);
 }
 
 int lz77_decompress(FILE *input, FILE *output, FILE *log)
 {
-    uint8_t output_buffer[MAX_OUTPUT_BUFFER_SIZE + HALF_OUTPUT_BUFFER_SIZE] = {0};
-    int32_t cycle_pos = 1;
-    int32_t dwdiw[] = {HALF_OUTPUT_BUFFER_SIZE, 0};
-    int32_t pos = 0;
-    int32_t count;
-    int32_t byte;
-    int64_t total_written = 0;
-    int64_t total_written_to_file = 0;
-    int32_t block_number = 0;
+    // Контейнер с фреймами начинается с нулевого байта, старый поток — с литерала
+    int first = fgetc(input);
+    if (first == 0)
+    {
+        uint8_t magic[LZ77_FRAME_MAGIC_SIZE - 1];
+        int got = fread(magic, 1, sizeof(magic), input) == sizeof(magic);
+        if (!got || memcmp(magic, LZ77_FRAME_MAGIC + 1, sizeof(magic)) != 0)
+        {
+            if (got && memcmp(magic, LZ77_DEDUP_MAGIC + 1, sizeof(magic)) == 0)
+                fprintf(stderr, "[ERROR] Deduplicated archive needs its chunk store\n");
+            else
+                fprintf(stderr, "[ERROR] Invalid frame magic\n");
+            return -1;
+        }
+        return lz77_frame_decompress(input, output, log);
+    }
+    if (first != EOF)
+        ungetc(first, input);
 
-    if (log)
+    if (LZ77_LOG_ON(log, LZ77_LOG_INFO))
     {
         fprintf(log, "[INFO] Starting decompression\n");
     }
 
-    while ((byte = fgetc(input)) != EOF)
+    // Вход читается большими кусками, выход копится в окне [история | данные], где история —
+    // последние MAX_OUTPUT_BUFFER_SIZE байт (до начала потока — нули, как в прежнем кольце)
+    uint8_t *in = malloc(DECODE_INPUT_SIZE);
+    uint8_t *window = calloc(1, MAX_OUTPUT_BUFFER_SIZE + DECODE_OUTPUT_SIZE);
+    lz77_io *reader = lz77_io_reader(input);
+    lz77_io *writer = output ? lz77_io_writer(output) : NULL;
+    if (!in || !window || !reader || (output && !writer))
     {
-        count = byte >> 1;
-        if (byte & 1)
-        { // Литерал
-            int next_byte = fgetc(input);
-            if (next_byte == EOF)
-            {
-                fprintf(stderr, "[ERROR] EOF at literal length\n");
-                return -1;
-            }
-            count |= next_byte << 7;
-            if (count <= 0 || count > MAX_LITERAL_LENGTH)
-            {
-                fprintf(stderr, "[ERROR] Invalid literal length=%d\n", count);
-                return -1;
-            }
+        fprintf(stderr, "[ERROR] Out of memory\n");
+        lz77_io_close(reader);
+        lz77_io_close(writer);
+        free(in);
+        free(window);
+        return -1;
+    }
+    uint8_t *data = window + MAX_OUTPUT_BUFFER_SIZE, *oend = data + DECODE_OUTPUT_SIZE;
+    uint8_t *op = data;
+    const uint8_t *ip = in, *iend = in;
+    int64_t total_written_to_file = 0;
+    int32_t block_number = 0;
+    int eof = 0;
+    int status = 0;
 
-            size_t bytes_to_read = count;
-            while (bytes_to_read > 0)
+    for (;;)
+    {
+        // Недоразобранный хвост переносится в начало, чтобы токен не рвался на границе куска
+        size_t rest = iend - ip;
+        if (!eof && rest < DECODE_INPUT_SIZE / 2)
+        {
+            memmove(in, ip, rest);
+            size_t n = lz77_io_read(reader, in + rest, DECODE_INPUT_SIZE - rest);
+            if (!n && lz77_io_error(reader))
             {
-                size_t chunk = bytes_to_read;
-                if (pos + chunk > MAX_OUTPUT_BUFFER_SIZE)
-                {
-                    chunk = MAX_OUTPUT_BUFFER_SIZE - pos;
-                }
-                if (fread(output_buffer + pos, 1, chunk, input) != chunk)
-                {
-                    fprintf(stderr, "[ERROR] Read error at literal\n");
-                    return -1;
-                }
-                total_written += chunk;
-                bytes_to_read -= chunk;
-                pos = (pos + chunk) & OUTPUT_BUF_MASK;
+                fprintf(stderr, "[ERROR] Read error\n");
+                status = -1;
+                break;
             }
+            eof = !n;
+            ip = in;
+            iend = in + rest + n;
         }
-        else
-        { // Совпадения
-            int next_byte = fgetc(input);
-            if (next_byte == EOF)
-            {
-                fprintf(stderr, "[ERROR] EOF at match distance\n");
-                return -1;
-            }
-            count |= (next_byte << 7);
-            if (count <= 0 || count > MAX_OUTPUT_BUFFER_SIZE)
-            {
-                fprintf(stderr, "[ERROR] Invalid match distance=%d\n", count);
-                return -1;
-            }
-
-            int32_t len = fgetc(input);
-            if (len == EOF)
-            {
-                fprintf(stderr, "[ERROR] EOF at match length\n");
-                return -1;
-            }
-            if (len < MIN_MATCH_LENGTH || len > LOOKAHEAD_BUFFER_SIZE)
-            {
-                fprintf(stderr, "[ERROR] Invalid match length=%u\n", len);
-                return -1;
-            }
 
-            cpy(output_buffer, pos, count, len);
-            total_written += len;
-            pos = (len + pos) & OUTPUT_BUF_MASK;
-
-            int next_char = fgetc(input);
-            if (next_char == EOF)
-            {
-                fprintf(stderr, "[ERROR] EOF at next char\n");
-                return -1;
-            }
-            output_buffer[pos] = next_char;
-            total_written++;
-            pos = (1 + pos) & OUTPUT_BUF_MASK;
+        const uint8_t *before = ip;
+        if (lz77_decode_tokens(&ip, iend, &op, oend, window, 0) != 0)
+        {
+            fprintf(stderr, "[ERROR] Corrupted token at output offset %lld\n",
+                    (long long)(total_written_to_file + (op - data)));
+            status = -1;
+            break;
         }
 
-        if (((cycle_pos & 1) && pos >= HALF_OUTPUT_BUFFER_SIZE) || (!(cycle_pos & 1) && pos < HALF_OUTPUT_BUFFER_SIZE))
+        int done = eof && ip == iend;
+        if (done || oend - op < DECODE_OUTPUT_SIZE / 2)
         {
-            size_t written = fwrite(output_buffer + dwdiw[cycle_pos & 1], 1, HALF_OUTPUT_BUFFER_SIZE, output);
-            if (written != HALF_OUTPUT_BUFFER_SIZE)
+            size_t len = op - data;
+            if (writer && lz77_io_write(writer, data, len) != 0)
             {
-                fprintf(stderr, "[ERROR] Write error, written=%zu\n", written);
-                return -1;
+                fprintf(stderr, "[ERROR] Write error, size=%zu\n", len);
+                status = -1;
+                break;
             }
-            total_written_to_file += written;
-            if (log)
+            total_written_to_file += len;
+            if (LZ77_LOG_ON(log, LZ77_LOG_FRAMES))
             {
                 fprintf(log, "[INFO] Block %d written, size=%zu, total_written_to_file=%lld\n",
-                        block_number, written, total_written_to_file);
+                        block_number, len, (long long)total_written_to_file);
             }
             block_number++;
-            cycle_pos++;
+            memmove(window, op - MAX_OUTPUT_BUFFER_SIZE, MAX_OUTPUT_BUFFER_SIZE);
+            op = data;
         }
-    }
-
-    int64_t remaining = total_written - total_written_to_file;
-    if (remaining < 0 || remaining > HALF_OUTPUT_BUFFER_SIZE)
-    {
-        fprintf(stderr, "[ERROR] Invalid remaining: %lld\n", remaining);
-        return -1;
-    }
-    if (remaining > 0)
-    {
-        int32_t src_offset = dwdiw[cycle_pos & 1];
-        if (pos < src_offset)
-        {
-            src_offset = (src_offset == HALF_OUTPUT_BUFFER_SIZE) ? 0 : HALF_OUTPUT_BUFFER_SIZE;
-        }
-        size_t written = fwrite(output_buffer + src_offset, 1, remaining, output);
-        if (written != remaining)
-        {
-            fprintf(stderr, "[ERROR] Final write error, written=%zu\n", written);
-            return -1;
-        }
-        total_written_to_file += written;
-        if (log)
+        else if (eof && ip == before)
         {
-            fprintf(log, "[INFO] Final block written, size=%zu, total_written_to_file=%lld\n",
-                    written, total_written_to_file);
+            fprintf(stderr, "[ERROR] Unexpected EOF inside token\n");
+            status = -1;
+            break;
         }
+        if (done)
+            break;
     }
 
-    if (log)
+    lz77_io_close(reader);
+    if (lz77_io_close(writer) != 0 && !status)
     {
-        fprintf(log, "[INFO] Decompression completed, total_written=%lld, total_written_to_file=%lld, blocks=%d\n",
-                total_written, total_written_to_file, block_number);
+        fprintf(stderr, "[ERROR] Write error\n");
+        status = -1;
     }
-    return 0;
+    if (LZ77_LOG_ON(log, LZ77_LOG_INFO) && !status)
+    {
+        fprintf(log, "[INFO] Decompression completed, total_written_to_file=%lld, blocks=%d\n",
+                (long long)total_written_to_file, block_number);
+    }
+    free(in);
+    free(window);
+    // В старом потоке контрольных сумм нет: проверка лишь разобрала токены
+    return !status && !output ? LZ77_UNVERIFIED : status;
 }
@@ -21,22 +21,240 @@
 #define HALF_OUTPUT_BUFFER_SIZE (MAX_OUTPUT_BUFFER_SIZE >> 1)
 #define OUTPUT_BUF_MASK (MAX_OUTPUT_BUFFER_SIZE - 1)
 #define MAX_LITERAL_LENGTH MAX_BUFFER_SIZE
-// Структура для хранения статистики блока
+
+// Уровни подробности лога (lz77_set_log_level); ошибки всегда идут в stderr
+#define LZ77_LOG_QUIET 0  // Ничего
+#define LZ77_LOG_INFO 1   // Параметры, итог и сводка телеметрии
+#define LZ77_LOG_FRAMES 2 // Плюс строка на каждый фрейм (по умолчанию)
+#define LZ77_LOG_DEBUG 3  // Плюс внутренние шаги старого потокового формата
+
+// Фазы сжатия, время которых собирает телеметрия
+typedef enum
+{
+    LZ77_PHASE_READ,   // Чтение входа
+    LZ77_PHASE_SEARCH, // Поиск совпадений и запись токенов
+    LZ77_PHASE_EMIT,   // Энтропийное кодирование блоков
+    LZ77_PHASE_WRITE,  // Запись выхода
+    LZ77_PHASES
+} lz77_phase;
+
+// Гистограммы телеметрии по log2: корзина k считает значения из [2^(k-1), 2^k), корзина 0 — нули
+#define LZ77_METRICS_BUCKETS 32
+
+// Телеметрия сжатия. Счётчики ведутся в каждом рабочем потоке отдельно и складываются
+// в конце; время фаз суммируется по потокам.
+typedef struct {
+    uint64_t bytes_in;
+    uint64_t bytes_out;    // Токены блоков без заголовков контейнера
+    uint64_t blocks;
+    uint64_t skipped_blocks; // Блоков, которые проба сочла несжимаемыми: без поиска совпадений
+    uint64_t literals;     // Байт в литералах
+    uint64_t literal_runs; // Непустых серий литералов
+    uint64_t matches;
+    uint64_t match_bytes;
+    uint64_t match_len[LZ77_METRICS_BUCKETS];
+    uint64_t distance[LZ77_METRICS_BUCKETS];
+    uint64_t literal_run[LZ77_METRICS_BUCKETS]; // Серии перед каждым совпадением, включая пустые
+    uint64_t phase_ns[LZ77_PHASES];
+} lz77_metrics;
+
+// Уровни сжатия: 1-2 — одна проба по хешу, 3 — 8 слотов на корзину (как lz77_compress),
+// 4-7 — хеш-цепочки, 8-9 — двоичное дерево
+#define LZ77_MIN_LEVEL 1
+#define LZ77_MAX_LEVEL 9
+#define LZ77_DEFAULT_LEVEL 3
+// Ленивый разбор: 0 — жадный, 1 — проверка следующей позиции, 2 — двух следующих
+#define LZ77_MAX_LAZY 2
+// log2 окна поиска для фреймов; 0 — прежнее окно SEARCH_BUFFER_SIZE с 15-битными дистанциями
+#define LZ77_MIN_WINDOW_LOG 16
+#define LZ77_MAX_WINDOW_LOG 23
+// Дальние совпадения (LDM): log2 дальнего окна и log2 памяти его индекса в байтах
+#define LZ77_MIN_LDM_LOG 20
+#define LZ77_MAX_LDM_LOG 30
+#define LZ77_DEFAULT_LDM_LOG 27
+#define LZ77_MIN_LDM_MEM_LOG 16
+#define LZ77_MAX_LDM_MEM_LOG 30
+#define LZ77_DEFAULT_LDM_MEM_LOG 24
+
+// Параметры сжатия независимыми фреймами
 typedef struct {
-    uint32_t block_number;    // Номер блока
-    uint32_t bytes_read;      // Количество считанных байт
-    uint32_t match_count;     // Количество совпадений
-    uint32_t total_match_len; // Суммарная длина совпадений
-} BlockStats;
-
-// Узел связного списка для истории блоков
-typedef struct BlockStatsNode {
-    BlockStats stats;
-    struct BlockStatsNode *next;
-} BlockStatsNode;
+    int threads;    // Число рабочих потоков
+    int frame_log;  // log2 размера фрейма
+    int chain;      // Фрейм начинается с хвоста предыдущего как истории
+    int seek_table; // Дописывать таблицу поиска фреймов в конец файла
+    int level;      // Уровень сжатия LZ77_MIN_LEVEL..LZ77_MAX_LEVEL
+    int lazy;       // Глубина ленивого разбора 0..LZ77_MAX_LAZY, -1 — по уровню
+    int window_log; // log2 окна LZ77_MIN_WINDOW_LOG..LZ77_MAX_WINDOW_LOG, 0 — окно 8 КБ
+    int ldm_log;    // log2 дальнего окна LZ77_MIN_LDM_LOG..LZ77_MAX_LDM_LOG, 0 — без дальних совпадений
+    int ldm_mem_log; // log2 памяти индекса дальних совпадений в байтах
+    int entropy;    // Кодировать токены фреймов Хаффманом, если это короче
+    int sequences;  // Упакованные последовательности; 0 — прежние токены с next_char
+    int checksum;   // Контрольные суммы фреймов и всего содержимого (xxHash64)
+    lz77_metrics *metrics; // Куда прибавить телеметрию сжатия; NULL — только сводка в лог
+} lz77_params;
 
+// Приёмник выходных данных потокового API; возвращает 0 при успехе
+typedef int (*lz77_write_fn)(void *opaque, const void *data, size_t len);
+
+// Потоковые контексты: состояние живёт в куче, поэтому независимых потоков может быть сколько угодно
+typedef struct lz77_cctx lz77_cctx;
+typedef struct lz77_dctx lz77_dctx;
+
+// Старый потоковый формат: пустой вход даёт пустой поток, пустой поток — пустой выход.
+// Контрольных сумм в нём нет.
 int lz77_compress(FILE *input, FILE *output, FILE *log);
+// output NULL — только проверка: данные распаковываются и сверяются с контрольными суммами
+// контейнера, но никуда не пишутся. Так же и в lz77_decompress_frames.
+// Проверять нечем в старом потоке и в контейнере, сжатом без сумм (checksum 0): тогда при
+// успешном разборе возвращается LZ77_UNVERIFIED, а не 0 — порча, не нарушившая разбор,
+// так не видна. Ошибки — отрицательные значения.
+#define LZ77_UNVERIFIED 1
 int lz77_decompress(FILE *input, FILE *output, FILE *log);
 
+void lz77_params_default(lz77_params *params);
+
+// Подробность логов всех функций библиотеки, LZ77_LOG_*; уровни выше LZ77_LOG_MAX, заданного
+// при сборке, вырезаны из кода
+void lz77_set_log_level(int level);
+// Глубина конвейера ввода-вывода файловых функций: сколько буферов по 1 МБ читается вперёд
+// и пишется позади, пока кодек работает (io_uring для обычных файлов, иначе отдельный поток).
+// 0 — синхронный stdio. Действует на конвейеры, открытые после вызова.
+#define LZ77_IO_DEFAULT_DEPTH 4
+#define LZ77_IO_MAX_DEPTH 16
+void lz77_set_io_depth(int depth);
+// Сводка телеметрии одной строкой JSON или таблицей CSV (metric,bucket,value)
+void lz77_metrics_json(const lz77_metrics *metrics, FILE *out);
+void lz77_metrics_csv(const lz77_metrics *metrics, FILE *out);
+// Сжатие в контейнер с фреймами; фреймы сжимаются пулом потоков и пишутся по порядку.
+// С дальними совпадениями фреймы сцеплены и сжимаются последовательно.
+int lz77_compress_frames(FILE *input, FILE *output, FILE *log, const lz77_params *params);
+// Параллельная распаковка по таблице поиска с записью фреймов через pwrite.
+// Без таблицы, для сцепленных фреймов или не обычных файлов распаковывает последовательно.
+int lz77_decompress_frames(FILE *input, FILE *output, FILE *log, int threads);
+// Распаковка в dst только байтов [offset, offset + len) по таблице поиска; декодируются
+// лишь пересекающиеся фреймы. Возвращает число скопированных байт или -1.
+int64_t lz77_decompress_range(FILE *input, uint64_t offset, uint64_t len, void *dst);
+
+// Сжатие и распаковка буфер-в-буфер без stdio и промежуточных колец.
+// Размер dst для lz77_compress_buf с гарантией берётся из lz77_compress_bound.
+// Контрольных сумм в выходе нет (короткие сообщения от них заметно растут): повреждённые
+// данные могут распаковаться без ошибки в неверные байты. Целостность, если она нужна,
+// проверяет вызывающий.
+size_t lz77_compress_bound(size_t src_len);
+// Возвращает размер сжатых данных или -1
+int64_t lz77_compress_buf(const void *src, size_t src_len, void *dst, size_t dst_cap);
+int64_t lz77_compress_buf_level(const void *src, size_t src_len, void *dst, size_t dst_cap, int level);
+// Контекст буферного сжатия: таблицы поиска и буферы кодов Хаффмана выделяются один раз и
+// переиспользуются между сообщениями, поэтому короткое сообщение не платит за их выделение и
+// обнуление. Контекст принадлежит одному потоку; выход тот же, что у lz77_compress_buf_level.
+typedef struct lz77_buf_ctx lz77_buf_ctx;
+lz77_buf_ctx *lz77_buf_ctx_create(int level);
+void lz77_buf_ctx_free(lz77_buf_ctx *ctx);
+int64_t lz77_compress_buf_ctx(lz77_buf_ctx *ctx, const void *src, size_t src_len, void *dst, size_t dst_cap);
+// Исходный размер по префиксам фреймов, без распаковки; -1 для повреждённых данных
+int64_t lz77_decompressed_size(const void *src, size_t src_len);
+// Распаковка прямо в dst; возвращает число записанных байт или -1
+int64_t lz77_decompress_buf(const void *src, size_t src_len, void *dst, size_t dst_cap);
+
+// Словари для коротких сообщений. Словарь — произвольные байты (образцы типичных данных),
+// которые служат историей первого фрейма: совпадения ссылаются в него с первого байта.
+// lz77_dict_load один раз строит из словаря снимок таблиц поиска; словарь после загрузки
+// неизменяем и может использоваться из многих потоков. Контекст lz77_dict_ctx держит
+// рабочие таблицы и буфер одного потока и переиспользуется между сообщениями.
+#define LZ77_DICT_MIN_SIZE 8
+#define LZ77_DICT_MAX_SIZE (1 << 16)
+#define LZ77_DICT_DEFAULT_SIZE (1 << 15)
+
+typedef struct lz77_dict lz77_dict;
+typedef struct lz77_dict_ctx lz77_dict_ctx;
+
+// Обучение: из образцов (samples подряд, размеры в sizes) выбираются самые частые фрагменты.
+// Возвращает размер словаря в dict (не больше dict_cap) или 0, если образцов слишком мало.
+size_t lz77_dict_train(const void *samples, const size_t *sizes, size_t count, void *dict, size_t dict_cap);
+// Загрузка словаря для сжатия уровнем level (LZ77_MIN_LEVEL..LZ77_MAX_LEVEL, 0 — по умолчанию);
+// распаковке уровень безразличен. Берутся последние LZ77_DICT_MAX_SIZE байт.
+lz77_dict *lz77_dict_load(const void *content, size_t len, int level);
+void lz77_dict_free(lz77_dict *dict);
+// Идентификатор словаря, записываемый в сжатые им данные
+uint32_t lz77_dict_id(const lz77_dict *dict);
+lz77_dict_ctx *lz77_dict_ctx_create(const lz77_dict *dict);
+void lz77_dict_ctx_free(lz77_dict_ctx *ctx);
+// То же, что lz77_compress_buf и lz77_decompress_buf, но со словарём контекста. Граница
+// сжатого размера — lz77_compress_bound(src_len) + 4. Как и у lz77_compress_buf, контрольных
+// сумм в выходе нет.
+int64_t lz77_compress_dict(lz77_dict_ctx *ctx, const void *src, size_t src_len, void *dst, size_t dst_cap);
+int64_t lz77_decompress_dict(lz77_dict_ctx *ctx, const void *src, size_t src_len, void *dst, size_t dst_cap);
+
+// Потоковое сжатие порциями произвольного размера. update копит данные до полного фрейма,
+// flush сразу выпускает неполный фрейм, finish дописывает конец контейнера, end делает то же
+// (если finish ещё не было) и освобождает контекст. reset начинает новый контейнер в том же контексте без новых
+// выделений памяти — так дешевле сжимать много мелких потоков подряд.
+lz77_cctx *lz77_cctx_init(const lz77_params *params, lz77_write_fn write, void *opaque);
+int lz77_cctx_update(lz77_cctx *ctx, const void *src, size_t len);
+int lz77_cctx_flush(lz77_cctx *ctx);
+int lz77_cctx_finish(lz77_cctx *ctx);
+int lz77_cctx_reset(lz77_cctx *ctx, lz77_write_fn write, void *opaque);
+int lz77_cctx_end(lz77_cctx *ctx);
+
+// Потоковая распаковка контейнера: фреймы отдаются в write по мере готовности.
+// finish проверяет, что поток завершён, end делает то же и освобождает контекст; reset
+// начинает новый контейнер, сохраняя буферы, если они подходят его заголовку.
+lz77_dctx *lz77_dctx_init(lz77_write_fn write, void *opaque);
+int lz77_dctx_update(lz77_dctx *ctx, const void *src, size_t len);
+int lz77_dctx_finish(lz77_dctx *ctx);
+int lz77_dctx_reset(lz77_dctx *ctx, lz77_write_fn write, void *opaque);
+int lz77_dctx_end(lz77_dctx *ctx);
+
+// Пакетная обработка файлов: файлы раздаются пулу из threads потоков, у каждого потока свой
+// контекст, переиспользуемый от файла к файлу. Каждый файл сжимается в один поток.
+typedef struct {
+    const char *input;
+    const char *output; // NULL при распаковке — только проверка
+    int status;        // Заполняется обработкой: 0, -1 или LZ77_UNVERIFIED (проверка без сумм)
+    uint64_t in_size;  // Прочитано байт
+    uint64_t out_size; // Записано байт
+} lz77_batch_item;
+
+// Сжатие в контейнеры, как lz77_cctx с params; возвращает число файлов с ошибкой
+size_t lz77_compress_batch(lz77_batch_item *items, size_t count, const lz77_params *params, FILE *log);
+// Распаковка контейнеров и файлов старого формата; возвращает число файлов с ошибкой.
+// Файлы без контрольных сумм при проверке (output NULL) не ошибка, их status — LZ77_UNVERIFIED.
+size_t lz77_decompress_batch(lz77_batch_item *items, size_t count, int threads, FILE *log);
+
+// Архивы с дедупликацией для множества похожих больших файлов (ночные снимки, сборки).
+// Вход режется на фрагменты по содержимому (скользящий хеш Gear, как в FastCDC): граница
+// зависит лишь от соседних байт, так что вставка или удаление сдвигает только ближайшие
+// фрагменты. Фрагменты лежат в хранилище — каталоге с файлом сжатых фрагментов и индексом
+// их отпечатков; в хранилище сжимаются и дописываются только новые фрагменты, а архив — это
+// список отпечатков. Распаковать архив можно только с тем хранилищем, в которое он записан.
+// Хранилище открывает один процесс на запись или сколько угодно на чтение.
+#define LZ77_CDC_LOG 13 // log2 среднего размера фрагмента; наименьший — в 4 раза меньше, наибольший — в 8 раз больше
+
+typedef struct lz77_store lz77_store;
+
+// Итог сжатия одного архива
+typedef struct {
+    uint64_t bytes_in;
+    uint64_t chunks;
+    uint64_t new_chunks;   // Фрагментов, которых не было в хранилище
+    uint64_t new_bytes;    // Их исходный размер
+    uint64_t stored_bytes; // Сколько сжатых байт дописано в хранилище
+    uint64_t archive_bytes;
+} lz77_dedup_stats;
+
+// Открытие хранилища в каталоге path; writable — для сжатия, каталог и файлы тогда создаются
+// при необходимости. NULL при ошибке (она уже выведена в stderr).
+lz77_store *lz77_store_open(const char *path, int writable);
+// Возвращает -1, если не удалось закрыть файлы хранилища
+int lz77_store_close(lz77_store *store);
+// Сжатие input в архив output; новые фрагменты сжимаются пулом из params->threads потоков
+// уровнем params->level. Добавленное в хранилище фиксируется перед возвратом, при ошибке
+// откатывается. stats может быть NULL.
+int lz77_dedup_compress(lz77_store *store, FILE *input, FILE *output, FILE *log, const lz77_params *params,
+                        lz77_dedup_stats *stats);
+// Распаковка архива; каждый фрагмент сверяется со своим отпечатком. output NULL — только проверка.
+// В stats (может быть NULL) заполняются bytes_in — размер содержимого, chunks и archive_bytes.
+int lz77_dedup_decompress(lz77_store *store, FILE *input, FILE *output, FILE *log, lz77_dedup_stats *stats);
+
 #endif
 
@@ -0,0 +1,219 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "lz77_internal.h"
+
+// Порция чтения файла; контекст сам копит данные до полного фрейма
+#define BATCH_CHUNK ((size_t)1 << 16)
+
+// Состояние одного рабочего места пула: создаётся при первом файле и живёт до конца пакета
+typedef struct {
+    lz77_cctx *cctx;
+    lz77_dctx *dctx;
+    uint8_t *chunk;
+    lz77_metrics metrics;
+} batch_worker;
+
+typedef struct {
+    const lz77_params *params; // NULL — распаковка
+    batch_worker *workers;
+    FILE *log;
+} batch_state;
+
+typedef struct {
+    lz77_task task;
+    batch_state *state;
+    lz77_batch_item *item;
+} batch_job;
+
+// Приёмник в файл со счётом записанного; без файла (проверка) только считает
+typedef struct {
+    FILE *file;
+    uint64_t written;
+} batch_sink;
+
+static int batch_write(void *opaque, const void *data, size_t len)
+{
+    batch_sink *sink = opaque;
+    sink->written += len;
+    return sink->file ? lz77_file_write(sink->file, data, len) : 0;
+}
+
+// Сжатие одного файла контекстом рабочего места
+static int batch_compress(batch_state *state, batch_worker *w, FILE *input, batch_sink *sink, lz77_batch_item *item)
+{
+    if (!w->cctx)
+    {
+        lz77_params p = *state->params;
+        p.metrics = &w->metrics;
+        if (!(w->cctx = lz77_cctx_init(&p, batch_write, sink)))
+            return -1;
+    }
+    else if (lz77_cctx_reset(w->cctx, batch_write, sink) != 0)
+        return -1;
+    size_t n;
+    int status = 0;
+    while (!status && (n = fread(w->chunk, 1, BATCH_CHUNK, input)) > 0)
+    {
+        item->in_size += n;
+        status = lz77_cctx_update(w->cctx, w->chunk, n);
+    }
+    if (!status)
+        status = ferror(input) ? -1 : lz77_cctx_finish(w->cctx);
+    // Незавершённый контейнер при освобождении дописал бы хвост в приёмник, который живёт только
+    // до конца этого файла: контекст закрывается сразу, следующий файл создаст новый
+    if (status)
+    {
+        lz77_cctx_end(w->cctx);
+        w->cctx = NULL;
+    }
+    return status;
+}
+
+// Распаковка одного файла; старый потоковый формат (первый байт не нулевой) уходит в lz77_decompress.
+// Проверка (без выхода) данных без контрольных сумм возвращает LZ77_UNVERIFIED.
+static int batch_decompress(batch_worker *w, FILE *input, batch_sink *sink, lz77_batch_item *item)
+{
+    size_t n = fread(w->chunk, 1, BATCH_CHUNK, input);
+    if (n && w->chunk[0] != LZ77_FRAME_MAGIC[0])
+    {
+        int status = fseek(input, 0, SEEK_SET) != 0 ? -1 : lz77_decompress(input, sink->file, NULL);
+        if (status < 0)
+            return -1;
+        item->in_size = ftell(input);
+        sink->written = sink->file ? ftell(sink->file) : 0;
+        return status;
+    }
+    lz77_frame_info info;
+    int unchecked = n >= LZ77_FRAME_HEADER_SIZE && lz77_frame_parse(w->chunk, &info) == 0 && !info.check_size;
+    if (!w->dctx)
+    {
+        if (!(w->dctx = lz77_dctx_init(batch_write, sink)))
+            return -1;
+    }
+    else if (lz77_dctx_reset(w->dctx, batch_write, sink) != 0)
+        return -1;
+    for (; n > 0; n = fread(w->chunk, 1, BATCH_CHUNK, input))
+    {
+        item->in_size += n;
+        if (lz77_dctx_update(w->dctx, w->chunk, n) != 0)
+            return -1;
+    }
+    if (ferror(input) || lz77_dctx_finish(w->dctx) != 0)
+        return -1;
+    return unchecked && !sink->file ? LZ77_UNVERIFIED : 0;
+}
+
+static void batch_job_run(void *arg, int worker)
+{
+    batch_job *job = arg;
+    batch_state *state = job->state;
+    batch_worker *w = &state->workers[worker];
+    lz77_batch_item *item = job->item;
+
+    item->status = -1;
+    item->in_size = item->out_size = 0;
+    if (!w->chunk && !(w->chunk = malloc(BATCH_CHUNK)))
+        return;
+    FILE *input = fopen(item->input, "rb");
+    FILE *output = input && item->output ? fopen(item->output, "wb") : NULL;
+    batch_sink sink = {output, 0};
+    if (output || (input && !item->output && !state->params))
+        item->status = state->params ? batch_compress(state, w, input, &sink, item)
+                                     : batch_decompress(w, input, &sink, item);
+    if (input)
+        fclose(input);
+    if (output && fclose(output) != 0)
+        item->status = -1;
+    item->out_size = sink.written;
+    if (item->status < 0)
+        fprintf(stderr, "[ERROR] Batch: failed to process %s\n", item->input);
+    else if (LZ77_LOG_ON(state->log, LZ77_LOG_FRAMES))
+        fprintf(state->log, "[INFO] Batch: %s -> %s, %llu -> %llu bytes\n", item->input,
+                item->output ? item->output : "(verified)",
+                (unsigned long long)item->in_size, (unsigned long long)item->out_size);
+}
+
+static size_t batch_run(lz77_batch_item *items, size_t count, const lz77_params *params, int threads, FILE *log)
+{
+    lz77_pool *pool = lz77_pool_create(threads);
+    int nworkers = pool ? lz77_pool_size(pool) : 0;
+    batch_worker *workers = calloc(nworkers ? nworkers : 1, sizeof(batch_worker));
+    batch_job *jobs = calloc(count ? count : 1, sizeof(batch_job));
+    batch_state state = {params, workers, log};
+    size_t failed = 0;
+
+    if (!pool || !workers || !jobs)
+    {
+        fprintf(stderr, "[ERROR] Out of memory\n");
+        lz77_pool_destroy(pool);
+        free(workers);
+        free(jobs);
+        for (size_t i = 0; i < count; i++)
+            items[i].status = -1;
+        return count;
+    }
+    if (LZ77_LOG_ON(log, LZ77_LOG_INFO))
+        fprintf(log, "[INFO] Starting batch %s: files=%zu, threads=%d\n", params ? "compression" : "decompression",
+                count, nworkers);
+
+    // Файлы раздаются по одному: мелкие и крупные вперемешку сами выравнивают нагрузку
+    for (size_t i = 0; i < count; i++)
+    {
+        jobs[i].task.fn = batch_job_run;
+        jobs[i].task.arg = &jobs[i];
+        jobs[i].state = &state;
+        jobs[i].item = &items[i];
+        lz77_pool_submit(pool, &jobs[i].task);
+    }
+    uint64_t total_in = 0, total_out = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        lz77_pool_wait(pool, &jobs[i].task);
+        failed += items[i].status < 0;
+        total_in += items[i].in_size;
+        total_out += items[i].out_size;
+    }
+    lz77_pool_destroy(pool);
+
+    lz77_metrics metrics = {0};
+    for (int i = 0; i < nworkers; i++)
+    {
+        // Контейнеры уже завершены, end только освобождает контексты
+        if (workers[i].cctx)
+            lz77_cctx_end(workers[i].cctx);
+        if (workers[i].dctx)
+            lz77_dctx_end(workers[i].dctx);
+        lz77_metrics_add(&metrics, &workers[i].metrics);
+        free(workers[i].chunk);
+    }
+    free(workers);
+    free(jobs);
+
+    if (LZ77_LOG_ON(log, LZ77_LOG_INFO))
+        fprintf(log, "[INFO] Batch completed: files=%zu, failed=%zu, in=%llu, out=%llu\n", count, failed,
+                (unsigned long long)total_in, (unsigned long long)total_out);
+    if (params)
+    {
+        lz77_metrics_log(&metrics, log);
+        if (params->metrics)
+            lz77_metrics_add(params->metrics, &metrics);
+    }
+    return failed;
+}
+
+size_t lz77_compress_batch(lz77_batch_item *items, size_t count, const lz77_params *params, FILE *log)
+{
+    lz77_params p;
+    if (params)
+        p = *params;
+    else
+        lz77_params_default(&p);
+    return batch_run(items, count, &p, p.threads, log);
+}
+
+size_t lz77_decompress_batch(lz77_batch_item *items, size_t count, int threads, FILE *log)
+{
+    return batch_run(items, count, NULL, threads, log);
+}
@@ -0,0 +1,1224 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "lz77_internal.h"
+
+// Параметры уровней сжатия
+typedef struct {
+    lz77_mf_kind kind;
+    uint32_t depth;
+    uint32_t good_len;
+    uint32_t skip_log;
+    int lazy;
+} level_params;
+
+static const level_params levels[LZ77_MAX_LEVEL + 1] = {
+    {LZ77_MF_BUCKET, MAX_MATCH_INDICES, MAX_MATCH_LENGTH, 0, 0}, // 0 — то же, что уровень по умолчанию
+    {LZ77_MF_FAST, 1, MAX_MATCH_LENGTH, 5, 0},
+    {LZ77_MF_FAST, 1, MAX_MATCH_LENGTH, 0, 0},
+    {LZ77_MF_BUCKET, MAX_MATCH_INDICES, MAX_MATCH_LENGTH, 0, 0},
+    {LZ77_MF_CHAIN, 8, 32, 0, 1},
+    {LZ77_MF_CHAIN, 16, 64, 0, 1},
+    {LZ77_MF_CHAIN, 24, 128, 0, 2},
+    {LZ77_MF_BT, 16, MAX_MATCH_LENGTH, 0, 2},
+    {LZ77_MF_BT, 24, MAX_MATCH_LENGTH, 0, 2},
+    {LZ77_MF_BT, 32, MAX_MATCH_LENGTH, 0, 2},
+};
+
+// Лучшее найденное совпадение
+typedef struct {
+    size_t len;
+    size_t dist;
+    size_t gain; // Экономия (см. match_gain), 0 — совпадения нет
+} mf_match;
+
+// Байт дистанции прежнего формата: 6 бит в первом байте, дальше по 7
+static inline size_t varint_size(size_t dist)
+{
+    return dist < (1u << 6) ? 1 : dist < (1u << 13) ? 2 : dist < (1u << 20) ? 3 : dist < (1u << 27) ? 4 : 5;
+}
+
+// Байт дистанции последовательности: le16 или по 7 бит
+static inline size_t offset_size(size_t dist, int varint)
+{
+    if (!varint)
+        return 2;
+    return dist < (1u << 7) ? 1 : dist < (1u << 14) ? 2 : dist < (1u << 21) ? 3 : dist < (1u << 28) ? 4 : 5;
+}
+
+// Байт токена вместе с дистанцией; next_char прежнего формата — тот же литерал и в расчёт
+// не входит
+static inline size_t match_cost(const lz77_matcher *m, size_t dist)
+{
+    if (!m->sequences)
+        return 1 + (m->varint ? varint_size(dist) : 2);
+    return 1 + offset_size(dist, m->varint);
+}
+
+// Кандидаты сравниваются по экономии в 1/16 бита. Без энтропийной ступени литерал стоит
+// 8 бит, совпадение — байты своего токена. С ней литерал стоит энтропии байтов участка
+// (см. price_segment), а последовательность — кодов трёх её полей и дополнительных бит
+// дистанции. Коды дальних дистанций встречаются реже и длиннее, поэтому разряд дистанции
+// оценён дороже бита: иначе глубокий поиск меняет ближние совпадения на чуть более длинные
+// дальние, и старшие уровни сжимают хуже младших.
+#define PRICE_SHIFT 4
+#define ENTROPY_SEQUENCE_BITS 6
+#define ENTROPY_DISTANCE_PRICE 20 // Цена разряда дистанции в 1/16 бита
+#define RAW_LITERAL_PRICE (8 << PRICE_SHIFT)
+
+// log2(v) в 1/16: номер старшего бита и следующие 4 бита как линейная доля
+static inline uint32_t log2_price(uint32_t v)
+{
+    unsigned n = 31 - __builtin_clz(v);
+    uint32_t frac = n >= PRICE_SHIFT ? v >> (n - PRICE_SHIFT) : v << (PRICE_SHIFT - n);
+    return n << PRICE_SHIFT | (frac & ((1u << PRICE_SHIFT) - 1));
+}
+
+// Цена совпадения без литералов
+static inline size_t match_price(const lz77_matcher *m, size_t dist)
+{
+    if (!m->entropy_priced)
+        return match_cost(m, dist) * RAW_LITERAL_PRICE;
+    return ((size_t)ENTROPY_SEQUENCE_BITS << PRICE_SHIFT) + ENTROPY_DISTANCE_PRICE * (31 - __builtin_clz((uint32_t)dist));
+}
+
+// Экономия совпадения; 0 — совпадения нет или оно не окупается. Совпадение короче своего
+// токена отсекается при любых ценах: на этом держится оценка lz77_block_bound. Вровень
+// с токеном оно экономит только после кодов Хаффмана — без них экономия нулевая.
+static inline size_t match_gain(const lz77_matcher *m, size_t len, size_t dist)
+{
+    if (len < MIN_MATCH_LENGTH || len < match_cost(m, dist))
+        return 0;
+    size_t saved = len * m->literal_price, cost = match_price(m, dist);
+    return saved > cost ? saved - cost : 0;
+}
+
+// Кандидат заменяет лучший, если экономит больше, а при равной экономии — если он ближе:
+// короткая дистанция дешевле и в varint, и после энтропийной ступени. 1 — заменил
+static inline int take_match(const lz77_matcher *m, size_t len, size_t dist, mf_match *best)
+{
+    // Не длиннее и не ближе лучшего — не выгоднее его
+    if (len <= best->len && dist >= best->dist)
+        return 0;
+    size_t gain = match_gain(m, len, dist);
+    if (gain < best->gain || !gain || (gain == best->gain && dist >= best->dist))
+        return 0;
+    best->len = len;
+    best->dist = dist;
+    best->gain = gain;
+    return 1;
+}
+
+static inline uint32_t block_hash(const uint8_t *p)
+{
+    return (read24(p) * 2654435769u) >> (32 - HASH_LOG) & HASH_MASK;
+}
+
+static inline uint32_t hash_bits(const uint8_t *p, int bits)
+{
+    return (read24(p) * 2654435769u) >> (32 - bits);
+}
+
+static inline uint32_t hash4_bits(const uint8_t *p, int bits)
+{
+    return (read_le32(p) * 2654435761u) >> (32 - bits);
+}
+
+lz77_matcher *lz77_matcher_create(int level, int lazy, int window_log)
+{
+    if (level < 0 || level > LZ77_MAX_LEVEL || lazy > LZ77_MAX_LAZY ||
+        (window_log && (window_log < LZ77_MIN_WINDOW_LOG || window_log > LZ77_MAX_WINDOW_LOG)))
+        return NULL;
+    lz77_matcher *m = calloc(1, sizeof(lz77_matcher));
+    if (!m)
+        return NULL;
+    const level_params *lp = &levels[level];
+    m->level = level;
+    m->kind = lp->kind;
+    m->depth = lp->depth;
+    m->good_len = lp->good_len;
+    m->skip_log = lp->skip_log;
+    m->lazy = lazy < 0 ? lp->lazy : lazy;
+    m->varint = window_log != 0;
+    m->window = window_log ? (size_t)1 << window_log : SEARCH_BUFFER_SIZE;
+
+    int ok = 1;
+    switch (m->kind)
+    {
+    case LZ77_MF_BUCKET:
+        m->bucket = calloc(1, sizeof(uint32_t[HASH_TABLE_SIZE][MAX_MATCH_INDICES]));
+        m->cursor = calloc(1, HASH_TABLE_SIZE);
+        ok = m->bucket && m->cursor;
+        break;
+    case LZ77_MF_FAST:
+        m->head_mask = ((size_t)1 << LZ77_FAST_HASH_LOG) - 1;
+        ok = (m->head = calloc(m->head_mask + 1, sizeof(uint32_t))) != NULL;
+        break;
+    case LZ77_MF_CHAIN:
+    case LZ77_MF_BT:
+        // Звеньев вдвое больше окна: слот позиции не перезаписывается, пока она в окне
+        m->head_mask = ((size_t)1 << LZ77_CHAIN_HASH_LOG) - 1;
+        m->links_mask = 2 * m->window - 1;
+        m->head = calloc(m->head_mask + 1, sizeof(uint32_t));
+        m->links = malloc((m->links_mask + 1) * (m->kind == LZ77_MF_BT ? 2 : 1) * sizeof(uint32_t));
+        ok = m->head && m->links;
+        break;
+    }
+    if (!ok)
+    {
+        lz77_matcher_free(m);
+        return NULL;
+    }
+    return m;
+}
+
+void lz77_matcher_free(lz77_matcher *m)
+{
+    if (!m)
+        return;
+    free(m->bucket);
+    free(m->cursor);
+    free(m->head);
+    free(m->links);
+    lz77_ldm_free(m->ldm);
+    lz77_entropy_free(m->entropy);
+    free(m);
+}
+
+int lz77_matcher_enable_entropy(lz77_matcher *m)
+{
+    if (!m->entropy)
+        m->entropy = lz77_entropy_create();
+    return m->entropy ? 0 : -1;
+}
+
+int lz77_matcher_enable_ldm(lz77_matcher *m, int ldm_log, int mem_log)
+{
+    if (!m->varint)
+        return -1;
+    lz77_ldm_free(m->ldm);
+    m->ldm = lz77_ldm_create(ldm_log, mem_log);
+    return m->ldm ? 0 : -1;
+}
+
+// Новое поколение таблиц под блок из len позиций. Вместо очистки позиции блока сдвигаются
+// за конец прошлого больше чем на окно: старые записи оказываются дальше окна и отсекаются
+// обычной проверкой дистанции. Таблицы чистятся, только когда сдвиг подходит к пределу
+// uint32. Звенья цепочек и узлы дерева перезаписываются при вставке, чистить нужно лишь головы.
+static void matcher_reset(lz77_matcher *m, size_t len)
+{
+    size_t next = m->limit ? m->limit + m->window + 1 : 0;
+    if (next + len >= UINT32_MAX)
+    {
+        if (m->bucket)
+        {
+            memset(m->bucket, 0, sizeof(uint32_t[HASH_TABLE_SIZE][MAX_MATCH_INDICES]));
+            memset(m->cursor, 0, HASH_TABLE_SIZE);
+        }
+        if (m->head)
+            memset(m->head, 0, (m->head_mask + 1) * sizeof(uint32_t));
+        next = 0;
+    }
+    m->offset = next;
+    m->limit = next + len;
+}
+
+static inline void bucket_insert(lz77_matcher *m, const uint8_t *base, size_t pos)
+{
+    uint32_t h = block_hash(base + pos);
+    m->bucket[h][m->cursor[h]++ & (MAX_MATCH_INDICES - 1)] = pos;
+}
+
+static void bucket_find(lz77_matcher *m, const uint8_t *base, size_t pos, size_t max_len, mf_match *best)
+{
+    uint32_t h = block_hash(base + pos);
+    for (uint32_t i = 0; i < MAX_MATCH_INDICES; i++)
+    {
+        size_t cand = m->bucket[h][i];
+        size_t distance = pos - cand;
+        if (cand >= pos || distance > m->window)
+            continue;
+        take_match(m, lz77_match_length(base + cand, base + pos, max_len), distance, best);
+    }
+    m->bucket[h][m->cursor[h]++ & (MAX_MATCH_INDICES - 1)] = pos;
+}
+
+static void fast_find(lz77_matcher *m, const uint8_t *base, size_t pos, size_t max_len, mf_match *best)
+{
+    uint32_t h = hash4_bits(base + pos, LZ77_FAST_HASH_LOG);
+    size_t cand = m->head[h];
+    m->head[h] = pos + 1;
+    if (!cand-- || pos - cand > m->window)
+        return;
+    take_match(m, lz77_match_length(base + cand, base + pos, max_len), pos - cand, best);
+}
+
+static void chain_find(lz77_matcher *m, const uint8_t *base, size_t pos, size_t max_len, mf_match *best)
+{
+    uint32_t h = hash_bits(base + pos, LZ77_CHAIN_HASH_LOG);
+    uint32_t cand = m->head[h];
+    m->links[pos & m->links_mask] = cand;
+    m->head[h] = pos + 1;
+
+    size_t good = m->good_len < max_len ? m->good_len : max_len;
+    for (uint32_t depth = m->depth; cand && depth; depth--)
+    {
+        size_t c = cand - 1;
+        if (pos - c > m->window)
+            break;
+        // Быстрый отсев: кандидат обязан совпасть на байте, которым побил бы текущий лучший
+        if (base[c + best->len] == base[pos + best->len])
+        {
+            size_t len = lz77_match_length(base + c, base + pos, max_len);
+            if (take_match(m, len, pos - c, best) && len >= good)
+                break;
+        }
+        uint32_t next = m->links[c & m->links_mask];
+        // Цепочка строго убывает; всё прочее — остатки прошлых блоков
+        if (next >= cand)
+            break;
+        cand = next;
+    }
+}
+
+// Вставка позиции в двоичное дерево с попутным поиском (схема bt из LZMA)
+static void bt_find(lz77_matcher *m, const uint8_t *base, size_t pos, size_t max_len, mf_match *best)
+{
+    uint32_t h = hash_bits(base + pos, LZ77_CHAIN_HASH_LOG);
+    uint32_t cand = m->head[h];
+    uint32_t *son = m->links;
+    uint32_t *ptr0 = son + 2 * (pos & m->links_mask) + 1;
+    uint32_t *ptr1 = son + 2 * (pos & m->links_mask);
+    const uint8_t *cur = base + pos;
+    size_t len0 = 0, len1 = 0;
+    size_t good = m->good_len < max_len ? m->good_len : max_len;
+
+    m->head[h] = pos + 1;
+    for (uint32_t depth = m->depth; cand && depth; depth--)
+    {
+        size_t c = cand - 1;
+        if (c >= pos || pos - c > m->window)
+            break;
+        uint32_t *pair = son + 2 * (c & m->links_mask);
+        const uint8_t *pb = base + c;
+        size_t len = len0 < len1 ? len0 : len1;
+        len += lz77_match_length(pb + len, cur + len, max_len - len);
+        take_match(m, len, pos - c, best);
+        if (len >= good)
+        {
+            // Достаточно длинное совпадение: узел c заменяется текущей позицией
+            *ptr1 = pair[0];
+            *ptr0 = pair[1];
+            return;
+        }
+        if (pb[len] < cur[len])
+        {
+            *ptr1 = cand;
+            ptr1 = pair + 1;
+            cand = *ptr1;
+            len1 = len;
+        }
+        else
+        {
+            *ptr0 = cand;
+            ptr0 = pair;
+            cand = *ptr0;
+            len0 = len;
+        }
+    }
+    *ptr0 = *ptr1 = 0;
+}
+
+// Поиск по дереву без вставки: у позиции вблизи конца данных сравнение обрезано, и вставка с
+// ним нарушила бы порядок дерева для следующих блоков
+static void bt_search(lz77_matcher *m, const uint8_t *base, size_t pos, size_t max_len, mf_match *best)
+{
+    uint32_t cand = m->head[hash_bits(base + pos, LZ77_CHAIN_HASH_LOG)];
+    const uint8_t *cur = base + pos;
+    size_t len0 = 0, len1 = 0;
+
+    for (uint32_t depth = m->depth; cand && depth; depth--)
+    {
+        size_t c = cand - 1;
+        if (c >= pos || pos - c > m->window)
+            break;
+        const uint32_t *pair = m->links + 2 * (c & m->links_mask);
+        size_t len = len0 < len1 ? len0 : len1;
+        len += lz77_match_length(base + c + len, cur + len, max_len - len);
+        take_match(m, len, pos - c, best);
+        if (len >= max_len)
+            break;
+        if (base[c + len] < cur[len])
+        {
+            cand = pair[1];
+            len1 = len;
+        }
+        else
+        {
+            cand = pair[0];
+            len0 = len;
+        }
+    }
+}
+
+// Позиция вставляется, только если до конца данных больше insert_margin байт: хешу нужны
+// байты позиции, а дерево упорядочено по MAX_MATCH_LENGTH байтам, и обрезанное концом
+// сравнение испортило бы его. Остальные вставляет следующий блок, когда данные за ними есть.
+static inline size_t insert_margin(const lz77_matcher *m)
+{
+    return m->kind == LZ77_MF_BT ? MAX_MATCH_LENGTH + 1 : MIN_MATCH_LENGTH;
+}
+
+static inline void mf_find(lz77_matcher *m, const uint8_t *base, size_t pos, size_t max_len, mf_match *best)
+{
+    switch (m->kind)
+    {
+    case LZ77_MF_FAST:
+        fast_find(m, base, pos, max_len, best);
+        break;
+    case LZ77_MF_BUCKET:
+        bucket_find(m, base, pos, max_len, best);
+        break;
+    case LZ77_MF_CHAIN:
+        chain_find(m, base, pos, max_len, best);
+        break;
+    case LZ77_MF_BT:
+        bt_find(m, base, pos, max_len, best);
+        break;
+    }
+}
+
+// Вставка позиции без поиска (внутри совпадения и для истории)
+static inline void mf_insert(lz77_matcher *m, const uint8_t *base, size_t pos, size_t end)
+{
+    mf_match skip = {MAX_MATCH_LENGTH, 0, SIZE_MAX};
+    switch (m->kind)
+    {
+    case LZ77_MF_FAST:
+        if (pos + 4 <= end)
+            m->head[hash4_bits(base + pos, LZ77_FAST_HASH_LOG)] = pos + 1;
+        break;
+    case LZ77_MF_BUCKET:
+        bucket_insert(m, base, pos);
+        break;
+    case LZ77_MF_CHAIN:
+    {
+        uint32_t h = hash_bits(base + pos, LZ77_CHAIN_HASH_LOG);
+        m->links[pos & m->links_mask] = m->head[h];
+        m->head[h] = pos + 1;
+        break;
+    }
+    case LZ77_MF_BT:
+        // Дерево должно оставаться упорядоченным, поэтому вставка — тот же обход
+        if (pos + insert_margin(m) < end)
+            bt_find(m, base, pos, MAX_MATCH_LENGTH, &skip);
+        break;
+    }
+}
+
+// Продолжение таблиц прошлого блока, когда история — его хвост: сдвиг поколения выбирается так,
+// чтобы история легла на уже вставленные позиции. Позиции до истории обязаны быть дальше окна:
+// история покрывает всё окно либо всё, что сопоставитель видел с начала поколения. -1 — нужна
+// вставка истории заново.
+static int matcher_follow(lz77_matcher *m, size_t hist_len, size_t src_len)
+{
+    size_t prev = m->limit;
+    if (!m->indexed || (hist_len < m->window && hist_len != prev - m->offset) ||
+        hist_len > prev - m->offset || prev + src_len >= UINT32_MAX)
+        return -1;
+    m->offset = prev - hist_len;
+    m->limit = prev + src_len;
+    return 0;
+}
+
+void lz77_matcher_prime(lz77_matcher *m, const uint8_t *base, size_t hist_len)
+{
+    matcher_reset(m, hist_len);
+    size_t off = m->offset, end = off + hist_len;
+    base -= off;
+    for (size_t p = off + (hist_len > m->window ? hist_len - m->window : 0); p + MIN_MATCH_LENGTH < end; p++)
+        mf_insert(m, base, p, end);
+    m->primed = hist_len;
+}
+
+// Звенья позиций за историей перезаписываются их вставкой раньше, чем до них дойдёт поиск,
+// поэтому копируется только начало звеньев
+void lz77_matcher_copy_tables(lz77_matcher *dst, const lz77_matcher *src, size_t hist_len)
+{
+    if (src->bucket)
+    {
+        memcpy(dst->bucket, src->bucket, sizeof(uint32_t[HASH_TABLE_SIZE][MAX_MATCH_INDICES]));
+        memcpy(dst->cursor, src->cursor, HASH_TABLE_SIZE);
+    }
+    if (src->head)
+        memcpy(dst->head, src->head, (src->head_mask + 1) * sizeof(uint32_t));
+    if (src->links)
+    {
+        size_t used = hist_len < src->links_mask + 1 ? hist_len : src->links_mask + 1;
+        size_t from = src->offset & src->links_mask, width = src->kind == LZ77_MF_BT ? 2 : 1;
+        size_t first = used < src->links_mask + 1 - from ? used : src->links_mask + 1 - from;
+        memcpy(dst->links + width * from, src->links + width * from, first * width * sizeof(uint32_t));
+        memcpy(dst->links, src->links, (used - first) * width * sizeof(uint32_t));
+    }
+    dst->offset = src->offset;
+    dst->limit = src->limit;
+    dst->primed = hist_len;
+    // Новое сообщение: отказ от поиска после прошлых не переносится
+    dst->miss_streak = dst->skip_search = 0;
+}
+
+// Совпадение не длиннее своего токена, но каждый литерал между совпадениями платит
+// заголовок: серий литералов не больше src_len / (MIN_MATCH_LENGTH + 2) + 1.
+// Ещё байт — тип блока при энтропийной ступени. Последовательности укладываются в ту же
+// границу: совпадение с байтом токена тоже не длиннее себя, а серия литералов добавляет
+// к своим байтам не больше 1 + len / 255.
+size_t lz77_block_bound(size_t src_len)
+{
+    return 1 + src_len + 2 * (src_len / (MIN_MATCH_LENGTH + 2) + 1) + 2 * (src_len / LZ77_MAX_LITERAL_CHUNK + 1);
+}
+
+// Дистанция varint: в первом байте бит 0 — признак совпадения (0), бит 1 — продолжение,
+// биты 2-7 — младшие 6 бит; дальше по 7 бит со старшим битом продолжения
+#define VARINT_MAX_BYTES 5
+
+// Разбор дистанции совпадения; возвращает число байт дистанции или 0, если вход кончился
+// раньше или varint длиннее VARINT_MAX_BYTES
+static inline size_t read_distance(const uint8_t *ip, size_t avail, int varint, size_t *dist)
+{
+    if (!varint)
+    {
+        if (avail < 2)
+            return 0;
+        *dist = ip[0] >> 1 | (size_t)ip[1] << 7;
+        return 2;
+    }
+    size_t d = ip[0] >> 2, n = 1;
+    for (uint8_t more = ip[0] & 2; more; n++)
+    {
+        if (n >= avail || n >= VARINT_MAX_BYTES)
+            return 0;
+        d |= (size_t)(ip[n] & 0x7F) << (7 * n - 1);
+        more = ip[n] & 0x80;
+    }
+    *dist = d;
+    return n;
+}
+
+// Упакованная последовательность:
+//   токен: старшая тетрада — число литералов, младшая — длина совпадения - MIN_MATCH_LENGTH;
+//     значение 15 продолжается байтами расширения: 255 — прибавить и читать дальше
+//   расширение числа литералов | литералы | дистанция | расширение длины совпадения
+// Дистанция — le16 в окне SEARCH_BUFFER_SIZE или по 7 бит со старшим битом продолжения.
+// Последняя последовательность блока — только литералы: вход кончается сразу за ними.
+#define SEQ_RUN_MASK 15
+
+static inline uint8_t *emit_run(uint8_t *op, size_t value)
+{
+    for (; value >= 255; value -= 255)
+        *op++ = 255;
+    *op++ = value;
+    return op;
+}
+
+static inline uint8_t *emit_sequence(uint8_t *op, const uint8_t *lit, size_t lit_len, size_t dist, size_t len, int varint)
+{
+    size_t code = len - MIN_MATCH_LENGTH;
+    *op++ = (lit_len < SEQ_RUN_MASK ? lit_len : SEQ_RUN_MASK) << 4 | (code < SEQ_RUN_MASK ? code : SEQ_RUN_MASK);
+    if (lit_len >= SEQ_RUN_MASK)
+        op = emit_run(op, lit_len - SEQ_RUN_MASK);
+    memcpy(op, lit, lit_len);
+    op += lit_len;
+    if (!varint)
+    {
+        *op++ = dist & 0xFF;
+        *op++ = dist >> 8;
+    }
+    else
+    {
+        for (; dist > 0x7F; dist >>= 7)
+            *op++ = (dist & 0x7F) | 0x80;
+        *op++ = dist;
+    }
+    if (code >= SEQ_RUN_MASK)
+        op = emit_run(op, code - SEQ_RUN_MASK);
+    return op;
+}
+
+static uint8_t *emit_last_literals(uint8_t *op, const uint8_t *lit, size_t lit_len)
+{
+    *op++ = (lit_len < SEQ_RUN_MASK ? lit_len : SEQ_RUN_MASK) << 4;
+    if (lit_len >= SEQ_RUN_MASK)
+        op = emit_run(op, lit_len - SEQ_RUN_MASK);
+    memcpy(op, lit, lit_len);
+    return op + lit_len;
+}
+
+// Сколько позиций в конце длинного совпадения вставляется в обычный поиск: вставлять всё
+// совпадение на мегабайты дорого, а продолжение данных ищет совпадения рядом с концом
+#define TAIL_INSERT 256
+
+// Первая вставляемая позиция совпадения [from, stop). Последнее окно блока таблицы, которые
+// продолжит следующий блок, заменяют ему вставку истории, поэтому оно вставляется целиком
+static inline size_t insert_from(const lz77_matcher *m, size_t from, size_t stop, size_t end)
+{
+    size_t tail = stop - from > TAIL_INSERT ? stop - TAIL_INSERT : from;
+    if (m->follows && end - tail < m->window)
+        tail = end - from <= m->window ? from : end - m->window;
+    return tail;
+}
+
+// Литералы с anchor и дальнее совпадение. Последовательность вмещает его целиком; токены
+// режутся по MAX_MATCH_LENGTH, next_char каждого берётся из самого совпадения, а хвост,
+// на котором токен не окупится, остаётся литералами. Возвращает новую позицию разбора в *pos.
+static uint8_t *emit_long_match(lz77_matcher *m, uint8_t *op, const uint8_t *base, size_t anchor,
+                                const lz77_ldm_match *lm, size_t *pos)
+{
+    metrics_literals(&m->metrics, lm->start - anchor);
+    metrics_match(&m->metrics, lm->len, lm->dist);
+    if (m->sequences)
+    {
+        *pos = lm->start + lm->len;
+        return emit_sequence(op, base + anchor, lm->start - anchor, lm->dist, lm->len, 1);
+    }
+    op = emit_literals(op, base + anchor, lm->start - anchor);
+    size_t p = lm->start, left = lm->len;
+    size_t min_left = 2 + varint_size(lm->dist);
+    if (min_left < MIN_MATCH_LENGTH + 1)
+        min_left = MIN_MATCH_LENGTH + 1;
+    while (left >= min_left)
+    {
+        size_t len = left - 1 < MAX_MATCH_LENGTH ? left - 1 : MAX_MATCH_LENGTH;
+        op = emit_distance(op, lm->dist, 1);
+        *op++ = len;
+        *op++ = base[p + len];
+        p += len + 1;
+        left -= len + 1;
+    }
+    *pos = p;
+    return op;
+}
+
+// Поиск с вставкой позиции; inserted — первая ещё не вставленная позиция
+static inline void find_at(lz77_matcher *m, const uint8_t *base, size_t pos, size_t end, size_t *inserted, mf_match *best)
+{
+    size_t max_len = end - pos - !m->sequences;
+    if (max_len > MAX_MATCH_LENGTH)
+        max_len = MAX_MATCH_LENGTH;
+    best->len = MIN_MATCH_LENGTH - 1;
+    best->dist = best->gain = 0;
+    if (m->kind == LZ77_MF_BT && pos + insert_margin(m) >= end)
+        bt_search(m, base, pos, max_len, best);
+    else
+        mf_find(m, base, pos, max_len, best);
+    *inserted = pos + 1;
+    // Дерево может разойтись с данными после обрезки по good_len, длину перепроверяем
+    if (m->kind == LZ77_MF_BT && best->len >= MIN_MATCH_LENGTH)
+        best->len = lz77_match_length(base + pos - best->dist, base + pos, best->len);
+    // Последовательность не ограничена MAX_MATCH_LENGTH: упёршееся в него совпадение
+    // продолжается до конца данных
+    if (m->sequences && best->len == MAX_MATCH_LENGTH && pos + best->len < end)
+        best->len += lz77_match_length(base + pos + best->len - best->dist, base + pos + best->len,
+                                       end - pos - best->len);
+    // Длина могла измениться, экономия пересчитывается. Неокупаемое совпадение не пишется,
+    // поэтому токен не длиннее своего совпадения: на этом держится оценка lz77_block_bound
+    if (best->gain && !(best->gain = match_gain(m, best->len, best->dist)))
+        best->len = 0;
+}
+
+// Состояние разбора блока
+typedef struct {
+    size_t pos;
+    size_t anchor;   // Начало ещё не записанных литералов
+    size_t inserted; // Первая ещё не вставленная позиция
+    size_t misses;
+    size_t price_end; // Конец участка, для которого посчитана цена литерала
+    uint8_t *op;
+} parse_state;
+
+// Цена литерала участка с pos: энтропия нулевого порядка его байтов, не меньше бита — короче
+// коды Хаффмана не бывают. Литералы блока кодируются общей таблицей, но в смеси текста и
+// несжимаемых данных средняя цена переоценила бы литералы текста, поэтому блок делится на
+// участки по PRICE_SEGMENT, а короткий хвост присоединяется к последнему.
+#define PRICE_SEGMENT (16 << 10)
+#define PRICE_MIN_BLOCK 4096
+
+static void price_segment(lz77_matcher *m, const uint8_t *base, size_t pos, size_t end, parse_state *st)
+{
+    size_t len = end - pos < 2 * PRICE_SEGMENT ? end - pos : PRICE_SEGMENT;
+    st->price_end = pos + len;
+    if (!m->entropy_priced)
+        return;
+    uint32_t count[256] = {0};
+    for (size_t i = 0; i < len; i++)
+        count[base[pos + i]]++;
+    uint64_t bits = 0;
+    uint32_t total = log2_price((uint32_t)len);
+    for (int c = 0; c < 256; c++)
+        if (count[c])
+            bits += (uint64_t)count[c] * (total - log2_price(count[c]));
+    bits /= len;
+    m->literal_price = bits > 1 << PRICE_SHIFT ? (uint32_t)bits : 1 << PRICE_SHIFT;
+}
+
+// Жадный или ленивый разбор до limit: совпадение (вместе с next_char в прежнем формате)
+// не заходит за limit. Литералы с anchor остаются незаписанными.
+static void parse_range(lz77_matcher *m, const uint8_t *base, size_t limit, size_t end, parse_state *st)
+{
+    size_t pos = st->pos;
+    uint8_t *op = st->op;
+
+    // Хеши читают до 4 байт с позиции, в прежнем формате за совпадением ещё нужен next_char
+    while (pos + MIN_MATCH_LENGTH < limit)
+    {
+        mf_match best, next;
+        if (pos >= st->price_end)
+            price_segment(m, base, pos, end, st);
+        find_at(m, base, pos, limit, &st->inserted, &best);
+
+        if (best.len < MIN_MATCH_LENGTH)
+        {
+            pos += m->skip_log ? 1 + (st->misses++ >> m->skip_log) : 1;
+            continue;
+        }
+        st->misses = 0;
+
+        // Ленивый разбор: откладываем совпадение, если со следующей позиции (или через одну
+        // при lazy = 2) начинается более выгодное. Отсрочка стоит литерала, а открытие новой
+        // серии литералов в прежнем формате — ещё и двухбайтового заголовка, поэтому там
+        // откладываем только внутри уже начатой серии. В последовательностях серия бесплатна,
+        // и отсрочка сразу за совпадением окупается: на журналах с энтропийной ступенью это
+        // несколько процентов размера за небольшую прибавку времени поиска.
+        while (m->lazy && (pos > st->anchor || m->sequences) && best.len < m->good_len && pos + 1 + MIN_MATCH_LENGTH < limit)
+        {
+            find_at(m, base, pos + 1, limit, &st->inserted, &next);
+            if (next.gain > best.gain + m->literal_price)
+            {
+                pos++;
+                best = next;
+                continue;
+            }
+            if (m->lazy < 2 || pos + 2 + MIN_MATCH_LENGTH >= limit)
+                break;
+            find_at(m, base, pos + 2, limit, &st->inserted, &next);
+            if (next.gain <= best.gain + 2 * m->literal_price)
+                break;
+            pos += 2;
+            best = next;
+        }
+
+        size_t stop = pos + best.len;
+        metrics_literals(&m->metrics, pos - st->anchor);
+        metrics_match(&m->metrics, best.len, best.dist);
+        if (m->sequences)
+            op = emit_sequence(op, base + st->anchor, pos - st->anchor, best.dist, best.len, m->varint);
+        else
+        {
+            op = emit_literals(op, base + st->anchor, pos - st->anchor);
+            op = emit_distance(op, best.dist, m->varint);
+            *op++ = best.len;
+            *op++ = base[stop++];
+        }
+
+        pos = insert_from(m, st->inserted, stop, end);
+        for (; pos < stop && pos + MIN_MATCH_LENGTH < end; pos++)
+            mf_insert(m, base, pos, end);
+        pos = st->anchor = stop;
+    }
+    st->pos = pos;
+    st->op = op;
+}
+
+// Токены блока; место под lz77_block_bound(src_len) проверено вызывающей стороной
+static size_t compress_tokens(lz77_matcher *m, const uint8_t *base, size_t hist_len, size_t src_len, uint8_t *dst)
+{
+    // Дальние совпадения находятся заранее, обычный поиск заполняет промежутки между ними
+    const lz77_ldm_match *ldm = NULL;
+    size_t ldm_count = m->ldm ? lz77_ldm_find(m->ldm, base, hist_len, hist_len + src_len, &ldm) : 0;
+
+    // Коды Хаффмана короткого блока не окупают своих таблиц: цены — по байтам токенов
+    m->entropy_priced = m->entropy && src_len >= PRICE_MIN_BLOCK;
+    m->literal_price = RAW_LITERAL_PRICE;
+    // Таблицы со снимком словаря или прошлым блоком того же потока уже содержат историю
+    if ((!m->primed || m->primed != hist_len) && matcher_follow(m, hist_len, src_len) != 0)
+        lz77_matcher_prime(m, base, hist_len);
+    m->primed = 0;
+    // Дальше позиции считаются со сдвигом поколения (см. matcher_reset)
+    size_t off = m->offset, hist_end = off + hist_len;
+    size_t end = hist_end + src_len;
+    m->limit = end;
+    base -= off;
+    // Конец истории ждал данных за собой (insert_margin): теперь они есть
+    size_t margin = insert_margin(m);
+    for (size_t p = hist_len > margin ? hist_end - margin : off; p < hist_end && p + MIN_MATCH_LENGTH < end; p++)
+        mf_insert(m, base, p, end);
+    parse_state st = {off + hist_len, off + hist_len, off + hist_len, 0, 0, dst};
+
+    for (size_t i = 0; i < ldm_count; i++)
+    {
+        lz77_ldm_match lm = ldm[i];
+        lm.start += off;
+        parse_range(m, base, lm.start, end, &st);
+        st.op = emit_long_match(m, st.op, base, st.anchor, &lm, &st.anchor);
+        size_t tail = insert_from(m, lm.start, st.anchor, end);
+        for (size_t p = tail > st.inserted ? tail : st.inserted; p < st.anchor && p + MIN_MATCH_LENGTH < end; p++)
+            mf_insert(m, base, p, end);
+        st.pos = st.inserted = st.anchor;
+        st.misses = 0;
+    }
+    parse_range(m, base, end, end, &st);
+    metrics_literals(&m->metrics, end - st.anchor);
+    if (m->sequences)
+        st.op = emit_last_literals(st.op, base + st.anchor, end - st.anchor);
+    else
+        st.op = emit_literals(st.op, base + st.anchor, end - st.anchor);
+    m->indexed = m->follows;
+    return st.op - dst;
+}
+
+// Значение поля токена с байтами расширения; NULL, если вход кончился раньше
+static inline const uint8_t *read_run(const uint8_t *ip, const uint8_t *iend, size_t *value)
+{
+    size_t v = SEQ_RUN_MASK;
+    uint8_t b;
+    do
+    {
+        if (ip == iend)
+            return NULL;
+        b = *ip++;
+        v += b;
+    } while (b == 255);
+    *value = v;
+    return ip;
+}
+
+// Разбор дистанции последовательности; NULL, если вход кончился раньше или varint длиннее
+// VARINT_MAX_BYTES
+static inline const uint8_t *read_offset(const uint8_t *ip, const uint8_t *iend, int varint, size_t *dist)
+{
+    if (!varint)
+    {
+        if (iend - ip < 2)
+            return NULL;
+        *dist = ip[0] | (size_t)ip[1] << 8;
+        return ip + 2;
+    }
+    size_t d = 0;
+    for (int shift = 0; shift < 7 * VARINT_MAX_BYTES; shift += 7)
+    {
+        if (ip == iend)
+            return NULL;
+        uint8_t b = *ip++;
+        d |= (size_t)(b & 0x7F) << shift;
+        if (!(b & 0x80))
+        {
+            *dist = d;
+            return ip;
+        }
+    }
+    return NULL;
+}
+
+// Разбор своих же токенов на литералы и последовательности для энтропийной ступени
+static void block_sequences(lz77_entropy *e, const uint8_t *ip, size_t len, int varint, int sequences)
+{
+    const uint8_t *iend = ip + len;
+    size_t pending = 0;
+    e->nlit = e->nseq = 0;
+    // Последовательности переносятся как есть, только литералы собираются подряд
+    while (sequences && ip < iend)
+    {
+        size_t lit_len = *ip >> 4, code = *ip & SEQ_RUN_MASK;
+        ip++;
+        if (lit_len == SEQ_RUN_MASK)
+            ip = read_run(ip, iend, &lit_len);
+        memcpy(e->lits + e->nlit, ip, lit_len);
+        e->nlit += lit_len;
+        ip += lit_len;
+        if (ip == iend)
+            return;
+        ip = read_offset(ip, iend, varint, &len);
+        if (code == SEQ_RUN_MASK)
+            ip = read_run(ip, iend, &code);
+        e->ll[e->nseq] = lit_len;
+        e->ml[e->nseq] = code + MIN_MATCH_LENGTH;
+        e->of[e->nseq] = len;
+        e->nseq++;
+    }
+    while (ip < iend)
+    {
+        size_t count = ip[0] >> 1 | (size_t)ip[1] << 7;
+        if (ip[0] & 1)
+        {
+            memcpy(e->lits + e->nlit, ip + 2, count);
+            e->nlit += count;
+            pending += count;
+            ip += 2 + count;
+            continue;
+        }
+        size_t n = read_distance(ip, iend - ip, varint, &count);
+        e->ll[e->nseq] = pending;
+        e->ml[e->nseq] = ip[n];
+        e->of[e->nseq] = count;
+        e->nseq++;
+        e->lits[e->nlit++] = ip[n + 1];
+        pending = 1;
+        ip += n + 2;
+    }
+}
+
+// Проба читает до PROBE_WINDOWS окон по PROBE_WINDOW байт, разнесённых по блоку, — доли
+// процента большого блока. Повторы 4-байтных фрагментов внутри выборки оценивают долю
+// совпадений, а сумма квадратов частот байтов — энтропию Реньи второго порядка, нижнюю
+// границу энтропии Шеннона: если она близка к 8 битам, кодам Хаффмана выигрывать нечего.
+#define PROBE_WINDOW 256
+#define PROBE_WINDOWS 16
+#define PROBE_MIN_WINDOWS 4
+#define PROBE_MIN_LEN (PROBE_MIN_WINDOWS * PROBE_WINDOW)
+#define PROBE_HASH_LOG 10
+// Повторов меньше 1/128 выборки — совпадений почти нет
+#define PROBE_REPEAT_SHIFT 7
+// Совпадения пар байтов не чаще равномерного распределения плюс 1/16 — энтропия выше 7.9 бита
+#define PROBE_UNIFORM_SHIFT 4
+
+int lz77_probe_block(const uint8_t *src, size_t len)
+{
+    size_t windows = len / PROBE_WINDOW;
+    if (len < PROBE_MIN_LEN)
+        return LZ77_PROBE_COMPRESSIBLE;
+    if (windows > PROBE_WINDOWS)
+        windows = PROBE_WINDOWS;
+
+    uint32_t count[256] = {0};
+    uint32_t seen[1 << PROBE_HASH_LOG] = {0};
+    size_t repeats = 0, grams = 0;
+    for (size_t w = 0; w < windows; w++)
+    {
+        const uint8_t *p = src + w * (len - PROBE_WINDOW) / (windows - 1);
+        for (size_t i = 0; i < PROBE_WINDOW; i++)
+            count[p[i]]++;
+        for (size_t i = 0; i + 4 <= PROBE_WINDOW; i++, grams++)
+        {
+            uint32_t v = read_le32(p + i);
+            uint32_t *slot = &seen[(v * 2654435761u) >> (32 - PROBE_HASH_LOG)];
+            repeats += *slot == v;
+            *slot = v;
+        }
+    }
+    if (repeats << PROBE_REPEAT_SHIFT >= grams)
+        return LZ77_PROBE_COMPRESSIBLE;
+
+    // Для равномерных байтов сумма c(c-1) в среднем n(n-1)/256
+    uint64_t n = windows * PROBE_WINDOW, pairs = 0;
+    for (int i = 0; i < 256; i++)
+        pairs += (uint64_t)count[i] * (count[i] - (count[i] != 0));
+    uint64_t uniform = n * (n - 1);
+    return pairs * 256 <= uniform + (uniform >> PROBE_UNIFORM_SHIFT) ? LZ77_PROBE_RANDOM : LZ77_PROBE_LITERALS;
+}
+
+// Токены блока без поиска — одна серия литералов
+static size_t literal_tokens(lz77_matcher *m, const uint8_t *src, size_t src_len, uint8_t *dst)
+{
+    m->primed = 0;
+    metrics_literals(&m->metrics, src_len);
+    uint8_t *op = m->sequences ? emit_last_literals(dst, src, src_len) : emit_literals(dst, src, src_len);
+    return op - dst;
+}
+
+// После блока, который полный поиск не сжал хотя бы на 1/32, следующие 2^k - 1 блоков
+// (k — длина такой серии, не больше BACKOFF_MAX_LOG) идут без поиска. Короткие блоки
+// (сообщения) не пробуются и не влияют на отказ от поиска.
+#define BACKOFF_MAX_LOG 3
+
+size_t lz77_block_compress(lz77_matcher *m, const uint8_t *base, size_t hist_len, size_t src_len,
+                           uint8_t *dst, size_t dst_cap)
+{
+    if (dst_cap < lz77_block_bound(src_len))
+    {
+        m->indexed = 0;
+        return 0;
+    }
+    uint64_t t = metrics_clock();
+    const uint8_t *src = base + hist_len;
+    // Дальние совпадения находят повторы и в несжимаемых данных (одинаковые архивы в tar),
+    // поэтому с ними блок ищется всегда
+    int probe = m->ldm || src_len < PROBE_MIN_LEN ? LZ77_PROBE_COMPRESSIBLE
+              : m->skip_search ? LZ77_PROBE_LITERALS : lz77_probe_block(src, src_len);
+    int searched = probe == LZ77_PROBE_COMPRESSIBLE;
+    size_t size;
+    if (m->skip_search && !searched)
+        m->skip_search--;
+    // Позиции блока без поиска не попадают в таблицы, продолжать их следующему блоку нечего
+    if (!searched)
+    {
+        m->metrics.skipped_blocks++;
+        m->indexed = 0;
+    }
+
+    if (!m->entropy)
+    {
+        size = searched ? compress_tokens(m, base, hist_len, src_len, dst) : literal_tokens(m, src, src_len, dst);
+        metrics_phase(&m->metrics, LZ77_PHASE_SEARCH, t);
+    }
+    else if (probe == LZ77_PROBE_RANDOM)
+    {
+        m->primed = 0;
+        dst[0] = LZ77_BLOCK_TYPE_STORED;
+        memcpy(dst + 1, src, src_len);
+        size = src_len + 1;
+        metrics_literals(&m->metrics, src_len);
+        metrics_phase(&m->metrics, LZ77_PHASE_EMIT, t);
+    }
+    else
+    {
+        // Коды Хаффмана берутся, только если они короче самих токенов, а то и другое —
+        // только если короче исходных байтов
+        lz77_entropy *e = m->entropy;
+        if (lz77_entropy_reserve(e, src_len) != 0)
+        {
+            m->indexed = 0;
+            return 0;
+        }
+        size_t tokens = searched ? compress_tokens(m, base, hist_len, src_len, e->tokens)
+                                 : literal_tokens(m, src, src_len, e->tokens);
+        t = metrics_phase(&m->metrics, LZ77_PHASE_SEARCH, t);
+        block_sequences(e, e->tokens, tokens, m->varint, m->sequences);
+        size_t coded = lz77_entropy_encode(e, dst + 1, tokens);
+        if (coded && coded < tokens && coded < src_len)
+        {
+            dst[0] = LZ77_BLOCK_TYPE_HUFFMAN;
+            size = coded + 1;
+        }
+        else if (tokens < src_len)
+        {
+            dst[0] = LZ77_BLOCK_TYPE_TOKENS;
+            memcpy(dst + 1, e->tokens, tokens);
+            size = tokens + 1;
+        }
+        else
+        {
+            dst[0] = LZ77_BLOCK_TYPE_STORED;
+            memcpy(dst + 1, src, src_len);
+            size = src_len + 1;
+        }
+        metrics_phase(&m->metrics, LZ77_PHASE_EMIT, t);
+    }
+    if (searched && src_len >= PROBE_MIN_LEN && !m->ldm)
+    {
+        if (size >= src_len - (src_len >> 5))
+        {
+            m->miss_streak += m->miss_streak < BACKOFF_MAX_LOG;
+            m->skip_search = (1u << m->miss_streak) - 1;
+        }
+        else
+            m->miss_streak = 0;
+    }
+    metrics_block(&m->metrics, src_len, size);
+    return size;
+}
+
+// Запас до конца выхода, при котором быстрый цикл пишет без проверок: самое длинное
+// совпадение с next_char плюс перехлёст широкого копирования
+#define FAST_OUT_MARGIN (MAX_MATCH_LENGTH + 1 + WILD_COPY)
+// Запас до конца входа: заголовок литерала и короткий литерал, копируемый двумя словами
+// по 16 байт; он же покрывает самое длинное совпадение (дистанция, длина, next_char)
+#define FAST_LITERAL (2 * WILD_COPY)
+#define FAST_IN_MARGIN (2 + FAST_LITERAL)
+
+int lz77_decode_tokens(const uint8_t **pip, const uint8_t *iend, uint8_t **pop, uint8_t *oend, const uint8_t *base,
+                       int varint)
+{
+    const uint8_t *ip = *pip;
+    uint8_t *op = *pop;
+    int status = 0;
+
+    // Быстрый цикл: запас на концах проверяется один раз на токен, копирование идёт с перехлёстом
+    while ((size_t)(iend - ip) >= FAST_IN_MARGIN && (size_t)(oend - op) >= FAST_OUT_MARGIN)
+    {
+        size_t count = ip[0] >> 1 | (size_t)ip[1] << 7;
+        if (ip[0] & 1)
+        { // Литерал
+            if (count == 0)
+            {
+                status = -1;
+                break;
+            }
+            if (count <= FAST_LITERAL)
+            {
+                memcpy(op, ip + 2, WILD_COPY);
+                memcpy(op + WILD_COPY, ip + 2 + WILD_COPY, WILD_COPY);
+            }
+            else if (count <= (size_t)(iend - ip) - 2 && count <= (size_t)(oend - op))
+                memcpy(op, ip + 2, count);
+            else
+                break;
+            ip += 2 + count;
+            op += count;
+        }
+        else
+        { // Совпадение
+            size_t n = read_distance(ip, VARINT_MAX_BYTES, varint, &count);
+            size_t len = ip[n];
+            if (!n || count == 0 || count > (size_t)(op - base) || len < MIN_MATCH_LENGTH)
+            {
+                status = -1;
+                break;
+            }
+            wild_copy_match(op, count, len);
+            op += len;
+            *op++ = ip[n + 1];
+            ip += n + 2;
+        }
+    }
+
+    // Хвост: каждое поле проверяется, неполный токен оставляется вызывающей стороне
+    while (!status && iend - ip >= 2)
+    {
+        size_t count = ip[0] >> 1 | (size_t)ip[1] << 7;
+        if (ip[0] & 1)
+        {
+            if (count == 0)
+                status = -1;
+            else if (count > (size_t)(iend - ip) - 2 || count > (size_t)(oend - op))
+                break;
+            else
+            {
+                memcpy(op, ip + 2, count);
+                ip += 2 + count;
+                op += count;
+            }
+        }
+        else
+        {
+            size_t avail = iend - ip;
+            size_t n = read_distance(ip, avail, varint, &count);
+            if (!n && avail < VARINT_MAX_BYTES)
+                break;
+            if (!n)
+            {
+                status = -1;
+                break;
+            }
+            if (avail < n + 2)
+                break;
+            size_t len = ip[n];
+            if (count == 0 || count > (size_t)(op - base) || len < MIN_MATCH_LENGTH)
+                status = -1;
+            else if (len + 1 > (size_t)(oend - op))
+                break;
+            else
+            {
+                const uint8_t *match = op - count;
+                if (count >= len)
+                    memcpy(op, match, len);
+                else
+                    for (size_t i = 0; i < len; i++)
+                        op[i] = match[i];
+                op += len;
+                *op++ = ip[n + 1];
+                ip += n + 2;
+            }
+        }
+    }
+    *pip = ip;
+    *pop = op;
+    return status;
+}
+
+// Запасы быстрого цикла последовательностей: на входе — токен, до 14 литералов, дистанция
+// и гарантия, что литералы не последние; на выходе — литералы словом WILD_COPY и короткое
+// совпадение с перехлёстом
+#define FAST_SEQ_IN (2 * WILD_COPY)
+#define FAST_SEQ_OUT (4 * WILD_COPY)
+
+// Распаковка блока последовательностей целиком. Пока до концов входа и выхода хватает запаса,
+// короткие поля токена не проверяются по отдельности и копируются словами с перехлёстом;
+// длинные поля и конец блока разбираются с проверками.
+static int decode_sequences(const uint8_t *ip, const uint8_t *iend, uint8_t *op, uint8_t *oend, const uint8_t *base,
+                            int varint)
+{
+    for (;;)
+    {
+        while ((size_t)(iend - ip) >= FAST_SEQ_IN && (size_t)(oend - op) >= FAST_SEQ_OUT)
+        {
+            size_t lit_len = *ip >> 4, len = (*ip & SEQ_RUN_MASK) + MIN_MATCH_LENGTH, dist;
+            if (lit_len == SEQ_RUN_MASK || len == SEQ_RUN_MASK + MIN_MATCH_LENGTH)
+                break;
+            memcpy(op, ip + 1, WILD_COPY);
+            ip += 1 + lit_len;
+            op += lit_len;
+            if (!varint)
+            {
+                dist = ip[0] | (size_t)ip[1] << 8;
+                ip += 2;
+            }
+            else if (!(ip = read_offset(ip, iend, 1, &dist)))
+                return -1;
+            if (!dist || dist > (size_t)(op - base))
+                return -1;
+            wild_copy_match(op, dist, len);
+            op += len;
+        }
+
+        if (ip == iend)
+            return -1;
+        size_t lit_len = *ip >> 4, len = (*ip & SEQ_RUN_MASK) + MIN_MATCH_LENGTH;
+        ip++;
+        if (lit_len == SEQ_RUN_MASK && !(ip = read_run(ip, iend, &lit_len)))
+            return -1;
+        if (lit_len > (size_t)(iend - ip) || lit_len > (size_t)(oend - op))
+            return -1;
+        if (lit_len <= WILD_COPY && iend - ip >= WILD_COPY && oend - op >= WILD_COPY)
+            memcpy(op, ip, WILD_COPY);
+        else
+            memcpy(op, ip, lit_len);
+        ip += lit_len;
+        op += lit_len;
+        // Вход кончился на литералах: это последняя последовательность
+        if (ip == iend)
+            return op == oend ? 0 : -1;
+
+        size_t dist;
+        if (!(ip = read_offset(ip, iend, varint, &dist)))
+            return -1;
+        if (len == SEQ_RUN_MASK + MIN_MATCH_LENGTH)
+        {
+            if (!(ip = read_run(ip, iend, &len)))
+                return -1;
+            len += MIN_MATCH_LENGTH;
+        }
+        if (!dist || dist > (size_t)(op - base) || len > (size_t)(oend - op))
+            return -1;
+        copy_match(op, dist, len, oend - op);
+        op += len;
+    }
+}
+
+int lz77_block_decompress(const uint8_t *src, size_t src_len, uint8_t *base, size_t hist_len, size_t raw_len,
+                          int format)
+{
+    const uint8_t *ip = src, *iend = src + src_len;
+    uint8_t *op = base + hist_len, *oend = op + raw_len;
+
+    if (format & LZ77_BLOCK_ENTROPY)
+    {
+        if (ip == iend)
+            return -1;
+        if (*ip == LZ77_BLOCK_TYPE_HUFFMAN)
+            return lz77_entropy_decode(ip + 1, src_len - 1, base, hist_len, raw_len);
+        if (*ip == LZ77_BLOCK_TYPE_STORED)
+        {
+            if (src_len - 1 != raw_len)
+                return -1;
+            memcpy(op, ip + 1, raw_len);
+            return 0;
+        }
+        if (*ip++ != LZ77_BLOCK_TYPE_TOKENS)
+            return -1;
+    }
+    if (format & LZ77_BLOCK_SEQUENCES)
+        return decode_sequences(ip, iend, op, oend, base, format & LZ77_BLOCK_VARINT);
+    if (lz77_decode_tokens(&ip, iend, &op, oend, base, format & LZ77_BLOCK_VARINT) != 0)
+        return -1;
+    return ip == iend && op == oend ? 0 : -1;
+}
@@ -0,0 +1,238 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "lz77_internal.h"
+
+// Буферные функции пишут тот же контейнер, что и lz77_compress_frames, но без таблицы
+// поиска и контрольных сумм (короткие сообщения от них заметно растут): фреймы сцеплены,
+// а история берётся прямо из src/dst без копирования. Суммы, если они есть, проверяются.
+#define BUF_FRAME_LOG LZ77_DEFAULT_FRAME_LOG
+#define BUF_FRAME_SIZE ((size_t)1 << BUF_FRAME_LOG)
+
+size_t lz77_compress_bound(size_t src_len)
+{
+    size_t full = src_len / BUF_FRAME_SIZE, rest = src_len % BUF_FRAME_SIZE;
+    size_t bound = LZ77_FRAME_HEADER_SIZE + full * (LZ77_FRAME_PREFIX_SIZE + lz77_block_bound(BUF_FRAME_SIZE)) + 4;
+    if (rest)
+        bound += LZ77_FRAME_PREFIX_SIZE + lz77_block_bound(rest);
+    return bound;
+}
+
+int64_t lz77_compress_buf(const void *src, size_t src_len, void *dst, size_t dst_cap)
+{
+    return lz77_compress_buf_level(src, src_len, dst, dst_cap, LZ77_DEFAULT_LEVEL);
+}
+
+// Фреймы src подряд в [op, oend) с концом контейнера; возвращает конец записанного или NULL.
+// История фрейма берётся прямо из src. Со словарём первый фрейм копируется за словарь в буфер
+// контекста и сжимается с ним как с историей, а таблицы поиска копируются из снимка.
+static uint8_t *buf_compress_frames(lz77_matcher *m, lz77_dict_ctx *dctx, const uint8_t *in, size_t src_len,
+                                    uint8_t *op, uint8_t *oend)
+{
+    for (size_t pos = 0; pos < src_len; pos += BUF_FRAME_SIZE)
+    {
+        size_t raw = src_len - pos < BUF_FRAME_SIZE ? src_len - pos : BUF_FRAME_SIZE;
+        size_t hist_len = pos < m->window ? pos : m->window;
+        const uint8_t *base = in + pos - hist_len;
+        if (dctx && !pos)
+        {
+            uint8_t *scratch = lz77_dict_scratch(dctx, raw);
+            if (!scratch)
+                return NULL;
+            hist_len = dctx->dict->len;
+            memcpy(scratch + hist_len, in, raw);
+            lz77_matcher_copy_tables(m, dctx->dict->snapshot, hist_len);
+            base = scratch;
+        }
+        m->follows = pos + raw < src_len;
+        size_t room = (size_t)(oend - op);
+        size_t csize = room < LZ77_FRAME_PREFIX_SIZE + 4 ? 0
+                     : lz77_block_compress(m, base, hist_len, raw, op + LZ77_FRAME_PREFIX_SIZE,
+                                           room - LZ77_FRAME_PREFIX_SIZE - 4);
+        if (!csize)
+            return NULL;
+        write_le32(op, csize);
+        write_le32(op + 4, raw);
+        op += LZ77_FRAME_PREFIX_SIZE + csize;
+    }
+    if (oend - op < 4)
+        return NULL;
+    write_le32(op, 0);
+    return op + 4;
+}
+
+struct lz77_buf_ctx {
+    lz77_matcher *matcher;
+};
+
+lz77_buf_ctx *lz77_buf_ctx_create(int level)
+{
+    lz77_buf_ctx *ctx = calloc(1, sizeof(lz77_buf_ctx));
+    if (!ctx)
+        return NULL;
+    ctx->matcher = lz77_matcher_create(level, -1, 0);
+    if (!ctx->matcher || lz77_matcher_enable_entropy(ctx->matcher) != 0)
+    {
+        lz77_buf_ctx_free(ctx);
+        return NULL;
+    }
+    ctx->matcher->sequences = 1;
+    return ctx;
+}
+
+void lz77_buf_ctx_free(lz77_buf_ctx *ctx)
+{
+    if (!ctx)
+        return;
+    lz77_matcher_free(ctx->matcher);
+    free(ctx);
+}
+
+// Таблицы не чистятся: первый блок сообщения сдвигает поколение позиций (matcher_reset), и
+// записи прошлых сообщений оказываются дальше окна
+int64_t lz77_compress_buf_ctx(lz77_buf_ctx *ctx, const void *src, size_t src_len, void *dst, size_t dst_cap)
+{
+    uint8_t *op = dst;
+
+    if (!ctx || (!src && src_len) || !dst || dst_cap < LZ77_FRAME_HEADER_SIZE + 4)
+        return -1;
+    // Новое сообщение: отказ от поиска после прошлых не переносится
+    ctx->matcher->primed = ctx->matcher->indexed = 0;
+    ctx->matcher->miss_streak = ctx->matcher->skip_search = 0;
+
+    lz77_frame_header(op, LZ77_FLAG_CHAINED | LZ77_FLAG_ENTROPY | LZ77_FLAG_SEQUENCES, BUF_FRAME_LOG, 0);
+    op = buf_compress_frames(ctx->matcher, NULL, src, src_len, op + LZ77_FRAME_HEADER_SIZE, op + dst_cap);
+    return op ? op - (uint8_t *)dst : -1;
+}
+
+int64_t lz77_compress_buf_level(const void *src, size_t src_len, void *dst, size_t dst_cap, int level)
+{
+    if ((!src && src_len) || !dst || dst_cap < LZ77_FRAME_HEADER_SIZE + 4)
+        return -1;
+    lz77_buf_ctx *ctx = lz77_buf_ctx_create(level);
+    int64_t size = ctx ? lz77_compress_buf_ctx(ctx, src, src_len, dst, dst_cap) : -1;
+    lz77_buf_ctx_free(ctx);
+    return size;
+}
+
+int64_t lz77_compress_dict(lz77_dict_ctx *ctx, const void *src, size_t src_len, void *dst, size_t dst_cap)
+{
+    uint8_t *op = dst;
+
+    if (!ctx || (!src && src_len) || !dst || dst_cap < LZ77_FRAME_HEADER_SIZE + LZ77_DICT_ID_SIZE + 4)
+        return -1;
+    lz77_frame_header(op, LZ77_FLAG_CHAINED | LZ77_FLAG_ENTROPY | LZ77_FLAG_SEQUENCES | LZ77_FLAG_DICT,
+                      BUF_FRAME_LOG, LZ77_DICT_WINDOW_LOG);
+    write_le32(op + LZ77_FRAME_HEADER_SIZE, ctx->dict->id);
+    op = buf_compress_frames(ctx->matcher, ctx, src, src_len, op + LZ77_FRAME_HEADER_SIZE + LZ77_DICT_ID_SIZE,
+                             op + dst_cap);
+    return op ? op - (uint8_t *)dst : -1;
+}
+
+// Проверка заголовка буфера; возвращает его длину вместе с идентификатором словаря или -1.
+// Флаг словаря разбирается здесь, а не в lz77_frame_parse, и остаётся в info->flags.
+static int buf_header(const uint8_t *in, size_t src_len, lz77_frame_info *info)
+{
+    uint8_t header[LZ77_FRAME_HEADER_SIZE];
+    if (!in || src_len < LZ77_FRAME_HEADER_SIZE + 4)
+        return -1;
+    memcpy(header, in, sizeof(header));
+    header[5] &= ~LZ77_FLAG_DICT;
+    if (lz77_frame_parse(header, info) != 0)
+        return -1;
+    if (!(in[5] & LZ77_FLAG_DICT))
+        return LZ77_FRAME_HEADER_SIZE;
+    info->flags |= LZ77_FLAG_DICT;
+    return src_len < LZ77_FRAME_HEADER_SIZE + LZ77_DICT_ID_SIZE + 4 ? -1 : LZ77_FRAME_HEADER_SIZE + LZ77_DICT_ID_SIZE;
+}
+
+int64_t lz77_decompressed_size(const void *src, size_t src_len)
+{
+    const uint8_t *ip = src, *iend = ip + src_len;
+    lz77_frame_info info;
+    uint64_t total = 0;
+
+    int header_len = buf_header(ip, src_len, &info);
+    if (header_len < 0)
+        return -1;
+    for (ip += header_len; iend - ip >= 4; ip += LZ77_FRAME_PREFIX_SIZE)
+    {
+        size_t csize = read_le32(ip);
+        if (!csize)
+            return (int64_t)total;
+        if (iend - ip < LZ77_FRAME_PREFIX_SIZE || csize > (size_t)(iend - ip) - LZ77_FRAME_PREFIX_SIZE)
+            return -1;
+        total += read_le32(ip + 4);
+        ip += csize;
+    }
+    return -1;
+}
+
+// Распаковка фреймов с ip прямо в dst: предыдущие данные и есть история. Со словарём первый
+// фрейм распаковывается за словарь в буфер контекста и копируется в dst.
+static int64_t buf_decompress_frames(const uint8_t *ip, const uint8_t *iend, const lz77_frame_info *info,
+                                     lz77_dict_ctx *dctx, uint8_t *out, size_t dst_cap)
+{
+    size_t written = 0;
+    size_t hist_cap = (info->flags & LZ77_FLAG_CHAINED) ? info->window : 0;
+    uint64_t content = 0, checksum;
+    for (; iend - ip >= 4; ip += LZ77_FRAME_PREFIX_SIZE)
+    {
+        size_t csize = read_le32(ip);
+        if (!csize)
+        {
+            if (info->tail_size &&
+                ((size_t)(iend - ip) < 4 + info->tail_size || read_le64(ip + 4) != content))
+                return -1;
+            return (int64_t)written;
+        }
+        if (iend - ip < LZ77_FRAME_PREFIX_SIZE || csize > (size_t)(iend - ip) - LZ77_FRAME_PREFIX_SIZE)
+            return -1;
+        size_t raw = read_le32(ip + 4);
+        if (!raw || raw > info->frame_size || raw > dst_cap - written)
+            return -1;
+        size_t hist_len = written < hist_cap ? written : hist_cap;
+        uint8_t *base = out + written - hist_len;
+        int staged = dctx && !written;
+        if (staged)
+        {
+            if (!(base = lz77_dict_scratch(dctx, raw)))
+                return -1;
+            hist_len = dctx->dict->len;
+        }
+        if (lz77_frame_decode(ip + LZ77_FRAME_PREFIX_SIZE, csize, base, hist_len, raw, info, &checksum) != 0)
+            return -1;
+        content = lz77_content_checksum(content, checksum);
+        if (staged)
+            memcpy(out, base + hist_len, raw);
+        written += raw;
+        ip += csize;
+    }
+    return -1;
+}
+
+int64_t lz77_decompress_buf(const void *src, size_t src_len, void *dst, size_t dst_cap)
+{
+    const uint8_t *ip = src;
+    lz77_frame_info info;
+
+    int header_len = buf_header(ip, src_len, &info);
+    if (header_len < 0 || (info.flags & LZ77_FLAG_DICT) || (!dst && dst_cap))
+        return -1;
+    return buf_decompress_frames(ip + header_len, ip + src_len, &info, NULL, dst, dst_cap);
+}
+
+int64_t lz77_decompress_dict(lz77_dict_ctx *ctx, const void *src, size_t src_len, void *dst, size_t dst_cap)
+{
+    const uint8_t *ip = src;
+    lz77_frame_info info;
+
+    int header_len = buf_header(ip, src_len, &info);
+    if (!ctx || header_len < 0 || !(info.flags & LZ77_FLAG_DICT) || (!dst && dst_cap))
+        return -1;
+    // Словарь должен быть тем же, иначе дистанции укажут в чужие байты
+    if (read_le32(ip + LZ77_FRAME_HEADER_SIZE) != ctx->dict->id)
+        return -1;
+    return buf_decompress_frames(ip + header_len, ip + src_len, &info, ctx, dst, dst_cap);
+}
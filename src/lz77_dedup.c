@@ -0,0 +1,819 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "lz77_internal.h"
+
+// Архивы с дедупликацией. Хранилище — каталог с двумя файлами:
+//   chunks — заголовок и сжатые фрагменты подряд (блоки lz77_block_compress);
+//   index  — заголовок и записи по 32 байта: отпечаток (16) | смещение в chunks (le64) |
+//            сжатый размер (le32) | исходный размер (le32).
+// Заголовок обоих: магия (4) | версия | log2 среднего фрагмента | 0 | 0 | идентификатор
+// хранилища (le64). Новые фрагменты сначала дописываются в chunks и сбрасываются на диск, и
+// только потом их записи попадают в index: после сбоя индекс ссылается лишь на записанные
+// данные, а оборванный хвост индекса отбрасывается при открытии.
+// Архив: заголовок с магией LZ77_DEDUP_MAGIC и идентификатором хранилища, записи по 20 байт
+// отпечаток (16) | исходный размер (le32), нулевая запись и размер содержимого (le64).
+// Отпечаток — два xxHash64 фрагмента с разными seed: 128 бит, случайное совпадение
+// отпечатков разных фрагментов исключено и на миллиардах фрагментов.
+
+#define STORE_VERSION 1
+#define STORE_HEADER_SIZE 16
+#define STORE_INDEX_MAGIC "LZ7I"
+#define STORE_CHUNKS_MAGIC "LZ7C"
+#define STORE_ENTRY_SIZE 32
+#define ARCHIVE_RECORD_SIZE 20
+#define FINGERPRINT_SIZE 16
+#define FINGERPRINT_SEED 0x9E3779B97F4A7C15ull
+
+#define CDC_MIN_SIZE ((size_t)1 << (LZ77_CDC_LOG - 2))
+#define CDC_AVG_SIZE ((size_t)1 << LZ77_CDC_LOG)
+#define CDC_MAX_SIZE ((size_t)1 << (LZ77_CDC_LOG + 3))
+// Нормализация FastCDC: до среднего размера граница требует на два нулевых бита больше,
+// после — на два меньше, и размеры теснее собираются у среднего. Проверяются старшие биты:
+// в них вклад всех последних 64 байт, а в младших — лишь нескольких.
+#define CDC_MASK_SMALL (~0ull << (64 - (LZ77_CDC_LOG + 2)))
+#define CDC_MASK_LARGE (~0ull << (64 - (LZ77_CDC_LOG - 2)))
+// Порция входа: её фрагменты отпечатываются и сжимаются пулом, затем пишутся по порядку
+#define SEGMENT_SIZE ((size_t)4 << 20)
+#define SEGMENT_CHUNKS (SEGMENT_SIZE / CDC_MIN_SIZE + 1)
+// Фрагменты сжимаются независимо окном, покрывающим наибольший из них
+#define CHUNK_WINDOW_LOG LZ77_MIN_WINDOW_LOG
+#define CHUNK_FORMAT (LZ77_BLOCK_VARINT | LZ77_BLOCK_ENTROPY | LZ77_BLOCK_SEQUENCES)
+
+#if LZ77_CDC_LOG + 3 > CHUNK_WINDOW_LOG
+#error "Окно сжатия фрагментов не покрывает наибольший фрагмент"
+#endif
+
+typedef struct {
+    uint8_t fp[FINGERPRINT_SIZE];
+    uint64_t offset;
+    uint32_t c_size;
+    uint32_t u_size;
+} store_entry;
+
+struct lz77_store {
+    FILE *index;
+    FILE *chunks;
+    int writable;
+    uint64_t id;
+    store_entry *entries;
+    size_t count;
+    size_t cap;
+    size_t committed;          // Записей, уже лежащих в файле индекса
+    uint64_t chunks_end;       // Конец данных фрагментов, включая ещё не зафиксированные
+    uint64_t chunks_committed;
+    uint32_t *slots;           // Открытая адресация по отпечатку: номер записи + 1, 0 — пусто
+    size_t slot_mask;
+};
+
+static void fingerprint(const uint8_t *data, size_t len, uint8_t fp[FINGERPRINT_SIZE])
+{
+    write_le64(fp, lz77_xxh64(data, len, 0));
+    write_le64(fp + 8, lz77_xxh64(data, len, FINGERPRINT_SEED));
+}
+
+static size_t store_find(const lz77_store *s, const uint8_t *fp)
+{
+    for (size_t i = read_le64(fp) & s->slot_mask; s->slots[i]; i = (i + 1) & s->slot_mask)
+        if (memcmp(s->entries[s->slots[i] - 1].fp, fp, FINGERPRINT_SIZE) == 0)
+            return s->slots[i] - 1;
+    return SIZE_MAX;
+}
+
+static void store_slot(lz77_store *s, size_t entry)
+{
+    size_t i = read_le64(s->entries[entry].fp) & s->slot_mask;
+    while (s->slots[i])
+        i = (i + 1) & s->slot_mask;
+    s->slots[i] = (uint32_t)(entry + 1);
+}
+
+static void store_reslot(lz77_store *s)
+{
+    memset(s->slots, 0, (s->slot_mask + 1) * sizeof(uint32_t));
+    for (size_t i = 0; i < s->count; i++)
+        store_slot(s, i);
+}
+
+// Новая запись с отпечатком fp; место фрагмента в chunks задаётся после его сжатия
+static size_t store_add(lz77_store *s, const uint8_t *fp, uint32_t u_size)
+{
+    if (s->count == s->cap)
+    {
+        size_t cap = s->cap ? s->cap * 2 : 1024;
+        store_entry *entries = realloc(s->entries, cap * sizeof(store_entry));
+        if (!entries)
+            return SIZE_MAX;
+        s->entries = entries;
+        s->cap = cap;
+    }
+    // Слотов не меньше чем вдвое больше записей
+    if ((s->count + 1) * 2 > s->slot_mask + 1)
+    {
+        size_t size = s->slot_mask + 1 >= 1024 ? (s->slot_mask + 1) * 2 : 1024;
+        uint32_t *slots = malloc(size * sizeof(uint32_t));
+        if (!slots)
+            return SIZE_MAX;
+        free(s->slots);
+        s->slots = slots;
+        s->slot_mask = size - 1;
+        store_reslot(s);
+    }
+    store_entry *e = &s->entries[s->count];
+    memcpy(e->fp, fp, FINGERPRINT_SIZE);
+    e->offset = 0;
+    e->c_size = 0;
+    e->u_size = u_size;
+    store_slot(s, s->count);
+    return s->count++;
+}
+
+static void dedup_header(uint8_t header[STORE_HEADER_SIZE], const char *magic, uint64_t id)
+{
+    memcpy(header, magic, 4);
+    header[4] = STORE_VERSION;
+    header[5] = LZ77_CDC_LOG;
+    header[6] = 0;
+    header[7] = 0;
+    write_le64(header + 8, id);
+}
+
+static int dedup_header_check(const uint8_t header[STORE_HEADER_SIZE], const char *magic)
+{
+    return memcmp(header, magic, 4) == 0 && header[4] == STORE_VERSION && header[5] == LZ77_CDC_LOG ? 0 : -1;
+}
+
+static FILE *store_file(const char *dir, const char *name, const char *mode)
+{
+    char path[4096];
+    if (snprintf(path, sizeof(path), "%s/%s", dir, name) >= (int)sizeof(path))
+        return NULL;
+    return fopen(path, mode);
+}
+
+// Блокировка на весь файл индекса: писатель один, читателей сколько угодно
+static int store_lock(FILE *file, int writable)
+{
+    struct flock lock;
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type = writable ? F_WRLCK : F_RDLCK;
+    lock.l_whence = SEEK_SET;
+    return fcntl(fileno(file), F_SETLK, &lock);
+}
+
+static int store_read(lz77_store *s, uint64_t offset, uint8_t *dst, size_t len)
+{
+    while (len)
+    {
+        ssize_t n = pread(fileno(s->chunks), dst, len, (off_t)offset);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        dst += n;
+        len -= (size_t)n;
+        offset += (uint64_t)n;
+    }
+    return 0;
+}
+
+// Загрузка индекса. Чтение останавливается на первой записи, которая обрывается или
+// ссылается за конец chunks, — это хвост прерванной фиксации; писатель его отрезает.
+static int store_load(lz77_store *s)
+{
+    if (fseeko(s->chunks, 0, SEEK_END) != 0)
+        return -1;
+    off_t end = ftello(s->chunks);
+    if (end < STORE_HEADER_SIZE || fseeko(s->index, STORE_HEADER_SIZE, SEEK_SET) != 0)
+        return -1;
+    s->chunks_end = s->chunks_committed = (uint64_t)end;
+
+    uint8_t buf[STORE_ENTRY_SIZE * 256];
+    size_t n;
+    int torn = 0;
+    while (!torn && (n = fread(buf, 1, sizeof(buf), s->index)) > 0)
+        for (size_t off = 0; off < n; off += STORE_ENTRY_SIZE)
+        {
+            const uint8_t *p = buf + off;
+            if (n - off < STORE_ENTRY_SIZE)
+            {
+                torn = 1;
+                break;
+            }
+            uint64_t offset = read_le64(p + 16);
+            uint32_t c_size = read_le32(p + 24);
+            uint32_t u_size = read_le32(p + 28);
+            if (offset < STORE_HEADER_SIZE || offset > s->chunks_end || !c_size || c_size > s->chunks_end - offset ||
+                !u_size || u_size > CDC_MAX_SIZE || c_size > lz77_block_bound(u_size))
+            {
+                torn = 1;
+                break;
+            }
+            size_t i = store_add(s, p, u_size);
+            if (i == SIZE_MAX)
+                return -1;
+            s->entries[i].offset = offset;
+            s->entries[i].c_size = c_size;
+        }
+    if (ferror(s->index))
+        return -1;
+    s->committed = s->count;
+    if (torn && s->writable &&
+        ftruncate(fileno(s->index), (off_t)(STORE_HEADER_SIZE + s->count * STORE_ENTRY_SIZE)) != 0)
+        return -1;
+    return 0;
+}
+
+lz77_store *lz77_store_open(const char *path, int writable)
+{
+    lz77_store *s = path ? calloc(1, sizeof(lz77_store)) : NULL;
+    if (!s)
+    {
+        fprintf(stderr, "[ERROR] lz77_store_open: invalid arguments or out of memory\n");
+        return NULL;
+    }
+    s->writable = writable;
+    if (writable && mkdir(path, 0777) != 0 && errno != EEXIST)
+    {
+        fprintf(stderr, "[ERROR] Cannot create chunk store %s\n", path);
+        free(s);
+        return NULL;
+    }
+
+    int created = 0;
+    s->index = store_file(path, "index", writable ? "r+b" : "rb");
+    if (!s->index && writable && errno == ENOENT)
+    {
+        // Файл фрагментов без индекса — чужой или повреждённый каталог, его не трогаем
+        FILE *probe = store_file(path, "chunks", "rb");
+        if (probe)
+            fclose(probe);
+        else if ((s->index = store_file(path, "index", "w+b")))
+        {
+            s->chunks = store_file(path, "chunks", "w+b");
+            created = 1;
+        }
+    }
+    else if (s->index)
+        s->chunks = store_file(path, "chunks", writable ? "r+b" : "rb");
+
+    int status = 0;
+    uint8_t header[STORE_HEADER_SIZE], other[STORE_HEADER_SIZE];
+    if (!s->index || !s->chunks)
+    {
+        fprintf(stderr, "[ERROR] Cannot open chunk store %s\n", path);
+        status = -1;
+    }
+    else if (store_lock(s->index, writable) != 0)
+    {
+        fprintf(stderr, "[ERROR] Chunk store %s is in use by another process\n", path);
+        status = -1;
+    }
+    else if (created)
+    {
+        // Идентификатор связывает архивы с хранилищем, в которое записаны их фрагменты
+        uint64_t seed = (uint64_t)time(NULL) << 20 ^ (uint64_t)getpid() ^ (uint64_t)(uintptr_t)s;
+        s->id = lz77_splitmix64(&seed);
+        dedup_header(header, STORE_INDEX_MAGIC, s->id);
+        dedup_header(other, STORE_CHUNKS_MAGIC, s->id);
+        if (fwrite(header, 1, sizeof(header), s->index) != sizeof(header) ||
+            fwrite(other, 1, sizeof(other), s->chunks) != sizeof(other) || fflush(s->index) != 0 ||
+            fflush(s->chunks) != 0)
+        {
+            fprintf(stderr, "[ERROR] Cannot initialize chunk store %s\n", path);
+            status = -1;
+        }
+    }
+    else if (fread(header, 1, sizeof(header), s->index) != sizeof(header) ||
+             fread(other, 1, sizeof(other), s->chunks) != sizeof(other) ||
+             dedup_header_check(header, STORE_INDEX_MAGIC) != 0 ||
+             dedup_header_check(other, STORE_CHUNKS_MAGIC) != 0 || memcmp(header + 8, other + 8, 8) != 0)
+    {
+        fprintf(stderr, "[ERROR] %s is not a chunk store or it is damaged\n", path);
+        status = -1;
+    }
+    else
+        s->id = read_le64(header + 8);
+
+    if (!status && store_load(s) != 0)
+    {
+        fprintf(stderr, "[ERROR] Cannot load chunk store index %s\n", path);
+        status = -1;
+    }
+    if (!status && !s->slots)
+    {
+        s->slots = calloc(1024, sizeof(uint32_t));
+        s->slot_mask = 1023;
+        if (!s->slots)
+        {
+            fprintf(stderr, "[ERROR] lz77_store_open: out of memory\n");
+            status = -1;
+        }
+    }
+    if (status)
+    {
+        lz77_store_close(s);
+        return NULL;
+    }
+    return s;
+}
+
+int lz77_store_close(lz77_store *store)
+{
+    if (!store)
+        return 0;
+    int status = 0;
+    if (store->chunks && fclose(store->chunks) != 0)
+        status = -1;
+    // Закрытие индекса снимает блокировку
+    if (store->index && fclose(store->index) != 0)
+        status = -1;
+    free(store->entries);
+    free(store->slots);
+    free(store);
+    return status;
+}
+
+// Фиксация добавленного: данные фрагментов на диск раньше ссылающихся на них записей индекса
+static int store_commit(lz77_store *s)
+{
+    if (s->committed == s->count)
+        return 0;
+    if (fflush(s->chunks) != 0 || fsync(fileno(s->chunks)) != 0 || fseeko(s->index, 0, SEEK_END) != 0)
+        return -1;
+    for (size_t i = s->committed; i < s->count; i++)
+    {
+        uint8_t rec[STORE_ENTRY_SIZE];
+        memcpy(rec, s->entries[i].fp, FINGERPRINT_SIZE);
+        write_le64(rec + 16, s->entries[i].offset);
+        write_le32(rec + 24, s->entries[i].c_size);
+        write_le32(rec + 28, s->entries[i].u_size);
+        if (fwrite(rec, 1, sizeof(rec), s->index) != sizeof(rec))
+            return -1;
+    }
+    if (fflush(s->index) != 0 || fsync(fileno(s->index)) != 0)
+        return -1;
+    s->committed = s->count;
+    s->chunks_committed = s->chunks_end;
+    return 0;
+}
+
+// Отказ от незафиксированного: записи и дописанные данные отрезаются
+static void store_rollback(lz77_store *s)
+{
+    s->count = s->committed;
+    s->chunks_end = s->chunks_committed;
+    store_reslot(s);
+    fflush(s->chunks);
+    fflush(s->index);
+    if (ftruncate(fileno(s->chunks), (off_t)s->chunks_committed) != 0 ||
+        ftruncate(fileno(s->index), (off_t)(STORE_HEADER_SIZE + s->committed * STORE_ENTRY_SIZE)) != 0)
+        fprintf(stderr, "[ERROR] Cannot roll back chunk store\n");
+}
+
+// Длина следующего фрагмента из len доступных байт. Граница ищется не раньше CDC_MIN_SIZE и
+// не позже CDC_MAX_SIZE; len меньше CDC_MAX_SIZE бывает только в конце входа.
+static size_t cdc_cut(const uint64_t gear[256], const uint8_t *src, size_t len)
+{
+    if (len <= CDC_MIN_SIZE)
+        return len;
+    size_t normal = len < CDC_AVG_SIZE ? len : CDC_AVG_SIZE;
+    size_t limit = len < CDC_MAX_SIZE ? len : CDC_MAX_SIZE;
+    uint64_t h = 0;
+    size_t i = CDC_MIN_SIZE;
+    for (; i < normal; i++)
+    {
+        h = (h << 1) + gear[src[i]];
+        if (!(h & CDC_MASK_SMALL))
+            return i + 1;
+    }
+    for (; i < limit; i++)
+    {
+        h = (h << 1) + gear[src[i]];
+        if (!(h & CDC_MASK_LARGE))
+            return i + 1;
+    }
+    return limit;
+}
+
+typedef struct {
+    size_t start;  // Смещение в порции
+    size_t len;
+    uint8_t fp[FINGERPRINT_SIZE];
+    size_t entry;  // Запись хранилища нового фрагмента; SIZE_MAX — фрагмент уже есть
+    size_t out_off; // Место сжатого фрагмента в буфере порции
+    size_t out_len;
+} dedup_chunk;
+
+// Порция и этап её обработки: сначала отпечатки всех фрагментов, затем сжатие новых
+typedef struct {
+    const uint8_t *data;
+    dedup_chunk *chunks;
+    size_t count;
+    uint8_t *out;
+    lz77_matcher **matchers;
+    int compress;
+} dedup_segment;
+
+typedef struct {
+    lz77_task task;
+    dedup_segment *seg;
+    size_t first;
+    size_t end;
+} dedup_job;
+
+static void dedup_job_run(void *arg, int worker)
+{
+    dedup_job *job = arg;
+    dedup_segment *seg = job->seg;
+    for (size_t i = job->first; i < job->end; i++)
+    {
+        dedup_chunk *c = &seg->chunks[i];
+        const uint8_t *src = seg->data + c->start;
+        if (!seg->compress)
+            fingerprint(src, c->len, c->fp);
+        else if (c->entry != SIZE_MAX)
+            c->out_len = lz77_block_compress(seg->matchers[worker], src, 0, c->len, seg->out + c->out_off,
+                                             lz77_block_bound(c->len));
+    }
+}
+
+// Фрагменты порции делятся между заданиями поровну
+static void dedup_run(lz77_pool *pool, dedup_job *jobs, int njobs, dedup_segment *seg, int compress)
+{
+    size_t per = (seg->count + (size_t)njobs - 1) / (size_t)njobs;
+    seg->compress = compress;
+    for (int j = 0; j < njobs; j++)
+    {
+        jobs[j].seg = seg;
+        jobs[j].first = (size_t)j * per < seg->count ? (size_t)j * per : seg->count;
+        jobs[j].end = seg->count - jobs[j].first < per ? seg->count : jobs[j].first + per;
+        lz77_pool_submit(pool, &jobs[j].task);
+    }
+    for (int j = 0; j < njobs; j++)
+        lz77_pool_wait(pool, &jobs[j].task);
+}
+
+int lz77_dedup_compress(lz77_store *store, FILE *input, FILE *output, FILE *log, const lz77_params *params,
+                        lz77_dedup_stats *stats)
+{
+    lz77_params p;
+    if (params)
+        p = *params;
+    else
+        lz77_params_default(&p);
+    if (!store || !store->writable || !input || !output || p.level < 0 || p.level > LZ77_MAX_LEVEL)
+    {
+        fprintf(stderr, "[ERROR] lz77_dedup_compress: invalid arguments\n");
+        return -1;
+    }
+
+    // Таблица Gear фиксирована: от неё зависят границы, а значит, и совпадение фрагментов
+    uint64_t gear[256], seed = 0;
+    for (int i = 0; i < 256; i++)
+        gear[i] = lz77_splitmix64(&seed);
+
+    lz77_pool *pool = lz77_pool_create(p.threads);
+    if (!pool)
+        return -1;
+    int workers = lz77_pool_size(pool);
+    int njobs = workers * 4;
+    int status = 0;
+    lz77_metrics metrics = {0};
+    lz77_dedup_stats st = {0};
+
+    lz77_matcher **matchers = calloc(workers, sizeof(lz77_matcher *));
+    dedup_job *jobs = calloc(njobs, sizeof(dedup_job));
+    dedup_chunk *chunks = malloc(SEGMENT_CHUNKS * sizeof(dedup_chunk));
+    uint8_t *records = malloc(SEGMENT_CHUNKS * ARCHIVE_RECORD_SIZE + ARCHIVE_RECORD_SIZE + 8);
+    uint8_t *packed = NULL;
+    size_t packed_cap = 0;
+    lz77_map map;
+    int mapped = lz77_map_input(&map, input) == 0;
+    lz77_io *in = mapped ? NULL : lz77_io_reader(input);
+    uint8_t *buf = mapped ? NULL : malloc(SEGMENT_SIZE);
+    lz77_io *out = lz77_io_writer(output);
+    if (!matchers || !jobs || !chunks || !records || (!mapped && (!in || !buf)) || !out)
+        status = -1;
+    for (int i = 0; !status && i < workers; i++)
+        if (!(matchers[i] = lz77_matcher_create(p.level, p.lazy, CHUNK_WINDOW_LOG)) ||
+            lz77_matcher_enable_entropy(matchers[i]) != 0)
+            status = -1;
+        else
+            matchers[i]->sequences = 1;
+    for (int j = 0; !status && j < njobs; j++)
+    {
+        jobs[j].task.fn = dedup_job_run;
+        jobs[j].task.arg = &jobs[j];
+    }
+    if (status)
+        fprintf(stderr, "[ERROR] lz77_dedup_compress: out of memory\n");
+
+    if (LZ77_LOG_ON(log, LZ77_LOG_INFO))
+        fprintf(log, "[INFO] Dedup compression: threads=%d, level=%d, chunk=%zu/%zu/%zu, store_chunks=%zu, io=%s/%s\n",
+                workers, p.level, CDC_MIN_SIZE, CDC_AVG_SIZE, CDC_MAX_SIZE, store->count,
+                mapped ? "mmap" : in ? lz77_io_backend_name(in) : "-", out ? lz77_io_backend_name(out) : "-");
+
+    uint8_t header[STORE_HEADER_SIZE];
+    dedup_header(header, LZ77_DEDUP_MAGIC, store->id);
+    if (!status && lz77_io_write(out, header, sizeof(header)) != 0)
+        status = -1;
+    st.archive_bytes = sizeof(header);
+    if (!status && fseeko(store->chunks, (off_t)store->chunks_end, SEEK_SET) != 0)
+    {
+        fprintf(stderr, "[ERROR] lz77_dedup_compress: chunk store seek error\n");
+        status = -1;
+    }
+
+    size_t pos = 0, fill = 0;
+    int eof = 0;
+    uint64_t segment_no = 0;
+    while (!status)
+    {
+        const uint8_t *data;
+        size_t len;
+        if (mapped)
+        {
+            data = map.data + pos;
+            len = map.len - pos < SEGMENT_SIZE ? map.len - pos : SEGMENT_SIZE;
+            eof = pos + len == map.len;
+        }
+        else
+        {
+            uint64_t t = metrics_clock();
+            while (!eof && fill < SEGMENT_SIZE)
+            {
+                size_t n = lz77_io_read(in, buf + fill, SEGMENT_SIZE - fill);
+                fill += n;
+                eof = !n;
+            }
+            metrics_phase(&metrics, LZ77_PHASE_READ, t);
+            data = buf;
+            len = fill;
+        }
+        if (!len)
+            break;
+
+        // Хвост без границы переносится в следующую порцию, пока вход не кончился
+        size_t count = 0, cut = 0;
+        while (cut < len && (eof || len - cut >= CDC_MAX_SIZE))
+        {
+            chunks[count].start = cut;
+            chunks[count].len = cdc_cut(gear, data + cut, len - cut);
+            cut += chunks[count++].len;
+        }
+
+        dedup_segment seg = {data, chunks, count, NULL, matchers, 0};
+        dedup_run(pool, jobs, njobs, &seg, 0);
+        // Поиск по хранилищу последователен; новый фрагмент сразу заносится в таблицу, так
+        // что его повтор в той же порции уже становится ссылкой
+        size_t need = 0, fresh = 0;
+        for (size_t i = 0; !status && i < count; i++)
+        {
+            dedup_chunk *c = &chunks[i];
+            c->out_len = 0;
+            if (store_find(store, c->fp) != SIZE_MAX)
+            {
+                c->entry = SIZE_MAX;
+                continue;
+            }
+            if ((c->entry = store_add(store, c->fp, (uint32_t)c->len)) == SIZE_MAX)
+            {
+                fprintf(stderr, "[ERROR] lz77_dedup_compress: out of memory\n");
+                status = -1;
+            }
+            c->out_off = need;
+            need += lz77_block_bound(c->len);
+            fresh++;
+            st.new_bytes += c->len;
+        }
+        if (!status && need > packed_cap)
+        {
+            uint8_t *grown = realloc(packed, need);
+            if (!grown)
+            {
+                fprintf(stderr, "[ERROR] lz77_dedup_compress: out of memory\n");
+                status = -1;
+            }
+            else
+            {
+                packed = grown;
+                packed_cap = need;
+            }
+        }
+        if (status)
+            break;
+        seg.out = packed;
+        if (fresh)
+            dedup_run(pool, jobs, njobs, &seg, 1);
+
+        uint64_t t = metrics_clock();
+        uint8_t *rp = records;
+        for (size_t i = 0; !status && i < count; i++)
+        {
+            dedup_chunk *c = &chunks[i];
+            if (c->entry != SIZE_MAX)
+            {
+                store_entry *e = &store->entries[c->entry];
+                if (!c->out_len || fwrite(packed + c->out_off, 1, c->out_len, store->chunks) != c->out_len)
+                {
+                    fprintf(stderr, "[ERROR] lz77_dedup_compress: chunk store write error\n");
+                    status = -1;
+                    break;
+                }
+                e->offset = store->chunks_end;
+                e->c_size = (uint32_t)c->out_len;
+                store->chunks_end += c->out_len;
+                st.stored_bytes += c->out_len;
+            }
+            memcpy(rp, c->fp, FINGERPRINT_SIZE);
+            write_le32(rp + FINGERPRINT_SIZE, (uint32_t)c->len);
+            rp += ARCHIVE_RECORD_SIZE;
+        }
+        if (!status && lz77_io_write(out, records, (size_t)(rp - records)) != 0)
+            status = -1;
+        metrics_phase(&metrics, LZ77_PHASE_WRITE, t);
+        st.archive_bytes += (uint64_t)(rp - records);
+        st.chunks += count;
+        st.new_chunks += fresh;
+        st.bytes_in += cut;
+        if (LZ77_LOG_ON(log, LZ77_LOG_FRAMES))
+            fprintf(log, "[INFO] Segment %llu: bytes=%zu, chunks=%zu, new=%zu\n", (unsigned long long)segment_no, cut,
+                    count, fresh);
+        segment_no++;
+
+        if (mapped)
+            pos += cut;
+        else
+        {
+            memmove(buf, buf + cut, len - cut);
+            fill = len - cut;
+        }
+        if (eof && cut == len)
+            break;
+    }
+
+    if (!status && in && lz77_io_error(in))
+    {
+        fprintf(stderr, "[ERROR] lz77_dedup_compress: read error\n");
+        status = -1;
+    }
+    if (!status)
+    {
+        memset(records, 0, ARCHIVE_RECORD_SIZE);
+        write_le64(records + ARCHIVE_RECORD_SIZE, st.bytes_in);
+        if (lz77_io_write(out, records, ARCHIVE_RECORD_SIZE + 8) != 0)
+            status = -1;
+        st.archive_bytes += ARCHIVE_RECORD_SIZE + 8;
+    }
+    if (!status && store_commit(store) != 0)
+    {
+        fprintf(stderr, "[ERROR] lz77_dedup_compress: cannot commit chunk store\n");
+        status = -1;
+    }
+    if (status)
+        store_rollback(store);
+
+    lz77_map_close(&map, 0);
+    lz77_io_close(in);
+    uint64_t t = metrics_clock();
+    if (lz77_io_close(out) != 0 && !status)
+    {
+        fprintf(stderr, "[ERROR] lz77_dedup_compress: write error\n");
+        status = -1;
+    }
+    metrics_phase(&metrics, LZ77_PHASE_WRITE, t);
+    if (LZ77_LOG_ON(log, LZ77_LOG_INFO))
+        fprintf(log, "[INFO] Dedup compression %s: bytes=%llu, chunks=%llu, new_chunks=%llu, new_bytes=%llu, "
+                "stored=%llu, archive=%llu\n", status ? "failed" : "completed", (unsigned long long)st.bytes_in,
+                (unsigned long long)st.chunks, (unsigned long long)st.new_chunks, (unsigned long long)st.new_bytes,
+                (unsigned long long)st.stored_bytes, (unsigned long long)st.archive_bytes);
+    for (int i = 0; matchers && i < workers; i++)
+        if (matchers[i])
+            lz77_metrics_add(&metrics, &matchers[i]->metrics);
+    lz77_metrics_log(&metrics, log);
+    if (p.metrics)
+        lz77_metrics_add(p.metrics, &metrics);
+    if (stats)
+        *stats = st;
+
+    lz77_pool_destroy(pool);
+    for (int i = 0; matchers && i < workers; i++)
+        lz77_matcher_free(matchers[i]);
+    free(matchers);
+    free(jobs);
+    free(chunks);
+    free(records);
+    free(packed);
+    free(buf);
+    return status;
+}
+
+int lz77_dedup_decompress(lz77_store *store, FILE *input, FILE *output, FILE *log, lz77_dedup_stats *stats)
+{
+    if (!store || !input)
+    {
+        fprintf(stderr, "[ERROR] lz77_dedup_decompress: invalid arguments\n");
+        return -1;
+    }
+    int status = 0;
+    lz77_io *in = lz77_io_reader(input);
+    lz77_io *out = output ? lz77_io_writer(output) : NULL;
+    uint8_t *packed = malloc(lz77_block_bound(CDC_MAX_SIZE));
+    uint8_t *chunk = malloc(CDC_MAX_SIZE);
+    if (!in || (output && !out) || !packed || !chunk)
+    {
+        fprintf(stderr, "[ERROR] lz77_dedup_decompress: out of memory\n");
+        status = -1;
+    }
+
+    uint8_t header[STORE_HEADER_SIZE];
+    if (!status && (lz77_io_read(in, header, sizeof(header)) != sizeof(header) ||
+                    dedup_header_check(header, LZ77_DEDUP_MAGIC) != 0))
+    {
+        fprintf(stderr, "[ERROR] Invalid deduplicated archive header\n");
+        status = -1;
+    }
+    else if (!status && read_le64(header + 8) != store->id)
+    {
+        fprintf(stderr, "[ERROR] Archive was written to another chunk store\n");
+        status = -1;
+    }
+
+    uint64_t total = 0, count = 0;
+    while (!status)
+    {
+        uint8_t rec[ARCHIVE_RECORD_SIZE], fp[FINGERPRINT_SIZE];
+        if (lz77_io_read(in, rec, sizeof(rec)) != sizeof(rec))
+        {
+            fprintf(stderr, "[ERROR] Unexpected end of deduplicated archive\n");
+            status = -1;
+            break;
+        }
+        uint32_t u_size = read_le32(rec + FINGERPRINT_SIZE);
+        if (!u_size)
+        {
+            uint8_t size[8];
+            if (lz77_io_read(in, size, sizeof(size)) != sizeof(size) || read_le64(size) != total)
+            {
+                fprintf(stderr, "[ERROR] Deduplicated archive content size mismatch\n");
+                status = -1;
+            }
+            break;
+        }
+        size_t i = store_find(store, rec);
+        if (i == SIZE_MAX || store->entries[i].u_size != u_size)
+        {
+            fprintf(stderr, "[ERROR] Chunk %llu is missing from chunk store\n", (unsigned long long)count);
+            status = -1;
+            break;
+        }
+        const store_entry *e = &store->entries[i];
+        if (store_read(store, e->offset, packed, e->c_size) != 0 ||
+            lz77_block_decompress(packed, e->c_size, chunk, 0, u_size, CHUNK_FORMAT) != 0 ||
+            (fingerprint(chunk, u_size, fp), memcmp(fp, rec, FINGERPRINT_SIZE) != 0))
+        {
+            fprintf(stderr, "[ERROR] Chunk %llu is corrupted in chunk store\n", (unsigned long long)count);
+            status = -1;
+            break;
+        }
+        if (out && lz77_io_write(out, chunk, u_size) != 0)
+        {
+            status = -1;
+            break;
+        }
+        total += u_size;
+        count++;
+    }
+    if (!status && lz77_io_error(in))
+    {
+        fprintf(stderr, "[ERROR] lz77_dedup_decompress: read error\n");
+        status = -1;
+    }
+    lz77_io_close(in);
+    if (lz77_io_close(out) != 0 && !status)
+    {
+        fprintf(stderr, "[ERROR] lz77_dedup_decompress: write error\n");
+        status = -1;
+    }
+    if (LZ77_LOG_ON(log, LZ77_LOG_INFO))
+        fprintf(log, "[INFO] Dedup %s %s: chunks=%llu, bytes=%llu\n", out ? "decompression" : "verification",
+                status ? "failed" : "completed", (unsigned long long)count, (unsigned long long)total);
+    if (stats)
+    {
+        memset(stats, 0, sizeof(*stats));
+        stats->bytes_in = total;
+        stats->chunks = count;
+        stats->archive_bytes = STORE_HEADER_SIZE + count * ARCHIVE_RECORD_SIZE + ARCHIVE_RECORD_SIZE + 8;
+    }
+    free(packed);
+    free(chunk);
+    return status;
+}
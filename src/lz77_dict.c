@@ -0,0 +1,247 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "lz77_internal.h"
+
+// Обучение по схеме COVER: образцы делятся на эпохи, в каждой выбирается отрезок
+// TRAIN_SEGMENT байт с наибольшей суммой частот его фрагментов по TRAIN_DMER байт.
+// Частота фрагмента — в скольких образцах он встречается: повторы внутри одного сообщения
+// сжимаются и без словаря. Фрагменты выбранного отрезка обнуляются, чтобы следующие эпохи
+// не брали те же данные.
+#define TRAIN_DMER 8
+#define TRAIN_SEGMENT 64
+#define TRAIN_HASH_LOG 20
+
+typedef struct {
+    size_t start;
+    uint64_t score;
+} train_segment;
+
+// Образцы подряд и курсор образца, в котором лежит текущая позиция
+typedef struct {
+    const uint8_t *data;
+    const size_t *sizes;
+    size_t count;
+    size_t sample;     // Номер образца под курсором
+    size_t sample_end; // Конец этого образца в data
+    uint32_t *freq;
+} train_state;
+
+static inline uint32_t dmer_hash(const uint8_t *p)
+{
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return (uint32_t)((v * 0x9E3779B185EBCA87ull) >> (64 - TRAIN_HASH_LOG));
+}
+
+// Слот частоты фрагмента в позиции pos или NULL, если фрагмент пересекает конец образца.
+// Позиции идут почти по порядку (скользящее окно отстаёт не больше чем на отрезок),
+// поэтому курсор образца сдвигается на считанные шаги.
+static uint32_t *dmer_slot(train_state *ts, size_t pos)
+{
+    while (pos >= ts->sample_end && ts->sample + 1 < ts->count)
+        ts->sample_end += ts->sizes[++ts->sample];
+    while (pos < ts->sample_end - ts->sizes[ts->sample])
+        ts->sample_end -= ts->sizes[ts->sample--];
+    if (pos + TRAIN_DMER > ts->sample_end)
+        return NULL;
+    return &ts->freq[dmer_hash(ts->data + pos)];
+}
+
+// Вклад фрагмента: встреченный лишь в одном образце бесполезен
+static inline uint64_t dmer_score(const uint32_t *slot)
+{
+    return slot && *slot > 1 ? *slot : 0;
+}
+
+static int cmp_segment(const void *a, const void *b)
+{
+    const train_segment *x = a, *y = b;
+    return x->score < y->score ? -1 : x->score > y->score;
+}
+
+size_t lz77_dict_train(const void *samples, const size_t *sizes, size_t count, void *dict, size_t dict_cap)
+{
+    const uint8_t *data = samples;
+    size_t total = 0;
+
+    if (!samples || !sizes || !count || !dict)
+        return 0;
+    for (size_t i = 0; i < count; i++)
+        total += sizes[i];
+    if (dict_cap > LZ77_DICT_MAX_SIZE)
+        dict_cap = LZ77_DICT_MAX_SIZE;
+    if (dict_cap < TRAIN_SEGMENT || total < TRAIN_SEGMENT)
+        return 0;
+    // Образцов меньше словаря: выбирать не из чего, словарь — сами образцы
+    if (total <= dict_cap)
+    {
+        memcpy(dict, data, total);
+        return total;
+    }
+
+    size_t nseg = dict_cap / TRAIN_SEGMENT;
+    size_t epoch = total / nseg;
+    uint32_t *freq = calloc((size_t)1 << TRAIN_HASH_LOG, sizeof(uint32_t));
+    uint32_t *seen = calloc((size_t)1 << TRAIN_HASH_LOG, sizeof(uint32_t));
+    train_segment *chosen = malloc(nseg * sizeof(train_segment));
+    if (!freq || !seen || !chosen)
+    {
+        free(freq);
+        free(seen);
+        free(chosen);
+        return 0;
+    }
+
+    // Частоты по образцам: seen помнит последний образец, в котором встретился фрагмент
+    size_t pos = 0;
+    for (size_t i = 0; i < count; pos += sizes[i++])
+        for (size_t p = pos; p + TRAIN_DMER <= pos + sizes[i]; p++)
+        {
+            uint32_t h = dmer_hash(data + p);
+            if (seen[h] != i + 1)
+            {
+                seen[h] = i + 1;
+                freq[h]++;
+            }
+        }
+    free(seen);
+
+    train_state ts = {data, sizes, count, 0, sizes[0], freq};
+    size_t used = 0;
+    for (size_t e = 0; e < nseg; e++)
+    {
+        size_t begin = e * epoch, end = e + 1 == nseg ? total : begin + epoch;
+        if (end - begin < TRAIN_SEGMENT)
+            continue;
+        // Скользящая сумма по фрагментам, начинающимся внутри отрезка [s, s + TRAIN_SEGMENT)
+        size_t span = TRAIN_SEGMENT - TRAIN_DMER + 1;
+        uint64_t score = 0, best_score = 0;
+        size_t best = begin;
+        for (size_t p = begin; p < begin + span; p++)
+            score += dmer_score(dmer_slot(&ts, p));
+        best_score = score;
+        for (size_t s = begin + 1; s + TRAIN_SEGMENT <= end; s++)
+        {
+            score += dmer_score(dmer_slot(&ts, s + span - 1));
+            score -= dmer_score(dmer_slot(&ts, s - 1));
+            if (score > best_score)
+            {
+                best_score = score;
+                best = s;
+            }
+        }
+        if (!best_score)
+            continue;
+        for (size_t p = best; p < best + span; p++)
+        {
+            uint32_t *slot = dmer_slot(&ts, p);
+            if (slot)
+                *slot = 0;
+        }
+        chosen[used].start = best;
+        chosen[used].score = best_score;
+        used++;
+    }
+    free(freq);
+
+    // Ценные отрезки — в конец словаря: ближе к сообщению, короче дистанции
+    qsort(chosen, used, sizeof(train_segment), cmp_segment);
+    uint8_t *op = dict;
+    for (size_t i = 0; i < used; i++, op += TRAIN_SEGMENT)
+        memcpy(op, data + chosen[i].start, TRAIN_SEGMENT);
+    free(chosen);
+    return used * TRAIN_SEGMENT;
+}
+
+// FNV-1a по содержимому: одинаковые словари дают одинаковый идентификатор
+static uint32_t dict_hash(const uint8_t *p, size_t len)
+{
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++)
+        h = (h ^ p[i]) * 16777619u;
+    return h;
+}
+
+lz77_dict *lz77_dict_load(const void *content, size_t len, int level)
+{
+    if (!content || len < LZ77_DICT_MIN_SIZE || level < 0 || level > LZ77_MAX_LEVEL)
+        return NULL;
+    if (len > LZ77_DICT_MAX_SIZE)
+    {
+        content = (const uint8_t *)content + len - LZ77_DICT_MAX_SIZE;
+        len = LZ77_DICT_MAX_SIZE;
+    }
+    lz77_dict *dict = calloc(1, sizeof(lz77_dict));
+    if (!dict)
+        return NULL;
+    dict->content = malloc(len);
+    dict->snapshot = lz77_matcher_create(level ? level : LZ77_DEFAULT_LEVEL, -1, LZ77_DICT_WINDOW_LOG);
+    if (!dict->content || !dict->snapshot)
+    {
+        lz77_dict_free(dict);
+        return NULL;
+    }
+    memcpy(dict->content, content, len);
+    dict->len = len;
+    dict->id = dict_hash(dict->content, len);
+    lz77_matcher_prime(dict->snapshot, dict->content, len);
+    return dict;
+}
+
+void lz77_dict_free(lz77_dict *dict)
+{
+    if (!dict)
+        return;
+    free(dict->content);
+    lz77_matcher_free(dict->snapshot);
+    free(dict);
+}
+
+uint32_t lz77_dict_id(const lz77_dict *dict)
+{
+    return dict->id;
+}
+
+lz77_dict_ctx *lz77_dict_ctx_create(const lz77_dict *dict)
+{
+    if (!dict)
+        return NULL;
+    lz77_dict_ctx *ctx = calloc(1, sizeof(lz77_dict_ctx));
+    if (!ctx)
+        return NULL;
+    ctx->dict = dict;
+    ctx->matcher = lz77_matcher_create(dict->snapshot->level, -1, LZ77_DICT_WINDOW_LOG);
+    if (!ctx->matcher || lz77_matcher_enable_entropy(ctx->matcher) != 0)
+    {
+        lz77_dict_ctx_free(ctx);
+        return NULL;
+    }
+    ctx->matcher->sequences = 1;
+    return ctx;
+}
+
+void lz77_dict_ctx_free(lz77_dict_ctx *ctx)
+{
+    if (!ctx)
+        return;
+    lz77_matcher_free(ctx->matcher);
+    free(ctx->scratch);
+    free(ctx);
+}
+
+uint8_t *lz77_dict_scratch(lz77_dict_ctx *ctx, size_t frame_len)
+{
+    size_t need = ctx->dict->len + frame_len;
+    if (need > ctx->scratch_cap)
+    {
+        uint8_t *scratch = realloc(ctx->scratch, need);
+        if (!scratch)
+            return NULL;
+        ctx->scratch = scratch;
+        ctx->scratch_cap = need;
+        memcpy(scratch, ctx->dict->content, ctx->dict->len);
+    }
+    return ctx->scratch;
+}
@@ -0,0 +1,609 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "lz77_internal.h"
+
+// Энтропийный блок: канонические коды Хаффмана длиной до HUF_MAX_BITS.
+//   число литералов (le32) | число последовательностей (le32)
+//   четыре таблицы: литералы, длины литералов, длины совпадений, дистанции —
+//     число символов (le16) и длины кодов по 4 бита, младшая тетрада первой
+//   размеры LIT_STREAMS потоков литералов (le32) | потоки литералов | поток последовательностей
+// Литералы делятся на LIT_STREAMS равных частей со своими потоками бит: декодер ведёт их
+// вперемешку, и обращения к таблице не ждут друг друга.
+// Последовательность — длина литералов, длина совпадения и дистанция, каждая как код с
+// дополнительными битами. Литералы после последней последовательности идут в конец блока.
+#define HUF_MAX_BITS 11
+#define LIT_SYMBOLS 256
+#define LEN_CODES 72
+#define DIST_CODES 32
+#define TABLE_LIT 0
+#define TABLE_LL 1
+#define TABLE_ML 2
+#define TABLE_OF 3
+#define TABLES 4
+#define LIT_STREAMS 4
+
+static const int table_symbols[TABLES] = {LIT_SYMBOLS, LEN_CODES, LEN_CODES, DIST_CODES};
+
+// Код длины: значения до 16 как есть, дальше два старших бита и остальные дополнительными битами
+static inline unsigned len_code(uint32_t v)
+{
+    if (v < 16)
+        return v;
+    unsigned n = 31 - __builtin_clz(v);
+    return 16 + 2 * (n - 4) + ((v >> (n - 1)) & 1);
+}
+
+static inline unsigned len_extra_bits(unsigned code)
+{
+    return code < 16 ? 0 : (code - 16) / 2 + 3;
+}
+
+static inline uint32_t len_base(unsigned code)
+{
+    if (code < 16)
+        return code;
+    return (uint32_t)(2 | ((code - 16) & 1)) << len_extra_bits(code);
+}
+
+// Код дистанции — номер старшего бита, остальные биты дополнительные
+static inline unsigned dist_code(uint32_t dist)
+{
+    return 31 - __builtin_clz(dist);
+}
+
+// Запись битов младшими вперёд
+typedef struct {
+    uint8_t *p;
+    uint8_t *end;
+    uint64_t bits;
+    int count;
+    int overflow;
+} bit_writer;
+
+static inline void bw_put(bit_writer *bw, uint32_t value, int n)
+{
+    bw->bits |= (uint64_t)value << bw->count;
+    bw->count += n;
+    if (bw->count < 32)
+        return;
+    if (bw->end - bw->p < 4)
+    {
+        bw->overflow = 1;
+        bw->p = bw->end;
+    }
+    else
+    {
+        write_le32(bw->p, (uint32_t)bw->bits);
+        bw->p += 4;
+    }
+    bw->bits >>= 32;
+    bw->count -= 32;
+}
+
+// Дописывает неполные байты; возвращает конец потока или NULL при нехватке места
+static uint8_t *bw_finish(bit_writer *bw)
+{
+    for (; bw->count > 0; bw->count -= 8, bw->bits >>= 8)
+    {
+        if (bw->p == bw->end)
+            return NULL;
+        *bw->p++ = (uint8_t)bw->bits;
+    }
+    return bw->overflow ? NULL : bw->p;
+}
+
+// Чтение битов младшими вперёд. За концом потока подставляются нули, pad считает их:
+// поток цел, пока ни один подставленный бит не прочитан (count >= pad).
+typedef struct {
+    const uint8_t *p;
+    const uint8_t *end;
+    uint64_t bits;
+    int count;
+    int pad;
+} bit_reader;
+
+static inline void br_init(bit_reader *br, const uint8_t *src, size_t len)
+{
+    br->p = src;
+    br->end = src + len;
+    br->bits = 0;
+    br->count = 0;
+    br->pad = 0;
+}
+
+// После пополнения в запасе не меньше 56 бит
+static inline void br_refill(bit_reader *br)
+{
+    if (br->end - br->p >= 8)
+    {
+        br->bits |= read_le64(br->p) << br->count;
+        br->p += (63 - br->count) >> 3;
+        br->count |= 56;
+        return;
+    }
+    while (br->count <= 56)
+    {
+        if (br->p < br->end)
+            br->bits |= (uint64_t)*br->p++ << br->count;
+        else
+            br->pad += 8;
+        br->count += 8;
+    }
+}
+
+static inline uint32_t br_read(bit_reader *br, int n)
+{
+    uint32_t v = (uint32_t)(br->bits & (((uint64_t)1 << n) - 1));
+    br->bits >>= n;
+    br->count -= n;
+    return v;
+}
+
+static inline int br_ok(const bit_reader *br)
+{
+    return br->count >= br->pad;
+}
+
+static int cmp_key(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Длины кодов Хаффмана (слияние двух очередей по возрастанию частот). Если код выходит
+// длиннее HUF_MAX_BITS, частоты сплющиваются вдвое и дерево строится заново. Символы
+// сортируются один раз ключом частота:символ; сплющивание порядка не меняет.
+static void huf_lengths(const uint32_t *freq, int n, uint8_t *len)
+{
+    uint64_t key[LIT_SYMBOLS];
+    int sym[LIT_SYMBOLS];
+    uint32_t w[2 * LIT_SYMBOLS];
+    uint32_t f[LIT_SYMBOLS];
+    int parent[2 * LIT_SYMBOLS];
+    uint8_t depth[2 * LIT_SYMBOLS];
+    int k = 0;
+
+    memset(len, 0, n);
+    for (int s = 0; s < n; s++)
+        if (freq[s])
+            key[k++] = (uint64_t)freq[s] << 8 | (uint64_t)s;
+    if (k == 1)
+        len[key[0] & 0xff] = 1;
+    if (k < 2)
+        return;
+    qsort(key, k, sizeof(key[0]), cmp_key);
+    for (int i = 0; i < k; i++)
+    {
+        f[i] = (uint32_t)(key[i] >> 8);
+        sym[i] = (int)(key[i] & 0xff);
+    }
+
+    for (;;)
+    {
+        for (int i = 0; i < k; i++)
+            w[i] = f[i];
+        int leaf = 0, node = k;
+        for (int next = k; next < 2 * k - 1; next++)
+        {
+            int c[2];
+            for (int j = 0; j < 2; j++)
+                c[j] = leaf < k && (node >= next || w[leaf] <= w[node]) ? leaf++ : node++;
+            w[next] = w[c[0]] + w[c[1]];
+            parent[c[0]] = parent[c[1]] = next;
+        }
+        depth[2 * k - 2] = 0;
+        int max = 0;
+        for (int i = 2 * k - 3; i >= 0; i--)
+        {
+            depth[i] = depth[parent[i]] + 1;
+            if (i < k && depth[i] > max)
+                max = depth[i];
+        }
+        if (max <= HUF_MAX_BITS)
+            break;
+        for (int i = 0; i < k; i++)
+            f[i] = (f[i] >> 1) | 1;
+    }
+    for (int i = 0; i < k; i++)
+        len[sym[i]] = depth[i];
+}
+
+// Канонические коды с обращённым порядком бит для записи младшими вперёд; 0 или -1,
+// если длины не образуют префиксный код
+static int huf_codes(const uint8_t *len, int n, uint16_t *code)
+{
+    uint32_t count[HUF_MAX_BITS + 1] = {0};
+    uint32_t next[HUF_MAX_BITS + 2];
+    for (int s = 0; s < n; s++)
+        count[len[s]]++;
+    count[0] = 0;
+    next[1] = 0;
+    for (int l = 1; l <= HUF_MAX_BITS; l++)
+    {
+        next[l + 1] = (next[l] + count[l]) << 1;
+        if (next[l] + count[l] > (1u << l))
+            return -1;
+    }
+    for (int s = 0; s < n; s++)
+    {
+        if (!len[s])
+            continue;
+        uint32_t c = next[len[s]]++, r = 0;
+        for (int b = 0; b < len[s]; b++)
+            r |= ((c >> b) & 1) << (len[s] - 1 - b);
+        code[s] = r;
+    }
+    return 0;
+}
+
+// Таблица декодирования: индекс — следующие table_log бит, элемент — символ << 4 | длина
+typedef struct {
+    int log;
+    uint16_t entry[1 << HUF_MAX_BITS];
+} huf_table;
+
+// Литералы декодируются по два символа за обращение, если оба кода умещаются в table_log бит
+typedef struct {
+    uint8_t sym[2];
+    uint8_t bits;
+    uint8_t count;
+} lit_entry;
+
+static int huf_table_build(huf_table *t, const uint8_t *len, int n)
+{
+    uint16_t code[LIT_SYMBOLS];
+    int max = 1;
+    for (int s = 0; s < n; s++)
+        if (len[s] > max)
+            max = len[s];
+    if (huf_codes(len, n, code) != 0)
+        return -1;
+    t->log = max;
+    memset(t->entry, 0, sizeof(uint16_t) << max);
+    for (int s = 0; s < n; s++)
+        for (uint32_t i = len[s] ? code[s] : 1u << max; i < (1u << max); i += 1u << len[s])
+            t->entry[i] = s << 4 | len[s];
+    return 0;
+}
+
+static void lit_table_build(lit_entry *lt, const huf_table *t)
+{
+    uint32_t size = 1u << t->log;
+    for (uint32_t i = 0; i < size; i++)
+    {
+        uint16_t e1 = t->entry[i];
+        int l1 = e1 & 15;
+        uint16_t e2 = t->entry[i >> l1];
+        int l2 = e2 & 15;
+        lt[i].sym[0] = e1 >> 4;
+        lt[i].sym[1] = e2 >> 4;
+        // Старшие биты i >> l1 за пределами table_log - l1 — не данные, а нули индекса
+        if (l1 && l2 && l1 + l2 <= t->log)
+        {
+            lt[i].bits = l1 + l2;
+            lt[i].count = 2;
+        }
+        else
+        {
+            lt[i].bits = l1;
+            lt[i].count = 1;
+        }
+    }
+}
+
+// Таблица последовательностей: код уже развёрнут в базу значения и число дополнительных бит
+typedef struct {
+    uint32_t base;
+    uint8_t bits;  // Длина кода
+    uint8_t extra; // Дополнительных бит за кодом
+} seq_entry;
+
+typedef struct {
+    int log;
+    seq_entry entry[1 << HUF_MAX_BITS];
+} seq_table;
+
+static void seq_table_build(seq_table *st, const huf_table *t, int kind)
+{
+    st->log = t->log;
+    for (uint32_t i = 0; i < (1u << t->log); i++)
+    {
+        unsigned sym = t->entry[i] >> 4;
+        seq_entry *e = &st->entry[i];
+        e->bits = t->entry[i] & 15;
+        if (kind == TABLE_OF)
+        {
+            e->base = (uint32_t)1 << sym;
+            e->extra = sym;
+        }
+        else
+        {
+            e->base = len_base(sym) + (kind == TABLE_ML ? MIN_MATCH_LENGTH : 0);
+            e->extra = len_extra_bits(sym);
+        }
+    }
+}
+
+static inline size_t seq_decode(const seq_table *st, bit_reader *br)
+{
+    const seq_entry *e = &st->entry[br->bits & ((1u << st->log) - 1)];
+    br->bits >>= e->bits;
+    br->count -= e->bits;
+    return e->base + br_read(br, e->extra);
+}
+
+static inline unsigned huf_decode(const huf_table *t, bit_reader *br)
+{
+    uint16_t e = t->entry[br->bits & ((1u << t->log) - 1)];
+    br->bits >>= e & 15;
+    br->count -= e & 15;
+    return e >> 4;
+}
+
+lz77_entropy *lz77_entropy_create(void)
+{
+    return calloc(1, sizeof(lz77_entropy));
+}
+
+void lz77_entropy_free(lz77_entropy *e)
+{
+    if (!e)
+        return;
+    free(e->tokens);
+    free(e->lits);
+    free(e->ll);
+    free(e->ml);
+    free(e->of);
+    free(e);
+}
+
+int lz77_entropy_reserve(lz77_entropy *e, size_t src_len)
+{
+    if (src_len <= e->block_cap)
+        return 0;
+    // Каждое совпадение покрывает не меньше MIN_MATCH_LENGTH байт
+    size_t seq_cap = src_len / MIN_MATCH_LENGTH + 1;
+    uint8_t *tokens = realloc(e->tokens, lz77_block_bound(src_len));
+    uint8_t *lits = tokens ? realloc(e->lits, src_len) : NULL;
+    uint32_t *ll = lits ? realloc(e->ll, seq_cap * sizeof(uint32_t)) : NULL;
+    uint32_t *ml = ll ? realloc(e->ml, seq_cap * sizeof(uint32_t)) : NULL;
+    uint32_t *of = ml ? realloc(e->of, seq_cap * sizeof(uint32_t)) : NULL;
+    // Успешно перевыделенные буферы сохраняются, чтобы их освободил lz77_entropy_free
+    if (tokens)
+        e->tokens = tokens;
+    if (lits)
+        e->lits = lits;
+    if (ll)
+        e->ll = ll;
+    if (ml)
+        e->ml = ml;
+    if (!of)
+        return -1;
+    e->of = of;
+    e->block_cap = src_len;
+    return 0;
+}
+
+// Запись длин кодов таблицы: число символов до последнего используемого и тетрады длин
+static uint8_t *put_lengths(uint8_t *op, uint8_t *oend, const uint8_t *len, int n)
+{
+    int used = n;
+    while (used && !len[used - 1])
+        used--;
+    if (oend - op < 2 + (used + 1) / 2)
+        return NULL;
+    *op++ = used & 0xFF;
+    *op++ = used >> 8;
+    for (int s = 0; s < used; s += 2)
+        *op++ = len[s] | (s + 1 < used ? len[s + 1] : 0) << 4;
+    return op;
+}
+
+size_t lz77_entropy_encode(const lz77_entropy *e, uint8_t *dst, size_t dst_cap)
+{
+    uint32_t freq[TABLES][LIT_SYMBOLS] = {{0}};
+    uint8_t len[TABLES][LIT_SYMBOLS];
+    uint16_t code[TABLES][LIT_SYMBOLS];
+    uint8_t *op = dst, *oend = dst + dst_cap;
+
+    for (size_t i = 0; i < e->nlit; i++)
+        freq[TABLE_LIT][e->lits[i]]++;
+    for (size_t i = 0; i < e->nseq; i++)
+    {
+        freq[TABLE_LL][len_code(e->ll[i])]++;
+        freq[TABLE_ML][len_code(e->ml[i] - MIN_MATCH_LENGTH)]++;
+        freq[TABLE_OF][dist_code(e->of[i])]++;
+    }
+
+    if (dst_cap < 8)
+        return 0;
+    write_le32(op, e->nlit);
+    write_le32(op + 4, e->nseq);
+    op += 8;
+    for (int t = 0; t < TABLES; t++)
+    {
+        huf_lengths(freq[t], table_symbols[t], len[t]);
+        huf_codes(len[t], table_symbols[t], code[t]);
+        if (!(op = put_lengths(op, oend, len[t], table_symbols[t])))
+            return 0;
+    }
+
+    if (oend - op < 4 * LIT_STREAMS)
+        return 0;
+    uint8_t *sizes = op;
+    size_t part = (e->nlit + LIT_STREAMS - 1) / LIT_STREAMS;
+    op += 4 * LIT_STREAMS;
+    for (int k = 0; k < LIT_STREAMS; k++)
+    {
+        size_t from = k * part < e->nlit ? k * part : e->nlit;
+        size_t to = e->nlit - from > part ? from + part : e->nlit;
+        bit_writer bw = {op, oend, 0, 0, 0};
+        for (size_t i = from; i < to; i++)
+            bw_put(&bw, code[TABLE_LIT][e->lits[i]], len[TABLE_LIT][e->lits[i]]);
+        uint8_t *next = bw_finish(&bw);
+        if (!next)
+            return 0;
+        write_le32(sizes + 4 * k, next - op);
+        op = next;
+    }
+
+    bit_writer sw = {op, oend, 0, 0, 0};
+    for (size_t i = 0; i < e->nseq; i++)
+    {
+        unsigned c = len_code(e->ll[i]);
+        bw_put(&sw, code[TABLE_LL][c], len[TABLE_LL][c]);
+        bw_put(&sw, e->ll[i] - len_base(c), len_extra_bits(c));
+        c = len_code(e->ml[i] - MIN_MATCH_LENGTH);
+        bw_put(&sw, code[TABLE_ML][c], len[TABLE_ML][c]);
+        bw_put(&sw, e->ml[i] - MIN_MATCH_LENGTH - len_base(c), len_extra_bits(c));
+        c = dist_code(e->of[i]);
+        bw_put(&sw, code[TABLE_OF][c], len[TABLE_OF][c]);
+        bw_put(&sw, e->of[i] - (1u << c), c);
+    }
+    if (!(op = bw_finish(&sw)))
+        return 0;
+    return op - dst;
+}
+
+// Разбор таблицы из заголовка блока; возвращает указатель за ней или NULL
+static const uint8_t *get_table(const uint8_t *ip, const uint8_t *iend, int n, huf_table *t, uint8_t *len)
+{
+    if (iend - ip < 2)
+        return NULL;
+    int used = ip[0] | ip[1] << 8;
+    ip += 2;
+    if (used > n || iend - ip < (used + 1) / 2)
+        return NULL;
+    memset(len, 0, n);
+    for (int s = 0; s < used; s++)
+        len[s] = s & 1 ? ip[s / 2] >> 4 : ip[s / 2] & 15;
+    ip += (used + 1) / 2;
+    for (int s = 0; s < used; s++)
+        if (len[s] > HUF_MAX_BITS)
+            return NULL;
+    return huf_table_build(t, len, n) == 0 ? ip : NULL;
+}
+
+static inline void lit_step(const lit_entry *lt, uint32_t mask, bit_reader *br, uint8_t **lp)
+{
+    const lit_entry *e = &lt[br->bits & mask];
+    (*lp)[0] = e->sym[0];
+    (*lp)[1] = e->sym[1];
+    *lp += e->count;
+    br->bits >>= e->bits;
+    br->count -= e->bits;
+}
+
+// Литералы распаковываются в хвост выхода [oend - nlit, oend): совпадения пишут только
+// левее ещё не прочитанных литералов, поэтому отдельный буфер не нужен.
+// Возвращает указатель за потоками литералов или NULL.
+static const uint8_t *decode_literals(const huf_table *t, const uint8_t *ip, const uint8_t *iend, uint8_t *dst,
+                                      size_t nlit)
+{
+    lit_entry lt[1 << HUF_MAX_BITS];
+    bit_reader br[LIT_STREAMS];
+    uint8_t *lp[LIT_STREAMS], *lend[LIT_STREAMS];
+    uint32_t mask = (1u << t->log) - 1;
+    size_t part = (nlit + LIT_STREAMS - 1) / LIT_STREAMS;
+
+    if ((size_t)(iend - ip) < 4 * LIT_STREAMS)
+        return NULL;
+    const uint8_t *sp = ip + 4 * LIT_STREAMS;
+    for (int k = 0; k < LIT_STREAMS; k++)
+    {
+        size_t size = read_le32(ip + 4 * k);
+        if (size > (size_t)(iend - sp))
+            return NULL;
+        br_init(&br[k], sp, size);
+        sp += size;
+        size_t from = k * part < nlit ? k * part : nlit;
+        lp[k] = dst + from;
+        lend[k] = nlit - from > part ? lp[k] + part : dst + nlit;
+    }
+
+    lit_table_build(lt, t);
+    // Быстрый цикл: на поток 4 обращения по два символа не длиннее HUF_MAX_BITS в сумме,
+    // то есть до 8 байт и 44 бит после пополнения
+    while (lend[0] - lp[0] >= 8 && lend[1] - lp[1] >= 8 && lend[2] - lp[2] >= 8 && lend[3] - lp[3] >= 8)
+    {
+        for (int k = 0; k < LIT_STREAMS; k++)
+            br_refill(&br[k]);
+        for (int i = 0; i < 4; i++)
+        {
+            lit_step(lt, mask, &br[0], &lp[0]);
+            lit_step(lt, mask, &br[1], &lp[1]);
+            lit_step(lt, mask, &br[2], &lp[2]);
+            lit_step(lt, mask, &br[3], &lp[3]);
+        }
+    }
+    for (int k = 0; k < LIT_STREAMS; k++)
+    {
+        while (lp[k] < lend[k])
+        {
+            br_refill(&br[k]);
+            *lp[k]++ = huf_decode(t, &br[k]);
+        }
+        if (!br_ok(&br[k]))
+            return NULL;
+    }
+    return sp;
+}
+
+int lz77_entropy_decode(const uint8_t *src, size_t src_len, uint8_t *base, size_t hist_len, size_t raw_len)
+{
+    const uint8_t *ip = src, *iend = src + src_len;
+    huf_table tables[TABLES];
+    uint8_t len[LIT_SYMBOLS];
+    uint8_t *op = base + hist_len, *oend = op + raw_len;
+
+    if (src_len < 8)
+        return -1;
+    size_t nlit = read_le32(ip), nseq = read_le32(ip + 4);
+    ip += 8;
+    if (nlit > raw_len || nseq > raw_len / MIN_MATCH_LENGTH + 1)
+        return -1;
+    for (int t = 0; t < TABLES; t++)
+        if (!(ip = get_table(ip, iend, table_symbols[t], &tables[t], len)))
+            return -1;
+    const uint8_t *lit = oend - nlit;
+    if (!(ip = decode_literals(&tables[TABLE_LIT], ip, iend, oend - nlit, nlit)))
+        return -1;
+
+    seq_table ll_table, ml_table, of_table;
+    seq_table_build(&ll_table, &tables[TABLE_LL], TABLE_LL);
+    seq_table_build(&ml_table, &tables[TABLE_ML], TABLE_ML);
+    seq_table_build(&of_table, &tables[TABLE_OF], TABLE_OF);
+    bit_reader br;
+    br_init(&br, ip, iend - ip);
+    // Код с дополнительными битами занимает до 42 бит, поэтому пополнение на каждое поле
+    for (size_t i = 0; i < nseq; i++)
+    {
+        br_refill(&br);
+        size_t ll = seq_decode(&ll_table, &br);
+        br_refill(&br);
+        size_t ml = seq_decode(&ml_table, &br);
+        br_refill(&br);
+        size_t dist = seq_decode(&of_table, &br);
+
+        if (ll > (size_t)(oend - lit))
+            return -1;
+        // Короткая серия копируется одним словом, если оно не задевает непрочитанные литералы
+        if (ll <= 16 && (size_t)(lit - op) >= 16 && (size_t)(oend - lit) >= 16)
+            memcpy(op, lit, 16);
+        else
+            memmove(op, lit, ll);
+        op += ll;
+        lit += ll;
+        // Совпадение не должно залезать на непрочитанные литералы
+        if (dist > (size_t)(op - base) || ml > (size_t)(lit - op))
+            return -1;
+        copy_match(op, dist, ml, lit - op);
+        op += ml;
+    }
+    size_t rest = oend - lit;
+    memmove(op, lit, rest);
+    op += rest;
+    return op == oend && br_ok(&br) ? 0 : -1;
+}
@@ -0,0 +1,884 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "lz77_internal.h"
+
+// Задание на сжатие одного фрейма
+typedef struct {
+    lz77_task task;
+    lz77_matcher **matchers; // По одному на рабочий поток
+    uint8_t *in;             // [история | данные фрейма]
+    size_t hist_len;
+    size_t raw_len;
+    int follows;             // Следующий фрейм продолжит таблицы этого (lz77_matcher.follows)
+    uint8_t *out;            // [префикс фрейма | токены | сумма]
+    size_t out_cap;
+    size_t out_len;
+    int checksum;            // Дописывать сумму фрейма
+    uint64_t frame_checksum;
+} frame_job;
+
+// Задание на распаковку одного фрейма по таблице поиска
+typedef struct {
+    lz77_task task;
+    const lz77_seek_entry *entry;
+    uint8_t **buffers; // По одному на рабочий поток: [токены | данные]
+    size_t in_cap;
+    const lz77_frame_info *info;
+    int in_fd;
+    int out_fd;        // -1 — только проверка
+    uint8_t *out_map;  // Отображённый выход: фрейм распаковывается прямо на своё место
+    long long start;
+    int status;
+    uint64_t checksum;
+} unframe_job;
+
+void lz77_params_default(lz77_params *params)
+{
+    params->threads = 1;
+    params->frame_log = LZ77_DEFAULT_FRAME_LOG;
+    params->chain = 0;
+    params->seek_table = 1;
+    params->level = LZ77_DEFAULT_LEVEL;
+    params->lazy = -1;
+    params->window_log = 0;
+    params->ldm_log = 0;
+    params->ldm_mem_log = LZ77_DEFAULT_LDM_MEM_LOG;
+    params->entropy = 1;
+    params->sequences = 1;
+    params->checksum = 1;
+    params->metrics = NULL;
+}
+
+int lz77_window_init(lz77_window *w, size_t hist_cap, size_t frame_size)
+{
+    // Запас в четверть окна: при гигантской истории сдвиг случается раз на много фреймов
+    size_t slack = hist_cap / 4 > frame_size ? hist_cap / 4 : frame_size;
+    w->cap = hist_cap + slack;
+    w->hist_cap = hist_cap;
+    w->len = 0;
+    w->buf = malloc(w->cap);
+    return w->buf ? 0 : -1;
+}
+
+void lz77_window_free(lz77_window *w)
+{
+    free(w->buf);
+    w->buf = NULL;
+}
+
+size_t lz77_window_reserve(lz77_window *w, size_t need)
+{
+    if (w->len + need <= w->cap)
+        return 0;
+    size_t keep = w->len < w->hist_cap ? w->len : w->hist_cap;
+    size_t shift = w->len - keep;
+    memmove(w->buf, w->buf + shift, keep);
+    w->len = keep;
+    return shift;
+}
+
+void lz77_window_commit(lz77_window *w, size_t n)
+{
+    w->len = w->hist_cap ? w->len + n : 0;
+}
+
+size_t lz77_read_full(FILE *input, uint8_t *dst, size_t len)
+{
+    size_t total = 0;
+    while (total < len)
+    {
+        size_t n = fread(dst + total, 1, len - total, input);
+        if (!n)
+            break;
+        total += n;
+    }
+    return total;
+}
+
+static void frame_job_run(void *arg, int worker)
+{
+    frame_job *job = arg;
+    size_t check_size = job->checksum ? LZ77_FRAME_CHECKSUM_SIZE : 0;
+    job->matchers[worker]->follows = job->follows;
+    job->out_len = lz77_block_compress(job->matchers[worker], job->in, job->hist_len, job->raw_len,
+                                       job->out + LZ77_FRAME_PREFIX_SIZE,
+                                       job->out_cap - LZ77_FRAME_PREFIX_SIZE - check_size);
+    // Сумма считается здесь же, в рабочем потоке, пока данные фрейма ещё в кеше
+    if (job->out_len && job->checksum)
+    {
+        job->frame_checksum = lz77_frame_checksum(job->in + job->hist_len, job->raw_len,
+                                                  job->out + LZ77_FRAME_PREFIX_SIZE + job->out_len);
+        job->out_len += check_size;
+    }
+}
+
+uint64_t lz77_frame_checksum(const uint8_t *data, size_t raw_len, uint8_t dst[LZ77_FRAME_CHECKSUM_SIZE])
+{
+    uint64_t h = lz77_xxh64(data, raw_len, 0);
+    write_le32(dst, (uint32_t)h);
+    return h;
+}
+
+int lz77_frame_decode(const uint8_t *src, size_t csize, uint8_t *base, size_t hist_len, size_t raw_len,
+                      const lz77_frame_info *info, uint64_t *checksum)
+{
+    *checksum = 0;
+    if (csize <= info->check_size ||
+        lz77_block_decompress(src, csize - info->check_size, base, hist_len, raw_len, info->format) != 0)
+        return -1;
+    if (!info->check_size)
+        return 0;
+    *checksum = lz77_xxh64(base + hist_len, raw_len, 0);
+    return read_le32(src + csize - info->check_size) == (uint32_t)*checksum ? 0 : -1;
+}
+
+int lz77_content_checksum_write(uint64_t content, lz77_write_fn write, void *opaque)
+{
+    uint8_t bytes[LZ77_CONTENT_CHECKSUM_SIZE];
+    write_le64(bytes, content);
+    return write(opaque, bytes, sizeof(bytes));
+}
+
+void lz77_frame_header(uint8_t header[LZ77_FRAME_HEADER_SIZE], int flags, int frame_log, int window_log)
+{
+    memcpy(header, LZ77_FRAME_MAGIC, LZ77_FRAME_MAGIC_SIZE);
+    header[4] = window_log ? LZ77_FRAME_VERSION_WINDOW : LZ77_FRAME_VERSION;
+    header[5] = flags;
+    header[6] = frame_log;
+    header[7] = window_log;
+}
+
+int lz77_frame_parse(const uint8_t header[LZ77_FRAME_HEADER_SIZE], lz77_frame_info *info)
+{
+    int version = header[4], window_log = header[7];
+    if (memcmp(header, LZ77_FRAME_MAGIC, LZ77_FRAME_MAGIC_SIZE) != 0 || (header[5] & ~LZ77_FLAG_ALL) ||
+        header[6] < LZ77_MIN_FRAME_LOG || header[6] > LZ77_MAX_FRAME_LOG)
+        return -1;
+    if (version == LZ77_FRAME_VERSION ? window_log != 0
+        : version != LZ77_FRAME_VERSION_WINDOW || window_log < LZ77_MIN_WINDOW_LOG || window_log > LZ77_MAX_LDM_LOG)
+        return -1;
+    info->flags = header[5];
+    info->frame_size = (size_t)1 << header[6];
+    info->window = window_log ? (size_t)1 << window_log : SEARCH_BUFFER_SIZE;
+    info->format = (window_log ? LZ77_BLOCK_VARINT : 0) | (info->flags & LZ77_FLAG_ENTROPY ? LZ77_BLOCK_ENTROPY : 0) |
+                   (info->flags & LZ77_FLAG_SEQUENCES ? LZ77_BLOCK_SEQUENCES : 0);
+    info->check_size = info->flags & LZ77_FLAG_CHECKSUM ? LZ77_FRAME_CHECKSUM_SIZE : 0;
+    info->tail_size = info->flags & LZ77_FLAG_CHECKSUM ? LZ77_CONTENT_CHECKSUM_SIZE : 0;
+    return 0;
+}
+
+int lz77_file_write(void *opaque, const void *data, size_t len)
+{
+    return fwrite(data, 1, len, opaque) == len ? 0 : -1;
+}
+
+int lz77_seek_add(lz77_seek_builder *seek, size_t c_size, size_t u_size)
+{
+    if (seek->count == seek->cap)
+    {
+        size_t cap = seek->cap ? seek->cap * 2 : 64;
+        lz77_seek_entry *entries = realloc(seek->entries, cap * sizeof(lz77_seek_entry));
+        if (!entries)
+            return -1;
+        seek->entries = entries;
+        seek->cap = cap;
+    }
+    lz77_seek_entry *entry = &seek->entries[seek->count++];
+    entry->c_offset = seek->c_offset;
+    entry->c_size = c_size;
+    entry->u_offset = seek->u_offset;
+    entry->u_size = u_size;
+    seek->c_offset += LZ77_FRAME_PREFIX_SIZE + c_size;
+    seek->u_offset += u_size;
+    return 0;
+}
+
+int lz77_seek_write(const lz77_seek_builder *seek, lz77_write_fn write, void *opaque)
+{
+    uint8_t record[LZ77_SEEK_ENTRY_SIZE];
+    for (size_t i = 0; i < seek->count; i++)
+    {
+        write_le64(record, seek->entries[i].c_offset);
+        write_le32(record + 8, seek->entries[i].c_size);
+        write_le64(record + 12, seek->entries[i].u_offset);
+        write_le32(record + 20, seek->entries[i].u_size);
+        if (write(opaque, record, sizeof(record)) != 0)
+            return -1;
+    }
+    write_le32(record, seek->count);
+    memcpy(record + 4, LZ77_SEEK_MAGIC, 4);
+    return write(opaque, record, LZ77_SEEK_FOOTER_SIZE);
+}
+
+static int frame_job_write(frame_job *job, lz77_io *output, FILE *log, uint64_t frame_no, lz77_seek_builder *seek,
+                           uint64_t *content, lz77_metrics *io)
+{
+    if (!job->out_len)
+    {
+        fprintf(stderr, "[ERROR] Frame %llu: compression failed\n", (unsigned long long)frame_no);
+        return -1;
+    }
+    write_le32(job->out, job->out_len);
+    write_le32(job->out + 4, job->raw_len);
+    size_t total = LZ77_FRAME_PREFIX_SIZE + job->out_len;
+    uint64_t t = metrics_clock();
+    int written = lz77_io_write(output, job->out, total);
+    metrics_phase(io, LZ77_PHASE_WRITE, t);
+    if (written != 0)
+    {
+        fprintf(stderr, "[ERROR] Frame %llu: write error\n", (unsigned long long)frame_no);
+        return -1;
+    }
+    if (LZ77_LOG_ON(log, LZ77_LOG_FRAMES))
+        fprintf(log, "[INFO] Frame %llu written: raw=%zu, compressed=%zu\n",
+                (unsigned long long)frame_no, job->raw_len, job->out_len);
+    if (lz77_seek_add(seek, job->out_len, job->raw_len) != 0)
+    {
+        fprintf(stderr, "[ERROR] Frame %llu: out of memory for seek table\n", (unsigned long long)frame_no);
+        return -1;
+    }
+    if (job->checksum)
+        *content = lz77_content_checksum(*content, job->frame_checksum);
+    return 0;
+}
+
+// Дальним совпадениям нужна непрерывная история на много фреймов назад: вместо копии окна
+// в каждое задание фреймы идут последовательно через потоковый контекст со сдвигаемым окном
+static int compress_frames_ldm(FILE *input, FILE *output, FILE *log, const lz77_params *params)
+{
+    lz77_metrics metrics = {0};
+    lz77_params cp = *params;
+    const lz77_params *p = &cp;
+    cp.metrics = &metrics;
+    size_t frame_size = (size_t)1 << p->frame_log;
+    // Отображённый вход отдаётся контексту прямо со страниц файла, без промежуточного куска
+    lz77_map map;
+    int mapped = lz77_map_input(&map, input) == 0;
+    uint8_t *chunk = mapped ? NULL : malloc(frame_size);
+    lz77_io *in = mapped ? NULL : lz77_io_reader(input);
+    lz77_io *out = lz77_io_writer(output);
+    lz77_cctx *ctx = (mapped || (chunk && in)) && out ? lz77_cctx_init(p, lz77_io_write, out) : NULL;
+    uint64_t total = 0;
+    int status = 0;
+
+    if (!ctx)
+    {
+        fprintf(stderr, "[ERROR] lz77_compress_frames: out of memory for long-distance window\n");
+        lz77_map_close(&map, 0);
+        lz77_io_close(in);
+        lz77_io_close(out);
+        free(chunk);
+        return -1;
+    }
+    if (LZ77_LOG_ON(log, LZ77_LOG_INFO))
+        fprintf(log, "[INFO] Frame compression: threads=1, frame_size=%zu, chained=1, level=%d, window_log=%d, "
+                "ldm_log=%d, ldm_mem_log=%d, entropy=%d, sequences=%d, checksum=%d, io=%s/%s\n", frame_size,
+                p->level, p->window_log, p->ldm_log, p->ldm_mem_log, p->entropy, p->sequences, p->checksum,
+                mapped ? "mmap" : lz77_io_backend_name(in), lz77_io_backend_name(out));
+
+    size_t n;
+    uint64_t t = metrics_clock();
+    for (; mapped && !status && total < map.len; total += n)
+    {
+        n = map.len - total < frame_size ? map.len - total : frame_size;
+        status = lz77_cctx_update(ctx, map.data + total, n);
+    }
+    while (!mapped && !status && (n = lz77_io_read(in, chunk, frame_size)) > 0)
+    {
+        metrics_phase(&metrics, LZ77_PHASE_READ, t);
+        status = lz77_cctx_update(ctx, chunk, n);
+        total += n;
+        t = metrics_clock();
+    }
+    if (!status && in && lz77_io_error(in))
+    {
+        fprintf(stderr, "[ERROR] lz77_compress_frames: read error\n");
+        status = -1;
+    }
+    if (lz77_cctx_end(ctx) != 0)
+        status = -1;
+    lz77_map_close(&map, 0);
+    lz77_io_close(in);
+    if (lz77_io_close(out) != 0 && !status)
+    {
+        fprintf(stderr, "[ERROR] lz77_compress_frames: write error\n");
+        status = -1;
+    }
+    if (LZ77_LOG_ON(log, LZ77_LOG_INFO))
+        fprintf(log, "[INFO] Frame compression %s: frames=%llu\n", status ? "failed" : "completed",
+                (unsigned long long)((total + frame_size - 1) / frame_size));
+    lz77_metrics_log(&metrics, log);
+    if (params->metrics)
+        lz77_metrics_add(params->metrics, &metrics);
+    free(chunk);
+    return status;
+}
+
+int lz77_compress_frames(FILE *input, FILE *output, FILE *log, const lz77_params *params)
+{
+    lz77_params p;
+    if (params)
+        p = *params;
+    else
+        lz77_params_default(&p);
+    if (!input || !output || p.frame_log < LZ77_MIN_FRAME_LOG || p.frame_log > LZ77_MAX_FRAME_LOG ||
+        p.level < 0 || p.level > LZ77_MAX_LEVEL ||
+        (p.window_log && (p.window_log < LZ77_MIN_WINDOW_LOG || p.window_log > LZ77_MAX_WINDOW_LOG)) ||
+        (p.ldm_log && (p.ldm_log < LZ77_MIN_LDM_LOG || p.ldm_log > LZ77_MAX_LDM_LOG ||
+                       p.ldm_mem_log < LZ77_MIN_LDM_MEM_LOG || p.ldm_mem_log > LZ77_MAX_LDM_MEM_LOG)))
+    {
+        fprintf(stderr, "[ERROR] lz77_compress_frames: invalid arguments\n");
+        return -1;
+    }
+    if (p.ldm_log)
+    {
+        if (LZ77_LOG_ON(log, LZ77_LOG_INFO) && p.threads > 1)
+            fprintf(log, "[INFO] Long-distance matching compresses frames sequentially\n");
+        return compress_frames_ldm(input, output, log, &p);
+    }
+
+    size_t frame_size = (size_t)1 << p.frame_log;
+    size_t hist_cap = !p.chain ? 0 : p.window_log ? (size_t)1 << p.window_log : SEARCH_BUFFER_SIZE;
+    lz77_pool *pool = lz77_pool_create(p.threads);
+    if (!pool)
+        return -1;
+    int workers = lz77_pool_size(pool);
+    int nslots = workers * 2;
+    int status = 0;
+    lz77_seek_builder seek = LZ77_SEEK_BUILDER_INIT;
+    lz77_metrics metrics = {0}; // Чтение и запись в этом потоке; поиск — в сопоставителях
+
+    lz77_matcher **matchers = calloc(workers, sizeof(lz77_matcher *));
+    frame_job *jobs = calloc(nslots, sizeof(frame_job));
+    uint8_t *tail = malloc(hist_cap + 1);
+    // Отображённый обычный файл сжимается прямо со страниц: задание получает указатель на
+    // [история | фрейм] внутри отображения вместо копии. Иначе чтение следующих фреймов и
+    // запись готовых идут в конвейере, пока фреймы сжимаются.
+    lz77_map map;
+    int mapped = lz77_map_input(&map, input) == 0;
+    lz77_io *in = mapped ? NULL : lz77_io_reader(input);
+    lz77_io *out = lz77_io_writer(output);
+    if (!matchers || !jobs || !tail || (!mapped && !in) || !out)
+        status = -1;
+    // Несцепленный фрейм не ссылается за своё начало, окно шире фрейма только тратит память
+    int mf_window_log = !p.chain && p.window_log > p.frame_log ? p.frame_log : p.window_log;
+    for (int i = 0; !status && i < workers; i++)
+        if (!(matchers[i] = lz77_matcher_create(p.level, p.lazy, mf_window_log)) ||
+            (p.entropy && lz77_matcher_enable_entropy(matchers[i]) != 0))
+            status = -1;
+        else
+            matchers[i]->sequences = p.sequences;
+    // Единственный поток сжимает фреймы по порядку, и сцепленный фрейм продолжает таблицы
+    // прошлого; в нескольких потоках история каждого задания вставляется заново
+    int follows = p.chain && workers == 1;
+    for (int i = 0; !status && i < nslots; i++)
+    {
+        jobs[i].task.fn = frame_job_run;
+        jobs[i].task.arg = &jobs[i];
+        jobs[i].matchers = matchers;
+        jobs[i].checksum = p.checksum;
+        jobs[i].out_cap = LZ77_FRAME_PREFIX_SIZE + lz77_block_bound(frame_size) +
+                          (p.checksum ? LZ77_FRAME_CHECKSUM_SIZE : 0);
+        jobs[i].in = mapped ? NULL : malloc(hist_cap + frame_size);
+        jobs[i].out = malloc(jobs[i].out_cap);
+        if ((!mapped && !jobs[i].in) || !jobs[i].out)
+            status = -1;
+    }
+    if (status)
+        fprintf(stderr, "[ERROR] lz77_compress_frames: out of memory\n");
+
+    if (LZ77_LOG_ON(log, LZ77_LOG_INFO))
+        fprintf(log, "[INFO] Frame compression: threads=%d, frame_size=%zu, chained=%d, level=%d, window_log=%d, "
+                "entropy=%d, sequences=%d, checksum=%d, io=%s/%s\n", workers, frame_size, p.chain, p.level,
+                p.window_log, p.entropy, p.sequences, p.checksum, mapped ? "mmap" : in ? lz77_io_backend_name(in) : "-",
+                out ? lz77_io_backend_name(out) : "-");
+
+    uint8_t header[LZ77_FRAME_HEADER_SIZE];
+    lz77_frame_header(header, (p.chain ? LZ77_FLAG_CHAINED : 0) | (p.seek_table ? LZ77_FLAG_SEEK_TABLE : 0) |
+                      (p.entropy ? LZ77_FLAG_ENTROPY : 0) | (p.sequences ? LZ77_FLAG_SEQUENCES : 0) |
+                      (p.checksum ? LZ77_FLAG_CHECKSUM : 0), p.frame_log, p.window_log);
+    if (!status && lz77_io_write(out, header, sizeof(header)) != 0)
+        status = -1;
+
+    uint64_t frame_no = 0, next_write = 0, content = 0;
+    size_t tail_len = 0;
+    while (!status)
+    {
+        // Слот освобождается только после записи его фрейма, так что порядок сохраняется
+        while (!status && frame_no - next_write >= (uint64_t)nslots)
+        {
+            frame_job *done = &jobs[next_write % nslots];
+            lz77_pool_wait(pool, &done->task);
+            status = frame_job_write(done, out, log, next_write++, &seek, &content, &metrics);
+        }
+        if (status)
+            break;
+
+        frame_job *job = &jobs[frame_no % nslots];
+        if (mapped)
+        {
+            size_t offset = frame_no * frame_size;
+            if (offset >= map.len)
+                break;
+            job->hist_len = offset < hist_cap ? offset : hist_cap;
+            job->in = map.data + offset - job->hist_len;
+            job->raw_len = map.len - offset < frame_size ? map.len - offset : frame_size;
+            job->follows = follows && offset + job->raw_len < map.len;
+        }
+        else
+        {
+            memcpy(job->in, tail, tail_len);
+            job->hist_len = tail_len;
+            uint64_t t = metrics_clock();
+            job->raw_len = lz77_io_read(in, job->in + tail_len, frame_size);
+            metrics_phase(&metrics, LZ77_PHASE_READ, t);
+            if (!job->raw_len)
+                break;
+            // Неполный фрейм — последний; конец потока ровно на границе фрейма не виден заранее
+            job->follows = follows && job->raw_len == frame_size;
+
+            size_t filled = tail_len + job->raw_len;
+            tail_len = filled < hist_cap ? filled : hist_cap;
+            memcpy(tail, job->in + filled - tail_len, tail_len);
+        }
+
+        lz77_pool_submit(pool, &job->task);
+        frame_no++;
+    }
+
+    // Дожидаемся всех отправленных заданий, даже если запись уже сломалась
+    while (next_write < frame_no)
+    {
+        frame_job *done = &jobs[next_write % nslots];
+        lz77_pool_wait(pool, &done->task);
+        if (!status)
+            status = frame_job_write(done, out, log, next_write, &seek, &content, &metrics);
+        next_write++;
+    }
+    if (!status && in && lz77_io_error(in))
+    {
+        fprintf(stderr, "[ERROR] lz77_compress_frames: read error\n");
+        status = -1;
+    }
+    if (!status)
+    {
+        uint8_t end_mark[4] = {0};
+        if (lz77_io_write(out, end_mark, sizeof(end_mark)) != 0)
+            status = -1;
+        else if (p.checksum && lz77_content_checksum_write(content, lz77_io_write, out) != 0)
+            status = -1;
+        else if (p.seek_table && lz77_seek_write(&seek, lz77_io_write, out) != 0)
+            status = -1;
+    }
+    lz77_map_close(&map, 0);
+    lz77_io_close(in);
+    uint64_t t = metrics_clock();
+    if (lz77_io_close(out) != 0 && !status)
+    {
+        fprintf(stderr, "[ERROR] lz77_compress_frames: write error\n");
+        status = -1;
+    }
+    metrics_phase(&metrics, LZ77_PHASE_WRITE, t);
+    if (LZ77_LOG_ON(log, LZ77_LOG_INFO))
+        fprintf(log, "[INFO] Frame compression %s: frames=%llu\n", status ? "failed" : "completed",
+                (unsigned long long)frame_no);
+    for (int i = 0; matchers && i < workers; i++)
+        if (matchers[i])
+            lz77_metrics_add(&metrics, &matchers[i]->metrics);
+    lz77_metrics_log(&metrics, log);
+    if (p.metrics)
+        lz77_metrics_add(p.metrics, &metrics);
+
+    lz77_pool_destroy(pool);
+    for (int i = 0; jobs && i < nslots; i++)
+    {
+        if (!mapped)
+            free(jobs[i].in);
+        free(jobs[i].out);
+    }
+    for (int i = 0; matchers && i < workers; i++)
+        lz77_matcher_free(matchers[i]);
+    free(jobs);
+    free(matchers);
+    free(tail);
+    free(seek.entries);
+    return status;
+}
+
+// Выход сразу нужного размера, отображённый в память: размер содержимого берётся из таблицы
+// поиска в конце входа, start — начало контейнера. Позиция входа сохраняется; -2 — её не
+// удалось вернуть, и читать дальше нельзя.
+static int map_frame_output(FILE *input, long long start, FILE *output, lz77_map *map)
+{
+    struct stat st;
+    uint8_t header[LZ77_FRAME_HEADER_SIZE];
+    lz77_seek_entry *entries;
+    size_t count;
+    long long pos = ftello(input);
+    memset(map, 0, sizeof(*map));
+    if (pos < 0 || fstat(fileno(input), &st) != 0 || !S_ISREG(st.st_mode))
+        return -1;
+    int found = lz77_read_seek_table(input, start, header, &entries, &count) == 0 && count;
+    uint64_t size = found ? entries[count - 1].u_offset + entries[count - 1].u_size : 0;
+    free(entries);
+    if (fseeko(input, pos, SEEK_SET) != 0)
+        return -2;
+    return found ? lz77_map_output(map, output, size) : -1;
+}
+
+int lz77_frame_decompress(FILE *input, FILE *output, FILE *log)
+{
+    uint8_t header[LZ77_FRAME_HEADER_SIZE] = LZ77_FRAME_MAGIC;
+    lz77_frame_info info;
+    if (lz77_read_full(input, header + LZ77_FRAME_MAGIC_SIZE, LZ77_FRAME_HEADER_SIZE - LZ77_FRAME_MAGIC_SIZE) !=
+        LZ77_FRAME_HEADER_SIZE - LZ77_FRAME_MAGIC_SIZE)
+    {
+        fprintf(stderr, "[ERROR] EOF at frame header\n");
+        return -1;
+    }
+    if (lz77_frame_parse(header, &info) != 0)
+    {
+        fprintf(stderr, "[ERROR] Unsupported frame header: version=%u, frame_log=%u, window_log=%u\n",
+                header[4], header[6], header[7]);
+        return -1;
+    }
+
+    size_t frame_size = info.frame_size;
+    // История сцепленных фреймов — одно окно, размер берётся из заголовка
+    size_t hist_cap = (info.flags & LZ77_FLAG_CHAINED) ? info.window : 0;
+    size_t in_cap = lz77_block_bound(frame_size) + info.check_size;
+    uint8_t *in = malloc(in_cap);
+    lz77_window out = {0};
+    uint64_t frame_no = 0, total = 0, content = 0, checksum;
+    int status = -1;
+    // С таблицей поиска размер содержимого известен заранее: фреймы распаковываются прямо в
+    // отображённый выход, историей служат уже распакованные страницы. Иначе следующие фреймы
+    // читаются, а распакованные пишутся в конвейере, пока декодируется текущий.
+    lz77_map map = {0};
+    int map_status = output && (info.flags & LZ77_FLAG_SEEK_TABLE) ?
+                     map_frame_output(input, ftello(input) - LZ77_FRAME_HEADER_SIZE, output, &map) : -1;
+    int mapped = map_status == 0;
+    lz77_io *reader = map_status == -2 ? NULL : lz77_io_reader(input);
+    lz77_io *writer = output && !mapped ? lz77_io_writer(output) : NULL;
+
+    if ((!mapped && lz77_window_init(&out, hist_cap, frame_size) != 0) || !in || !reader || (output && !mapped && !writer))
+    {
+        fprintf(stderr, map_status == -2 ? "[ERROR] Seek error\n" : "[ERROR] Out of memory\n");
+        goto done;
+    }
+    if (LZ77_LOG_ON(log, LZ77_LOG_INFO))
+        fprintf(log, "[INFO] Starting frame decompression: frame_size=%zu, chained=%d, window=%zu, checksum=%d, "
+                "io=%s/%s\n", frame_size, hist_cap != 0, info.window, info.check_size != 0,
+                lz77_io_backend_name(reader), mapped ? "mmap" : writer ? lz77_io_backend_name(writer) : "-");
+
+    for (;; frame_no++)
+    {
+        uint8_t prefix[LZ77_FRAME_PREFIX_SIZE];
+        if (lz77_io_read(reader, prefix, 4) != 4)
+        {
+            fprintf(stderr, "[ERROR] EOF at frame %llu\n", (unsigned long long)frame_no);
+            goto done;
+        }
+        size_t csize = read_le32(prefix);
+        if (!csize)
+            break;
+        if (lz77_io_read(reader, prefix + 4, 4) != 4)
+        {
+            fprintf(stderr, "[ERROR] EOF at frame %llu\n", (unsigned long long)frame_no);
+            goto done;
+        }
+        size_t raw = read_le32(prefix + 4);
+        if (raw == 0 || raw > frame_size || csize > in_cap)
+        {
+            fprintf(stderr, "[ERROR] Invalid frame %llu: raw=%zu, compressed=%zu\n", (unsigned long long)frame_no, raw, csize);
+            goto done;
+        }
+        if (lz77_io_read(reader, in, csize) != csize)
+        {
+            fprintf(stderr, "[ERROR] Read error at frame %llu\n", (unsigned long long)frame_no);
+            goto done;
+        }
+        uint8_t *base;
+        size_t hist_len;
+        if (mapped)
+        {
+            if (raw > map.len - total)
+            {
+                fprintf(stderr, "[ERROR] Frame %llu exceeds content size %zu\n", (unsigned long long)frame_no, map.len);
+                goto done;
+            }
+            hist_len = total < hist_cap ? total : hist_cap;
+            base = map.data + total - hist_len;
+        }
+        else
+        {
+            lz77_window_reserve(&out, raw);
+            base = out.buf;
+            hist_len = out.len;
+        }
+        if (lz77_frame_decode(in, csize, base, hist_len, raw, &info, &checksum) != 0)
+        {
+            fprintf(stderr, "[ERROR] Corrupted frame %llu\n", (unsigned long long)frame_no);
+            goto done;
+        }
+        content = lz77_content_checksum(content, checksum);
+        if (writer && lz77_io_write(writer, base + hist_len, raw) != 0)
+        {
+            fprintf(stderr, "[ERROR] Write error at frame %llu\n", (unsigned long long)frame_no);
+            goto done;
+        }
+        total += raw;
+        if (!mapped)
+            lz77_window_commit(&out, raw);
+    }
+    if (mapped && total != map.len)
+    {
+        fprintf(stderr, "[ERROR] Content size mismatch: %llu of %zu bytes\n", (unsigned long long)total, map.len);
+        goto done;
+    }
+    if (info.tail_size)
+    {
+        uint8_t tail[LZ77_CONTENT_CHECKSUM_SIZE];
+        if (lz77_io_read(reader, tail, sizeof(tail)) != sizeof(tail) || read_le64(tail) != content)
+        {
+            fprintf(stderr, "[ERROR] Content checksum mismatch\n");
+            goto done;
+        }
+    }
+    // Хвост выхода ещё в конвейере: ошибка его записи видна только при закрытии
+    lz77_io *pending = writer;
+    writer = NULL;
+    if (lz77_io_close(pending) != 0 || lz77_map_close(&map, 0) != 0)
+    {
+        fprintf(stderr, "[ERROR] Write error at frame %llu\n", (unsigned long long)frame_no);
+        goto done;
+    }
+    // Без сумм проверка лишь разобрала фреймы: целостность данных не подтверждена
+    status = output || info.check_size ? 0 : LZ77_UNVERIFIED;
+    if (LZ77_LOG_ON(log, LZ77_LOG_INFO))
+        fprintf(log, "[INFO] Frame decompression completed: frames=%llu, total_written=%llu%s\n",
+                (unsigned long long)frame_no, (unsigned long long)total, info.tail_size ? ", checksum verified" : "");
+
+done:
+    lz77_io_close(reader);
+    lz77_io_close(writer);
+    lz77_map_close(&map, status != 0);
+    free(in);
+    lz77_window_free(&out);
+    return status;
+}
+
+int lz77_seek_open(FILE *input, long long start, uint8_t header[LZ77_FRAME_HEADER_SIZE],
+                   long long *table_pos, size_t *count)
+{
+    uint8_t footer[LZ77_SEEK_FOOTER_SIZE];
+
+    lz77_frame_info info;
+
+    if (fseeko(input, start, SEEK_SET) != 0 ||
+        lz77_read_full(input, header, LZ77_FRAME_HEADER_SIZE) != LZ77_FRAME_HEADER_SIZE ||
+        lz77_frame_parse(header, &info) != 0 || !(info.flags & LZ77_FLAG_SEEK_TABLE))
+        return -1;
+    if (fseeko(input, -LZ77_SEEK_FOOTER_SIZE, SEEK_END) != 0)
+        return -1;
+    long long footer_pos = ftello(input);
+    if (lz77_read_full(input, footer, sizeof(footer)) != sizeof(footer) || memcmp(footer + 4, LZ77_SEEK_MAGIC, 4) != 0)
+        return -1;
+
+    *count = read_le32(footer);
+    *table_pos = footer_pos - (long long)*count * LZ77_SEEK_ENTRY_SIZE;
+    return *table_pos < start + LZ77_FRAME_HEADER_SIZE + 4 ? -1 : 0;
+}
+
+int lz77_seek_entry_read(FILE *input, long long table_pos, size_t index, lz77_seek_entry *entry)
+{
+    uint8_t record[LZ77_SEEK_ENTRY_SIZE];
+    if (fseeko(input, table_pos + (long long)index * LZ77_SEEK_ENTRY_SIZE, SEEK_SET) != 0 ||
+        lz77_read_full(input, record, sizeof(record)) != sizeof(record))
+        return -1;
+    entry->c_offset = read_le64(record);
+    entry->c_size = read_le32(record + 8);
+    entry->u_offset = read_le64(record + 12);
+    entry->u_size = read_le32(record + 20);
+    return entry->c_size && entry->u_size ? 0 : -1;
+}
+
+int lz77_read_seek_table(FILE *input, long long start, uint8_t header[LZ77_FRAME_HEADER_SIZE],
+                         lz77_seek_entry **entries, size_t *count)
+{
+    long long table_pos;
+    size_t n;
+    lz77_frame_info info;
+    *entries = NULL;
+    *count = 0;
+
+    if (lz77_seek_open(input, start, header, &table_pos, &n) != 0)
+        return -1;
+    lz77_frame_parse(header, &info);
+
+    lz77_seek_entry *table = malloc((n ? n : 1) * sizeof(lz77_seek_entry));
+    if (!table)
+        return -1;
+    uint64_t c_expected = LZ77_FRAME_HEADER_SIZE, u_expected = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        // Фреймы идут вплотную, поэтому таблица обязана быть непрерывной; размеры не больше
+        // фрейма и его границы, иначе выход по таблице отобразился бы любой длины
+        if (lz77_seek_entry_read(input, table_pos, i, &table[i]) != 0 ||
+            table[i].c_offset != c_expected || table[i].u_offset != u_expected ||
+            table[i].u_size > info.frame_size ||
+            table[i].c_size > lz77_block_bound(table[i].u_size) + info.check_size)
+        {
+            free(table);
+            return -1;
+        }
+        c_expected += LZ77_FRAME_PREFIX_SIZE + table[i].c_size;
+        u_expected += table[i].u_size;
+    }
+    if ((long long)(c_expected + 4 + info.tail_size) != table_pos - start)
+    {
+        free(table);
+        return -1;
+    }
+    *entries = table;
+    *count = n;
+    return 0;
+}
+
+static void unframe_job_run(void *arg, int worker)
+{
+    unframe_job *job = arg;
+    const lz77_seek_entry *entry = job->entry;
+    uint8_t *in = job->buffers[worker];
+    uint8_t *out = job->out_map ? job->out_map + entry->u_offset : in + job->in_cap;
+    size_t in_len = LZ77_FRAME_PREFIX_SIZE + entry->c_size;
+
+    job->status = -1;
+    if (in_len > job->in_cap)
+        return;
+    if (pread(job->in_fd, in, in_len, job->start + entry->c_offset) != (ssize_t)in_len)
+        return;
+    if (read_le32(in) != entry->c_size || read_le32(in + 4) != entry->u_size)
+        return;
+    if (lz77_frame_decode(in + LZ77_FRAME_PREFIX_SIZE, entry->c_size, out, 0, entry->u_size, job->info,
+                          &job->checksum) != 0)
+        return;
+    size_t written = 0;
+    while (!job->out_map && job->out_fd >= 0 && written < entry->u_size)
+    {
+        ssize_t n = pwrite(job->out_fd, out + written, entry->u_size - written, entry->u_offset + written);
+        if (n <= 0)
+            return;
+        written += n;
+    }
+    job->status = 0;
+}
+
+int lz77_decompress_frames(FILE *input, FILE *output, FILE *log, int threads)
+{
+    struct stat in_st, out_st;
+    uint8_t header[LZ77_FRAME_HEADER_SIZE];
+    lz77_seek_entry *entries = NULL;
+    size_t count;
+    long long start = ftello(input);
+
+    // Без выхода (проверка) писать некуда, и обычный файл на выходе не нужен
+    if (start < 0 || fstat(fileno(input), &in_st) != 0 || !S_ISREG(in_st.st_mode) ||
+        (output && (fstat(fileno(output), &out_st) != 0 || !S_ISREG(out_st.st_mode))) ||
+        lz77_read_seek_table(input, start, header, &entries, &count) != 0 || (header[5] & LZ77_FLAG_CHAINED))
+    {
+        if (LZ77_LOG_ON(log, LZ77_LOG_INFO))
+            fprintf(log, "[INFO] Parallel decompression unavailable, falling back to sequential\n");
+        free(entries);
+        if (start < 0 || fseeko(input, start, SEEK_SET) != 0)
+            return start < 0 ? lz77_decompress(input, output, log) : -1;
+        return lz77_decompress(input, output, log);
+    }
+
+    lz77_frame_info info;
+    lz77_frame_parse(header, &info);
+    size_t frame_size = info.frame_size;
+    size_t in_cap = LZ77_FRAME_PREFIX_SIZE + lz77_block_bound(frame_size) + info.check_size;
+    lz77_pool *pool = lz77_pool_create(threads);
+    int workers = pool ? lz77_pool_size(pool) : 0;
+    uint8_t **buffers = calloc(workers ? workers : 1, sizeof(uint8_t *));
+    unframe_job *jobs = calloc(count ? count : 1, sizeof(unframe_job));
+    int status = pool && buffers && jobs ? 0 : -1;
+
+    for (int i = 0; !status && i < workers; i++)
+        if (!(buffers[i] = malloc(in_cap + frame_size)))
+            status = -1;
+    if (status)
+        fprintf(stderr, "[ERROR] Out of memory\n");
+    if (!status && output && fflush(output) != 0)
+        status = -1;
+    // Размер выхода известен по таблице: он отображается целиком, и рабочие потоки распаковывают
+    // фреймы прямо на свои места в нём, без буфера и pwrite
+    lz77_map map = {0};
+    uint64_t size = count ? entries[count - 1].u_offset + entries[count - 1].u_size : 0;
+    int mapped = !status && output && lz77_map_output(&map, output, size) == 0;
+    if (LZ77_LOG_ON(log, LZ77_LOG_INFO))
+        fprintf(log, "[INFO] Parallel decompression: threads=%d, frames=%zu, frame_size=%zu, io=%s\n", workers, count,
+                frame_size, mapped ? "mmap" : "pwrite");
+
+    size_t submitted = 0;
+    for (; !status && submitted < count; submitted++)
+    {
+        jobs[submitted].task.fn = unframe_job_run;
+        jobs[submitted].task.arg = &jobs[submitted];
+        jobs[submitted].entry = &entries[submitted];
+        jobs[submitted].buffers = buffers;
+        jobs[submitted].in_cap = in_cap;
+        jobs[submitted].info = &info;
+        jobs[submitted].in_fd = fileno(input);
+        jobs[submitted].out_fd = output ? fileno(output) : -1;
+        jobs[submitted].out_map = mapped ? map.data : NULL;
+        jobs[submitted].start = start;
+        lz77_pool_submit(pool, &jobs[submitted].task);
+    }
+    // Сумма содержимого сворачивается из сумм фреймов по порядку, как при сжатии
+    uint64_t content = 0;
+    for (size_t i = 0; i < submitted; i++)
+    {
+        lz77_pool_wait(pool, &jobs[i].task);
+        if (jobs[i].status && !status)
+        {
+            fprintf(stderr, "[ERROR] Corrupted or unwritable frame %zu\n", i);
+            status = -1;
+        }
+        content = lz77_content_checksum(content, jobs[i].checksum);
+    }
+    if (!status && info.tail_size)
+    {
+        uint8_t tail[LZ77_CONTENT_CHECKSUM_SIZE];
+        off_t pos = start + (count ? entries[count - 1].c_offset + LZ77_FRAME_PREFIX_SIZE + entries[count - 1].c_size
+                                   : LZ77_FRAME_HEADER_SIZE) + 4;
+        if (pread(fileno(input), tail, sizeof(tail), pos) != (ssize_t)sizeof(tail) || read_le64(tail) != content)
+        {
+            fprintf(stderr, "[ERROR] Content checksum mismatch\n");
+            status = -1;
+        }
+    }
+    if (lz77_map_close(&map, status != 0) != 0 && !status)
+    {
+        fprintf(stderr, "[ERROR] Write error\n");
+        status = -1;
+    }
+    if (!status && !output && !info.check_size)
+        status = LZ77_UNVERIFIED;
+    if (LZ77_LOG_ON(log, LZ77_LOG_INFO))
+        fprintf(log, "[INFO] Parallel decompression %s: total_written=%llu\n", status < 0 ? "failed" : "completed",
+                count ? (unsigned long long)(entries[count - 1].u_offset + entries[count - 1].u_size) : 0ULL);
+
+    lz77_pool_destroy(pool);
+    for (int i = 0; buffers && i < workers; i++)
+        free(buffers[i]);
+    free(buffers);
+    free(jobs);
+    free(entries);
+    return status;
+}
@@ -0,0 +1,669 @@
+#ifndef LZ77_INTERNAL_H
+#define LZ77_INTERNAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "lz77.h"
+
+// Формат контейнера с фреймами:
+//   заголовок: магия (4 байта) | версия | флаги | log2 размера фрейма | log2 окна
+//   фрейм:     сжатый размер (le32) | исходный размер (le32) | токены
+//   конец:     сжатый размер = 0
+//   таблица поиска (если LZ77_FLAG_SEEK_TABLE): записи фреймов | число записей (le32) | "LZ7S"
+// Первый байт магии нулевой: старый поток всегда начинается с литерала (нечётный байт),
+// поэтому lz77_decompress различает форматы по первому байту.
+// Версия 1: окно SEARCH_BUFFER_SIZE, дистанция — 15 бит в двух байтах, байт окна нулевой.
+// Версия 2: окно 2^log2 окна, дистанция — varint (см. lz77_block.c). С дальними
+// совпадениями log2 окна доходит до LZ77_MAX_LDM_LOG.
+// С флагом LZ77_FLAG_ENTROPY токены фрейма начинаются с байта типа блока: токены как есть,
+// их коды Хаффмана (см. lz77_entropy.c) или исходные байты несжимаемого фрейма.
+// С флагом LZ77_FLAG_SEQUENCES токены — упакованные последовательности без next_char
+// (см. lz77_block.c); без него — прежние токены литералов и совпадений.
+// С флагом LZ77_FLAG_DICT за заголовком идёт идентификатор словаря (le32), а история первого
+// фрейма — словарь. Такие данные распаковывает только lz77_decompress_dict, поэтому флаг не
+// входит в LZ77_FLAG_ALL и остальные распаковщики отвергают его как неизвестный.
+// С флагом LZ77_FLAG_CHECKSUM токены каждого фрейма заканчиваются младшими 32 битами xxHash64
+// его исходных данных (входят в сжатый размер), а за концом контейнера идёт сумма содержимого
+// (le64) — свёртка полных сумм фреймов по порядку (см. lz77_content_checksum). Так сумму
+// содержимого можно проверить и при параллельной распаковке.
+#define LZ77_FRAME_MAGIC "\0LZ7"
+#define LZ77_FRAME_MAGIC_SIZE 4
+#define LZ77_FRAME_VERSION 1
+#define LZ77_FRAME_VERSION_WINDOW 2
+#define LZ77_FRAME_HEADER_SIZE 8
+#define LZ77_FRAME_PREFIX_SIZE 8
+#define LZ77_FLAG_CHAINED 0x01
+#define LZ77_FLAG_SEEK_TABLE 0x02
+#define LZ77_FLAG_ENTROPY 0x04
+#define LZ77_FLAG_SEQUENCES 0x08
+#define LZ77_FLAG_DICT 0x10
+#define LZ77_FLAG_CHECKSUM 0x20
+#define LZ77_FLAG_ALL (0x0F | LZ77_FLAG_CHECKSUM)
+#define LZ77_FRAME_CHECKSUM_SIZE 4
+#define LZ77_CONTENT_CHECKSUM_SIZE 8
+#define LZ77_DICT_ID_SIZE 4
+#define LZ77_SEEK_MAGIC "LZ7S"
+// Архив с дедупликацией (lz77_dedup.c) тоже начинается с нулевого байта, но распаковывается
+// только вместе со своим хранилищем фрагментов
+#define LZ77_DEDUP_MAGIC "\0LZD"
+#define LZ77_SEEK_ENTRY_SIZE 24
+#define LZ77_SEEK_FOOTER_SIZE 8
+#define LZ77_MIN_FRAME_LOG 16
+#define LZ77_MAX_FRAME_LOG 30
+#define LZ77_DEFAULT_FRAME_LOG 20
+
+// Максимальная длина литерала в одном заголовке (15 бит)
+#define LZ77_MAX_LITERAL_CHUNK (MAX_COPY - 1)
+
+static inline uint32_t read_le32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline void write_le32(uint8_t *p, uint32_t v)
+{
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    p[2] = (v >> 16) & 0xFF;
+    p[3] = (v >> 24) & 0xFF;
+}
+
+static inline uint64_t read_le64(const uint8_t *p)
+{
+    return (uint64_t)read_le32(p) | (uint64_t)read_le32(p + 4) << 32;
+}
+
+static inline void write_le64(uint8_t *p, uint64_t v)
+{
+    write_le32(p, (uint32_t)v);
+    write_le32(p + 4, (uint32_t)(v >> 32));
+}
+
+static inline uint32_t read24(const uint8_t *p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16;
+}
+
+// Формат блоков фрейма
+#define LZ77_BLOCK_VARINT 0x01  // Дистанции в токенах совпадений записаны varint
+#define LZ77_BLOCK_ENTROPY 0x02 // Блок начинается с байта типа
+#define LZ77_BLOCK_SEQUENCES 0x04 // Токены — упакованные последовательности
+// Типы блоков при LZ77_BLOCK_ENTROPY
+#define LZ77_BLOCK_TYPE_TOKENS 0
+#define LZ77_BLOCK_TYPE_HUFFMAN 1
+#define LZ77_BLOCK_TYPE_STORED 2 // Исходные байты блока как есть
+
+// Разобранный заголовок контейнера
+typedef struct {
+    int flags;
+    size_t frame_size;
+    size_t window; // Наибольшая дистанция совпадения
+    int format;    // LZ77_BLOCK_*
+    size_t check_size; // Байт суммы в конце токенов фрейма: 0 или LZ77_FRAME_CHECKSUM_SIZE
+    size_t tail_size;  // Байт за концом контейнера до таблицы поиска: сумма содержимого или 0
+} lz77_frame_info;
+
+// xxHash64 от data с начальным значением seed
+uint64_t lz77_xxh64(const void *data, size_t len, uint64_t seed);
+
+// Генератор splitmix64 для таблиц gear: одна и та же таблица при каждом запуске
+static inline uint64_t lz77_splitmix64(uint64_t *state)
+{
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// Следующее значение суммы содержимого (начальное — 0) после фрейма с полной суммой frame
+static inline uint64_t lz77_content_checksum(uint64_t content, uint64_t frame)
+{
+    uint8_t bytes[8];
+    write_le64(bytes, frame);
+    return lz77_xxh64(bytes, sizeof(bytes), content);
+}
+
+// Телеметрия и лог. Сборка с LZ77_METRICS=0 убирает счётчики и таймеры, LZ77_LOG_MAX —
+// сообщения подробнее заданного уровня; порог внутри него задаёт lz77_set_log_level.
+#ifndef LZ77_METRICS
+#define LZ77_METRICS 1
+#endif
+#ifndef LZ77_LOG_MAX
+#define LZ77_LOG_MAX LZ77_LOG_DEBUG
+#endif
+
+extern int lz77_log_level;
+#define LZ77_LOG_ON(log, level) ((log) && (level) <= LZ77_LOG_MAX && (level) <= lz77_log_level)
+
+uint64_t lz77_now_ns(void);
+void lz77_metrics_add(lz77_metrics *dst, const lz77_metrics *src);
+// Сводка одной строкой "[INFO] Metrics: {...}" при уровне LZ77_LOG_INFO
+void lz77_metrics_log(const lz77_metrics *metrics, FILE *log);
+
+static inline unsigned metrics_bucket(uint64_t v)
+{
+    unsigned k = v ? 64 - __builtin_clzll(v) : 0;
+    return k < LZ77_METRICS_BUCKETS ? k : LZ77_METRICS_BUCKETS - 1;
+}
+
+static inline void metrics_literals(lz77_metrics *mt, size_t len)
+{
+#if LZ77_METRICS
+    mt->literals += len;
+    mt->literal_runs += len != 0;
+    mt->literal_run[metrics_bucket(len)]++;
+#else
+    (void)mt, (void)len;
+#endif
+}
+
+static inline void metrics_match(lz77_metrics *mt, size_t len, size_t dist)
+{
+#if LZ77_METRICS
+    mt->matches++;
+    mt->match_bytes += len;
+    mt->match_len[metrics_bucket(len)]++;
+    mt->distance[metrics_bucket(dist)]++;
+#else
+    (void)mt, (void)len, (void)dist;
+#endif
+}
+
+static inline void metrics_block(lz77_metrics *mt, size_t src_len, size_t size)
+{
+#if LZ77_METRICS
+    mt->bytes_in += src_len;
+    mt->bytes_out += size;
+    mt->blocks++;
+#else
+    (void)mt, (void)src_len, (void)size;
+#endif
+}
+
+// Отметка времени для metrics_phase; без телеметрии часы не читаются
+static inline uint64_t metrics_clock(void)
+{
+#if LZ77_METRICS
+    return lz77_now_ns();
+#else
+    return 0;
+#endif
+}
+
+// Время с отметки since прибавляется к фазе; возвращает новую отметку
+static inline uint64_t metrics_phase(lz77_metrics *mt, lz77_phase phase, uint64_t since)
+{
+#if LZ77_METRICS
+    uint64_t now = lz77_now_ns();
+    mt->phase_ns[phase] += now - since;
+    return now;
+#else
+    (void)mt, (void)phase, (void)since;
+    return 0;
+#endif
+}
+
+// Длина общего префикса a и b, не больше max_len; из каждого буфера читается не больше
+// max_len байт. Ядро (по байту, по 8 байт, SSE2, AVX2) выбирается при первом вызове по
+// возможностям процессора; переменная окружения LZ77_MATCH_KERNEL задаёт его явно.
+typedef size_t (*lz77_match_length_fn)(const uint8_t *a, const uint8_t *b, size_t max_len);
+extern lz77_match_length_fn lz77_match_length;
+// Имя выбранного ядра сравнения
+const char *lz77_match_kernel(void);
+
+// Запас за концом совпадения, который может перезаписать wild_copy_match
+#define WILD_COPY 16
+
+// Копирование совпадения словами по 8/16 байт с перехлёстом до WILD_COPY байт за op + len
+static inline void wild_copy_match(uint8_t *op, size_t dist, size_t len)
+{
+    // Для периода меньше 8 — ближайшее кратное ему расстояние не меньше 8
+    static const uint8_t short_period[8] = {0, 8, 8, 9, 8, 10, 12, 14};
+    const uint8_t *match = op - dist;
+    uint8_t *end = op + len;
+    if (dist < 8)
+    {
+        // Короткий период размножается побайтно на первые 8 байт, дальше источник отстоит
+        // на кратное периоду расстояние, и копировать можно целыми словами
+        for (int i = 0; i < 8; i++)
+            op[i] = match[i];
+        op += 8;
+        dist = short_period[dist];
+        match = op - dist;
+    }
+    if (dist < 16)
+    {
+        for (; op < end; op += 8, match += 8)
+            memcpy(op, match, 8);
+        return;
+    }
+    for (; op < end; op += 16, match += 16)
+        memcpy(op, match, 16);
+}
+
+// Копирование совпадения в op, за которым доступно room >= len байт. Без запаса WILD_COPY
+// широко копируется всё, кроме последних WILD_COPY байт, остаток — по байту.
+static inline void copy_match(uint8_t *op, size_t dist, size_t len, size_t room)
+{
+    if (len + WILD_COPY <= room)
+        wild_copy_match(op, dist, len);
+    else if (dist >= len)
+        memcpy(op, op - dist, len);
+    else
+    {
+        size_t i = 0;
+        if (len > WILD_COPY)
+            wild_copy_match(op, dist, i = len - WILD_COPY);
+        for (; i < len; i++)
+            op[i] = op[i - dist];
+    }
+}
+
+// Энтропийная ступень: токены блока раскладываются на литералы и последовательности
+// (ll[i] литералов, затем совпадение ml[i] байт на дистанции of[i]) и кодируются Хаффманом.
+// В прежнем формате next_char токена совпадения становится первым литералом следующей
+// последовательности.
+typedef struct {
+    uint8_t *tokens; // Токены блока до перекодирования
+    uint8_t *lits;
+    size_t nlit;
+    uint32_t *ll;
+    uint32_t *ml;
+    uint32_t *of;
+    size_t nseq;
+    size_t block_cap; // Под блок какого размера выделены буферы
+} lz77_entropy;
+
+lz77_entropy *lz77_entropy_create(void);
+void lz77_entropy_free(lz77_entropy *e);
+// Буферы под блок из src_len байт; 0 или -1
+int lz77_entropy_reserve(lz77_entropy *e, size_t src_len);
+// Кодирование литералов и последовательностей; возвращает размер или 0, если не влезло в dst_cap
+size_t lz77_entropy_encode(const lz77_entropy *e, uint8_t *dst, size_t dst_cap);
+// Распаковка энтропийного блока (без байта типа) в base[hist_len, hist_len + raw_len)
+int lz77_entropy_decode(const uint8_t *src, size_t src_len, uint8_t *base, size_t hist_len, size_t raw_len);
+
+// Способы поиска совпадений, выбираемые уровнем сжатия
+typedef enum
+{
+    LZ77_MF_FAST,   // Одна проба по хешу, как в LZ4
+    LZ77_MF_BUCKET, // 8 слотов на корзину с перезаписью по кругу, как в lz77_compress
+    LZ77_MF_CHAIN,  // Хеш-цепочки ограниченной глубины
+    LZ77_MF_BT      // Двоичное дерево суффиксов
+} lz77_mf_kind;
+
+// Дальние совпадения: разреженный индекс по скользящему хешу gear (последние
+// LZ77_LDM_MIN_MATCH байт) на всё дальнее окно. Индекс живёт между блоками, позиции в нём
+// абсолютные от начала потока. Найденные совпадения ставятся в блок раньше обычного поиска.
+#define LZ77_LDM_MIN_MATCH 64
+#define LZ77_LDM_BUCKET 4
+#define LZ77_LDM_MIN_RATE_LOG 4
+
+typedef struct {
+    size_t start; // Позиция в base
+    size_t dist;
+    size_t len;
+} lz77_ldm_match;
+
+typedef struct lz77_ldm lz77_ldm;
+
+lz77_ldm *lz77_ldm_create(int ldm_log, int mem_log);
+void lz77_ldm_free(lz77_ldm *ldm);
+// Данные в буфере сдвинулись к его началу на shift байт
+void lz77_ldm_slide(lz77_ldm *ldm, size_t shift);
+// Поиск дальних совпадений в base[hist_len, end) с пополнением индекса. Совпадения не
+// пересекаются и идут по возрастанию start; массив принадлежит индексу до следующего вызова.
+size_t lz77_ldm_find(lz77_ldm *ldm, const uint8_t *base, size_t hist_len, size_t end, const lz77_ldm_match **matches);
+
+#define LZ77_FAST_HASH_LOG 14
+#define LZ77_CHAIN_HASH_LOG 15
+
+// Состояние поиска совпадений. Позиции абсолютные (от начала блока с историей),
+// поэтому кольцо не нужно. В head и links хранится позиция + 1, 0 — пусто.
+typedef struct {
+    int level;
+    lz77_mf_kind kind;
+    uint32_t depth;    // Сколько кандидатов смотреть на позицию
+    uint32_t good_len; // Длина, после которой поиск прекращается
+    uint32_t skip_log; // LZ4-ускорение шага после промахов (0 — выключено)
+    int lazy;          // Глубина ленивого разбора: 0 — жадный, 1-2 — просмотр вперёд
+    int varint;        // Дистанции записываются varint (окно больше SEARCH_BUFFER_SIZE)
+    int sequences;     // Упакованные последовательности вместо токенов с next_char
+    int entropy_priced;     // Цены разбора блока по кодам Хаффмана, а не по байтам токенов
+    uint32_t literal_price; // Цена литерала на текущем участке в 1/16 бита (см. lz77_block.c)
+    size_t window;
+    uint32_t (*bucket)[MAX_MATCH_INDICES];
+    uint8_t *cursor;
+    uint32_t *head;
+    size_t head_mask;
+    uint32_t *links;   // Цепочки: prev[pos]; дерево: пары потомков
+    size_t links_mask;
+    lz77_ldm *ldm;     // Дальние совпадения, NULL — выключены
+    lz77_entropy *entropy; // Энтропийная ступень, NULL — токены пишутся как есть
+    lz77_metrics metrics;  // Телеметрия блоков, сжатых этим сопоставителем
+    size_t primed;     // История следующего блока уже в таблицах (снимок словаря), 0 — нет
+    int follows;       // Следующий блок продолжит таблицы: его история — данные, сжатые до него
+    int indexed;       // Таблицы прошлого блока можно продолжить (он прошёл поиск при follows)
+    size_t offset;     // Сдвиг позиций текущего блока в таблицах — его поколение
+    size_t limit;      // Конец позиций последнего блока со сдвигом
+    uint32_t miss_streak; // Блоков подряд, не сжавшихся после полного поиска
+    uint32_t skip_search; // Сколько следующих блоков сжимать без поиска
+} lz77_matcher;
+
+// lazy < 0 — глубина ленивого разбора по умолчанию для уровня;
+// window_log 0 — прежнее окно SEARCH_BUFFER_SIZE с 15-битными дистанциями
+lz77_matcher *lz77_matcher_create(int level, int lazy, int window_log);
+void lz77_matcher_free(lz77_matcher *m);
+// Включение дальних совпадений; история блоков тогда должна идти подряд по потоку
+int lz77_matcher_enable_ldm(lz77_matcher *m, int ldm_log, int mem_log);
+// Блоки начинаются с байта типа и при выигрыше кодируются Хаффманом (LZ77_BLOCK_ENTROPY)
+int lz77_matcher_enable_entropy(lz77_matcher *m);
+// Сброс таблиц и вставка истории base[0, hist_len), как перед сжатием блока
+void lz77_matcher_prime(lz77_matcher *m, const uint8_t *base, size_t hist_len);
+// Копия таблиц src, подготовленных lz77_matcher_prime для hist_len байт, в dst того же уровня
+// и окна: следующий блок dst с той же историей не вставляет её заново
+void lz77_matcher_copy_tables(lz77_matcher *dst, const lz77_matcher *src, size_t hist_len);
+
+// Загруженный словарь: содержимое и сопоставитель с уже вставленным словарём
+struct lz77_dict {
+    uint8_t *content;
+    size_t len;
+    uint32_t id;
+    lz77_matcher *snapshot;
+};
+
+// Рабочее состояние одного потока: таблицы, в которые копируется снимок, и буфер
+// [словарь | первый фрейм], в котором сжимается и распаковывается первый фрейм сообщения
+struct lz77_dict_ctx {
+    const lz77_dict *dict;
+    lz77_matcher *matcher;
+    uint8_t *scratch;
+    size_t scratch_cap;
+};
+
+// Окно сжатия со словарём: словарь целиком в досягаемости дистанций
+#define LZ77_DICT_WINDOW_LOG LZ77_MIN_WINDOW_LOG
+
+// Буфер контекста под [словарь | frame_len байт]; NULL при нехватке памяти
+uint8_t *lz77_dict_scratch(lz77_dict_ctx *ctx, size_t frame_len);
+
+// Верхняя граница размера сжатого блока из src_len байт; годится и для токенов старого
+// потокового формата — они те же, только без байта типа
+size_t lz77_block_bound(size_t src_len);
+
+// Запись токенов без проверок: место под них резервирует вызывающий по lz77_block_bound.
+// Дистанция — два байта старого формата или varint (см. lz77_block.c).
+static inline uint8_t *emit_distance(uint8_t *op, size_t dist, int varint)
+{
+    if (!varint)
+    {
+        *op++ = (dist & 0x7F) << 1;
+        *op++ = dist >> 7;
+        return op;
+    }
+    *op++ = (dist & 0x3F) << 2 | (dist > 0x3F) << 1;
+    for (dist >>= 6; dist; dist >>= 7)
+        *op++ = (dist & 0x7F) | (dist > 0x7F) << 7;
+    return op;
+}
+
+// Литералы кусками не длиннее LZ77_MAX_LITERAL_CHUNK, у каждого двухбайтовый заголовок
+static inline uint8_t *emit_literals(uint8_t *op, const uint8_t *src, size_t len)
+{
+    while (len)
+    {
+        size_t chunk = len < LZ77_MAX_LITERAL_CHUNK ? len : LZ77_MAX_LITERAL_CHUNK;
+        *op++ = (chunk & 0x7F) << 1 | 1;
+        *op++ = (chunk >> 7) & 0xFF;
+        memcpy(op, src, chunk);
+        op += chunk;
+        src += chunk;
+        len -= chunk;
+    }
+    return op;
+}
+
+#if SEARCH_BUFFER_SIZE > 0xffff
+#error "Окно поиска не помещается в 16 бит хеш-таблицы"
+#endif
+
+// Хеш-таблица старого кодера (lz77.c). Позиции хранятся младшими 16 битами: окно поиска меньше
+// 65536, и дистанция восстанавливается по модулю. Корзина из MAX_MATCH_INDICES позиций занимает
+// 16 байт и не пересекает строку кеша, а вся таблица — 128 КБ вместо 256. Поиск читает только
+// корзину; курсоры нужны лишь вставке и лежат отдельно плотным массивом в 8 КБ, который обычно
+// остаётся в L1.
+typedef struct {
+    uint16_t bucket[HASH_TABLE_SIZE][MAX_MATCH_INDICES];
+    uint8_t cursor[HASH_TABLE_SIZE];
+} lz77_legacy_table;
+
+// Корзина по первым трём байтам позиции
+static inline uint32_t lz77_legacy_hash(const uint8_t *ctx)
+{
+    uint32_t v;
+    memcpy(&v, ctx, sizeof(v));
+    return ((v & 0x00ffffff) * 2654435769u) >> (32 - HASH_LOG) & HASH_MASK;
+}
+
+// Вставка позиции pos в корзину ihash. Предвыборки корзины впереди здесь нет: второй хеш на
+// каждую вставку на реальных файлах стоил больше, чем экономил на промахах (таблица 128 КБ)
+static inline void lz77_legacy_insert(lz77_legacy_table *table, size_t pos, uint32_t ihash)
+{
+    table->bucket[ihash][table->cursor[ihash]++ & (MAX_MATCH_INDICES - 1)] = (uint16_t)pos;
+}
+
+// Перебор кандидатов корзины ihash для src + pos по плоскому входу: позиции в таблице —
+// младшие 16 бит смещения, дистанция восстанавливается по модулю 65536 и не дальше
+// SEARCH_BUFFER_SIZE; совпадение не длиннее дистанции и max_len. Возвращает длину лучшего
+// совпадения (меньше MIN_MATCH_LENGTH — нет) и его дистанцию в *dist.
+static inline size_t lz77_legacy_search(const lz77_legacy_table *table, uint32_t ihash, const uint8_t *src, size_t pos,
+                                        size_t max_len, size_t *dist)
+{
+    const uint16_t *bucket = table->bucket[ihash];
+    size_t best = MIN_MATCH_LENGTH - 1;
+    for (uint32_t i = 0; i < MAX_MATCH_INDICES; i++)
+    {
+        size_t distance = (uint16_t)(pos - bucket[i]);
+        if (distance < MIN_MATCH_LENGTH || distance > SEARCH_BUFFER_SIZE || distance > pos)
+            continue;
+        size_t j = lz77_match_length(src + pos, src + pos - distance, distance < max_len ? distance : max_len);
+        if (j > best)
+        {
+            best = j;
+            *dist = distance;
+        }
+    }
+    return best;
+}
+
+// Приёмник токенов: кодер пишет в блок памяти напрямую через emit_*, заранее резервируя
+// место под худший размер порции, и полный блок уходит одной записью в write. Цель задаёт
+// write: файл (lz77_file_write), конвейер на файл или канал (lz77_io_write) и т. п.; без write
+// блок — буфер вызывающего, и нехватка места в нём — ошибка.
+typedef struct {
+    uint8_t *buf;
+    uint8_t *op; // Курсор записи: вызывающий сдвигает его сам после записи в резерв
+    uint8_t *end;
+    lz77_write_fn write;
+    void *opaque;
+    int owned;   // buf выделен приёмником
+} lz77_sink;
+
+// buf NULL — блок из cap байт выделяется здесь; -1 при нехватке памяти
+int lz77_sink_init(lz77_sink *sink, void *buf, size_t cap, lz77_write_fn write, void *opaque);
+// Отдаёт накопленное в write; без write — ничего не делает
+int lz77_sink_flush(lz77_sink *sink);
+void lz77_sink_free(lz77_sink *sink);
+// Медленный путь lz77_sink_reserve
+uint8_t *lz77_sink_drain(lz77_sink *sink, size_t n);
+
+// Курсор, за которым свободно не меньше n байт; при нехватке блок сливается в write.
+// NULL — ошибка записи, n больше блока или буфер вызывающего кончился.
+static inline uint8_t *lz77_sink_reserve(lz77_sink *sink, size_t n)
+{
+    return (size_t)(sink->end - sink->op) >= n ? sink->op : lz77_sink_drain(sink, n);
+}
+
+// Проба сжимаемости блока по выборке из него (см. lz77_block.c)
+#define LZ77_PROBE_COMPRESSIBLE 0 // Стоит искать совпадения
+#define LZ77_PROBE_LITERALS 1     // Повторов нет, но байты распределены неравномерно
+#define LZ77_PROBE_RANDOM 2       // Ни повторов, ни выигрыша от кодов Хаффмана
+int lz77_probe_block(const uint8_t *src, size_t len);
+
+// Сжатие блока base[hist_len, hist_len + src_len) в dst. Байты base[0, hist_len)
+// служат историей (хвост предыдущего фрейма). Возвращает размер или 0 при нехватке места.
+// С энтропийной ступенью блок начинается с байта типа.
+size_t lz77_block_compress(lz77_matcher *m, const uint8_t *base, size_t hist_len, size_t src_len,
+                           uint8_t *dst, size_t dst_cap);
+
+// Разбор токенов из [*ip, iend) в [*op, oend); дистанции отсчитываются назад не дальше base.
+// Останавливается на неполном токене или токене, не влезающем в выход, сдвигая *ip и *op
+// за разобранное. varint — формат дистанций, как в lz77_frame_info. Возвращает 0 или -1 для
+// повреждённых данных.
+int lz77_decode_tokens(const uint8_t **ip, const uint8_t *iend, uint8_t **op, uint8_t *oend, const uint8_t *base,
+                       int varint);
+
+// Распаковка блока в base[hist_len, hist_len + raw_len); format — LZ77_BLOCK_* из заголовка.
+// Возвращает 0 или -1 при ошибке.
+int lz77_block_decompress(const uint8_t *src, size_t src_len, uint8_t *base, size_t hist_len, size_t raw_len,
+                          int format);
+
+// Буфер [история | новые данные] для сцепленных фреймов. История сдвигается к началу, только
+// когда следующий фрейм не помещается, так что большое окно не копируется на каждом фрейме.
+typedef struct {
+    uint8_t *buf;
+    size_t cap;
+    size_t hist_cap; // Сколько истории сохраняет сдвиг; 0 — фреймы независимы
+    size_t len;      // Занято байт; len может превышать hist_cap до ближайшего сдвига
+} lz77_window;
+
+int lz77_window_init(lz77_window *w, size_t hist_cap, size_t frame_size);
+void lz77_window_free(lz77_window *w);
+// Освобождение места под need байт за buf + len; возвращает, на сколько сдвинулись данные
+size_t lz77_window_reserve(lz77_window *w, size_t need);
+// Учёт n байт, записанных за buf + len
+void lz77_window_commit(lz77_window *w, size_t n);
+
+// Пул рабочих потоков
+typedef struct lz77_task {
+    void (*fn)(void *arg, int worker);
+    void *arg;
+    int done;
+    struct lz77_task *next;
+} lz77_task;
+
+typedef struct lz77_pool lz77_pool;
+
+// При threads <= 1 потоки не создаются и задачи выполняются сразу в lz77_pool_submit
+lz77_pool *lz77_pool_create(int threads);
+// Число рабочих мест (индексов worker), не меньше 1
+int lz77_pool_size(const lz77_pool *pool);
+void lz77_pool_submit(lz77_pool *pool, lz77_task *task);
+void lz77_pool_wait(lz77_pool *pool, lz77_task *task);
+void lz77_pool_destroy(lz77_pool *pool);
+
+// Запись таблицы поиска: смещения отсчитываются от начала контейнера
+typedef struct {
+    uint64_t c_offset; // Смещение префикса фрейма
+    uint32_t c_size;   // Размер токенов фрейма без префикса
+    uint64_t u_offset; // Смещение данных фрейма в распакованном файле
+    uint32_t u_size;
+} lz77_seek_entry;
+
+// Таблица поиска, накапливаемая при сжатии
+typedef struct {
+    lz77_seek_entry *entries;
+    size_t count;
+    size_t cap;
+    uint64_t c_offset;
+    uint64_t u_offset;
+} lz77_seek_builder;
+
+#define LZ77_SEEK_BUILDER_INIT {NULL, 0, 0, LZ77_FRAME_HEADER_SIZE, 0}
+
+// Учёт записанного фрейма; -1 при нехватке памяти
+int lz77_seek_add(lz77_seek_builder *seek, size_t c_size, size_t u_size);
+// Запись таблицы с подвалом в приёмник
+int lz77_seek_write(const lz77_seek_builder *seek, lz77_write_fn write, void *opaque);
+
+// Сумма данных фрейма data[0, raw_len) дописывается в dst; возвращает полную сумму
+uint64_t lz77_frame_checksum(const uint8_t *data, size_t raw_len, uint8_t dst[LZ77_FRAME_CHECKSUM_SIZE]);
+// Распаковка токенов фрейма src[0, csize) в base[hist_len, hist_len + raw_len) со сверкой суммы,
+// если она есть; *checksum — полная сумма фрейма или 0. Возвращает 0 или -1 при повреждении.
+int lz77_frame_decode(const uint8_t *src, size_t csize, uint8_t *base, size_t hist_len, size_t raw_len,
+                      const lz77_frame_info *info, uint64_t *checksum);
+// Запись суммы содержимого после конца контейнера
+int lz77_content_checksum_write(uint64_t content, lz77_write_fn write, void *opaque);
+
+// Заполнение заголовка контейнера; window_log 0 — заголовок версии 1
+void lz77_frame_header(uint8_t header[LZ77_FRAME_HEADER_SIZE], int flags, int frame_log, int window_log);
+// Проверка заголовка контейнера и разбор его полей; 0 или -1 для неподдерживаемого заголовка
+int lz77_frame_parse(const uint8_t header[LZ77_FRAME_HEADER_SIZE], lz77_frame_info *info);
+
+// Приёмник поверх FILE*, opaque — сам поток
+int lz77_file_write(void *opaque, const void *data, size_t len);
+
+// Чтение ровно len байт, если поток не кончится раньше; возвращает прочитанное
+size_t lz77_read_full(FILE *input, uint8_t *dst, size_t len);
+
+// Конвейер ввода-вывода (lz77_io.c): чтение вперёд и запись позади большими буферами, пока
+// кодек занят своим. Между открытием и закрытием файл трогает только конвейер. Закрытие
+// читателя ставит позицию позиционируемого файла сразу за отданными кодеку байтами.
+typedef enum
+{
+    LZ77_IO_SYNC,   // Прямо через stdio: глубина 0, терминал или нехватка ресурсов
+    LZ77_IO_THREAD, // Отдельный поток с fread/fwrite
+    LZ77_IO_URING   // io_uring по смещениям, только обычные файлы
+} lz77_io_backend;
+
+typedef struct lz77_io lz77_io;
+
+// NULL только при нехватке памяти
+lz77_io *lz77_io_reader(FILE *input);
+lz77_io *lz77_io_writer(FILE *output);
+// Как lz77_read_full: меньше len байт — конец или ошибка (lz77_io_error)
+size_t lz77_io_read(lz77_io *io, void *dst, size_t len);
+// Приёмник lz77_write_fn, opaque — конвейер; ошибка записи всплывает здесь же позже или в close
+int lz77_io_write(void *opaque, const void *data, size_t len);
+int lz77_io_error(lz77_io *io);
+// Дописывает и освобождает; -1, если была ошибка ввода-вывода
+int lz77_io_close(lz77_io *io);
+const char *lz77_io_backend_name(const lz77_io *io);
+
+// Отображение обычного файла в память (lz77_io.c): кодек работает прямо со страницами файла,
+// без копий в буферы. Вход отображается с текущей позиции до конца, выход — заданной длины с
+// текущей позиции и с заранее выделенным местом. -1 — отображение невозможно (не обычный файл,
+// пустой вход, файл выхода без чтения, LZ77_IO_BACKEND в окружении), и кодек идёт через
+// конвейер lz77_io. Между открытием и закрытием файл трогает только отображение.
+typedef struct {
+    uint8_t *data;    // Байт файла на позиции открытия
+    size_t len;
+    FILE *file;
+    int writer;
+    long long start;  // Позиция файла при открытии
+    void *base;       // Отображение, выровненное на страницу
+    size_t map_len;
+} lz77_map;
+
+int lz77_map_input(lz77_map *map, FILE *input);
+int lz77_map_output(lz77_map *map, FILE *output, uint64_t len);
+// Снимает отображение и ставит позицию файла за его конец; discard у выхода обрезает файл до
+// позиции открытия. -1 при ошибке
+int lz77_map_close(lz77_map *map, int discard);
+
+// Последовательная распаковка контейнера; магия уже прочитана из input
+int lz77_frame_decompress(FILE *input, FILE *output, FILE *log);
+
+// Проверка заголовка контейнера со смещения start и поиск таблицы фреймов в конце input
+int lz77_seek_open(FILE *input, long long start, uint8_t header[LZ77_FRAME_HEADER_SIZE],
+                   long long *table_pos, size_t *count);
+// Чтение одной записи таблицы без загрузки всей таблицы
+int lz77_seek_entry_read(FILE *input, long long table_pos, size_t index, lz77_seek_entry *entry);
+
+// Чтение заголовка и таблицы поиска контейнера, начинающегося в input со смещения start.
+// Возвращает 0 и флаги заголовка либо -1, если таблицы нет или она повреждена.
+int lz77_read_seek_table(FILE *input, long long start, uint8_t header[LZ77_FRAME_HEADER_SIZE],
+                         lz77_seek_entry **entries, size_t *count);
+
+#endif
@@ -0,0 +1,632 @@
+// syscall() и флаги io_uring объявлены только с расширениями GNU
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "lz77_internal.h"
+
+#if defined(__linux__) && !defined(LZ77_NO_URING) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define LZ77_HAVE_URING 1
+#endif
+#endif
+#endif
+
+// Конвейер держит depth буферов по LZ77_IO_BUFFER_SIZE: пока кодек работает с одним, остальные
+// читаются вперёд или пишутся позади. Буферы ходят по кругу строго по порядку, так что
+// порядок байт сохраняется без нумерации.
+#define LZ77_IO_BUFFER_SIZE ((size_t)1 << 20)
+
+enum
+{
+    SLOT_FREE,  // Читателю — ждёт чтения, писателю — заполняется кодеком
+    SLOT_BUSY,  // Операция в полёте
+    SLOT_READY  // Читателю — данные готовы
+};
+
+typedef struct {
+    uint8_t *buf;
+    size_t len;       // Прочитано или к записи
+    int state;
+    struct iovec iov; // Ядро читает его и после отправки, пока операция не завершена
+} io_slot;
+
+#ifdef LZ77_HAVE_URING
+typedef struct {
+    int fd;
+    unsigned *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_map, *cq_map;
+    size_t sq_map_len, cq_map_len, sqes_len;
+} io_ring;
+#endif
+
+struct lz77_io {
+    FILE *file;
+    int writer;
+    lz77_io_backend backend;
+    io_slot slots[LZ77_IO_MAX_DEPTH];
+    int depth;
+    int cur;            // Слот, с которым работает кодек
+    size_t pos;         // Читатель: отдано кодеку из текущего слота
+    int error;
+    long long start;    // Позиция файла при открытии; -1 — файл не позиционируется
+    uint64_t processed; // Байт, отданных кодеку или принятых от него
+    // Поток: читает или пишет слоты по кругу, состояние слотов меняется под lock
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    int stop;
+#ifdef LZ77_HAVE_URING
+    io_ring ring;
+    long long offset;   // Смещение следующей отправляемой операции
+    unsigned inflight;
+    int eof;            // Короткое чтение уже было, дальше читать нечего
+#endif
+};
+
+static int io_depth = LZ77_IO_DEFAULT_DEPTH;
+
+void lz77_set_io_depth(int depth)
+{
+    io_depth = depth < 0 ? 0 : depth > LZ77_IO_MAX_DEPTH ? LZ77_IO_MAX_DEPTH : depth;
+}
+
+const char *lz77_io_backend_name(const lz77_io *io)
+{
+    static const char *names[] = {"sync", "thread", "uring"};
+    return names[io->backend];
+}
+
+#ifdef LZ77_HAVE_URING
+// Кольца io_uring без liburing: очереди заявок и завершений отображаются из ядра, хвост заявок
+// и голова завершений двигаются с барьерами release/acquire
+static int ring_init(io_ring *r, unsigned entries)
+{
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    memset(r, 0, sizeof(*r));
+    r->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (r->fd < 0)
+        return -1;
+    r->sq_map_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_map_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    int single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single && r->cq_map_len > r->sq_map_len)
+        r->sq_map_len = r->cq_map_len;
+    r->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+
+    r->sq_map = mmap(NULL, r->sq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED, r->fd, IORING_OFF_SQ_RING);
+    r->cq_map = single || r->sq_map == MAP_FAILED
+                    ? r->sq_map
+                    : mmap(NULL, r->cq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED, r->fd, IORING_OFF_CQ_RING);
+    r->sqes = r->cq_map == MAP_FAILED
+                  ? MAP_FAILED
+                  : mmap(NULL, r->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED, r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED)
+    {
+        if (r->cq_map != MAP_FAILED && r->cq_map != r->sq_map)
+            munmap(r->cq_map, r->cq_map_len);
+        if (r->sq_map != MAP_FAILED)
+            munmap(r->sq_map, r->sq_map_len);
+        close(r->fd);
+        return -1;
+    }
+    uint8_t *sq = r->sq_map, *cq = r->cq_map;
+    r->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    r->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned *)(sq + p.sq_off.array);
+    r->cq_head = (unsigned *)(cq + p.cq_off.head);
+    r->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    r->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return 0;
+}
+
+static void ring_free(io_ring *r)
+{
+    munmap(r->sqes, r->sqes_len);
+    if (r->cq_map != r->sq_map)
+        munmap(r->cq_map, r->cq_map_len);
+    munmap(r->sq_map, r->sq_map_len);
+    close(r->fd);
+}
+
+// Чтение целого буфера или запись заполненной части слота по следующему смещению.
+// READV/WRITEV вместо READ/WRITE есть в любом ядре с io_uring (с 5.1).
+static int ring_submit(lz77_io *io, int slot)
+{
+    io_ring *r = &io->ring;
+    io_slot *s = &io->slots[slot];
+    unsigned tail = *r->sq_tail;
+    unsigned idx = tail & *r->sq_mask;
+    struct io_uring_sqe *sqe = &r->sqes[idx];
+
+    s->iov.iov_base = s->buf;
+    s->iov.iov_len = io->writer ? s->len : LZ77_IO_BUFFER_SIZE;
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = io->writer ? IORING_OP_WRITEV : IORING_OP_READV;
+    sqe->fd = fileno(io->file);
+    sqe->addr = (uint64_t)(uintptr_t)&s->iov;
+    sqe->len = 1;
+    sqe->off = io->offset;
+    sqe->user_data = slot;
+    r->sq_array[idx] = idx;
+    __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    long n;
+    while ((n = syscall(__NR_io_uring_enter, r->fd, 1, 0, 0, NULL, 0)) < 0 && (errno == EINTR || errno == EAGAIN))
+        ;
+    if (n != 1)
+        return -1;
+    io->offset += s->iov.iov_len;
+    io->inflight++;
+    s->state = SLOT_BUSY;
+    return 0;
+}
+
+// Ожидание и разбор одного завершения. Короткое чтение обычного файла бывает только в конце,
+// поэтому после него новые чтения не отправляются; короткая запись — ошибка.
+static int ring_reap(lz77_io *io)
+{
+    io_ring *r = &io->ring;
+    unsigned head = *r->cq_head;
+    while (head == __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE))
+        if (syscall(__NR_io_uring_enter, r->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 &&
+            errno != EINTR && errno != EAGAIN)
+            return -1;
+    struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+    io_slot *s = &io->slots[cqe->user_data];
+    int res = cqe->res;
+    __atomic_store_n(r->cq_head, head + 1, __ATOMIC_RELEASE);
+    io->inflight--;
+    if (io->writer)
+    {
+        if (res < 0 || (size_t)res != s->len)
+            io->error = 1;
+        s->len = 0;
+        s->state = SLOT_FREE;
+        return 0;
+    }
+    if (res < 0)
+        io->error = 1;
+    s->len = res > 0 ? (size_t)res : 0;
+    if (s->len < LZ77_IO_BUFFER_SIZE)
+        io->eof = 1;
+    s->state = SLOT_READY;
+    return 0;
+}
+#endif
+
+static void *reader_main(void *arg)
+{
+    lz77_io *io = arg;
+    for (int i = 0;; i = (i + 1) % io->depth)
+    {
+        io_slot *s = &io->slots[i];
+        pthread_mutex_lock(&io->lock);
+        while (s->state != SLOT_FREE && !io->stop)
+            pthread_cond_wait(&io->changed, &io->lock);
+        int stop = io->stop;
+        pthread_mutex_unlock(&io->lock);
+        if (stop)
+            break;
+
+        size_t n = fread(s->buf, 1, LZ77_IO_BUFFER_SIZE, io->file);
+        int error = n < LZ77_IO_BUFFER_SIZE && ferror(io->file);
+        pthread_mutex_lock(&io->lock);
+        s->len = n;
+        s->state = SLOT_READY;
+        io->error |= error;
+        pthread_cond_broadcast(&io->changed);
+        pthread_mutex_unlock(&io->lock);
+        if (n < LZ77_IO_BUFFER_SIZE)
+            break;
+    }
+    return NULL;
+}
+
+// Писатель пишет отправленные слоты по порядку; после stop доделывает уже отправленные
+static void *writer_main(void *arg)
+{
+    lz77_io *io = arg;
+    for (int i = 0;; i = (i + 1) % io->depth)
+    {
+        io_slot *s = &io->slots[i];
+        pthread_mutex_lock(&io->lock);
+        while (s->state != SLOT_BUSY && !io->stop)
+            pthread_cond_wait(&io->changed, &io->lock);
+        int busy = s->state == SLOT_BUSY;
+        pthread_mutex_unlock(&io->lock);
+        if (!busy)
+            break;
+
+        int error = fwrite(s->buf, 1, s->len, io->file) != s->len;
+        pthread_mutex_lock(&io->lock);
+        s->len = 0;
+        s->state = SLOT_FREE;
+        io->error |= error;
+        pthread_cond_broadcast(&io->changed);
+        pthread_mutex_unlock(&io->lock);
+    }
+    return NULL;
+}
+
+// Выбор механизма: io_uring для обычных файлов (операции по смещениям, без лишнего потока),
+// поток для каналов и терминалов нет — там чтение вперёд может ждать ввода, которого не будет.
+// LZ77_IO_BACKEND=sync|thread|uring из окружения задаёт механизм явно (для замеров) и заодно
+// отключает отображение файлов в память (lz77_map_*).
+static lz77_io *io_open(FILE *file, int writer)
+{
+    lz77_io *io = calloc(1, sizeof(lz77_io));
+    if (!io)
+        return NULL;
+    io->file = file;
+    io->writer = writer;
+    io->depth = io_depth;
+    io->start = -1;
+
+    const char *forced = getenv("LZ77_IO_BACKEND");
+    struct stat st;
+    int fd = fileno(file);
+    if (io->depth < 2 || (forced && strcmp(forced, "sync") == 0) || fd < 0 || isatty(fd) || fstat(fd, &st) != 0)
+        return io;
+    uint8_t *buffers = malloc(io->depth * LZ77_IO_BUFFER_SIZE);
+    if (!buffers)
+        return io;
+    for (int i = 0; i < io->depth; i++)
+        io->slots[i].buf = buffers + i * LZ77_IO_BUFFER_SIZE;
+    // Прежние буферизованные данные stdio уходят раньше наших
+    if (writer && fflush(file) != 0)
+        io->error = 1;
+    io->start = ftello(file);
+
+#ifdef LZ77_HAVE_URING
+    int append = writer && (fcntl(fd, F_GETFL) & O_APPEND);
+    if (S_ISREG(st.st_mode) && io->start >= 0 && !append && !(forced && strcmp(forced, "thread") == 0) &&
+        ring_init(&io->ring, io->depth) == 0)
+    {
+        io->backend = LZ77_IO_URING;
+        io->offset = io->start;
+        for (int i = 0; !writer && i < io->depth; i++)
+            if (ring_submit(io, i) != 0)
+            {
+                io->error = 1;
+                break;
+            }
+        return io;
+    }
+#endif
+    pthread_mutex_init(&io->lock, NULL);
+    pthread_cond_init(&io->changed, NULL);
+    if (pthread_create(&io->thread, NULL, writer ? writer_main : reader_main, io) != 0)
+    {
+        pthread_mutex_destroy(&io->lock);
+        pthread_cond_destroy(&io->changed);
+        free(buffers);
+        io->slots[0].buf = NULL;
+        return io;
+    }
+    io->backend = LZ77_IO_THREAD;
+    return io;
+}
+
+lz77_io *lz77_io_reader(FILE *input)
+{
+    return io_open(input, 0);
+}
+
+lz77_io *lz77_io_writer(FILE *output)
+{
+    return io_open(output, 1);
+}
+
+int lz77_io_error(lz77_io *io)
+{
+    if (io->backend != LZ77_IO_THREAD)
+        return io->error;
+    pthread_mutex_lock(&io->lock);
+    int error = io->error;
+    pthread_mutex_unlock(&io->lock);
+    return error;
+}
+
+// Ожидание готовности текущего слота читателя
+static int slot_wait_ready(lz77_io *io, io_slot *s)
+{
+#ifdef LZ77_HAVE_URING
+    if (io->backend == LZ77_IO_URING)
+    {
+        while (s->state != SLOT_READY)
+            if (ring_reap(io) != 0)
+            {
+                io->error = 1;
+                return -1;
+            }
+        return 0;
+    }
+#endif
+    pthread_mutex_lock(&io->lock);
+    while (s->state != SLOT_READY)
+        pthread_cond_wait(&io->changed, &io->lock);
+    pthread_mutex_unlock(&io->lock);
+    return 0;
+}
+
+size_t lz77_io_read(lz77_io *io, void *dst, size_t len)
+{
+    if (io->backend == LZ77_IO_SYNC)
+    {
+        size_t n = lz77_read_full(io->file, dst, len);
+        if (n < len && ferror(io->file))
+            io->error = 1;
+        io->processed += n;
+        return n;
+    }
+    uint8_t *out = dst;
+    size_t total = 0;
+    while (total < len)
+    {
+        io_slot *s = &io->slots[io->cur];
+        if (slot_wait_ready(io, s) != 0)
+            break;
+        size_t n = s->len - io->pos < len - total ? s->len - io->pos : len - total;
+        memcpy(out + total, s->buf + io->pos, n);
+        io->pos += n;
+        total += n;
+        // Запрос выполнен внутри слота, или слот неполный — последний: он остаётся на месте,
+        // и дальше чтение отдаёт 0
+        if (io->pos < LZ77_IO_BUFFER_SIZE)
+            break;
+        io->pos = 0;
+        io->cur = (io->cur + 1) % io->depth;
+#ifdef LZ77_HAVE_URING
+        if (io->backend == LZ77_IO_URING)
+        {
+            s->state = SLOT_FREE;
+            if (!io->eof && ring_submit(io, s - io->slots) != 0)
+            {
+                io->error = 1;
+                break;
+            }
+            continue;
+        }
+#endif
+        // Ошибка потока видна по короткому слоту, отдельной проверки здесь не нужно
+        pthread_mutex_lock(&io->lock);
+        s->state = SLOT_FREE;
+        pthread_cond_broadcast(&io->changed);
+        pthread_mutex_unlock(&io->lock);
+    }
+    io->processed += total;
+    return total;
+}
+
+// Отправка заполненного слота писателя и ожидание, пока освободится следующий
+static int slot_submit(lz77_io *io)
+{
+    io_slot *s = &io->slots[io->cur];
+    int next = (io->cur + 1) % io->depth;
+#ifdef LZ77_HAVE_URING
+    if (io->backend == LZ77_IO_URING)
+    {
+        if (ring_submit(io, io->cur) != 0)
+            io->error = 1;
+        io->cur = next;
+        while (!io->error && io->slots[next].state != SLOT_FREE)
+            if (ring_reap(io) != 0)
+                io->error = 1;
+        return io->error ? -1 : 0;
+    }
+#endif
+    pthread_mutex_lock(&io->lock);
+    s->state = SLOT_BUSY;
+    pthread_cond_broadcast(&io->changed);
+    while (io->slots[next].state != SLOT_FREE)
+        pthread_cond_wait(&io->changed, &io->lock);
+    int error = io->error;
+    pthread_mutex_unlock(&io->lock);
+    io->cur = next;
+    return error ? -1 : 0;
+}
+
+int lz77_io_write(void *opaque, const void *data, size_t len)
+{
+    lz77_io *io = opaque;
+    io->processed += len;
+    if (io->backend == LZ77_IO_SYNC)
+    {
+        if (fwrite(data, 1, len, io->file) != len)
+            io->error = 1;
+        return io->error ? -1 : 0;
+    }
+    const uint8_t *src = data;
+    while (len)
+    {
+        io_slot *s = &io->slots[io->cur];
+        size_t n = LZ77_IO_BUFFER_SIZE - s->len < len ? LZ77_IO_BUFFER_SIZE - s->len : len;
+        memcpy(s->buf + s->len, src, n);
+        s->len += n;
+        src += n;
+        len -= n;
+        if (s->len == LZ77_IO_BUFFER_SIZE && slot_submit(io) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+int lz77_io_close(lz77_io *io)
+{
+    if (!io)
+        return 0;
+    if (io->backend != LZ77_IO_SYNC)
+    {
+        io_slot *s = &io->slots[io->cur];
+#ifdef LZ77_HAVE_URING
+        if (io->backend == LZ77_IO_URING)
+        {
+            if (io->writer && s->len && ring_submit(io, io->cur) != 0)
+                io->error = 1;
+            // Буферы нельзя освобождать, пока ядро в них пишет или из них читает
+            while (io->inflight)
+                if (ring_reap(io) != 0)
+                {
+                    io->error = 1;
+                    break;
+                }
+            ring_free(&io->ring);
+        }
+        else
+#endif
+        {
+            pthread_mutex_lock(&io->lock);
+            if (io->writer && s->len)
+                s->state = SLOT_BUSY;
+            io->stop = 1;
+            pthread_cond_broadcast(&io->changed);
+            pthread_mutex_unlock(&io->lock);
+            pthread_join(io->thread, NULL);
+            pthread_mutex_destroy(&io->lock);
+            pthread_cond_destroy(&io->changed);
+        }
+        // Читатель забирал из файла больше, чем отдал кодеку, а io_uring позицию файла не двигает:
+        // позиция ставится ровно за обработанными байтами
+        if (io->start >= 0 && (!io->writer || io->backend == LZ77_IO_URING) &&
+            fseeko(io->file, io->start + (long long)io->processed, SEEK_SET) != 0 && io->writer)
+            io->error = 1;
+        free(io->slots[0].buf);
+    }
+    int status = io->error ? -1 : 0;
+    free(io);
+    return status;
+}
+
+int lz77_sink_init(lz77_sink *sink, void *buf, size_t cap, lz77_write_fn write, void *opaque)
+{
+    sink->owned = !buf;
+    sink->buf = sink->op = buf ? buf : malloc(cap);
+    sink->end = sink->buf ? sink->buf + cap : NULL;
+    sink->write = write;
+    sink->opaque = opaque;
+    return sink->buf ? 0 : -1;
+}
+
+int lz77_sink_flush(lz77_sink *sink)
+{
+    if (!sink->write || sink->op == sink->buf)
+        return 0;
+    size_t len = sink->op - sink->buf;
+    sink->op = sink->buf;
+    return sink->write(sink->opaque, sink->buf, len);
+}
+
+uint8_t *lz77_sink_drain(lz77_sink *sink, size_t n)
+{
+    if (!sink->write || (size_t)(sink->end - sink->buf) < n || lz77_sink_flush(sink) != 0)
+        return NULL;
+    return sink->op;
+}
+
+void lz77_sink_free(lz77_sink *sink)
+{
+    if (sink->owned)
+        free(sink->buf);
+    sink->buf = sink->op = sink->end = NULL;
+}
+
+// Отображение от позиции start: mmap берёт смещение, кратное странице, поэтому отображение
+// начинается раньше на остаток, а data указывает ровно на start
+static int map_range(lz77_map *map, int fd, int prot, int flags)
+{
+    long page = sysconf(_SC_PAGESIZE);
+    size_t delta = (size_t)(map->start % (page > 0 ? page : 4096));
+    map->map_len = map->len + delta;
+    void *base = mmap(NULL, map->map_len, prot, flags, fd, (off_t)(map->start - delta));
+    if (base == MAP_FAILED)
+        return -1;
+    map->base = base;
+    map->data = (uint8_t *)base + delta;
+    // Кодеки идут по отображению строго вперёд: ядро читает дальше и раньше отпускает пройденное
+    posix_madvise(base, map->map_len, POSIX_MADV_SEQUENTIAL);
+    return 0;
+}
+
+// Общие условия: отображение не выключено окружением, файл обычный, позиция известна
+static int map_open(lz77_map *map, FILE *file, int writer, struct stat *st)
+{
+    memset(map, 0, sizeof(*map));
+    map->file = file;
+    map->writer = writer;
+    int fd = fileno(file);
+    if (getenv("LZ77_IO_BACKEND") || fd < 0 || fstat(fd, st) != 0 || !S_ISREG(st->st_mode))
+        return -1;
+    if (writer && fflush(file) != 0)
+        return -1;
+    map->start = ftello(file);
+    return map->start < 0 ? -1 : fd;
+}
+
+int lz77_map_input(lz77_map *map, FILE *input)
+{
+    struct stat st;
+    int fd = map_open(map, input, 0, &st);
+    if (fd < 0 || st.st_size <= map->start || (uint64_t)(st.st_size - map->start) > SIZE_MAX / 2)
+        return -1;
+    map->len = (size_t)(st.st_size - map->start);
+    return map_range(map, fd, PROT_READ, MAP_PRIVATE);
+}
+
+int lz77_map_output(lz77_map *map, FILE *output, uint64_t len)
+{
+    struct stat st;
+    int fd = map_open(map, output, 1, &st);
+    // Запись в отображение требует файла, открытого на чтение и запись; дозапись (O_APPEND)
+    // отображение обошло бы
+    if (fd < 0 || !len || len > SIZE_MAX / 2 || (fcntl(fd, F_GETFL) & (O_ACCMODE | O_APPEND)) != O_RDWR)
+        return -1;
+    map->len = (size_t)len;
+    // Место на диске выделяется заранее: нехватка видна здесь, а не сигналом SIGBUS при записи
+    // в страницу отображения
+    if (posix_fallocate(fd, (off_t)map->start, (off_t)len) == 0 &&
+        map_range(map, fd, PROT_READ | PROT_WRITE, MAP_SHARED) == 0)
+        return 0;
+    // Выделенное отдаётся обратно, и запись пойдёт через конвейер с позиции start
+    while (ftruncate(fd, (off_t)map->start) != 0 && errno == EINTR)
+        ;
+    map->len = 0;
+    return -1;
+}
+
+int lz77_map_close(lz77_map *map, int discard)
+{
+    if (!map->base)
+        return 0;
+    int status = munmap(map->base, map->map_len);
+    // Выход неудачной распаковки обрезается: заранее выделенное место не остаётся на диске
+    if (discard && map->writer)
+    {
+        map->len = 0;
+        while (ftruncate(fileno(map->file), (off_t)map->start) != 0)
+            if (errno != EINTR)
+            {
+                status = -1;
+                break;
+            }
+    }
+    if (fseeko(map->file, map->start + (long long)map->len, SEEK_SET) != 0)
+        status = -1;
+    map->base = NULL;
+    return status ? -1 : 0;
+}
@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "lz77_internal.h"
+
+// Запись индекса: младшие 32 бита абсолютной позиции конца окна хеша и контрольные биты хеша
+typedef struct {
+    uint32_t pos;
+    uint32_t check;
+} ldm_entry;
+
+struct lz77_ldm {
+    uint64_t gear[256];
+    uint64_t base_abs;   // Абсолютная позиция base[0] с начала потока
+    size_t window;
+    int rate_log;        // Позиция попадает в индекс, если старшие rate_log бит хеша нулевые
+    int bucket_log;
+    ldm_entry (*buckets)[LZ77_LDM_BUCKET];
+    uint8_t *cursor;
+    lz77_ldm_match *matches;
+    size_t matches_cap;
+};
+
+lz77_ldm *lz77_ldm_create(int ldm_log, int mem_log)
+{
+    if (ldm_log < LZ77_MIN_LDM_LOG || ldm_log > LZ77_MAX_LDM_LOG ||
+        mem_log < LZ77_MIN_LDM_MEM_LOG || mem_log > LZ77_MAX_LDM_MEM_LOG)
+        return NULL;
+    lz77_ldm *ldm = calloc(1, sizeof(lz77_ldm));
+    if (!ldm)
+        return NULL;
+    uint64_t seed = 0;
+    for (int i = 0; i < 256; i++)
+        ldm->gear[i] = lz77_splitmix64(&seed);
+    ldm->window = (size_t)1 << ldm_log;
+    // Индекс из 2^entries_log записей покрывает окно при выборке одной позиции из 2^rate_log;
+    // меньший бюджет памяти делает выборку реже, а не укорачивает покрытие окна
+    int entries_log = mem_log - 3;
+    ldm->bucket_log = entries_log - 2;
+    ldm->rate_log = ldm_log - entries_log;
+    if (ldm->rate_log < LZ77_LDM_MIN_RATE_LOG)
+        ldm->rate_log = LZ77_LDM_MIN_RATE_LOG;
+    ldm->buckets = calloc((size_t)1 << ldm->bucket_log, sizeof(*ldm->buckets));
+    ldm->cursor = calloc((size_t)1 << ldm->bucket_log, 1);
+    if (!ldm->buckets || !ldm->cursor)
+    {
+        lz77_ldm_free(ldm);
+        return NULL;
+    }
+    return ldm;
+}
+
+void lz77_ldm_free(lz77_ldm *ldm)
+{
+    if (!ldm)
+        return;
+    free(ldm->buckets);
+    free(ldm->cursor);
+    free(ldm->matches);
+    free(ldm);
+}
+
+void lz77_ldm_slide(lz77_ldm *ldm, size_t shift)
+{
+    ldm->base_abs += shift;
+}
+
+static int ldm_add(lz77_ldm *ldm, size_t count, size_t start, size_t dist, size_t len)
+{
+    if (count == ldm->matches_cap)
+    {
+        size_t cap = ldm->matches_cap ? ldm->matches_cap * 2 : 64;
+        lz77_ldm_match *matches = realloc(ldm->matches, cap * sizeof(lz77_ldm_match));
+        if (!matches)
+            return -1;
+        ldm->matches = matches;
+        ldm->matches_cap = cap;
+    }
+    ldm->matches[count].start = start;
+    ldm->matches[count].dist = dist;
+    ldm->matches[count].len = len;
+    return 0;
+}
+
+size_t lz77_ldm_find(lz77_ldm *ldm, const uint8_t *base, size_t hist_len, size_t end, const lz77_ldm_match **matches)
+{
+    size_t count = 0;
+    size_t anchor = hist_len;
+    // Хеш покрывает последние LZ77_LDM_MIN_MATCH байт, поэтому разгоняется на хвосте истории
+    size_t prime = hist_len >= LZ77_LDM_MIN_MATCH - 1 ? hist_len - (LZ77_LDM_MIN_MATCH - 1) : 0;
+    size_t bucket_mask = ((size_t)1 << ldm->bucket_log) - 1;
+    int select_shift = 64 - ldm->rate_log;
+    int bucket_shift = select_shift - ldm->bucket_log;
+    uint64_t h = 0;
+
+    for (size_t p = prime; p < end; p++)
+    {
+        h = (h << 1) + ldm->gear[base[p]];
+        if (p < prime + LZ77_LDM_MIN_MATCH - 1 || h >> select_shift)
+            continue;
+
+        ldm_entry *bucket = ldm->buckets[(h >> bucket_shift) & bucket_mask];
+        uint8_t *cursor = &ldm->cursor[(h >> bucket_shift) & bucket_mask];
+        uint32_t check = (uint32_t)(h >> 8);
+        uint32_t abs_pos = (uint32_t)(ldm->base_abs + p);
+        size_t s = p + 1 - LZ77_LDM_MIN_MATCH;
+        size_t best_start = 0, best_dist = 0, best_len = 0;
+
+        for (int i = 0; i < LZ77_LDM_BUCKET; i++)
+        {
+            // Позиции хранятся по модулю 2^32, окно не больше 2^30, поэтому дистанция однозначна
+            size_t dist = (uint32_t)(abs_pos - bucket[i].pos);
+            if (bucket[i].check != check || !dist || dist > ldm->window || dist > s || s < anchor)
+                continue;
+            size_t len = lz77_match_length(base + s - dist, base + s, end - s);
+            if (len < LZ77_LDM_MIN_MATCH)
+                continue;
+            size_t start = s;
+            while (start > anchor && start > dist && base[start - 1] == base[start - 1 - dist])
+                start--;
+            len += s - start;
+            if (len > best_len)
+            {
+                best_start = start;
+                best_dist = dist;
+                best_len = len;
+            }
+        }
+        bucket[*cursor & (LZ77_LDM_BUCKET - 1)].pos = abs_pos;
+        bucket[*cursor & (LZ77_LDM_BUCKET - 1)].check = check;
+        (*cursor)++;
+
+        if (!best_len || ldm_add(ldm, count, best_start, best_dist, best_len) != 0)
+            continue;
+        count++;
+        // Внутри совпадения позиции не индексируются: хеш разгоняется заново с его конца
+        anchor = best_start + best_len;
+        prime = anchor;
+        p = anchor - 1;
+        h = 0;
+    }
+    *matches = ldm->matches;
+    return count;
+}
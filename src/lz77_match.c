@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "lz77_internal.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define LZ77_HAVE_X86_KERNELS 1
+#endif
+
+// Ядра сравнения читают не больше max_len байт из каждого буфера, поэтому границы
+// проверяются один раз вызывающей стороной, а не на каждом байте.
+
+static size_t match_length_byte(const uint8_t *a, const uint8_t *b, size_t max_len)
+{
+    size_t len = 0;
+    while (len < max_len && a[len] == b[len])
+        len++;
+    return len;
+}
+
+// Номер первого различающегося байта в ненулевом XOR двух слов
+static inline size_t first_diff_byte(uint64_t diff)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return (size_t)__builtin_clzll(diff) >> 3;
+#else
+    return (size_t)__builtin_ctzll(diff) >> 3;
+#endif
+}
+
+static size_t match_length_word(const uint8_t *a, const uint8_t *b, size_t max_len)
+{
+    size_t len = 0;
+    while (len + 8 <= max_len)
+    {
+        uint64_t wa, wb;
+        memcpy(&wa, a + len, 8);
+        memcpy(&wb, b + len, 8);
+        if (wa != wb)
+            return len + first_diff_byte(wa ^ wb);
+        len += 8;
+    }
+    return len + match_length_byte(a + len, b + len, max_len - len);
+}
+
+#ifdef LZ77_HAVE_X86_KERNELS
+__attribute__((target("sse2"))) static size_t match_length_sse2(const uint8_t *a, const uint8_t *b, size_t max_len)
+{
+    size_t len = 0;
+    while (len + 16 <= max_len)
+    {
+        __m128i va = _mm_loadu_si128((const __m128i *)(a + len));
+        __m128i vb = _mm_loadu_si128((const __m128i *)(b + len));
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) ^ 0xFFFFu;
+        if (mask)
+            return len + (size_t)__builtin_ctz(mask);
+        len += 16;
+    }
+    return len + match_length_word(a + len, b + len, max_len - len);
+}
+
+__attribute__((target("avx2"))) static size_t match_length_avx2(const uint8_t *a, const uint8_t *b, size_t max_len)
+{
+    size_t len = 0;
+    // Короткие совпадения (большинство кандидатов) не стоят загрузки 32-байтных регистров
+    if (max_len >= 8)
+    {
+        uint64_t wa, wb;
+        memcpy(&wa, a, 8);
+        memcpy(&wb, b, 8);
+        if (wa != wb)
+            return first_diff_byte(wa ^ wb);
+        len = 8;
+    }
+    while (len + 32 <= max_len)
+    {
+        __m256i va = _mm256_loadu_si256((const __m256i *)(a + len));
+        __m256i vb = _mm256_loadu_si256((const __m256i *)(b + len));
+        uint32_t mask = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb));
+        if (mask)
+            return len + (size_t)__builtin_ctz(mask);
+        len += 32;
+    }
+    return len + match_length_word(a + len, b + len, max_len - len);
+}
+#endif
+
+typedef struct {
+    const char *name;
+    lz77_match_length_fn fn;
+} match_kernel;
+
+static const match_kernel kernels[] = {
+    {"byte", match_length_byte},
+    {"word", match_length_word},
+#ifdef LZ77_HAVE_X86_KERNELS
+    {"sse2", match_length_sse2},
+    {"avx2", match_length_avx2},
+#endif
+};
+
+#define KERNEL_COUNT (sizeof(kernels) / sizeof(kernels[0]))
+
+static size_t match_length_dispatch(const uint8_t *a, const uint8_t *b, size_t max_len);
+
+lz77_match_length_fn lz77_match_length = match_length_dispatch;
+static const char *kernel_name = "word";
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+
+static int kernel_supported(const char *name)
+{
+#ifdef LZ77_HAVE_X86_KERNELS
+    __builtin_cpu_init();
+    if (strcmp(name, "sse2") == 0)
+        return __builtin_cpu_supports("sse2");
+    if (strcmp(name, "avx2") == 0)
+        return __builtin_cpu_supports("avx2");
+#endif
+    return 1;
+}
+
+// Выбор ядра: LZ77_MATCH_KERNEL из окружения (для замеров), иначе самое широкое из доступных
+static void kernel_select(void)
+{
+    const char *forced = getenv("LZ77_MATCH_KERNEL");
+    size_t chosen = 1;
+    for (size_t i = 0; i < KERNEL_COUNT; i++)
+    {
+        if (!kernel_supported(kernels[i].name))
+            continue;
+        if (forced ? strcmp(forced, kernels[i].name) == 0 : i > chosen)
+            chosen = i;
+    }
+    kernel_name = kernels[chosen].name;
+    lz77_match_length = kernels[chosen].fn;
+}
+
+static size_t match_length_dispatch(const uint8_t *a, const uint8_t *b, size_t max_len)
+{
+    pthread_once(&kernel_once, kernel_select);
+    return lz77_match_length(a, b, max_len);
+}
+
+const char *lz77_match_kernel(void)
+{
+    pthread_once(&kernel_once, kernel_select);
+    return kernel_name;
+}
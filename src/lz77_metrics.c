@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "lz77_internal.h"
+
+int lz77_log_level = LZ77_LOG_FRAMES;
+
+static const char *const phase_names[LZ77_PHASES] = {"read", "search", "emit", "write"};
+
+void lz77_set_log_level(int level)
+{
+    lz77_log_level = level;
+}
+
+uint64_t lz77_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+void lz77_metrics_add(lz77_metrics *dst, const lz77_metrics *src)
+{
+    dst->bytes_in += src->bytes_in;
+    dst->bytes_out += src->bytes_out;
+    dst->blocks += src->blocks;
+    dst->skipped_blocks += src->skipped_blocks;
+    dst->literals += src->literals;
+    dst->literal_runs += src->literal_runs;
+    dst->matches += src->matches;
+    dst->match_bytes += src->match_bytes;
+    for (int i = 0; i < LZ77_METRICS_BUCKETS; i++)
+    {
+        dst->match_len[i] += src->match_len[i];
+        dst->distance[i] += src->distance[i];
+        dst->literal_run[i] += src->literal_run[i];
+    }
+    for (int i = 0; i < LZ77_PHASES; i++)
+        dst->phase_ns[i] += src->phase_ns[i];
+}
+
+// Гистограмма без нулевого хвоста
+static void json_histogram(FILE *out, const char *name, const uint64_t *hist)
+{
+    int used = LZ77_METRICS_BUCKETS;
+    while (used && !hist[used - 1])
+        used--;
+    fprintf(out, ",\"%s\":[", name);
+    for (int i = 0; i < used; i++)
+        fprintf(out, "%s%llu", i ? "," : "", (unsigned long long)hist[i]);
+    fputc(']', out);
+}
+
+void lz77_metrics_json(const lz77_metrics *m, FILE *out)
+{
+    fprintf(out, "{\"bytes_in\":%llu,\"bytes_out\":%llu,\"ratio\":%.4f,\"blocks\":%llu,\"skipped_blocks\":%llu,"
+            "\"literals\":%llu,\"literal_runs\":%llu,\"matches\":%llu,\"match_bytes\":%llu,\"avg_match_len\":%.2f,\"phase_ms\":{",
+            (unsigned long long)m->bytes_in, (unsigned long long)m->bytes_out,
+            m->bytes_in ? (double)m->bytes_out / m->bytes_in : 0.0, (unsigned long long)m->blocks,
+            (unsigned long long)m->skipped_blocks,
+            (unsigned long long)m->literals, (unsigned long long)m->literal_runs, (unsigned long long)m->matches,
+            (unsigned long long)m->match_bytes, m->matches ? (double)m->match_bytes / m->matches : 0.0);
+    for (int i = 0; i < LZ77_PHASES; i++)
+        fprintf(out, "%s\"%s\":%.3f", i ? "," : "", phase_names[i], m->phase_ns[i] / 1e6);
+    fputc('}', out);
+    json_histogram(out, "match_len_log2", m->match_len);
+    json_histogram(out, "distance_log2", m->distance);
+    json_histogram(out, "literal_run_log2", m->literal_run);
+    fputs("}\n", out);
+}
+
+void lz77_metrics_csv(const lz77_metrics *m, FILE *out)
+{
+    const struct {
+        const char *name;
+        uint64_t value;
+    } counters[] = {
+        {"bytes_in", m->bytes_in}, {"bytes_out", m->bytes_out}, {"blocks", m->blocks}, {"skipped_blocks", m->skipped_blocks},
+        {"literals", m->literals}, {"literal_runs", m->literal_runs}, {"matches", m->matches},
+        {"match_bytes", m->match_bytes},
+    };
+    const struct {
+        const char *name;
+        const uint64_t *hist;
+    } histograms[] = {
+        {"match_len_log2", m->match_len}, {"distance_log2", m->distance}, {"literal_run_log2", m->literal_run},
+    };
+
+    fputs("metric,bucket,value\n", out);
+    for (size_t i = 0; i < sizeof(counters) / sizeof(counters[0]); i++)
+        fprintf(out, "%s,,%llu\n", counters[i].name, (unsigned long long)counters[i].value);
+    for (int i = 0; i < LZ77_PHASES; i++)
+        fprintf(out, "phase_ms,%s,%.3f\n", phase_names[i], m->phase_ns[i] / 1e6);
+    for (size_t h = 0; h < sizeof(histograms) / sizeof(histograms[0]); h++)
+        for (int i = 0; i < LZ77_METRICS_BUCKETS; i++)
+            if (histograms[h].hist[i])
+                fprintf(out, "%s,%d,%llu\n", histograms[h].name, i, (unsigned long long)histograms[h].hist[i]);
+}
+
+void lz77_metrics_log(const lz77_metrics *m, FILE *log)
+{
+    // Без телеметрии в сборке счётчики пусты, сводка только ввела бы в заблуждение
+    if (!LZ77_METRICS || !LZ77_LOG_ON(log, LZ77_LOG_INFO))
+        return;
+    fputs("[INFO] Metrics: ", log);
+    lz77_metrics_json(m, log);
+}
@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "lz77_internal.h"
+
+typedef struct {
+    lz77_pool *pool;
+    int id;
+} pool_worker;
+
+struct lz77_pool {
+    pthread_t *threads;
+    pool_worker *workers;
+    int count;
+    pthread_mutex_t lock;
+    pthread_cond_t has_work;
+    pthread_cond_t task_done;
+    lz77_task *head, *tail;
+    int stop;
+};
+
+static void *pool_worker_main(void *arg)
+{
+    pool_worker *worker = arg;
+    lz77_pool *pool = worker->pool;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;)
+    {
+        while (!pool->head && !pool->stop)
+            pthread_cond_wait(&pool->has_work, &pool->lock);
+        if (!pool->head)
+            break;
+        lz77_task *task = pool->head;
+        pool->head = task->next;
+        if (!pool->head)
+            pool->tail = NULL;
+        pthread_mutex_unlock(&pool->lock);
+
+        task->fn(task->arg, worker->id);
+
+        pthread_mutex_lock(&pool->lock);
+        task->done = 1;
+        pthread_cond_broadcast(&pool->task_done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+lz77_pool *lz77_pool_create(int threads)
+{
+    lz77_pool *pool = calloc(1, sizeof(lz77_pool));
+    if (!pool)
+        return NULL;
+    if (threads <= 1)
+        return pool;
+
+    pool->threads = calloc(threads, sizeof(pthread_t));
+    pool->workers = calloc(threads, sizeof(pool_worker));
+    if (!pool->threads || !pool->workers)
+    {
+        free(pool->threads);
+        free(pool->workers);
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->has_work, NULL);
+    pthread_cond_init(&pool->task_done, NULL);
+
+    for (int i = 0; i < threads; i++)
+    {
+        pool->workers[i].pool = pool;
+        pool->workers[i].id = i;
+        if (pthread_create(&pool->threads[i], NULL, pool_worker_main, &pool->workers[i]) != 0)
+            break;
+        pool->count++;
+    }
+    if (pool->count == 0)
+    {
+        lz77_pool_destroy(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+int lz77_pool_size(const lz77_pool *pool)
+{
+    return pool->count ? pool->count : 1;
+}
+
+void lz77_pool_submit(lz77_pool *pool, lz77_task *task)
+{
+    task->done = 0;
+    task->next = NULL;
+    if (!pool->count)
+    {
+        task->fn(task->arg, 0);
+        task->done = 1;
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    if (pool->tail)
+        pool->tail->next = task;
+    else
+        pool->head = task;
+    pool->tail = task;
+    pthread_cond_signal(&pool->has_work);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void lz77_pool_wait(lz77_pool *pool, lz77_task *task)
+{
+    if (!pool->count)
+        return;
+    pthread_mutex_lock(&pool->lock);
+    while (!task->done)
+        pthread_cond_wait(&pool->task_done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void lz77_pool_destroy(lz77_pool *pool)
+{
+    if (!pool)
+        return;
+    if (pool->threads)
+    {
+        pthread_mutex_lock(&pool->lock);
+        pool->stop = 1;
+        pthread_cond_broadcast(&pool->has_work);
+        pthread_mutex_unlock(&pool->lock);
+        for (int i = 0; i < pool->count; i++)
+            pthread_join(pool->threads[i], NULL);
+        pthread_mutex_destroy(&pool->lock);
+        pthread_cond_destroy(&pool->has_work);
+        pthread_cond_destroy(&pool->task_done);
+    }
+    free(pool->threads);
+    free(pool->workers);
+    free(pool);
+}
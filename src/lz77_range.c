@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "lz77_internal.h"
+
+// Двоичный поиск первого фрейма, содержащего байт offset; таблица читается с диска по записям
+static int find_frame(FILE *input, long long table_pos, size_t count, uint64_t offset, size_t *index)
+{
+    size_t lo = 0, hi = count;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        lz77_seek_entry entry;
+        if (lz77_seek_entry_read(input, table_pos, mid, &entry) != 0)
+            return -1;
+        if (entry.u_offset + entry.u_size <= offset)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    *index = lo;
+    return 0;
+}
+
+int64_t lz77_decompress_range(FILE *input, uint64_t offset, uint64_t len, void *dst)
+{
+    uint8_t header[LZ77_FRAME_HEADER_SIZE];
+    lz77_frame_info info;
+    long long start = ftello(input);
+    long long table_pos;
+    size_t count, first;
+    lz77_seek_entry entry;
+
+    if (!dst || start < 0 || lz77_seek_open(input, start, header, &table_pos, &count) != 0)
+    {
+        fprintf(stderr, "[ERROR] lz77_decompress_range: input has no frame seek table\n");
+        return -1;
+    }
+    if (!count || !len)
+        return 0;
+    if (find_frame(input, table_pos, count, offset, &first) != 0)
+        return -1;
+    if (first == count)
+        return 0;
+
+    lz77_frame_parse(header, &info);
+    size_t frame_size = info.frame_size;
+    size_t in_cap = lz77_block_bound(frame_size) + info.check_size;
+    size_t hist_cap = 0;
+    size_t index = first;
+    // Сцепленные фреймы зависят от предыдущих, поэтому их приходится раскручивать с начала
+    if (info.flags & LZ77_FLAG_CHAINED)
+    {
+        hist_cap = info.window;
+        index = 0;
+    }
+
+    uint8_t *in = malloc(LZ77_FRAME_PREFIX_SIZE + in_cap);
+    lz77_window out;
+    uint8_t *dst_bytes = dst;
+    uint64_t copied = 0, checksum;
+    int64_t result = -1;
+    if (lz77_window_init(&out, hist_cap, frame_size) != 0 || !in)
+        goto done;
+
+    for (; index < count && copied < len; index++)
+    {
+        if (lz77_seek_entry_read(input, table_pos, index, &entry) != 0 || entry.c_size > in_cap || entry.u_size > frame_size)
+            goto done;
+        lz77_window_reserve(&out, entry.u_size);
+        size_t in_len = LZ77_FRAME_PREFIX_SIZE + entry.c_size;
+        if (fseeko(input, start + (long long)entry.c_offset, SEEK_SET) != 0 || lz77_read_full(input, in, in_len) != in_len ||
+            read_le32(in) != entry.c_size || read_le32(in + 4) != entry.u_size ||
+            lz77_frame_decode(in + LZ77_FRAME_PREFIX_SIZE, entry.c_size, out.buf, out.len, entry.u_size, &info,
+                              &checksum) != 0)
+        {
+            fprintf(stderr, "[ERROR] lz77_decompress_range: corrupted frame %zu\n", index);
+            goto done;
+        }
+
+        if (index >= first)
+        {
+            uint64_t from = offset + copied - entry.u_offset;
+            uint64_t n = entry.u_size - from;
+            if (n > len - copied)
+                n = len - copied;
+            memcpy(dst_bytes + copied, out.buf + out.len + from, n);
+            copied += n;
+        }
+        lz77_window_commit(&out, entry.u_size);
+    }
+    result = (int64_t)copied;
+
+done:
+    free(in);
+    lz77_window_free(&out);
+    return result;
+}
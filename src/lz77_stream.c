@@ -0,0 +1,394 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "lz77_internal.h"
+
+struct lz77_cctx {
+    lz77_params params;
+    lz77_write_fn write;
+    void *opaque;
+    lz77_matcher *matcher;
+    lz77_seek_builder seek;
+    lz77_window in;     // [история | накапливаемый фрейм]
+    size_t frame_size;
+    size_t fill;        // Байт фрейма, уже лежащих после истории
+    uint8_t *out;       // [префикс фрейма | токены | сумма]
+    size_t out_cap;
+    uint64_t content;   // Сумма содержимого по записанным фреймам
+    int header_written;
+    int finished;       // Конец контейнера записан, до reset писать нельзя
+};
+
+// Стадии разбора входа распаковщиком
+typedef enum
+{
+    DSTAGE_HEADER,
+    DSTAGE_PREFIX,
+    DSTAGE_PAYLOAD,
+    DSTAGE_CHECKSUM, // Сумма содержимого за концом контейнера
+    DSTAGE_DONE
+} dctx_stage;
+
+struct lz77_dctx {
+    lz77_write_fn write;
+    void *opaque;
+    dctx_stage stage;
+    uint8_t header[LZ77_FRAME_HEADER_SIZE];
+    uint8_t prefix[LZ77_FRAME_PREFIX_SIZE];
+    uint8_t *in;        // Токены текущего фрейма
+    size_t in_cap;
+    size_t have;        // Сколько байт текущей стадии уже накоплено
+    size_t need;
+    lz77_window out;    // [история | фрейм]
+    lz77_frame_info info;
+    uint64_t content;
+};
+
+static void cctx_free(lz77_cctx *ctx)
+{
+    lz77_matcher_free(ctx->matcher);
+    free(ctx->seek.entries);
+    lz77_window_free(&ctx->in);
+    free(ctx->out);
+    free(ctx);
+}
+
+lz77_cctx *lz77_cctx_init(const lz77_params *params, lz77_write_fn write, void *opaque)
+{
+    lz77_cctx *ctx = calloc(1, sizeof(lz77_cctx));
+    if (!ctx || !write)
+    {
+        free(ctx);
+        return NULL;
+    }
+    if (params)
+        ctx->params = *params;
+    else
+        lz77_params_default(&ctx->params);
+    int window_log = ctx->params.window_log, ldm_log = ctx->params.ldm_log;
+    if (ctx->params.frame_log < LZ77_MIN_FRAME_LOG || ctx->params.frame_log > LZ77_MAX_FRAME_LOG ||
+        (window_log && (window_log < LZ77_MIN_WINDOW_LOG || window_log > LZ77_MAX_WINDOW_LOG)) ||
+        (ldm_log && (ldm_log < LZ77_MIN_LDM_LOG || ldm_log > LZ77_MAX_LDM_LOG)))
+    {
+        free(ctx);
+        return NULL;
+    }
+    // Дальние совпадения ссылаются в прошлые фреймы и требуют varint-дистанций
+    if (ldm_log)
+    {
+        ctx->params.chain = 1;
+        if (!window_log)
+            window_log = LZ77_MIN_WINDOW_LOG;
+    }
+
+    lz77_seek_builder seek = LZ77_SEEK_BUILDER_INIT;
+    ctx->write = write;
+    ctx->opaque = opaque;
+    ctx->seek = seek;
+    ctx->frame_size = (size_t)1 << ctx->params.frame_log;
+    size_t hist_cap = !ctx->params.chain ? 0 : window_log ? (size_t)1 << window_log : SEARCH_BUFFER_SIZE;
+    if (ldm_log > window_log)
+        hist_cap = (size_t)1 << ldm_log;
+    ctx->out_cap = LZ77_FRAME_PREFIX_SIZE + lz77_block_bound(ctx->frame_size) +
+                   (ctx->params.checksum ? LZ77_FRAME_CHECKSUM_SIZE : 0);
+    if (!ctx->params.chain && window_log > ctx->params.frame_log)
+        window_log = ctx->params.frame_log;
+    ctx->matcher = lz77_matcher_create(ctx->params.level, ctx->params.lazy, window_log);
+    ctx->out = malloc(ctx->out_cap);
+    if (!ctx->matcher || (ldm_log && lz77_matcher_enable_ldm(ctx->matcher, ldm_log, ctx->params.ldm_mem_log) != 0) ||
+        (ctx->params.entropy && lz77_matcher_enable_entropy(ctx->matcher) != 0) ||
+        lz77_window_init(&ctx->in, hist_cap, ctx->frame_size) != 0 || !ctx->out)
+    {
+        cctx_free(ctx);
+        return NULL;
+    }
+    ctx->matcher->sequences = ctx->params.sequences;
+    // Фреймы сжимаются по порядку одним сопоставителем: таблицы переходят из фрейма в фрейм
+    ctx->matcher->follows = ctx->params.chain;
+    return ctx;
+}
+
+static int cctx_write_header(lz77_cctx *ctx)
+{
+    uint8_t header[LZ77_FRAME_HEADER_SIZE];
+    if (ctx->header_written)
+        return 0;
+    int window_log = ctx->params.window_log;
+    // Байт окна заголовка — наибольшая дистанция, обычная или дальняя
+    if (ctx->params.ldm_log)
+        window_log = ctx->params.ldm_log > window_log ? ctx->params.ldm_log : window_log;
+    lz77_frame_header(header, (ctx->params.chain ? LZ77_FLAG_CHAINED : 0) | (ctx->params.seek_table ? LZ77_FLAG_SEEK_TABLE : 0) |
+                      (ctx->params.entropy ? LZ77_FLAG_ENTROPY : 0) | (ctx->params.sequences ? LZ77_FLAG_SEQUENCES : 0) |
+                      (ctx->params.checksum ? LZ77_FLAG_CHECKSUM : 0), ctx->params.frame_log, window_log);
+    ctx->header_written = 1;
+    return ctx->write(ctx->opaque, header, sizeof(header));
+}
+
+int lz77_cctx_flush(lz77_cctx *ctx)
+{
+    if (!ctx || ctx->finished || cctx_write_header(ctx) != 0)
+        return -1;
+    if (!ctx->fill)
+        return 0;
+
+    size_t check_size = ctx->params.checksum ? LZ77_FRAME_CHECKSUM_SIZE : 0;
+    size_t csize = lz77_block_compress(ctx->matcher, ctx->in.buf, ctx->in.len, ctx->fill,
+                                       ctx->out + LZ77_FRAME_PREFIX_SIZE, ctx->out_cap - LZ77_FRAME_PREFIX_SIZE - check_size);
+    if (!csize)
+        return -1;
+    if (check_size)
+    {
+        uint64_t h = lz77_frame_checksum(ctx->in.buf + ctx->in.len, ctx->fill, ctx->out + LZ77_FRAME_PREFIX_SIZE + csize);
+        ctx->content = lz77_content_checksum(ctx->content, h);
+        csize += check_size;
+    }
+    write_le32(ctx->out, csize);
+    write_le32(ctx->out + 4, ctx->fill);
+    uint64_t t = metrics_clock();
+    int written = ctx->write(ctx->opaque, ctx->out, LZ77_FRAME_PREFIX_SIZE + csize);
+    metrics_phase(&ctx->matcher->metrics, LZ77_PHASE_WRITE, t);
+    if (written != 0 ||
+        (ctx->params.seek_table && lz77_seek_add(&ctx->seek, csize, ctx->fill) != 0))
+        return -1;
+    lz77_window_commit(&ctx->in, ctx->fill);
+    ctx->fill = 0;
+    return 0;
+}
+
+int lz77_cctx_update(lz77_cctx *ctx, const void *src, size_t len)
+{
+    const uint8_t *ip = src;
+    if (!ctx || ctx->finished || (!src && len))
+        return -1;
+    while (len)
+    {
+        size_t n = ctx->frame_size - ctx->fill;
+        if (n > len)
+            n = len;
+        // Место под фрейм освобождается, пока он пуст: сдвиг не трогает накопленные байты
+        if (!ctx->fill)
+        {
+            size_t shift = lz77_window_reserve(&ctx->in, ctx->frame_size);
+            if (shift && ctx->matcher->ldm)
+                lz77_ldm_slide(ctx->matcher->ldm, shift);
+        }
+        memcpy(ctx->in.buf + ctx->in.len + ctx->fill, ip, n);
+        ctx->fill += n;
+        ip += n;
+        len -= n;
+        if (ctx->fill == ctx->frame_size && lz77_cctx_flush(ctx) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+int lz77_cctx_finish(lz77_cctx *ctx)
+{
+    uint8_t end_mark[4] = {0};
+    if (!ctx)
+        return -1;
+    // Последний фрейм продолжать некому
+    ctx->matcher->follows = 0;
+    int status = lz77_cctx_flush(ctx);
+    ctx->finished = 1;
+    if (!status)
+        status = ctx->write(ctx->opaque, end_mark, sizeof(end_mark));
+    if (!status && ctx->params.checksum)
+        status = lz77_content_checksum_write(ctx->content, ctx->write, ctx->opaque);
+    if (!status && ctx->params.seek_table)
+        status = lz77_seek_write(&ctx->seek, ctx->write, ctx->opaque);
+    if (ctx->params.metrics)
+    {
+        lz77_metrics zero = {0};
+        lz77_metrics_add(ctx->params.metrics, &ctx->matcher->metrics);
+        ctx->matcher->metrics = zero;
+    }
+    return status;
+}
+
+// Буферы, окно и таблицы остаются: таблицы сбрасываются поколением при сжатии первого
+// блока, а история прошлого контейнера отбрасывается вместе с длиной окна
+int lz77_cctx_reset(lz77_cctx *ctx, lz77_write_fn write, void *opaque)
+{
+    lz77_seek_builder seek = LZ77_SEEK_BUILDER_INIT;
+    if (!ctx || !write)
+        return -1;
+    if (ctx->matcher->ldm &&
+        lz77_matcher_enable_ldm(ctx->matcher, ctx->params.ldm_log, ctx->params.ldm_mem_log) != 0)
+        return -1;
+    ctx->write = write;
+    ctx->opaque = opaque;
+    ctx->matcher->miss_streak = ctx->matcher->skip_search = 0;
+    ctx->matcher->follows = ctx->params.chain;
+    ctx->matcher->indexed = 0;
+    seek.entries = ctx->seek.entries;
+    seek.cap = ctx->seek.cap;
+    ctx->seek = seek;
+    ctx->in.len = 0;
+    ctx->fill = 0;
+    ctx->content = 0;
+    ctx->header_written = 0;
+    ctx->finished = 0;
+    return 0;
+}
+
+int lz77_cctx_end(lz77_cctx *ctx)
+{
+    if (!ctx)
+        return -1;
+    int status = ctx->finished ? 0 : lz77_cctx_finish(ctx);
+    cctx_free(ctx);
+    return status;
+}
+
+lz77_dctx *lz77_dctx_init(lz77_write_fn write, void *opaque)
+{
+    lz77_dctx *ctx = calloc(1, sizeof(lz77_dctx));
+    if (!ctx || !write)
+    {
+        free(ctx);
+        return NULL;
+    }
+    ctx->write = write;
+    ctx->opaque = opaque;
+    ctx->stage = DSTAGE_HEADER;
+    ctx->need = LZ77_FRAME_HEADER_SIZE;
+    return ctx;
+}
+
+// Заголовок накоплен: выделяем буферы под фреймы
+static int dctx_start(lz77_dctx *ctx)
+{
+    lz77_frame_info *info = &ctx->info;
+    if (lz77_frame_parse(ctx->header, info) != 0)
+        return -1;
+    size_t hist_cap = (info->flags & LZ77_FLAG_CHAINED) ? info->window : 0;
+    size_t in_cap = lz77_block_bound(info->frame_size) + info->check_size;
+    ctx->content = 0;
+    // Контекст после lz77_dctx_reset оставляет буферы, если они подходят новому контейнеру
+    if (ctx->in_cap < in_cap)
+    {
+        free(ctx->in);
+        ctx->in = malloc(in_cap);
+        ctx->in_cap = ctx->in ? in_cap : 0;
+        if (!ctx->in)
+            return -1;
+    }
+    if (ctx->out.buf && ctx->out.hist_cap == hist_cap && ctx->out.cap - hist_cap >= info->frame_size)
+    {
+        ctx->out.len = 0;
+        return 0;
+    }
+    lz77_window_free(&ctx->out);
+    return lz77_window_init(&ctx->out, hist_cap, info->frame_size);
+}
+
+// Все токены фрейма на месте: распаковываем и отдаём приёмнику
+static int dctx_frame(lz77_dctx *ctx)
+{
+    size_t raw = read_le32(ctx->prefix + 4);
+    uint64_t checksum;
+    lz77_window_reserve(&ctx->out, raw);
+    if (lz77_frame_decode(ctx->in, ctx->need, ctx->out.buf, ctx->out.len, raw, &ctx->info, &checksum) != 0 ||
+        ctx->write(ctx->opaque, ctx->out.buf + ctx->out.len, raw) != 0)
+        return -1;
+    ctx->content = lz77_content_checksum(ctx->content, checksum);
+    lz77_window_commit(&ctx->out, raw);
+    return 0;
+}
+
+int lz77_dctx_update(lz77_dctx *ctx, const void *src, size_t len)
+{
+    const uint8_t *ip = src;
+    if (!ctx || (!src && len))
+        return -1;
+    // После конца контейнера идёт таблица поиска, она потоковой распаковке не нужна
+    while (len && ctx->stage != DSTAGE_DONE)
+    {
+        uint8_t *dst = ctx->stage == DSTAGE_HEADER ? ctx->header : ctx->stage == DSTAGE_PAYLOAD ? ctx->in : ctx->prefix;
+        size_t n = ctx->need - ctx->have;
+        if (n > len)
+            n = len;
+        memcpy(dst + ctx->have, ip, n);
+        ctx->have += n;
+        ip += n;
+        len -= n;
+        if (ctx->have < ctx->need)
+            break;
+
+        ctx->have = 0;
+        switch (ctx->stage)
+        {
+        case DSTAGE_HEADER:
+            if (dctx_start(ctx) != 0)
+                return -1;
+            ctx->stage = DSTAGE_PREFIX;
+            ctx->need = 4;
+            break;
+        case DSTAGE_PREFIX:
+            if (ctx->need == 4)
+            {
+                // Нулевой сжатый размер — конец контейнера, исходного размера за ним нет
+                if (!read_le32(ctx->prefix))
+                {
+                    ctx->stage = ctx->info.tail_size ? DSTAGE_CHECKSUM : DSTAGE_DONE;
+                    ctx->need = ctx->info.tail_size;
+                }
+                else
+                {
+                    ctx->have = 4;
+                    ctx->need = LZ77_FRAME_PREFIX_SIZE;
+                }
+                break;
+            }
+            ctx->need = read_le32(ctx->prefix);
+            if (ctx->need > ctx->in_cap || !read_le32(ctx->prefix + 4) || read_le32(ctx->prefix + 4) > ctx->info.frame_size)
+                return -1;
+            ctx->stage = DSTAGE_PAYLOAD;
+            break;
+        case DSTAGE_PAYLOAD:
+            if (dctx_frame(ctx) != 0)
+                return -1;
+            ctx->stage = DSTAGE_PREFIX;
+            ctx->need = 4;
+            break;
+        case DSTAGE_CHECKSUM:
+            if (read_le64(ctx->prefix) != ctx->content)
+                return -1;
+            ctx->stage = DSTAGE_DONE;
+            break;
+        case DSTAGE_DONE:
+            break;
+        }
+    }
+    return 0;
+}
+
+int lz77_dctx_reset(lz77_dctx *ctx, lz77_write_fn write, void *opaque)
+{
+    if (!ctx || !write)
+        return -1;
+    ctx->write = write;
+    ctx->opaque = opaque;
+    ctx->stage = DSTAGE_HEADER;
+    ctx->have = 0;
+    ctx->need = LZ77_FRAME_HEADER_SIZE;
+    return 0;
+}
+
+int lz77_dctx_finish(lz77_dctx *ctx)
+{
+    return ctx && ctx->stage == DSTAGE_DONE ? 0 : -1;
+}
+
+int lz77_dctx_end(lz77_dctx *ctx)
+{
+    if (!ctx)
+        return -1;
+    int status = lz77_dctx_finish(ctx);
+    free(ctx->in);
+    lz77_window_free(&ctx->out);
+    free(ctx);
+    return status;
+}
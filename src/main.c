@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <dirent.h>
 #include "lz77.h"
 
 // Цвета для вывода
@@ -10,11 +11,27 @@
 #define YELLOW "\033[0;33m"
 #define RESET "\033[0m"
 
+// Имя файла, обозначающее stdin/stdout
+#define STDIO_NAME "-"
+
+// Верхняя граница числа рабочих потоков
+#define MAX_THREADS 256
+// Допустимые log2 размера фрейма (совпадают с ограничениями формата)
+#define MIN_FRAME_LOG 16
+#define MAX_FRAME_LOG 30
+// Наибольший диапазон для --range, читаемый целиком в память
+#define MAX_RANGE_LENGTH (1 << 30)
+// Порция чтения канала потоковыми контекстами
+#define STDIO_CHUNK (1 << 20)
+// Код выхода -t, когда ошибок нет, но в архиве нечем проверять целостность
+#define EXIT_UNVERIFIED 2
+
 // Перечисление для режимов работы
 typedef enum
 {
     MODE_COMPRESS,
     MODE_DECOMPRESS,
+    MODE_TRAIN,
     MODE_HELP
 } OperationMode;
 
@@ -38,20 +55,159 @@ void print_usage(void)
     printf("\n");
     printf("Утилита для сжатия и распаковки файлов с использованием алгоритма LZ77\n");
     printf("Использование:\n");
-    printf("  lz77 [-f] -c <input_file>    Сжать файл (выход: <input_file>.lz, лог: <имя_без_расширения>_compress.log)\n");
-    printf("  lz77 [-f] -d <input_file>.lz Распаковать файл (выход: d_<input_file>, лог: <имя_без_расширения>_unpack.log)\n");
+    printf("  lz77 [-f] [-T n] -c <input_file> Сжать файл (выход: <input_file>.lz, лог: <имя_без_расширения>_compress.log)\n");
+    printf("  lz77 [-f] [-T n] -d <file>.lz Распаковать файл (выход: d_<input_file>, лог: <имя_без_расширения>_unpack.log)\n");
+    printf("  lz77 [-T n] -t <file>.lz...    Проверить архивы: распаковать в память и сверить контрольные суммы;\n");
+    printf("                               код выхода %d — ошибок нет, но в архиве нет сумм (старый формат,\n", EXIT_UNVERIFIED);
+    printf("                               --no-check, словарь), и он не проверен\n");
+    printf("  lz77 [-f] [-T n] -c|-d <file>... | <dir> Пакетный режим: каждый файл (и файлы каталога\n");
+    printf("                               рекурсивно) в <file>.lz или d_<file>, без логов\n");
+    printf("  lz77 --train <dir> -o <dict> Обучить словарь на файлах-образцах из каталога <dir>\n");
     printf("  lz77 -h | --help             Показать справку\n");
     printf("Флаги:\n");
     printf("  -f                           Разрешить перезапись выходного файла и логов\n");
+    printf("  -o <file>                    Имя выходного файла (\"-\" — stdout)\n");
+    printf("  <input_file> = -             Читать stdin и писать в stdout (без лога); сжатие — в контейнер\n");
+    printf("                               с фреймами и контрольными суммами, распаковка — любого формата\n");
+    printf("  -1 ... -9                    Уровень сжатия: -1 быстрее всего, -9 лучше всего (по умолчанию -%d)\n", LZ77_DEFAULT_LEVEL);
+    printf("  --lazy <0|1|2>               Ленивый разбор: 0 — жадный, 1-2 — шагов просмотра вперёд\n");
+    printf("  -T <threads>                 Сжимать (распаковывать) фреймами в <threads> потоков\n");
+    printf("  --chain                      Начинать фрейм с хвоста предыдущего (лучше сжатие, но без\n");
+    printf("                               параллельной распаковки)\n");
+    printf("  -B <log>                     Размер фрейма 2^<log> байт (%d..%d, по умолчанию 20)\n", MIN_FRAME_LOG, MAX_FRAME_LOG);
+    printf("  -W <log>                     Окно поиска 2^<log> байт (%d..%d, по умолчанию 8 КБ);\n", LZ77_MIN_WINDOW_LOG, LZ77_MAX_WINDOW_LOG);
+    printf("                               окно шире фрейма работает только с --chain\n");
+    printf("  --long <log>                 Дальние совпадения в окне 2^<log> байт (%d..%d); фреймы\n", LZ77_MIN_LDM_LOG, LZ77_MAX_LDM_LOG);
+    printf("                               сцеплены и сжимаются в один поток\n");
+    printf("  --long-mem <log>             Память индекса дальних совпадений 2^<log> байт (%d..%d,\n", LZ77_MIN_LDM_MEM_LOG, LZ77_MAX_LDM_MEM_LOG);
+    printf("                               по умолчанию %d); меньше память — реже выборка позиций\n", LZ77_DEFAULT_LDM_MEM_LOG);
+    printf("  --no-seek                    Не записывать таблицу поиска фреймов\n");
+    printf("  --no-entropy                 Писать токены фреймов без кодов Хаффмана\n");
+    printf("  --no-check                   Не записывать контрольные суммы фреймов и содержимого\n");
+    printf("  --legacy-tokens              Прежний формат токенов (next_char после совпадения)\n");
+    printf("  --range <off>:<len>          Распаковать только <len> байт с позиции <off>\n");
+    printf("  --log-level <0..3>           Подробность лога: 0 — ничего, 1 — итог и сводка телеметрии,\n");
+    printf("                               2 — ещё строка на фрейм (по умолчанию), 3 — отладка\n");
+    printf("  --io-depth <0..%d>           Буферов по 1 МБ, читаемых вперёд и пишущих позади, пока кодек\n", LZ77_IO_MAX_DEPTH);
+    printf("                               занят (по умолчанию %d); 0 — читать и писать синхронно.\n", LZ77_IO_DEFAULT_DEPTH);
+    printf("                               Обычные файлы по возможности отображаются в память (mmap)\n");
+    printf("  --stats <file>               Записать телеметрию сжатия в <file> (CSV для .csv, иначе JSON)\n");
+    printf("  --files-from <list>          Пакетный режим: имена файлов из <list> по одному в строке\n");
+    printf("  -D <dict>                    Сжимать (распаковывать) со словарём из --train; для\n");
+    printf("                               коротких сообщений, файл обрабатывается в памяти целиком\n");
+    printf("  --store <dir>                Архив с дедупликацией: фрагменты, уже лежащие в хранилище <dir>,\n");
+    printf("                               заменяются ссылками, новые сжимаются и дописываются туда же;\n");
+    printf("                               -d и -t берут фрагменты из того же хранилища\n");
+    printf("  --dict-size <bytes>          Размер обучаемого словаря (до %d, по умолчанию %d)\n", LZ77_DICT_MAX_SIZE, LZ77_DICT_DEFAULT_SIZE);
     printf("Примеры:\n");
     printf("  lz77 -c document.txt         → создаст document.txt.lz, document_compress.log\n");
     printf("  lz77 -d document.txt.lz      → создаст d_document.txt, document_unpack.log\n");
     printf("  lz77 -f -c document.txt      → перезапишет document.txt.lz и document_compress.log\n");
+    printf("  lz77 -9 -c archive.tar       → максимальное сжатие (фреймы)\n");
+    printf("  lz77 -T 8 -c big.bin         → сожмёт big.bin фреймами в 8 потоков\n");
+    printf("  lz77 -W 20 --chain -c app.log → окно 1 МБ для далёких повторов\n");
+    printf("  lz77 --long 30 -c backups.tar → повторы на расстоянии до 1 ГБ\n");
+    printf("  cat log.txt | lz77 -c - > log.txt.lz → сжатие в конвейере\n");
+    printf("  lz77 -d --range 4096:100 big.bin.lz → извлечёт 100 байт с позиции 4096\n");
+    printf("  lz77 -T 8 -t backups/         → проверит все архивы каталога, ничего не записывая\n");
+    printf("  lz77 -T 8 -c logs/            → сожмёт все файлы каталога logs в 8 потоков\n");
+    printf("  lz77 --train samples/ -o json.dict → словарь по образцам сообщений\n");
+    printf("  lz77 -D json.dict -c msg.json → сожмёт короткое сообщение со словарём\n");
+    printf("  lz77 --store snap.store -c nightly.tar → сохранит лишь фрагменты, которых не было в прошлых снимках\n");
     printf("  lz77 -c ../word_direct/test_input.txt → обработает файл по указанному пути\n");
 }
 
-int lz77_compress(FILE *input, FILE *output, FILE *log);
-int lz77_decompress(FILE *input, FILE *output, FILE *log);
+// Разбор целочисленного значения флага в диапазоне [min, max]
+int parse_int_option(const char *text, int min, int max, int *value)
+{
+    char *end;
+    long parsed = strtol(text, &end, 10);
+    if (end == text || *end || parsed < min || parsed > max)
+        return 1;
+    *value = (int)parsed;
+    return 0;
+}
+
+// Разбор диапазона вида <смещение>:<длина>
+int parse_range_option(const char *text, unsigned long long *offset, unsigned long long *len)
+{
+    char *end;
+    *offset = strtoull(text, &end, 10);
+    if (end == text || *end != ':')
+        return 1;
+    text = end + 1;
+    *len = strtoull(text, &end, 10);
+    return end == text || *end || *len == 0;
+}
+
+// Извлечение диапазона распакованных данных в выходной файл
+int extract_range(FILE *input, FILE *output, unsigned long long offset, unsigned long long len)
+{
+    if (len > MAX_RANGE_LENGTH)
+    {
+        fprintf(stderr, RED "Ошибка: диапазон длиннее %d байт, используйте полную распаковку\n" RESET, MAX_RANGE_LENGTH);
+        return -1;
+    }
+    uint8_t *buffer = malloc(len);
+    if (!buffer)
+    {
+        fprintf(stderr, RED "Ошибка: не хватает памяти для диапазона\n" RESET);
+        return -1;
+    }
+    int64_t copied = lz77_decompress_range(input, offset, len, buffer);
+    int result = copied < 0 || fwrite(buffer, 1, copied, output) != (size_t)copied ? -1 : 0;
+    free(buffer);
+    return result;
+}
+
+// Приёмник потоковых контекстов: запись в FILE
+int write_to_file(void *opaque, const void *data, size_t len)
+{
+    return fwrite(data, 1, len, (FILE *)opaque) == len ? 0 : -1;
+}
+
+// Сжатие канала потоковым контекстом: контейнер с фреймами и контрольными суммами, вход
+// читается порциями и не копится в памяти
+int compress_stdio(FILE *input, FILE *output, const lz77_params *params)
+{
+    uint8_t *buffer = malloc(STDIO_CHUNK);
+    lz77_cctx *ctx = buffer ? lz77_cctx_init(params, write_to_file, output) : NULL;
+    int result = ctx ? 0 : -1;
+    size_t n;
+    while (!result && (n = fread(buffer, 1, STDIO_CHUNK, input)) > 0)
+        result = lz77_cctx_update(ctx, buffer, n);
+    if (ferror(input))
+        result = -1;
+    if (ctx && lz77_cctx_end(ctx) != 0)
+        result = -1;
+    free(buffer);
+    return result || fflush(output) != 0 ? -1 : 0;
+}
+
+// Распаковка канала: контейнер с фреймами — потоковым контекстом по мере чтения, старый
+// поток (первый байт ненулевой) — lz77_decompress, пустой вход — пустой выход
+int decompress_stdio(FILE *input, FILE *output, FILE *log)
+{
+    int first = getc(input);
+    if (first == EOF)
+        return ferror(input) ? -1 : 0;
+    if (ungetc(first, input) == EOF)
+        return -1;
+    if (first != 0)
+        return lz77_decompress(input, output, log);
+
+    uint8_t *buffer = malloc(STDIO_CHUNK);
+    lz77_dctx *ctx = buffer ? lz77_dctx_init(write_to_file, output) : NULL;
+    int result = ctx ? 0 : -1;
+    size_t n;
+    while (!result && (n = fread(buffer, 1, STDIO_CHUNK, input)) > 0)
+        result = lz77_dctx_update(ctx, buffer, n);
+    if (ferror(input) || (!result && lz77_dctx_finish(ctx) != 0))
+        result = -1;
+    lz77_dctx_end(ctx);
+    free(buffer);
+    return result || fflush(output) != 0 ? -1 : 0;
+}
 
 long get_file_size(const char *filename)
 {
@@ -117,7 +273,12 @@ int parse_filename(const char *input_filename, OperationMode mode, FileName *inp
         {
             fprintf(stderr, YELLOW "Предупреждение: входной файл %s уже имеет расширение .lz\n" RESET, input_filename);
         }
-        snprintf(output_file->full_name, sizeof(output_file->full_name), "%s.lz", input_filename);
+        if (snprintf(output_file->full_name, sizeof(output_file->full_name), "%s.lz", input_filename) >=
+            (int)sizeof(output_file->full_name))
+        {
+            fprintf(stderr, RED "Ошибка: слишком длинное имя файла %s\n" RESET, input_filename);
+            return 1;
+        }
     }
     else
     {
@@ -126,47 +287,83 @@ int parse_filename(const char *input_filename, OperationMode mode, FileName *inp
             fprintf(stderr, RED "Ошибка: входной файл %s должен иметь расширение .lz\n" RESET, input_filename);
             return 1;
         }
-        snprintf(output_file->full_name, sizeof(output_file->full_name), "d_%s%s", input_file->parts.base_name, input_file->parts.extension);
+        if (snprintf(output_file->full_name, sizeof(output_file->full_name), "d_%s%s", input_file->parts.base_name,
+                     input_file->parts.extension) >= (int)sizeof(output_file->full_name))
+        {
+            fprintf(stderr, RED "Ошибка: слишком длинное имя файла %s\n" RESET, input_filename);
+            return 1;
+        }
     }
 
     // Формирование имени лог-файла
-    snprintf(log_file->full_name, sizeof(log_file->full_name), "%s_%s.log", 
-             input_file->parts.base_name, mode == MODE_COMPRESS ? "compress" : "unpack");
+    if (snprintf(log_file->full_name, sizeof(log_file->full_name), "%s_%s.log", input_file->parts.base_name,
+                 mode == MODE_COMPRESS ? "compress" : "unpack") >= (int)sizeof(log_file->full_name))
+    {
+        fprintf(stderr, RED "Ошибка: слишком длинное имя файла %s\n" RESET, input_filename);
+        return 1;
+    }
 
     return 0;
 }
 
-// Открытие файлов с проверкой
+// Закрытие файла, если это не стандартный поток
+void close_file(FILE *file)
+{
+    if (!file)
+        return;
+    if (file == stdin || file == stdout)
+        fflush(file);
+    else
+        fclose(file);
+}
+
+// Открытие файлов с проверкой; "-" означает stdin/stdout, пустое имя выхода или лога — без него
 int open_files(const char *input_filename, const char *output_filename, const char *log_filename, 
                int force_overwrite, FILE **input_file, FILE **output_file, FILE **log_file)
 {
-    *input_file = fopen(input_filename, "rb");
+    *input_file = strcmp(input_filename, STDIO_NAME) == 0 ? stdin : fopen(input_filename, "rb");
     if (!*input_file)
     {
         fprintf(stderr, RED "Ошибка: не удалось открыть входной файл %s\n" RESET, input_filename);
         return 1;
     }
 
-    if (!force_overwrite && file_exists(output_filename))
+    if (!output_filename[0])
     {
-        fprintf(stderr, RED "Ошибка: выходной файл %s уже существует. Используйте -f для перезаписи\n" RESET, output_filename);
-        fclose(*input_file);
-        return 1;
+        *output_file = NULL;
     }
-
-    *output_file = fopen(output_filename, "wb");
-    if (!*output_file)
+    else if (strcmp(output_filename, STDIO_NAME) == 0)
     {
-        fprintf(stderr, RED "Ошибка: не удалось создать выходной файл %s\n" RESET, output_filename);
-        fclose(*input_file);
-        return 1;
+        *output_file = stdout;
+    }
+    else
+    {
+        if (!force_overwrite && file_exists(output_filename))
+        {
+            fprintf(stderr, RED "Ошибка: выходной файл %s уже существует. Используйте -f для перезаписи\n" RESET, output_filename);
+            close_file(*input_file);
+            return 1;
+        }
+
+        // Чтение нужно, чтобы распаковщик мог отобразить выход в память
+        *output_file = fopen(output_filename, "w+b");
+        if (!*output_file)
+        {
+            fprintf(stderr, RED "Ошибка: не удалось создать выходной файл %s\n" RESET, output_filename);
+            close_file(*input_file);
+            return 1;
+        }
     }
 
+    *log_file = NULL;
+    if (!log_filename[0])
+        return 0;
+
     if (!force_overwrite && file_exists(log_filename))
     {
         fprintf(stderr, RED "Ошибка: лог-файл %s уже существует. Используйте -f для перезаписи\n" RESET, log_filename);
-        fclose(*input_file);
-        fclose(*output_file);
+        close_file(*input_file);
+        close_file(*output_file);
         return 1;
     }
 
@@ -184,121 +381,866 @@ int open_files(const char *input_filename, const char *output_filename, const ch
     return 0;
 }
 
+// Сводка телеметрии: CSV для имени на .csv, иначе JSON
+int write_stats(const char *filename, const lz77_metrics *metrics)
+{
+    FILE *f = fopen(filename, "w");
+    if (!f)
+        return -1;
+    size_t len = strlen(filename);
+    if (len >= 4 && strcmp(filename + len - 4, ".csv") == 0)
+        lz77_metrics_csv(metrics, f);
+    else
+        lz77_metrics_json(metrics, f);
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+// Чтение всего потока в память; возвращает 0 или -1
+int read_stream(FILE *input, uint8_t **data, size_t *len)
+{
+    size_t cap = 1 << 16, used = 0;
+    uint8_t *buf = malloc(cap);
+    while (buf)
+    {
+        used += fread(buf + used, 1, cap - used, input);
+        if (used < cap)
+            break;
+        uint8_t *grown = realloc(buf, cap * 2);
+        if (!grown)
+        {
+            free(buf);
+            buf = NULL;
+            break;
+        }
+        buf = grown;
+        cap *= 2;
+    }
+    if (!buf || ferror(input))
+    {
+        free(buf);
+        return -1;
+    }
+    *data = buf;
+    *len = used;
+    return 0;
+}
+
+// Обучение словаря по всем обычным файлам каталога (без подкаталогов)
+int train_dictionary(const char *dirname, FILE *output, size_t dict_size)
+{
+    DIR *dir = opendir(dirname);
+    if (!dir)
+    {
+        fprintf(stderr, RED "Ошибка: не удалось открыть каталог %s\n" RESET, dirname);
+        return -1;
+    }
+    uint8_t *samples = NULL;
+    size_t *sizes = NULL, count = 0, sizes_cap = 0, total = 0;
+    int result = 0;
+    struct dirent *entry;
+    char path[4096];
+    while (!result && (entry = readdir(dir)))
+    {
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s", dirname, entry->d_name);
+        if (stat(path, &st) != 0 || !S_ISREG(st.st_mode) || !st.st_size)
+            continue;
+        FILE *f = fopen(path, "rb");
+        uint8_t *data = NULL;
+        size_t len = 0;
+        if (!f || read_stream(f, &data, &len) != 0)
+        {
+            fprintf(stderr, YELLOW "Предупреждение: не удалось прочитать образец %s\n" RESET, path);
+            if (f)
+                fclose(f);
+            continue;
+        }
+        fclose(f);
+        if (count == sizes_cap)
+        {
+            sizes_cap = sizes_cap ? sizes_cap * 2 : 256;
+            size_t *grown = realloc(sizes, sizes_cap * sizeof(size_t));
+            result = grown ? 0 : -1;
+            sizes = grown ? grown : sizes;
+        }
+        uint8_t *grown = result ? NULL : realloc(samples, total + len);
+        if (!grown)
+            result = -1;
+        else
+        {
+            samples = grown;
+            memcpy(samples + total, data, len);
+            total += len;
+            sizes[count++] = len;
+        }
+        free(data);
+    }
+    closedir(dir);
+
+    uint8_t *dict = result ? NULL : malloc(dict_size);
+    size_t dict_len = dict ? lz77_dict_train(samples, sizes, count, dict, dict_size) : 0;
+    if (result || !dict)
+        fprintf(stderr, RED "Ошибка: не хватает памяти для образцов\n" RESET);
+    else if (!dict_len)
+        fprintf(stderr, RED "Ошибка: образцов в %s слишком мало для словаря\n" RESET, dirname);
+    else if (fwrite(dict, 1, dict_len, output) != dict_len)
+        fprintf(stderr, RED "Ошибка: не удалось записать словарь\n" RESET);
+    else
+        printf("Словарь %zu байт обучен на %zu образцах (%zu байт)\n", dict_len, count, total);
+    result = dict_len && !ferror(output) ? 0 : -1;
+    free(dict);
+    free(samples);
+    free(sizes);
+    return result;
+}
+
+// Сжатие или распаковка всего входа в памяти со словарём из файла dict_filename
+int process_with_dict(FILE *input, FILE *output, const char *dict_filename, int level, OperationMode mode)
+{
+    FILE *dict_file = fopen(dict_filename, "rb");
+    uint8_t *content = NULL, *src = NULL, *dst = NULL;
+    size_t content_len = 0, src_len = 0;
+    int64_t size = -1;
+    if (!dict_file || read_stream(dict_file, &content, &content_len) != 0)
+    {
+        fprintf(stderr, RED "Ошибка: не удалось прочитать словарь %s\n" RESET, dict_filename);
+        if (dict_file)
+            fclose(dict_file);
+        return -1;
+    }
+    fclose(dict_file);
+
+    lz77_dict *dict = lz77_dict_load(content, content_len, level);
+    lz77_dict_ctx *ctx = lz77_dict_ctx_create(dict);
+    free(content);
+    if (!ctx)
+        fprintf(stderr, RED "Ошибка: словарь %s короче %d байт или не хватает памяти\n" RESET, dict_filename,
+                LZ77_DICT_MIN_SIZE);
+    else if (read_stream(input, &src, &src_len) == 0)
+    {
+        int64_t cap = mode == MODE_COMPRESS ? (int64_t)lz77_compress_bound(src_len) + 4 : lz77_decompressed_size(src, src_len);
+        if (cap >= 0 && (dst = malloc(cap ? cap : 1)))
+            size = mode == MODE_COMPRESS ? lz77_compress_dict(ctx, src, src_len, dst, cap)
+                                         : lz77_decompress_dict(ctx, src, src_len, dst, cap);
+        if (size >= 0 && output && fwrite(dst, 1, size, output) != (size_t)size)
+            size = -1;
+    }
+    free(src);
+    free(dst);
+    lz77_dict_ctx_free(ctx);
+    lz77_dict_free(dict);
+    return size < 0 ? -1 : 0;
+}
+
+// Список входных файлов пакетного режима
+typedef struct
+{
+    char **names;
+    size_t count;
+    size_t cap;
+} FileList;
+
+int file_list_add(FileList *list, const char *name)
+{
+    if (list->count == list->cap)
+    {
+        size_t cap = list->cap ? list->cap * 2 : 64;
+        char **grown = realloc(list->names, cap * sizeof(char *));
+        if (!grown)
+            return -1;
+        list->names = grown;
+        list->cap = cap;
+    }
+    if (!(list->names[list->count] = strdup(name)))
+        return -1;
+    list->count++;
+    return 0;
+}
+
+void file_list_free(FileList *list)
+{
+    for (size_t i = 0; i < list->count; i++)
+        free(list->names[i]);
+    free(list->names);
+}
+
+// Имя оканчивается на .lz
+int has_lz_extension(const char *name)
+{
+    size_t len = strlen(name);
+    return len >= 3 && strcmp(name + len - 3, ".lz") == 0;
+}
+
+// Рекурсивный обход каталога: при сжатии берутся файлы кроме .lz, при распаковке — только .lz
+int collect_directory(FileList *list, const char *dirname, OperationMode mode)
+{
+    DIR *dir = opendir(dirname);
+    if (!dir)
+    {
+        fprintf(stderr, RED "Ошибка: не удалось открыть каталог %s\n" RESET, dirname);
+        return -1;
+    }
+    int result = 0;
+    struct dirent *entry;
+    char path[4096];
+    while (!result && (entry = readdir(dir)))
+    {
+        struct stat st;
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+        snprintf(path, sizeof(path), "%s/%s", dirname, entry->d_name);
+        if (stat(path, &st) != 0)
+            continue;
+        if (S_ISDIR(st.st_mode))
+            result = collect_directory(list, path, mode);
+        else if (S_ISREG(st.st_mode) && has_lz_extension(path) == (mode == MODE_DECOMPRESS))
+            result = file_list_add(list, path);
+    }
+    closedir(dir);
+    return result;
+}
+
+// Файл со списком имён, по одному в строке ("-" — stdin)
+int collect_list_file(FileList *list, const char *listname)
+{
+    FILE *f = strcmp(listname, STDIO_NAME) == 0 ? stdin : fopen(listname, "r");
+    if (!f)
+    {
+        fprintf(stderr, RED "Ошибка: не удалось открыть список файлов %s\n" RESET, listname);
+        return -1;
+    }
+    char line[4096];
+    int result = 0;
+    while (!result && fgets(line, sizeof(line), f))
+    {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0])
+            result = file_list_add(list, line);
+    }
+    close_file(f);
+    return result;
+}
+
+// Имя результата пакетного режима: <file>.lz при сжатии, d_<file> без .lz рядом с архивом при распаковке
+int batch_output_name(const char *input, OperationMode mode, char *output, size_t cap)
+{
+    if (mode == MODE_COMPRESS)
+        return snprintf(output, cap, "%s.lz", input) < (int)cap ? 0 : -1;
+    if (!has_lz_extension(input))
+        return -1;
+    const char *slash = strrchr(input, '/');
+    int dir_len = slash ? (int)(slash - input + 1) : 0;
+    int base_len = (int)strlen(input) - dir_len - 3;
+    return snprintf(output, cap, "%.*sd_%.*s", dir_len, input, base_len, input + dir_len) < (int)cap ? 0 : -1;
+}
+
+// Пакет через хранилище фрагментов: писатель у хранилища один, так что файлы идут по очереди,
+// а пул потоков сжимает фрагменты внутри файла
+size_t dedup_batch(lz77_batch_item *items, size_t count, OperationMode mode, lz77_store *store,
+                   const lz77_params *params)
+{
+    size_t failed = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        lz77_batch_item *item = &items[i];
+        FILE *input = fopen(item->input, "rb");
+        FILE *output = input && item->output ? fopen(item->output, "wb") : NULL;
+        lz77_dedup_stats stats = {0};
+        item->status = -1;
+        if (input && (output || !item->output))
+            item->status = mode == MODE_COMPRESS ? lz77_dedup_compress(store, input, output, NULL, params, &stats)
+                                                 : lz77_dedup_decompress(store, input, output, NULL, &stats);
+        if (output && fclose(output) != 0)
+            item->status = -1;
+        if (input)
+            fclose(input);
+        if (item->status)
+        {
+            fprintf(stderr, RED "Ошибка: не удалось обработать %s\n" RESET, item->input);
+            failed++;
+        }
+        else if (mode == MODE_COMPRESS)
+        {
+            // Записанным считается и архив, и то, что дописано в хранилище
+            item->in_size = stats.bytes_in;
+            item->out_size = stats.archive_bytes + stats.stored_bytes;
+        }
+        else
+        {
+            item->in_size = stats.archive_bytes;
+            item->out_size = stats.bytes_in;
+        }
+    }
+    return failed;
+}
+
+// Пакетная обработка: файлы раздаются пулу потоков библиотеки, логи по файлам не ведутся.
+// При проверке (verify_only) выходные файлы не создаются.
+int run_batch(const FileList *inputs, OperationMode mode, int verify_only, const lz77_params *params,
+              int force_overwrite, lz77_store *store)
+{
+    lz77_batch_item *items = calloc(inputs->count ? inputs->count : 1, sizeof(lz77_batch_item));
+    FileList outputs = {0};
+    size_t count = 0, skipped = 0;
+    char output[4096];
+    if (!items)
+    {
+        fprintf(stderr, RED "Ошибка: не хватает памяти для списка файлов\n" RESET);
+        return 1;
+    }
+    for (size_t i = 0; i < inputs->count; i++)
+    {
+        const char *name = inputs->names[i];
+        if (verify_only)
+        {
+            items[count++].input = name;
+            continue;
+        }
+        if (batch_output_name(name, mode, output, sizeof(output)) != 0)
+        {
+            fprintf(stderr, RED "Ошибка: для %s нельзя построить имя выходного файла\n" RESET, name);
+            skipped++;
+            continue;
+        }
+        if (!force_overwrite && file_exists(output))
+        {
+            fprintf(stderr, RED "Ошибка: выходной файл %s уже существует. Используйте -f для перезаписи\n" RESET, output);
+            skipped++;
+            continue;
+        }
+        if (file_list_add(&outputs, output) != 0)
+        {
+            fprintf(stderr, RED "Ошибка: не хватает памяти для списка файлов\n" RESET);
+            free(items);
+            file_list_free(&outputs);
+            return 1;
+        }
+        items[count].input = name;
+        items[count].output = outputs.names[count];
+        count++;
+    }
+
+    size_t failed = store ? dedup_batch(items, count, mode, store, params)
+                    : mode == MODE_COMPRESS ? lz77_compress_batch(items, count, params, NULL)
+                                            : lz77_decompress_batch(items, count, params->threads, NULL);
+    unsigned long long total_in = 0, total_out = 0;
+    size_t unverified = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        total_in += items[i].in_size;
+        total_out += items[i].out_size;
+        if (items[i].status == LZ77_UNVERIFIED)
+        {
+            fprintf(stderr, YELLOW "Не проверено: в %s нет контрольных сумм\n" RESET, items[i].input);
+            unverified++;
+        }
+    }
+    printf("%s файлов: %zu, ошибок: %zu\n", mode == MODE_COMPRESS ? "Сжато" : verify_only ? "Проверено" : "Распаковано",
+           count - failed - unverified, failed + skipped);
+    if (unverified)
+        printf("Без контрольных сумм, не проверено: %zu\n", unverified);
+    printf("Прочитано: %llu байт, %s: %llu байт\n", total_in, verify_only ? "распаковано в памяти" : "записано", total_out);
+    if (mode == MODE_COMPRESS && total_in)
+        printf("Сжатие: %.2f%%\n", 100.0 * total_out / total_in);
+    free(items);
+    file_list_free(&outputs);
+    return failed + skipped ? 1 : unverified ? EXIT_UNVERIFIED : 0;
+}
+
 int main(int argc, char *argv[])
 {
     OperationMode mode = MODE_HELP;
+    int mode_set = 0;
     int force_overwrite = 0;
+    int use_frames = 0;
+    int use_range = 0;
+    int verify_only = 0;
+    unsigned long long range_offset = 0, range_len = 0;
     char *input_filename = NULL;
+    char *output_filename = NULL;
+    char *stats_filename = NULL;
+    char *dict_filename = NULL;
+    char *list_filename = NULL;
+    char *store_path = NULL;
+    FileList inputs = {0};
+    int dict_size = LZ77_DICT_DEFAULT_SIZE;
     FileName input_file, output_file, log_file;
+    lz77_params params;
+    lz77_metrics metrics = {0};
+
+    lz77_params_default(&params);
 
     // Обработка аргументов
-    if (argc < 2 || argc > 4)
+    if (argc < 2)
     {
         print_usage();
         return 1;
     }
 
-    if (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)
-    {
-        mode = MODE_HELP;
-    }
-    else if (argc == 4 && strcmp(argv[1], "-f") == 0)
+    for (int i = 1; i < argc; i++)
     {
-        force_overwrite = 1;
-        if (strcmp(argv[2], "-c") == 0)
-            mode = MODE_COMPRESS;
-        else if (strcmp(argv[2], "-d") == 0)
-            mode = MODE_DECOMPRESS;
-        else
+        if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0)
         {
-            fprintf(stderr, RED "Ошибка: неизвестный режим %s\n" RESET, argv[2]);
+            print_usage();
+            return 0;
+        }
+        else if (strcmp(argv[i], "-f") == 0)
+        {
+            force_overwrite = 1;
+        }
+        else if (strcmp(argv[i], "-c") == 0 || strcmp(argv[i], "-d") == 0 || strcmp(argv[i], "-t") == 0)
+        {
+            if (mode_set)
+            {
+                fprintf(stderr, RED "Ошибка: режим указан повторно\n" RESET);
+                return 1;
+            }
+            // Проверка — та же распаковка, только без выхода
+            mode = argv[i][1] == 'c' ? MODE_COMPRESS : MODE_DECOMPRESS;
+            verify_only = argv[i][1] == 't';
+            mode_set = 1;
+        }
+        else if (strcmp(argv[i], "--train") == 0)
+        {
+            if (mode_set)
+            {
+                fprintf(stderr, RED "Ошибка: режим указан повторно\n" RESET);
+                return 1;
+            }
+            mode = MODE_TRAIN;
+            mode_set = 1;
+        }
+        else if (strcmp(argv[i], "-D") == 0)
+        {
+            if (i + 1 >= argc)
+            {
+                fprintf(stderr, RED "Ошибка: -D ожидает имя файла словаря\n" RESET);
+                return 1;
+            }
+            dict_filename = argv[++i];
+        }
+        else if (strcmp(argv[i], "--files-from") == 0)
+        {
+            if (i + 1 >= argc)
+            {
+                fprintf(stderr, RED "Ошибка: --files-from ожидает файл со списком имён\n" RESET);
+                return 1;
+            }
+            list_filename = argv[++i];
+        }
+        else if (strcmp(argv[i], "--dict-size") == 0)
+        {
+            if (i + 1 >= argc || parse_int_option(argv[++i], LZ77_DICT_MIN_SIZE, LZ77_DICT_MAX_SIZE, &dict_size) != 0)
+            {
+                fprintf(stderr, RED "Ошибка: --dict-size ожидает размер от %d до %d байт\n" RESET,
+                        LZ77_DICT_MIN_SIZE, LZ77_DICT_MAX_SIZE);
+                return 1;
+            }
+        }
+        else if (argv[i][0] == '-' && argv[i][1] >= '0' + LZ77_MIN_LEVEL && argv[i][1] <= '0' + LZ77_MAX_LEVEL && !argv[i][2])
+        {
+            params.level = argv[i][1] - '0';
+            use_frames = 1;
+        }
+        else if (strcmp(argv[i], "--lazy") == 0)
+        {
+            if (i + 1 >= argc || parse_int_option(argv[++i], 0, LZ77_MAX_LAZY, &params.lazy) != 0)
+            {
+                fprintf(stderr, RED "Ошибка: --lazy ожидает глубину от 0 до %d\n" RESET, LZ77_MAX_LAZY);
+                return 1;
+            }
+            use_frames = 1;
+        }
+        else if (strcmp(argv[i], "-o") == 0)
+        {
+            if (i + 1 >= argc)
+            {
+                fprintf(stderr, RED "Ошибка: -o ожидает имя выходного файла\n" RESET);
+                return 1;
+            }
+            output_filename = argv[++i];
+        }
+        else if (strcmp(argv[i], "-T") == 0)
+        {
+            if (i + 1 >= argc || parse_int_option(argv[++i], 1, MAX_THREADS, &params.threads) != 0)
+            {
+                fprintf(stderr, RED "Ошибка: -T ожидает число потоков от 1 до %d\n" RESET, MAX_THREADS);
+                return 1;
+            }
+            use_frames = 1;
+        }
+        else if (strcmp(argv[i], "--chain") == 0)
+        {
+            params.chain = 1;
+            use_frames = 1;
+        }
+        else if (strcmp(argv[i], "-B") == 0)
+        {
+            if (i + 1 >= argc || parse_int_option(argv[++i], MIN_FRAME_LOG, MAX_FRAME_LOG, &params.frame_log) != 0)
+            {
+                fprintf(stderr, RED "Ошибка: -B ожидает log2 размера фрейма от %d до %d\n" RESET, MIN_FRAME_LOG, MAX_FRAME_LOG);
+                return 1;
+            }
+            use_frames = 1;
+        }
+        else if (strcmp(argv[i], "-W") == 0)
+        {
+            if (i + 1 >= argc || parse_int_option(argv[++i], LZ77_MIN_WINDOW_LOG, LZ77_MAX_WINDOW_LOG, &params.window_log) != 0)
+            {
+                fprintf(stderr, RED "Ошибка: -W ожидает log2 окна от %d до %d\n" RESET, LZ77_MIN_WINDOW_LOG, LZ77_MAX_WINDOW_LOG);
+                return 1;
+            }
+            use_frames = 1;
+        }
+        else if (strcmp(argv[i], "--long") == 0)
+        {
+            if (i + 1 >= argc || parse_int_option(argv[++i], LZ77_MIN_LDM_LOG, LZ77_MAX_LDM_LOG, &params.ldm_log) != 0)
+            {
+                fprintf(stderr, RED "Ошибка: --long ожидает log2 окна от %d до %d\n" RESET, LZ77_MIN_LDM_LOG, LZ77_MAX_LDM_LOG);
+                return 1;
+            }
+            use_frames = 1;
+        }
+        else if (strcmp(argv[i], "--long-mem") == 0)
+        {
+            if (i + 1 >= argc ||
+                parse_int_option(argv[++i], LZ77_MIN_LDM_MEM_LOG, LZ77_MAX_LDM_MEM_LOG, &params.ldm_mem_log) != 0)
+            {
+                fprintf(stderr, RED "Ошибка: --long-mem ожидает log2 памяти от %d до %d\n" RESET,
+                        LZ77_MIN_LDM_MEM_LOG, LZ77_MAX_LDM_MEM_LOG);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--range") == 0)
+        {
+            if (i + 1 >= argc || parse_range_option(argv[++i], &range_offset, &range_len) != 0)
+            {
+                fprintf(stderr, RED "Ошибка: --range ожидает <смещение>:<длина>\n" RESET);
+                return 1;
+            }
+            use_range = 1;
+        }
+        else if (strcmp(argv[i], "--store") == 0)
+        {
+            if (i + 1 >= argc)
+            {
+                fprintf(stderr, RED "Ошибка: --store ожидает каталог хранилища\n" RESET);
+                return 1;
+            }
+            store_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--no-entropy") == 0)
+        {
+            params.entropy = 0;
+            use_frames = 1;
+        }
+        else if (strcmp(argv[i], "--no-check") == 0)
+        {
+            params.checksum = 0;
+            use_frames = 1;
+        }
+        else if (strcmp(argv[i], "--log-level") == 0)
+        {
+            int level;
+            if (i + 1 >= argc || parse_int_option(argv[++i], LZ77_LOG_QUIET, LZ77_LOG_DEBUG, &level) != 0)
+            {
+                fprintf(stderr, RED "Ошибка: --log-level ожидает уровень от %d до %d\n" RESET, LZ77_LOG_QUIET, LZ77_LOG_DEBUG);
+                return 1;
+            }
+            lz77_set_log_level(level);
+        }
+        else if (strcmp(argv[i], "--io-depth") == 0)
+        {
+            int depth;
+            if (i + 1 >= argc || parse_int_option(argv[++i], 0, LZ77_IO_MAX_DEPTH, &depth) != 0)
+            {
+                fprintf(stderr, RED "Ошибка: --io-depth ожидает число буферов от 0 до %d\n" RESET, LZ77_IO_MAX_DEPTH);
+                return 1;
+            }
+            lz77_set_io_depth(depth);
+        }
+        else if (strcmp(argv[i], "--stats") == 0)
+        {
+            if (i + 1 >= argc)
+            {
+                fprintf(stderr, RED "Ошибка: --stats ожидает имя файла\n" RESET);
+                return 1;
+            }
+            stats_filename = argv[++i];
+            params.metrics = &metrics;
+            use_frames = 1;
+        }
+        else if (strcmp(argv[i], "--legacy-tokens") == 0)
+        {
+            params.sequences = 0;
+            use_frames = 1;
+        }
+        else if (strcmp(argv[i], "--no-seek") == 0)
+        {
+            params.seek_table = 0;
+            use_frames = 1;
+        }
+        else if (argv[i][0] == '-' && argv[i][1])
+        {
+            fprintf(stderr, RED "Ошибка: неизвестный флаг %s\n" RESET, argv[i]);
             print_usage();
             return 1;
         }
-        input_filename = argv[3];
+        else
+        {
+            if (!input_filename)
+                input_filename = argv[i];
+            if (file_list_add(&inputs, argv[i]) != 0)
+            {
+                fprintf(stderr, RED "Ошибка: не хватает памяти для списка файлов\n" RESET);
+                return 1;
+            }
+        }
+    }
+
+    if (store_path && (mode == MODE_TRAIN || dict_filename || use_range))
+    {
+        fprintf(stderr, RED "Ошибка: --store используется только с -c, -d и -t и не сочетается с -D и --range\n" RESET);
+        return 1;
     }
-    else if (argc == 3)
+
+    // Несколько файлов, каталог или список — пакетный режим
+    struct stat input_stat;
+    int use_batch = (mode == MODE_COMPRESS || mode == MODE_DECOMPRESS) &&
+                    (inputs.count > 1 || list_filename ||
+                     (input_filename && stat(input_filename, &input_stat) == 0 && S_ISDIR(input_stat.st_mode)));
+    if (use_batch)
     {
-        if (strcmp(argv[1], "-c") == 0)
-            mode = MODE_COMPRESS;
-        else if (strcmp(argv[1], "-d") == 0)
-            mode = MODE_DECOMPRESS;
-        else
+        FileList files = {0};
+        int result = 0;
+        if (output_filename || dict_filename || use_range)
         {
-            fprintf(stderr, RED "Ошибка: неизвестный режим %s\n" RESET, argv[1]);
-            print_usage();
-            return 1;
+            fprintf(stderr, RED "Ошибка: пакетный режим не сочетается с -o, -D и --range\n" RESET);
+            result = 1;
+        }
+        for (size_t i = 0; !result && i < inputs.count; i++)
+        {
+            if (stat(inputs.names[i], &input_stat) == 0 && S_ISDIR(input_stat.st_mode))
+                result = collect_directory(&files, inputs.names[i], mode) != 0;
+            else
+                result = file_list_add(&files, inputs.names[i]) != 0;
         }
-        input_filename = argv[2];
+        if (!result && list_filename)
+            result = collect_list_file(&files, list_filename) != 0;
+        lz77_store *store = NULL;
+        if (!result && store_path && !(store = lz77_store_open(store_path, mode == MODE_COMPRESS)))
+            result = 1;
+        if (!result)
+            result = run_batch(&files, mode, verify_only, &params, force_overwrite, store);
+        if (lz77_store_close(store) != 0 && !result)
+        {
+            fprintf(stderr, RED "Ошибка: не удалось закрыть хранилище %s\n" RESET, store_path);
+            result = 1;
+        }
+        if (!result && stats_filename && write_stats(stats_filename, &metrics) != 0)
+            fprintf(stderr, YELLOW "Предупреждение: не удалось записать телеметрию в %s\n" RESET, stats_filename);
+        file_list_free(&files);
+        file_list_free(&inputs);
+        return result;
     }
-    else
+    if (inputs.count > 1)
     {
         fprintf(stderr, RED "Ошибка: неверное количество аргументов\n" RESET);
+        file_list_free(&inputs);
         print_usage();
         return 1;
     }
+    file_list_free(&inputs);
 
-    // Основная логика
-    if (mode == MODE_HELP)
+    if (!mode_set || !input_filename)
     {
+        fprintf(stderr, RED "Ошибка: укажите режим -c, -d или --train и входной файл\n" RESET);
         print_usage();
-        return 0;
+        return 1;
+    }
+    if (use_range && (mode != MODE_DECOMPRESS || verify_only))
+    {
+        fprintf(stderr, RED "Ошибка: --range используется только с -d\n" RESET);
+        return 1;
+    }
+    if (verify_only && output_filename)
+    {
+        fprintf(stderr, RED "Ошибка: -t ничего не записывает и не сочетается с -o\n" RESET);
+        return 1;
     }
 
-    // Парсинг имени файла
-    if (parse_filename(input_filename, mode, &input_file, &output_file, &log_file) != 0)
+    if (mode == MODE_TRAIN)
+    {
+        // Выход по умолчанию — <каталог>.dict рядом с каталогом
+        char dict_name[sizeof(output_file.full_name)];
+        size_t len = strlen(input_filename);
+        while (len > 1 && input_filename[len - 1] == '/')
+            len--;
+        snprintf(dict_name, sizeof(dict_name), "%.*s.dict", (int)len, input_filename);
+        const char *name = output_filename ? output_filename : dict_name;
+        if (!force_overwrite && strcmp(name, STDIO_NAME) != 0 && file_exists(name))
+        {
+            fprintf(stderr, RED "Ошибка: выходной файл %s уже существует. Используйте -f для перезаписи\n" RESET, name);
+            return 1;
+        }
+        FILE *output = strcmp(name, STDIO_NAME) == 0 ? stdout : fopen(name, "wb");
+        if (!output)
+        {
+            fprintf(stderr, RED "Ошибка: не удалось создать выходной файл %s\n" RESET, name);
+            return 1;
+        }
+        int result = train_dictionary(input_filename, output, dict_size);
+        close_file(output);
+        return result ? 1 : 0;
+    }
+    if (dict_filename && use_range)
+    {
+        fprintf(stderr, RED "Ошибка: -D не сочетается с --range\n" RESET);
+        return 1;
+    }
+
+    // Парсинг имени файла; для stdin выход по умолчанию идёт в stdout, а лог не ведётся
+    int use_stdin = strcmp(input_filename, STDIO_NAME) == 0;
+    if (verify_only)
+    {
+        output_file.full_name[0] = '\0';
+        log_file.full_name[0] = '\0';
+    }
+    else if (use_stdin)
+    {
+        strcpy(output_file.full_name, STDIO_NAME);
+        log_file.full_name[0] = '\0';
+    }
+    else if (parse_filename(input_filename, mode, &input_file, &output_file, &log_file) != 0)
+    {
+        return 1;
+    }
+    if (output_filename)
+    {
+        strncpy(output_file.full_name, output_filename, sizeof(output_file.full_name) - 1);
+        output_file.full_name[sizeof(output_file.full_name) - 1] = '\0';
+    }
+    int use_stdout = strcmp(output_file.full_name, STDIO_NAME) == 0;
+    // Сообщения не должны смешиваться с данными, когда выход — stdout
+    FILE *info = use_stdout ? stderr : stdout;
+
+    // Хранилище открывается до выходного файла, чтобы при ошибке не оставлять пустой архив
+    lz77_store *store = NULL;
+    if (store_path && !(store = lz77_store_open(store_path, mode == MODE_COMPRESS)))
         return 1;
 
     // Открытие файлов
     FILE *input_file_ptr = NULL, *output_file_ptr = NULL, *log_file_ptr = NULL;
     if (open_files(input_filename, output_file.full_name, log_file.full_name, 
                    force_overwrite, &input_file_ptr, &output_file_ptr, &log_file_ptr) != 0)
+    {
+        lz77_store_close(store);
         return 1;
+    }
 
-    // Получение размера входного файла
-    long input_size = get_file_size(input_filename);
-    if (input_size < 0)
+    // Получение размера входного файла (для stdin неизвестен)
+    long input_size = use_stdin ? -1 : get_file_size(input_filename);
+    if (!use_stdin && input_size < 0)
     {
         fprintf(stderr, RED "Ошибка: не удалось определить размер входного файла\n" RESET);
-        fclose(input_file_ptr);
-        fclose(output_file_ptr);
-        if (log_file_ptr)
-            fclose(log_file_ptr);
+        close_file(input_file_ptr);
+        close_file(output_file_ptr);
+        close_file(log_file_ptr);
+        lz77_store_close(store);
         return 1;
     }
 
     // Выполнение операции
     int result;
+    lz77_dedup_stats dedup = {0};
     if (mode == MODE_COMPRESS)
     {
-        printf("Сжатие %s → %s...\n", input_filename, output_file.full_name);
-        result = lz77_compress(input_file_ptr, output_file_ptr, log_file_ptr);
+        fprintf(info, "Сжатие %s → %s...\n", input_filename, output_file.full_name);
+        if (store)
+            result = lz77_dedup_compress(store, input_file_ptr, output_file_ptr, log_file_ptr, &params, &dedup);
+        else if (dict_filename)
+            result = process_with_dict(input_file_ptr, output_file_ptr, dict_filename, params.level, mode);
+        else if (use_stdin && params.threads <= 1)
+            result = compress_stdio(input_file_ptr, output_file_ptr, &params);
+        else if (use_frames)
+            result = lz77_compress_frames(input_file_ptr, output_file_ptr, log_file_ptr, &params);
+        else
+            result = lz77_compress(input_file_ptr, output_file_ptr, log_file_ptr);
         if (result == 0)
         {
             fflush(output_file_ptr);
-            long output_size = get_file_size(output_file.full_name);
-            printf(GREEN "Сжатие успешно завершено: %s\n" RESET, output_file.full_name);
-            printf("Размер исходного файла: %ld байт\n", input_size);
-            printf("Размер сжатого файла: %ld байт\n", output_size);
-            if (input_size > 0)
-                printf("Сжатие: %.2f%%\n", 100.0 * output_size / input_size);
+            long output_size = use_stdout ? -1 : get_file_size(output_file.full_name);
+            fprintf(info, GREEN "Сжатие успешно завершено: %s\n" RESET, output_file.full_name);
+            if (input_size >= 0)
+                fprintf(info, "Размер исходного файла: %ld байт\n", input_size);
+            if (output_size >= 0)
+                fprintf(info, "Размер сжатого файла: %ld байт\n", output_size);
+            if (input_size > 0 && output_size >= 0)
+                fprintf(info, "Сжатие: %.2f%%\n", 100.0 * output_size / input_size);
+            if (store)
+            {
+                fprintf(info, "Фрагментов: %llu, новых: %llu (%llu байт)\n", (unsigned long long)dedup.chunks,
+                        (unsigned long long)dedup.new_chunks, (unsigned long long)dedup.new_bytes);
+                fprintf(info, "Дописано в хранилище: %llu байт\n", (unsigned long long)dedup.stored_bytes);
+                if (dedup.bytes_in)
+                    fprintf(info, "Сжатие с учётом хранилища: %.2f%%\n",
+                            100.0 * (dedup.archive_bytes + dedup.stored_bytes) / dedup.bytes_in);
+            }
+            if (stats_filename && write_stats(stats_filename, &metrics) != 0)
+                fprintf(stderr, YELLOW "Предупреждение: не удалось записать телеметрию в %s\n" RESET, stats_filename);
         }
         else
         {
             fprintf(stderr, RED "Ошибка сжатия\n" RESET);
         }
     }
+    else if (verify_only)
+    {
+        // Параллельная проверка по таблице поиска, когда она есть; иначе последовательная
+        fprintf(info, "Проверка %s...\n", input_filename);
+        if (store)
+            result = lz77_dedup_decompress(store, input_file_ptr, NULL, log_file_ptr, NULL);
+        else if (dict_filename)
+        {
+            // Данные со словарём, как и lz77_compress_buf, без контрольных сумм
+            result = process_with_dict(input_file_ptr, NULL, dict_filename, params.level, mode);
+            if (result == 0)
+                result = LZ77_UNVERIFIED;
+        }
+        else
+            result = lz77_decompress_frames(input_file_ptr, NULL, log_file_ptr, params.threads);
+        if (result == 0)
+            fprintf(info, GREEN "Проверка пройдена: %s\n" RESET, input_filename);
+        else if (result == LZ77_UNVERIFIED)
+            fprintf(info, YELLOW "Не проверено: в %s нет контрольных сумм (старый формат, --no-check или словарь); "
+                    "данные разобраны без ошибок, но их целостность не подтверждена\n" RESET, input_filename);
+        else
+            fprintf(stderr, RED "Ошибка проверки: %s повреждён\n" RESET, input_filename);
+    }
     else
     {
-        printf("Распаковка %s → %s...\n", input_filename, output_file.full_name);
-        result = lz77_decompress(input_file_ptr, output_file_ptr, log_file_ptr);
+        fprintf(info, "Распаковка %s → %s...\n", input_filename, output_file.full_name);
+        if (store)
+            result = lz77_dedup_decompress(store, input_file_ptr, output_file_ptr, log_file_ptr, NULL);
+        else if (dict_filename)
+            result = process_with_dict(input_file_ptr, output_file_ptr, dict_filename, params.level, mode);
+        else if (use_range)
+            result = extract_range(input_file_ptr, output_file_ptr, range_offset, range_len);
+        else if (use_stdin && params.threads <= 1)
+            result = decompress_stdio(input_file_ptr, output_file_ptr, log_file_ptr);
+        else if (use_frames)
+            result = lz77_decompress_frames(input_file_ptr, output_file_ptr, log_file_ptr, params.threads);
+        else
+            result = lz77_decompress(input_file_ptr, output_file_ptr, log_file_ptr);
         if (result == 0)
         {
             fflush(output_file_ptr);
-            long output_size = get_file_size(output_file.full_name);
-            printf(GREEN "Распаковка успешно завершена: %s\n" RESET, output_file.full_name);
-            printf("Размер сжатого файла: %ld байт\n", input_size);
-            printf("Размер распакованного файла: %ld байт\n", output_size);
+            long output_size = use_stdout ? -1 : get_file_size(output_file.full_name);
+            fprintf(info, GREEN "Распаковка успешно завершена: %s\n" RESET, output_file.full_name);
+            if (input_size >= 0)
+                fprintf(info, "Размер сжатого файла: %ld байт\n", input_size);
+            if (output_size >= 0)
+                fprintf(info, "Размер распакованного файла: %ld байт\n", output_size);
         }
         else
         {
@@ -307,12 +1249,16 @@ int main(int argc, char *argv[])
     }
 
     // Закрытие файлов
-    fclose(input_file_ptr);
-    fclose(output_file_ptr);
-    if (log_file_ptr)
-        fclose(log_file_ptr);
+    close_file(input_file_ptr);
+    close_file(output_file_ptr);
+    close_file(log_file_ptr);
+    if (lz77_store_close(store) != 0 && result == 0)
+    {
+        fprintf(stderr, RED "Ошибка: не удалось закрыть хранилище %s\n" RESET, store_path);
+        result = 1;
+    }
 
-    return result;
+    return result == LZ77_UNVERIFIED ? EXIT_UNVERIFIED : result;
 }
 
 
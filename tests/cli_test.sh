@@ -0,0 +1,105 @@
+#!/bin/sh
+# Круговые проверки утилиты: файлы и каналы (stdin/stdout), старый формат и фреймы, пустой
+# вход, проверка архивов (-t) и порча. Использование: tests/cli_test.sh [путь к lz77]
+# У каждого раздела в квадратных скобках — заявки, поведение которых он проверяет.
+
+LZ77=${1:-bin/lz77}
+case $LZ77 in
+/*) ;;
+*) LZ77=$(pwd)/$LZ77 ;;
+esac
+DIR=$(mktemp -d /tmp/lz77_cli_XXXXXX) || exit 1
+trap 'rm -rf "$DIR"' EXIT
+cd "$DIR" || exit 1
+failures=0
+
+fail()
+{
+    echo "  ОШИБКА: $*" >&2
+    failures=$((failures + 1))
+}
+
+# Входные файлы: пустой, один байт, текст, случайные данные и смесь больше буферов кодеров
+: > empty
+printf 'x' > one
+i=0
+while [ $i -lt 3000 ]; do
+    echo "строка $i: the quick brown fox jumps over the lazy dog $((i % 17))"
+    i=$((i + 1))
+done > text
+head -c 300000 /dev/urandom > random
+cat text random text text > mixed
+INPUTS="empty one text random mixed"
+
+# Файл → файл: старый формат, фреймы в несколько потоков и сцепленные фреймы [user-001, user-011]
+for f in $INPUTS; do
+    for mode in "" "-T 4" "-T 2 --chain -9"; do
+        # shellcheck disable=SC2086
+        "$LZ77" -f $mode -c "$f" -o "$f.lz" >/dev/null 2>&1 || fail "сжатие $f ($mode)"
+        "$LZ77" -f -d "$f.lz" -o "$f.out" >/dev/null 2>&1 || fail "распаковка $f ($mode)"
+        cmp -s "$f" "$f.out" || fail "файл $f ($mode) не совпал после распаковки"
+    done
+done
+
+# Канал → канал, в том числе через принудительный синхронный ввод-вывод [user-005, user-020, user-023]
+for f in $INPUTS; do
+    cat "$f" | "$LZ77" -c - 2>/dev/null | "$LZ77" -d - > "$f.pipe" 2>/dev/null || fail "канал $f"
+    cmp -s "$f" "$f.pipe" || fail "канал: $f не совпал после распаковки"
+    LZ77_IO_BACKEND=sync "$LZ77" -f -c "$f" -o "$f.sync.lz" >/dev/null 2>&1 || fail "сжатие $f (sync)"
+    "$LZ77" -f -c "$f" -o "$f.lz" >/dev/null 2>&1
+    cmp -s "$f.lz" "$f.sync.lz" || fail "$f: поток без отображения отличается от отображённого"
+    cat "$f.lz" | "$LZ77" -d - > "$f.pipe" 2>/dev/null || fail "распаковка из канала $f"
+    cmp -s "$f" "$f.pipe" || fail "распаковка из канала: $f не совпал"
+done
+
+# Канал сжимается в контейнер с фреймами (первый байт нулевой), в том числе в несколько потоков
+# [user-005]
+for f in text mixed; do
+    [ "$(cat "$f" | "$LZ77" -c - 2>/dev/null | head -c 1 | od -An -tu1 | tr -d ' ')" = 0 ] ||
+        fail "канал: $f сжат не в контейнер с фреймами"
+    cat "$f" | "$LZ77" -T 2 -9 -c - 2>/dev/null | "$LZ77" -d - > "$f.pipe" 2>/dev/null || fail "канал -T 2 $f"
+    cmp -s "$f" "$f.pipe" || fail "канал -T 2: $f не совпал после распаковки"
+done
+# Повреждённый контейнер из канала не распаковывается молча [user-018]
+cat mixed | "$LZ77" -c - 2>/dev/null > pipe.lz
+printf '\377' | dd of=pipe.lz bs=1 seek=100 conv=notrunc 2>/dev/null
+cat pipe.lz | "$LZ77" -d - > /dev/null 2>&1 && fail "канал: порча контейнера не замечена"
+
+# Пустой вход — пустой выход [user-005]
+[ "$(cat empty | "$LZ77" -c - 2>/dev/null | "$LZ77" -d - 2>/dev/null | wc -c)" -eq 0 ] || fail "пустой вход через канал"
+
+# Проверка фреймового архива и порча данных [user-018]
+"$LZ77" -f -T 2 -c mixed -o mixed.lz >/dev/null 2>&1
+"$LZ77" -t mixed.lz >/dev/null 2>&1 || fail "-t на целом архиве"
+cp mixed.lz bad.lz
+printf '\377' | dd of=bad.lz bs=1 seek=100 conv=notrunc 2>/dev/null
+"$LZ77" -t bad.lz >/dev/null 2>&1 && fail "-t не заметил порчу"
+head -c 1000 mixed.lz > cut.lz
+"$LZ77" -f -d cut.lz -o cut.out >/dev/null 2>&1 && fail "обрезанный архив распакован без ошибки"
+# Таблица поиска с размером фрейма больше возможного отвергается до отображения выхода:
+# распаковка идёт по самим фреймам. Порча фрейма не оставляет заранее выделенный файл [user-023]
+"$LZ77" -f -T 1 -c mixed -o seek.lz >/dev/null 2>&1
+cp seek.lz seek_bad.lz
+printf '\360\377\377\377' | dd of=seek.lz bs=1 seek=$(($(wc -c < seek.lz) - 12)) conv=notrunc 2>/dev/null
+"$LZ77" -f -d seek.lz -o seek.out >/dev/null 2>&1 || fail "распаковка с порченой таблицей поиска"
+cmp -s mixed seek.out || fail "порченая таблица поиска исказила выход"
+printf '\377' | dd of=seek_bad.lz bs=1 seek=100 conv=notrunc 2>/dev/null
+"$LZ77" -f -d seek_bad.lz -o seek_bad.out >/dev/null 2>&1 && fail "порча фрейма не замечена"
+[ ! -s seek_bad.out ] || fail "после ошибки распаковки остался файл выхода"
+# Обрезанная сигнатура — не архив с дедупликацией и не фреймы [user-025]
+printf '\000LZ' > short.lz
+"$LZ77" -d short.lz -o short.out 2>&1 | grep -q 'Invalid frame magic' || fail "обрезанная сигнатура не отвергнута"
+
+# Архивы без контрольных сумм (старый формат, --no-check) не считаются проверенными: код 2
+# [user-018]
+"$LZ77" -f -c mixed -o legacy.lz >/dev/null 2>&1
+"$LZ77" -t legacy.lz >/dev/null 2>&1
+[ $? -eq 2 ] || fail "-t на старом формате должен вернуть код 2"
+"$LZ77" -f -T 2 --no-check -c mixed -o nocheck.lz >/dev/null 2>&1
+"$LZ77" -t nocheck.lz >/dev/null 2>&1
+[ $? -eq 2 ] || fail "-t на архиве --no-check должен вернуть код 2"
+"$LZ77" -t mixed.lz legacy.lz >/dev/null 2>&1
+[ $? -eq 2 ] || fail "-t на нескольких файлах без контрольных сумм должен вернуть код 2"
+
+echo "Проваленных проверок утилиты: $failures"
+[ $failures -eq 0 ]
@@ -0,0 +1,876 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "lz77.h"
+
+// Тесты библиотеки: круговые проверки (сжатие → распаковка → сравнение) и повреждённые данные
+// для всех путей — буфер-в-буфер, потоковые контексты, фреймы в файлах, распаковка диапазона,
+// словари, пакеты файлов, архивы с дедупликацией и старый потоковый формат (отображение,
+// поток, канал), а также телеметрия сжатия.
+// Каждый тест печатает строку с итогом; код возврата — число проваленных проверок.
+
+static int failures;
+// Что сейчас проверяется (корпус, размер, вариант), для сообщений о провале
+static char context[128];
+
+#define CHECK(cond)                                                                             \
+    do                                                                                          \
+    {                                                                                           \
+        if (!(cond))                                                                            \
+        {                                                                                       \
+            fprintf(stderr, "  ОШИБКА %s:%d [%s]: %s\n", __FILE__, __LINE__, context, #cond);   \
+            failures++;                                                                         \
+        }                                                                                       \
+    } while (0)
+
+// Корпуса входа
+typedef enum
+{
+    CORPUS_TEXT,
+    CORPUS_RANDOM,
+    CORPUS_ZEROS,
+    CORPUS_MIXED,
+    CORPUS_COUNT
+} corpus_kind;
+
+static const char *corpus_names[CORPUS_COUNT] = {"text", "random", "zeros", "mixed"};
+
+static uint64_t rng_next(uint64_t *state)
+{
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 2685821657736338717ULL;
+}
+
+// Текст из слов небольшого словаря: много повторов на разных дистанциях
+static void gen_text(uint8_t *dst, size_t len, uint64_t *state)
+{
+    static const char *words[] = {"lorem", "ipsum", "dolor", "sit", "amet", "consectetur", "adipiscing",
+                                  "elit", "sed", "do", "eiusmod", "tempor", "incididunt", "ut", "labore",
+                                  "et", "dolore", "magna", "aliqua", "\n"};
+    size_t pos = 0;
+    while (pos < len)
+    {
+        const char *w = words[rng_next(state) % (sizeof(words) / sizeof(words[0]))];
+        for (size_t i = 0; w[i] && pos < len; i++)
+            dst[pos++] = (uint8_t)w[i];
+        if (pos < len)
+            dst[pos++] = ' ';
+    }
+}
+
+static uint8_t *make_corpus(corpus_kind kind, size_t len, uint64_t seed)
+{
+    uint8_t *data = malloc(len ? len : 1);
+    uint64_t state = 0x9E3779B97F4A7C15ULL ^ seed ^ kind;
+    if (!data)
+        return NULL;
+    switch (kind)
+    {
+    case CORPUS_TEXT:
+        gen_text(data, len, &state);
+        break;
+    case CORPUS_RANDOM:
+        for (size_t i = 0; i < len; i++)
+            data[i] = (uint8_t)(rng_next(&state) >> 56);
+        break;
+    case CORPUS_ZEROS:
+        memset(data, 0, len);
+        break;
+    default:
+        // Чередование несжимаемых и текстовых участков по 32 КБ
+        for (size_t pos = 0; pos < len; pos += 32768)
+        {
+            size_t n = len - pos < 32768 ? len - pos : 32768;
+            if (pos / 32768 % 2)
+                gen_text(data + pos, n, &state);
+            else
+                for (size_t i = 0; i < n; i++)
+                    data[pos + i] = (uint8_t)(rng_next(&state) >> 56);
+        }
+        break;
+    }
+    return data;
+}
+
+// Растущий буфер — приёмник потоковых контекстов
+typedef struct {
+    uint8_t *data;
+    size_t len, cap;
+} membuf;
+
+static int membuf_write(void *opaque, const void *data, size_t len)
+{
+    membuf *b = opaque;
+    if (b->len + len > b->cap)
+    {
+        size_t cap = b->cap ? b->cap : 4096;
+        while (cap < b->len + len)
+            cap *= 2;
+        uint8_t *p = realloc(b->data, cap);
+        if (!p)
+            return -1;
+        b->data = p;
+        b->cap = cap;
+    }
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+    return 0;
+}
+
+static FILE *file_with(const void *data, size_t len)
+{
+    FILE *f = tmpfile();
+    if (f && (fwrite(data, 1, len, f) != len || fflush(f) != 0))
+    {
+        fclose(f);
+        return NULL;
+    }
+    if (f)
+        rewind(f);
+    return f;
+}
+
+// Содержимое файла целиком с начала; NULL при ошибке
+static uint8_t *file_contents(FILE *f, size_t *len)
+{
+    if (fflush(f) != 0 || fseeko(f, 0, SEEK_END) != 0)
+        return NULL;
+    off_t size = ftello(f);
+    uint8_t *data = malloc(size > 0 ? (size_t)size : 1);
+    rewind(f);
+    if (!data || fread(data, 1, (size_t)size, f) != (size_t)size)
+    {
+        free(data);
+        return NULL;
+    }
+    *len = (size_t)size;
+    return data;
+}
+
+static int same(const uint8_t *a, size_t a_len, const uint8_t *b, size_t b_len)
+{
+    return a_len == b_len && (a_len == 0 || memcmp(a, b, a_len) == 0);
+}
+
+static const size_t sizes[] = {0, 1, 3, 100, 4096, 65543, (1 << 20) + 123};
+// Байт внутри токенов первого фрейма: за заголовком контейнера (8 байт) и префиксом фрейма
+// (8 байт). Таблицу поиска в конце контейнера последовательная распаковка не читает, поэтому
+// порча и обрезка проверяются на данных фреймов.
+#define FIRST_FRAME_BYTE 17
+#define SIZE_COUNT (sizeof(sizes) / sizeof(sizes[0]))
+
+static void test_buf(void)
+{
+    static const int levels[] = {1, 3, 6, 9};
+    // Контексты живут через все сообщения: таблицы прошлых не должны менять выход
+    lz77_buf_ctx *ctxs[sizeof(levels) / sizeof(levels[0])];
+    for (size_t li = 0; li < sizeof(levels) / sizeof(levels[0]); li++)
+        CHECK((ctxs[li] = lz77_buf_ctx_create(levels[li])) != NULL);
+    for (int kind = 0; kind < CORPUS_COUNT; kind++)
+        for (size_t si = 0; si < SIZE_COUNT; si++)
+        {
+            size_t n = sizes[si];
+            uint8_t *src = make_corpus(kind, n, si);
+            snprintf(context, sizeof(context), "%s, %zu байт", corpus_names[kind], n);
+            size_t bound = lz77_compress_bound(n);
+            uint8_t *dst = malloc(bound), *ref = malloc(bound), *out = malloc(n + 1);
+            CHECK(src && dst && ref && out);
+            if (!src || !dst || !ref || !out)
+                goto next;
+            for (size_t li = 0; li < sizeof(levels) / sizeof(levels[0]); li++)
+            {
+                int64_t c = ctxs[li] ? lz77_compress_buf_ctx(ctxs[li], src, n, dst, bound) : -1;
+                CHECK(c >= 0 && (size_t)c <= bound);
+                if (c < 0)
+                    continue;
+                CHECK(lz77_compress_buf_level(src, n, ref, bound, levels[li]) == c && memcmp(ref, dst, c) == 0);
+                CHECK(lz77_decompressed_size(dst, c) == (int64_t)n);
+                int64_t d = lz77_decompress_buf(dst, c, out, n);
+                CHECK(d == (int64_t)n && same(out, d, src, n));
+                // Мало места в dst и обрезанный вход — ошибка, а не запись за край
+                if (n)
+                    CHECK(lz77_decompress_buf(dst, c, out, n - 1) < 0);
+                CHECK(lz77_decompress_buf(dst, c - 1, out, n) < 0);
+                // Контрольной суммы нет: порча может пройти незамеченной, но не за пределы dst
+                if (c > 8)
+                {
+                    dst[c / 2] ^= 0x5A;
+                    d = lz77_decompress_buf(dst, c, out, n);
+                    CHECK(d <= (int64_t)n);
+                    dst[c / 2] ^= 0x5A;
+                }
+            }
+            // Слишком маленький dst при сжатии
+            if (n > 100)
+                CHECK(lz77_compress_buf(src, n, dst, 16) < 0);
+        next:
+            free(src);
+            free(dst);
+            free(ref);
+            free(out);
+        }
+    for (size_t li = 0; li < sizeof(levels) / sizeof(levels[0]); li++)
+        lz77_buf_ctx_free(ctxs[li]);
+}
+
+// Потоковые контексты: вход и контейнер подаются порциями случайного размера
+static void test_stream(void)
+{
+    for (int kind = 0; kind < CORPUS_COUNT; kind++)
+        for (size_t si = 0; si < SIZE_COUNT; si++)
+        {
+            size_t n = sizes[si];
+            uint8_t *src = make_corpus(kind, n, si);
+            membuf packed = {0}, out = {0};
+            snprintf(context, sizeof(context), "%s, %zu байт", corpus_names[kind], n);
+            lz77_params params;
+            uint64_t state = 12345 + si;
+            lz77_params_default(&params);
+            params.frame_log = 16;
+            lz77_cctx *cctx = lz77_cctx_init(&params, membuf_write, &packed);
+            CHECK(src && cctx);
+            if (!src || !cctx)
+                goto next;
+            for (size_t pos = 0; pos < n;)
+            {
+                size_t part = 1 + rng_next(&state) % 100000;
+                part = part < n - pos ? part : n - pos;
+                CHECK(lz77_cctx_update(cctx, src + pos, part) == 0);
+                pos += part;
+                if (rng_next(&state) % 4 == 0)
+                    CHECK(lz77_cctx_flush(cctx) == 0);
+            }
+            CHECK(lz77_cctx_end(cctx) == 0);
+
+            lz77_dctx *dctx = lz77_dctx_init(membuf_write, &out);
+            CHECK(dctx != NULL);
+            if (!dctx)
+                goto next;
+            for (size_t pos = 0; pos < packed.len;)
+            {
+                size_t part = 1 + rng_next(&state) % 70000;
+                part = part < packed.len - pos ? part : packed.len - pos;
+                CHECK(lz77_dctx_update(dctx, packed.data + pos, part) == 0);
+                pos += part;
+            }
+            CHECK(lz77_dctx_finish(dctx) == 0);
+            CHECK(same(out.data, out.len, src, n));
+
+            // Обрезанный контейнер не завершён
+            out.len = 0;
+            CHECK(lz77_dctx_reset(dctx, membuf_write, &out) == 0);
+            int status = lz77_dctx_update(dctx, packed.data, packed.len / 2);
+            CHECK(status != 0 || lz77_dctx_finish(dctx) != 0);
+
+            // Порча внутри фрейма ловится контрольными суммами
+            if (n >= 100)
+            {
+                out.len = 0;
+                packed.data[FIRST_FRAME_BYTE] ^= 0x20;
+                CHECK(lz77_dctx_reset(dctx, membuf_write, &out) == 0);
+                status = lz77_dctx_update(dctx, packed.data, packed.len);
+                CHECK(status != 0 || lz77_dctx_finish(dctx) != 0);
+            }
+            lz77_dctx_end(dctx);
+        next:
+            free(src);
+            free(packed.data);
+            free(out.data);
+        }
+}
+
+// Сжатие src фреймами в файл и распаковка обратно; возвращает сжатый файл или NULL
+static FILE *frames_roundtrip(const uint8_t *src, size_t n, const lz77_params *params)
+{
+    FILE *raw = file_with(src, n), *packed = tmpfile(), *unpacked = tmpfile();
+    size_t out_len = 0;
+    uint8_t *out = NULL;
+    CHECK(raw && packed && unpacked);
+    if (!raw || !packed || !unpacked)
+        goto done;
+    CHECK(lz77_compress_frames(raw, packed, NULL, params) == 0);
+    rewind(packed);
+    CHECK(lz77_decompress_frames(packed, unpacked, NULL, params->threads) == 0);
+    out = file_contents(unpacked, &out_len);
+    CHECK(out && same(out, out_len, src, n));
+    // Только проверка, без вывода; без контрольных сумм проверять нечем
+    rewind(packed);
+    CHECK(lz77_decompress_frames(packed, NULL, NULL, params->threads) == (params->checksum ? 0 : LZ77_UNVERIFIED));
+done:
+    if (raw)
+        fclose(raw);
+    if (unpacked)
+        fclose(unpacked);
+    free(out);
+    return packed;
+}
+
+static void test_frames(void)
+{
+    for (int kind = 0; kind < CORPUS_COUNT; kind++)
+        for (size_t si = 0; si < SIZE_COUNT; si++)
+            for (int variant = 0; variant < 7; variant++)
+            {
+                size_t n = sizes[si];
+                uint8_t *src = make_corpus(kind, n, si);
+                lz77_params params;
+                snprintf(context, sizeof(context), "%s, %zu байт, вариант %d", corpus_names[kind], n, variant);
+                lz77_params_default(&params);
+                params.frame_log = 16;
+                params.threads = variant == 1 ? 4 : variant == 6 ? 3 : 1;
+                params.chain = variant == 2 || variant >= 5;
+                params.ldm_log = variant == 3 ? 22 : 0;
+                params.level = variant == 3 || variant == 5 ? 9 : variant == 6 ? 4 : params.level;
+                // Окно шире фрейма: один поток продолжает таблицы прошлого фрейма, три —
+                // чередуют фреймы и вставляют историю заново
+                params.window_log = variant >= 5 ? 20 : 0;
+                params.checksum = variant != 4;
+                FILE *packed = src ? frames_roundtrip(src, n, &params) : NULL;
+                size_t len = 0;
+                uint8_t *data = packed ? file_contents(packed, &len) : NULL;
+                CHECK(data != NULL);
+                // Порча фрейма ловится контрольными суммами, обрезка — отсутствием конца
+                if (data && n >= 100 && params.checksum)
+                {
+                    FILE *bad;
+                    data[FIRST_FRAME_BYTE] ^= 0x01;
+                    bad = file_with(data, len);
+                    CHECK(bad && lz77_decompress_frames(bad, NULL, NULL, params.threads) != 0);
+                    if (bad)
+                        fclose(bad);
+                    data[FIRST_FRAME_BYTE] ^= 0x01;
+                    bad = file_with(data, len / 2);
+                    CHECK(bad && lz77_decompress_frames(bad, NULL, NULL, params.threads) != 0);
+                    if (bad)
+                        fclose(bad);
+                }
+                if (packed)
+                    fclose(packed);
+                free(data);
+                free(src);
+            }
+}
+
+// Телеметрия сжатия: все байты входа учтены литералами или совпадениями, блок — на фрейм
+static void test_metrics(void)
+{
+    size_t n = sizes[SIZE_COUNT - 1];
+    for (int kind = 0; kind < CORPUS_COUNT; kind++)
+        for (int threads = 1; threads <= 2; threads++)
+        {
+            uint8_t *src = make_corpus(kind, n, 5);
+            lz77_metrics metrics = {0};
+            lz77_params params;
+            snprintf(context, sizeof(context), "%s, потоков %d", corpus_names[kind], threads);
+            lz77_params_default(&params);
+            params.frame_log = 16;
+            params.threads = threads;
+            params.metrics = &metrics;
+            FILE *packed = src ? frames_roundtrip(src, n, &params) : NULL;
+            CHECK(packed && metrics.bytes_in == n && metrics.literals + metrics.match_bytes == n);
+            CHECK(metrics.blocks == (n + (1 << params.frame_log) - 1) >> params.frame_log);
+            CHECK(metrics.bytes_out > 0 && (kind != CORPUS_ZEROS || metrics.matches > 0));
+            if (packed)
+                fclose(packed);
+            free(src);
+        }
+}
+
+// Текст из словаря в 2000 случайных слов: повторов много, но короткие и далёкие совпадения
+// почти не окупаются — на таком входе старшие уровни сжимали хуже младших
+static uint8_t *make_words(size_t len, uint64_t seed)
+{
+    enum { VOCABULARY = 2000, MAX_WORD = 9 };
+    static char vocabulary[VOCABULARY][MAX_WORD + 1];
+    uint64_t state = seed;
+    uint8_t *data = malloc(len ? len : 1);
+    if (!data)
+        return NULL;
+    for (int w = 0; w < VOCABULARY; w++)
+    {
+        size_t n = 2 + rng_next(&state) % (MAX_WORD - 1);
+        for (size_t i = 0; i < n; i++)
+            vocabulary[w][i] = (char)('a' + rng_next(&state) % 26);
+        vocabulary[w][n] = '\0';
+    }
+    for (size_t pos = 0; pos < len;)
+    {
+        const char *w = vocabulary[rng_next(&state) % VOCABULARY];
+        for (size_t i = 0; w[i] && pos < len; i++)
+            data[pos++] = (uint8_t)w[i];
+        if (pos < len)
+            data[pos++] = ' ';
+    }
+    return data;
+}
+
+// Уровни: каждый распаковывается, а -3 (по умолчанию) сжимает не хуже -1 — и в окне по
+// умолчанию, и в широком окне со сцепленными фреймами. -9 не хуже младших уровней с допуском
+// в 1/256: глубокий поиск на тексте из случайных слов в широком окне уступает -6 десятые доли
+// процента, а прежняя оценка совпадений по одной длине проигрывала -1 несколько процентов.
+static void test_levels(void)
+{
+    static const char *names[] = {"words", "text", "mixed"};
+    size_t n = (1 << 20) + 123;
+    for (int k = 0; k < 3; k++)
+        for (int wide = 0; wide < 2; wide++)
+        {
+            uint8_t *src = k ? make_corpus(k == 1 ? CORPUS_TEXT : CORPUS_MIXED, n, 11) : make_words(n, 11);
+            long packed_size[LZ77_MAX_LEVEL + 1] = {0};
+            for (int level = 1; src && level <= LZ77_MAX_LEVEL; level++)
+            {
+                lz77_params params;
+                snprintf(context, sizeof(context), "%s, окно %s, уровень %d", names[k], wide ? "2^20" : "по умолчанию",
+                         level);
+                lz77_params_default(&params);
+                params.level = level;
+                params.window_log = wide ? 20 : 0;
+                params.chain = wide;
+                FILE *packed = frames_roundtrip(src, n, &params);
+                CHECK(packed && fseek(packed, 0, SEEK_END) == 0);
+                packed_size[level] = packed ? ftell(packed) : 0;
+                if (packed)
+                    fclose(packed);
+            }
+            for (int level = 1; src && level < LZ77_MAX_LEVEL; level++)
+            {
+                snprintf(context, sizeof(context), "%s, окно %s: -9 %ld байт, -%d %ld байт", names[k],
+                         wide ? "2^20" : "по умолчанию", packed_size[LZ77_MAX_LEVEL], level, packed_size[level]);
+                CHECK(packed_size[LZ77_MAX_LEVEL] <= packed_size[level] + packed_size[level] / 256);
+            }
+            snprintf(context, sizeof(context), "%s, окно %s: -3 %ld байт, -1 %ld байт", names[k],
+                     wide ? "2^20" : "по умолчанию", packed_size[3], packed_size[1]);
+            CHECK(src && packed_size[3] <= packed_size[1]);
+            free(src);
+        }
+}
+
+// Распаковка диапазонов по таблице поиска
+static void test_range(void)
+{
+    size_t n = (3 << 20) + 777;
+    uint8_t *src = make_corpus(CORPUS_MIXED, n, 7);
+    uint8_t *dst = malloc(n);
+    lz77_params params;
+    uint64_t state = 99;
+    lz77_params_default(&params);
+    params.frame_log = 16;
+    FILE *packed = src && dst ? frames_roundtrip(src, n, &params) : NULL;
+    CHECK(packed != NULL);
+    if (!packed)
+        goto done;
+    for (int i = 0; i < 64; i++)
+    {
+        rewind(packed);
+        uint64_t off = rng_next(&state) % n;
+        uint64_t len = rng_next(&state) % (i % 2 ? 300000 : 100);
+        len = len < n - off ? len : n - off;
+        CHECK(lz77_decompress_range(packed, off, len, dst) == (int64_t)len && memcmp(dst, src + off, len) == 0);
+    }
+    rewind(packed);
+    CHECK(lz77_decompress_range(packed, 0, n, dst) == (int64_t)n && memcmp(dst, src, n) == 0);
+    rewind(packed);
+    CHECK(lz77_decompress_range(packed, n, 0, dst) == 0);
+    fclose(packed);
+done:
+    free(src);
+    free(dst);
+}
+
+// Словари на коротких сообщениях одного вида
+static void test_dict(void)
+{
+    enum { MESSAGES = 400 };
+    uint8_t *samples = malloc(MESSAGES * 256), dict[LZ77_DICT_DEFAULT_SIZE];
+    size_t sample_sizes[MESSAGES], total = 0;
+    uint64_t state = 5;
+    CHECK(samples != NULL);
+    if (!samples)
+        return;
+    for (int i = 0; i < MESSAGES; i++)
+    {
+        int len = snprintf((char *)samples + total, 256,
+                           "{\"id\":%d,\"user\":\"user%llu\",\"action\":\"%s\",\"status\":%d,\"region\":\"eu-west\"}", i,
+                           (unsigned long long)(rng_next(&state) % 1000), i % 3 ? "login" : "logout",
+                           i % 7 ? 200 : 500);
+        sample_sizes[i] = (size_t)len;
+        total += (size_t)len;
+    }
+    size_t dict_len = lz77_dict_train(samples, sample_sizes, MESSAGES, dict, sizeof(dict));
+    CHECK(dict_len > 0);
+    lz77_dict *d = lz77_dict_load(dict, dict_len, 0);
+    lz77_dict *other = lz77_dict_load("совсем другой словарь", strlen("совсем другой словарь"), 0);
+    lz77_dict_ctx *ctx = d ? lz77_dict_ctx_create(d) : NULL;
+    lz77_dict_ctx *other_ctx = other ? lz77_dict_ctx_create(other) : NULL;
+    CHECK(d && other && ctx && other_ctx);
+    if (ctx && other_ctx)
+    {
+        uint8_t packed[512 + 4], out[256];
+        size_t off = 0, plain = 0, compressed = 0;
+        for (int i = 0; i < MESSAGES; off += sample_sizes[i++])
+        {
+            size_t n = sample_sizes[i];
+            int64_t c = lz77_compress_dict(ctx, samples + off, n, packed, sizeof(packed));
+            CHECK(c > 0 && (size_t)c <= lz77_compress_bound(n) + 4);
+            if (c <= 0)
+                continue;
+            plain += n;
+            compressed += (size_t)c;
+            int64_t got = lz77_decompress_dict(ctx, packed, c, out, sizeof(out));
+            CHECK(got == (int64_t)n && memcmp(out, samples + off, n) == 0);
+            // Чужой словарь, обрезка и нехватка места — ошибки
+            CHECK(lz77_decompress_dict(other_ctx, packed, c, out, sizeof(out)) < 0);
+            CHECK(lz77_decompress_dict(ctx, packed, c - 1, out, sizeof(out)) < 0);
+            CHECK(lz77_decompress_dict(ctx, packed, c, out, n - 1) < 0);
+        }
+        // Словарь должен заметно помогать на таких сообщениях
+        CHECK(compressed * 2 < plain);
+        // Пустое сообщение
+        int64_t c = lz77_compress_dict(ctx, "", 0, packed, sizeof(packed));
+        CHECK(c >= 0 && lz77_decompress_dict(ctx, packed, c, out, sizeof(out)) == 0);
+    }
+    lz77_dict_ctx_free(ctx);
+    lz77_dict_ctx_free(other_ctx);
+    lz77_dict_free(d);
+    lz77_dict_free(other);
+    free(samples);
+}
+
+// Распаковка архива из хранилища; 0 и содержимое в *out при успехе
+static int dedup_unpack(const char *dir, FILE *archive, uint8_t **out, size_t *out_len)
+{
+    lz77_store *store = lz77_store_open(dir, 0);
+    FILE *unpacked = tmpfile();
+    int status = -1;
+    *out = NULL;
+    if (store && unpacked)
+    {
+        rewind(archive);
+        status = lz77_dedup_decompress(store, archive, unpacked, NULL, NULL);
+        if (!status && !(*out = file_contents(unpacked, out_len)))
+            status = -1;
+    }
+    if (store && lz77_store_close(store) != 0)
+        status = -1;
+    if (unpacked)
+        fclose(unpacked);
+    return status;
+}
+
+// Два похожих «снимка» в одном хранилище: второй почти целиком из фрагментов первого
+static void test_dedup(void)
+{
+    char dir[] = "/tmp/lz77_test_XXXXXX", path[64];
+    size_t n = 2 << 20, insert = 1000;
+    uint8_t *first = make_corpus(CORPUS_MIXED, n, 1);
+    uint8_t *second = malloc(n + insert), *out = NULL;
+    size_t out_len = 0;
+    lz77_params params;
+    lz77_dedup_stats stats[2];
+    FILE *archives[2] = {NULL, NULL};
+    CHECK(mkdtemp(dir) != NULL && first && second);
+    if (!first || !second)
+        goto done;
+    // Вставка в середину сдвигает только ближайшие фрагменты
+    memcpy(second, first, n / 2);
+    memset(second + n / 2, 'x', insert);
+    memcpy(second + n / 2 + insert, first + n / 2, n - n / 2);
+    lz77_params_default(&params);
+    params.threads = 2;
+
+    lz77_store *store = lz77_store_open(dir, 1);
+    CHECK(store != NULL);
+    if (!store)
+        goto done;
+    for (int i = 0; i < 2; i++)
+    {
+        FILE *raw = i ? file_with(second, n + insert) : file_with(first, n);
+        archives[i] = tmpfile();
+        CHECK(raw && archives[i] && lz77_dedup_compress(store, raw, archives[i], NULL, &params, &stats[i]) == 0);
+        if (raw)
+            fclose(raw);
+    }
+    CHECK(lz77_store_close(store) == 0);
+    CHECK(stats[0].new_chunks == stats[0].chunks);
+    CHECK(stats[1].new_bytes * 8 < n);
+
+    CHECK(archives[0] && dedup_unpack(dir, archives[0], &out, &out_len) == 0 && same(out, out_len, first, n));
+    free(out);
+    CHECK(archives[1] && dedup_unpack(dir, archives[1], &out, &out_len) == 0 &&
+          same(out, out_len, second, n + insert));
+    free(out);
+    out = NULL;
+
+    // Испорченный фрагмент в хранилище не совпадёт со своим отпечатком
+    snprintf(path, sizeof(path), "%s/chunks", dir);
+    FILE *chunks = fopen(path, "r+b");
+    CHECK(chunks != NULL);
+    if (chunks)
+    {
+        int byte;
+        CHECK(fseek(chunks, 1000, SEEK_SET) == 0 && (byte = fgetc(chunks)) != EOF);
+        CHECK(fseek(chunks, 1000, SEEK_SET) == 0 && fputc(byte ^ 0x40, chunks) != EOF);
+        fclose(chunks);
+        CHECK(dedup_unpack(dir, archives[0], &out, &out_len) != 0);
+        free(out);
+        out = NULL;
+    }
+
+done:
+    for (int i = 0; i < 2; i++)
+        if (archives[i])
+            fclose(archives[i]);
+    snprintf(path, sizeof(path), "%s/chunks", dir);
+    remove(path);
+    snprintf(path, sizeof(path), "%s/index", dir);
+    remove(path);
+    rmdir(dir);
+    free(first);
+    free(second);
+}
+
+// Пакет файлов: сжатие пулом потоков, распаковка и проверка без вывода; файл с ошибкой не
+// мешает остальным
+static void test_batch(void)
+{
+    enum { FILES = 4 };
+    static const size_t lens[FILES] = {0, 100, 65543, (1 << 20) + 123};
+    char dir[] = "/tmp/lz77_test_XXXXXX", raw[FILES][64], packed[FILES][64], unpacked[FILES][64];
+    uint8_t *src[FILES] = {NULL};
+    lz77_batch_item items[FILES];
+    lz77_params params;
+    CHECK(mkdtemp(dir) != NULL);
+    for (int i = 0; i < FILES; i++)
+    {
+        snprintf(raw[i], sizeof(raw[i]), "%s/%d", dir, i);
+        snprintf(packed[i], sizeof(packed[i]), "%s/%d.lz", dir, i);
+        snprintf(unpacked[i], sizeof(unpacked[i]), "%s/%d.out", dir, i);
+        src[i] = make_corpus(i % CORPUS_COUNT, lens[i], i);
+        FILE *f = fopen(raw[i], "wb");
+        CHECK(src[i] && f && fwrite(src[i], 1, lens[i], f) == lens[i]);
+        if (f)
+            fclose(f);
+    }
+    lz77_params_default(&params);
+    params.threads = 2;
+
+    for (int checksum = 1; checksum >= 0; checksum--)
+    {
+        snprintf(context, sizeof(context), "контрольные суммы %d", checksum);
+        params.checksum = checksum;
+        for (int i = 0; i < FILES; i++)
+            items[i] = (lz77_batch_item){raw[i], packed[i], 0, 0, 0};
+        CHECK(lz77_compress_batch(items, FILES, &params, NULL) == 0);
+        for (int i = 0; i < FILES; i++)
+        {
+            CHECK(items[i].status == 0 && items[i].in_size == lens[i]);
+            items[i] = (lz77_batch_item){packed[i], unpacked[i], 0, 0, 0};
+        }
+        CHECK(lz77_decompress_batch(items, FILES, 2, NULL) == 0);
+        for (int i = 0; i < FILES; i++)
+        {
+            FILE *f = fopen(unpacked[i], "rb");
+            size_t len = 0;
+            uint8_t *out = f ? file_contents(f, &len) : NULL;
+            CHECK(items[i].status == 0 && out && same(out, len, src[i], lens[i]));
+            free(out);
+            if (f)
+                fclose(f);
+            // Проверка без вывода: без контрольных сумм целостность не подтверждена
+            items[i] = (lz77_batch_item){packed[i], NULL, 0, 0, 0};
+        }
+        CHECK(lz77_decompress_batch(items, FILES, 2, NULL) == 0);
+        for (int i = 0; i < FILES; i++)
+            CHECK(items[i].status == (checksum ? 0 : LZ77_UNVERIFIED));
+    }
+
+    // Недоступный вход — ошибка только своего файла
+    snprintf(context, sizeof(context), "нет входа");
+    items[0] = (lz77_batch_item){dir, packed[0], 0, 0, 0};
+    items[1] = (lz77_batch_item){raw[1], packed[1], 0, 0, 0};
+    CHECK(lz77_compress_batch(items, 2, &params, NULL) == 1 && items[0].status != 0 && items[1].status == 0);
+
+    for (int i = 0; i < FILES; i++)
+    {
+        remove(raw[i]);
+        remove(packed[i]);
+        remove(unpacked[i]);
+        free(src[i]);
+    }
+    rmdir(dir);
+}
+
+// Сжатие старым форматом из канала: вход пишет дочерний процесс
+static uint8_t *legacy_from_pipe(const uint8_t *src, size_t n, size_t *len)
+{
+    int fds[2];
+    uint8_t *data = NULL;
+    if (pipe(fds) != 0)
+        return NULL;
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        close(fds[0]);
+        size_t done = 0;
+        while (done < n)
+        {
+            ssize_t w = write(fds[1], src + done, n - done < 4093 ? n - done : 4093);
+            if (w <= 0)
+                _exit(1);
+            done += (size_t)w;
+        }
+        _exit(0);
+    }
+    close(fds[1]);
+    FILE *in = fdopen(fds[0], "rb"), *packed = tmpfile();
+    if (pid > 0 && in && packed && lz77_compress(in, packed, NULL) == 0)
+        data = file_contents(packed, len);
+    if (in)
+        fclose(in);
+    else
+        close(fds[0]);
+    if (packed)
+        fclose(packed);
+    if (pid > 0)
+        waitpid(pid, NULL, 0);
+    return data;
+}
+
+static uint8_t *legacy_compress(const uint8_t *src, size_t n, size_t *len)
+{
+    FILE *raw = file_with(src, n), *packed = tmpfile();
+    uint8_t *data = NULL;
+    if (raw && packed && lz77_compress(raw, packed, NULL) == 0)
+        data = file_contents(packed, len);
+    if (raw)
+        fclose(raw);
+    if (packed)
+        fclose(packed);
+    return data;
+}
+
+static int legacy_decompress(const uint8_t *packed, size_t len, uint8_t **out, size_t *out_len)
+{
+    FILE *in = file_with(packed, len), *unpacked = tmpfile();
+    int status = -1;
+    *out = NULL;
+    if (in && unpacked && lz77_decompress(in, unpacked, NULL) == 0)
+        status = (*out = file_contents(unpacked, out_len)) ? 0 : -1;
+    if (in)
+        fclose(in);
+    if (unpacked)
+        fclose(unpacked);
+    return status;
+}
+
+// Старый потоковый формат: отображённый файл, поток через конвейер и канал дают один и тот же
+// поток байт в байт, и он распаковывается в исходные данные
+static void test_legacy(void)
+{
+    for (int kind = 0; kind < CORPUS_COUNT; kind++)
+        for (size_t si = 0; si < SIZE_COUNT; si++)
+        {
+            size_t n = sizes[si], len = 0, stream_len = 0, pipe_len = 0, out_len = 0;
+            uint8_t *src = make_corpus(kind, n, si), *out = NULL;
+            snprintf(context, sizeof(context), "%s, %zu байт", corpus_names[kind], n);
+            uint8_t *packed = src ? legacy_compress(src, n, &len) : NULL;
+            setenv("LZ77_IO_BACKEND", "sync", 1);
+            uint8_t *streamed = src ? legacy_compress(src, n, &stream_len) : NULL;
+            unsetenv("LZ77_IO_BACKEND");
+            uint8_t *piped = src ? legacy_from_pipe(src, n, &pipe_len) : NULL;
+            CHECK(packed && streamed && piped);
+            if (!packed || !streamed || !piped)
+                goto next;
+            CHECK(same(packed, len, streamed, stream_len));
+            CHECK(same(packed, len, piped, pipe_len));
+            // Пустой вход — пустой поток
+            CHECK(n > 0 || len == 0);
+            CHECK(legacy_decompress(packed, len, &out, &out_len) == 0 && same(out, out_len, src, n));
+            free(out);
+            // Контрольных сумм в старом потоке нет: проверка без вывода не подтверждает целостность
+            FILE *in = file_with(packed, len);
+            CHECK(in && lz77_decompress(in, NULL, NULL) == LZ77_UNVERIFIED);
+            if (in)
+                fclose(in);
+            // Обрезка внутри токена
+            if (len > 1)
+            {
+                CHECK(legacy_decompress(packed, len - 1, &out, &out_len) != 0);
+                free(out);
+            }
+        next:
+            free(src);
+            free(packed);
+            free(streamed);
+            free(piped);
+        }
+}
+
+typedef struct {
+    const char *name;
+    void (*run)(void);
+    const char *requests; // Заявки, поведение которых проверяет тест
+} test_case;
+
+static const test_case tests[] = {
+    {"buf", test_buf, "user-004 user-013 user-014"},
+    {"stream", test_stream, "user-005 user-018"},
+    {"frames", test_frames, "user-001 user-002 user-011 user-012 user-018 user-019"},
+    {"metrics", test_metrics, "user-015"},
+    {"range", test_range, "user-003"},
+    {"dict", test_dict, "user-016"},
+    {"batch", test_batch, "user-017"},
+    {"dedup", test_dedup, "user-025"},
+    {"legacy", test_legacy, "user-009 user-020 user-021 user-022 user-023"},
+    {"levels", test_levels, "user-006 user-007 user-008 user-011"},
+};
+
+// Аргумент выбирает тест по имени или по заявке из его списка
+static int selects(const char *arg, const test_case *t)
+{
+    if (strcmp(arg, t->name) == 0)
+        return 1;
+    size_t len = strlen(arg);
+    for (const char *p = t->requests; len && (p = strstr(p, arg)) != NULL; p += len)
+        if ((p == t->requests || p[-1] == ' ') && (p[len] == ' ' || p[len] == '\0'))
+            return 1;
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int total = 0;
+    lz77_set_log_level(LZ77_LOG_QUIET);
+    for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++)
+    {
+        // Аргументы — имена тестов или заявки (user-011), которые нужно проверить; без них
+        // запускаются все
+        int selected = argc < 2;
+        for (int a = 1; a < argc; a++)
+            selected |= selects(argv[a], &tests[i]);
+        if (!selected)
+            continue;
+        int before = failures;
+        context[0] = '\0';
+        tests[i].run();
+        printf("%-8s %s\n", tests[i].name, failures == before ? "ok" : "ОШИБКИ");
+        fflush(stdout);
+        total++;
+    }
+    if (!total)
+    {
+        fprintf(stderr, "Ошибка: нет тестов с такими именами или заявками\n");
+        return 1;
+    }
+    printf("Проваленных проверок: %d\n", failures);
+    return failures ? 1 : 0;
+}